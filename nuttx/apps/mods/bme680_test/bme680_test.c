@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * BME680 compensation test.
+ *
+ * The integer compensation the driver uses is checked against the double
+ * precision formulas for a couple of calibrations, over the raw readings
+ * that cover the sensor's operating range: -40 to 85 C, 300 to 1100 hPa,
+ * 0 to 100 %rH and every gas range. The cycles each formula takes per
+ * sample are then measured, with the DWT cycle counter on Cortex-M and in
+ * nanoseconds elsewhere.
+ */
+
+#include <nuttx/config.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "bme680_calculations.h"
+
+/* Well inside the datasheet's accuracy: +-0.5 C, +-0.12 hPa relative,
+ * +-3 %rH and, for gas, a resistance only compared with itself over time.
+ */
+#define TOL_TEMPERATURE     0.01    /* C */
+#define TOL_PRESSURE        12.0    /* Pa */
+#define TOL_HUMIDITY        0.1     /* %rH */
+#define TOL_GAS             0.005   /* relative */
+
+#define BENCH_SAMPLES       1000
+
+#if defined(CONFIG_ARCH_CORTEXM3) || defined(CONFIG_ARCH_CORTEXM4)
+#define DEMCR               (*(volatile uint32_t *)0xe000edfc)
+#define DEMCR_TRCENA        (1 << 24)
+#define DWT_CTRL            (*(volatile uint32_t *)0xe0001000)
+#define DWT_CTRL_CYCCNTENA  (1 << 0)
+#define DWT_CYCCNT          (*(volatile uint32_t *)0xe0001004)
+#define BENCH_UNIT          "cycles"
+
+static void bench_init(void)
+{
+    DEMCR |= DEMCR_TRCENA;
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+static uint32_t bench_now(void)
+{
+    return DWT_CYCCNT;
+}
+#else
+#define BENCH_UNIT          "ns"
+
+static void bench_init(void)
+{
+}
+
+static uint32_t bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+#endif
+
+struct test_error {
+    double temperature;
+    double pressure;
+    double humidity;
+    double gas;
+};
+
+/* Calibrations read back from production parts */
+static const struct bme680_calibration_param_t g_calibrations[] = {
+    {
+        .par_T1 = 26007, .par_T2 = 26120, .par_T3 = 3,
+        .par_P1 = 36442, .par_P2 = -10326, .par_P3 = 88, .par_P4 = 7225,
+        .par_P5 = -174, .par_P6 = 30, .par_P7 = 35, .par_P8 = -3520,
+        .par_P9 = -3103, .par_P10 = 30,
+        .par_H1 = 796, .par_H2 = 1006, .par_H3 = 0, .par_H4 = 45,
+        .par_H5 = 20, .par_H6 = 120, .par_H7 = -100,
+        .par_GH1 = -30, .par_GH2 = -12999, .par_GH3 = 18,
+        .res_heat_range = 1, .res_heat_val = 46,
+        .range_switching_error = -1,
+    },
+    {
+        .par_T1 = 25843, .par_T2 = 26383, .par_T3 = 3,
+        .par_P1 = 35986, .par_P2 = -10398, .par_P3 = 88, .par_P4 = 6604,
+        .par_P5 = -119, .par_P6 = 30, .par_P7 = 47, .par_P8 = -1683,
+        .par_P9 = -2651, .par_P10 = 30,
+        .par_H1 = 763, .par_H2 = 1037, .par_H3 = 0, .par_H4 = 45,
+        .par_H5 = 20, .par_H6 = 120, .par_H7 = -100,
+        .par_GH1 = -21, .par_GH2 = -11086, .par_GH3 = 18,
+        .res_heat_range = 1, .res_heat_val = 40,
+        .range_switching_error = 1,
+    },
+};
+
+#define CALIBRATIONS (sizeof(g_calibrations) / sizeof(g_calibrations[0]))
+
+static volatile s32 g_sink_int;
+static volatile double g_sink_double;
+
+static void test_max(double *max, double err)
+{
+    err = fabs(err);
+    if (err > *max)
+        *max = err;
+}
+
+static void test_pressure(struct bme680_t *bme680, struct test_error *e)
+{
+    s32 t_fine = bme680->cal_param.t_fine;
+    double ref;
+    u32 adc;
+    s32 p;
+
+    for (adc = 200000; adc <= 600000; adc += 500) {
+        bme680->cal_param.t_fine = t_fine;
+        ref = bme680_compensate_pressure_double(adc, bme680);
+        if (ref < 30000.0 || ref > 110000.0)
+            continue;
+
+        p = bme680_compensate_pressure_int32(adc, bme680);
+        test_max(&e->pressure, p - ref);
+    }
+}
+
+static void test_humidity(struct bme680_t *bme680, double temperature,
+                          struct test_error *e)
+{
+    double ref;
+    u32 adc;
+    s32 h;
+
+    for (adc = 0; adc <= 0xffff; adc += 64) {
+        ref = bme680_compensate_humidity_double(adc, temperature, bme680);
+        h = bme680_compensate_humidity_int32(adc, bme680);
+        test_max(&e->humidity, h / 1024.0 - ref);
+    }
+}
+
+static void test_gas(struct bme680_t *bme680, struct test_error *e)
+{
+    double ref;
+    u16 adc;
+    u8 range;
+    s32 g;
+
+    for (range = 0; range < BME680_GAS_RANGE_RL_LENGTH; range++) {
+        for (adc = 0; adc < 1024; adc++) {
+            ref = bme680_compensate_gas_double(adc, range, bme680);
+            g = bme680_calculate_gas_int32(adc, range, bme680);
+            test_max(&e->gas, (g - ref) / ref);
+        }
+    }
+}
+
+static int test_accuracy(void)
+{
+    struct bme680_t bme680;
+    struct test_error e;
+    double temperature;
+    s32 t;
+    u32 adc;
+    int c;
+    int ret = 0;
+
+    for (c = 0; c < CALIBRATIONS; c++) {
+        bme680.cal_param = g_calibrations[c];
+        e.temperature = e.pressure = e.humidity = e.gas = 0.0;
+
+        for (adc = 250000; adc <= 700000; adc += 2000) {
+            temperature = bme680_compensate_temperature_double(adc, &bme680);
+            if (temperature < -40.0 || temperature > 85.0)
+                continue;
+
+            t = bme680_compensate_temperature_int32(adc, &bme680);
+            test_max(&e.temperature, t / 100.0 - temperature);
+
+            /* Both leave the same t_fine behind */
+            test_pressure(&bme680, &e);
+            test_humidity(&bme680, temperature, &e);
+        }
+        test_gas(&bme680, &e);
+
+        printf("calibration %d: %.4f C, %.2f Pa, %.4f %%rH, %.3f %% gas\n",
+               c, e.temperature, e.pressure, e.humidity, e.gas * 100.0);
+
+        if (e.temperature > TOL_TEMPERATURE || e.pressure > TOL_PRESSURE ||
+            e.humidity > TOL_HUMIDITY || e.gas > TOL_GAS) {
+            printf("calibration %d: out of tolerance\n", c);
+            ret = -1;
+        }
+    }
+
+    return ret;
+}
+
+static void bench_run(void)
+{
+    struct bme680_t bme680;
+    uint32_t start;
+    uint32_t t_int, p_int, h_int, g_int;
+    uint32_t t_dbl, p_dbl, h_dbl, g_dbl;
+    double temperature;
+    int i;
+
+    bme680.cal_param = g_calibrations[0];
+    bench_init();
+
+    start = bench_now();
+    for (i = 0; i < BENCH_SAMPLES; i++)
+        g_sink_int = bme680_compensate_temperature_int32(480000 + i, &bme680);
+    t_int = bench_now() - start;
+
+    start = bench_now();
+    for (i = 0; i < BENCH_SAMPLES; i++)
+        g_sink_int = bme680_compensate_pressure_int32(380000 + i, &bme680);
+    p_int = bench_now() - start;
+
+    start = bench_now();
+    for (i = 0; i < BENCH_SAMPLES; i++)
+        g_sink_int = bme680_compensate_humidity_int32(22000 + i, &bme680);
+    h_int = bench_now() - start;
+
+    start = bench_now();
+    for (i = 0; i < BENCH_SAMPLES; i++)
+        g_sink_int = bme680_calculate_gas_int32(i & 0x3ff, i & 0xf, &bme680);
+    g_int = bench_now() - start;
+
+    start = bench_now();
+    for (i = 0; i < BENCH_SAMPLES; i++)
+        g_sink_double = bme680_compensate_temperature_double(480000 + i,
+                                                             &bme680);
+    t_dbl = bench_now() - start;
+    temperature = g_sink_double;
+
+    start = bench_now();
+    for (i = 0; i < BENCH_SAMPLES; i++)
+        g_sink_double = bme680_compensate_pressure_double(380000 + i, &bme680);
+    p_dbl = bench_now() - start;
+
+    start = bench_now();
+    for (i = 0; i < BENCH_SAMPLES; i++)
+        g_sink_double = bme680_compensate_humidity_double(22000 + i,
+                                                          temperature, &bme680);
+    h_dbl = bench_now() - start;
+
+    start = bench_now();
+    for (i = 0; i < BENCH_SAMPLES; i++)
+        g_sink_double = bme680_compensate_gas_double(i & 0x3ff, i & 0xf,
+                                                     &bme680);
+    g_dbl = bench_now() - start;
+
+    printf("%-12s%10s%10s   (%s/sample)\n", "", "integer", "double",
+           BENCH_UNIT);
+    printf("%-12s%10lu%10lu\n", "temperature",
+           (unsigned long)t_int / BENCH_SAMPLES,
+           (unsigned long)t_dbl / BENCH_SAMPLES);
+    printf("%-12s%10lu%10lu\n", "pressure",
+           (unsigned long)p_int / BENCH_SAMPLES,
+           (unsigned long)p_dbl / BENCH_SAMPLES);
+    printf("%-12s%10lu%10lu\n", "humidity",
+           (unsigned long)h_int / BENCH_SAMPLES,
+           (unsigned long)h_dbl / BENCH_SAMPLES);
+    printf("%-12s%10lu%10lu\n", "gas",
+           (unsigned long)g_int / BENCH_SAMPLES,
+           (unsigned long)g_dbl / BENCH_SAMPLES);
+}
+
+#ifdef CONFIG_BUILD_KERNEL
+int main(int argc, FAR char *argv[])
+#else
+int bme680_test_main(int argc, char *argv[])
+#endif
+{
+    if (test_accuracy()) {
+        printf("FAILED\n");
+        return EXIT_FAILURE;
+    }
+    printf("integer compensation matches the double one\n");
+
+    bench_run();
+
+    return EXIT_SUCCESS;
+}
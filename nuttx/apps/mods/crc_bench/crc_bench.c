@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * CRC-16 (polynomial 0x8005) benchmark.
+ *
+ * Every variant of crc16_poly8005() is first checked against a bitwise
+ * reference, over buffers of all alignments and lengths up to a few
+ * packets, and when continued from a previous CRC. The throughput of each
+ * one is then timed over the packet sizes of the MHB and Mods data links.
+ * The byte-at-a-time table loop the library used to have is timed as
+ * well, as the baseline.
+ */
+
+#include <nuttx/config.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <crc16_poly8005.h>
+
+#define BENCH_MAX_SIZE      2048
+#define BENCH_CHECK_SIZE    300
+#define BENCH_DEFAULT_KB    1024
+
+struct bench_variant {
+    const char *name;
+    uint16_t (*run)(uint8_t *dest, const uint8_t *src, size_t len,
+                    uint16_t crc);
+};
+
+static uint8_t g_src[BENCH_MAX_SIZE + 8];
+static uint8_t g_dest[BENCH_MAX_SIZE + 8];
+static uint16_t g_byte_tab[256];
+
+static uint32_t bench_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint16_t bench_bitwise(const uint8_t *src, size_t len, uint16_t crc)
+{
+    int i;
+
+    while (len--) {
+        crc ^= *src++;
+        for (i = 0; i < 8; i++)
+            crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+    }
+
+    return crc;
+}
+
+static uint16_t run_byte(uint8_t *dest, const uint8_t *src, size_t len,
+                         uint16_t crc)
+{
+    while (len--)
+        crc = g_byte_tab[(crc ^ *src++) & 0xff] ^ (crc >> 8);
+
+    return crc;
+}
+
+static uint16_t run_sw(uint8_t *dest, const uint8_t *src, size_t len,
+                       uint16_t crc)
+{
+    return crc16_poly8005_sw(src, len, crc);
+}
+
+static uint16_t run_default(uint8_t *dest, const uint8_t *src, size_t len,
+                            uint16_t crc)
+{
+    return crc16_poly8005(src, len, crc);
+}
+
+static uint16_t run_memcpy(uint8_t *dest, const uint8_t *src, size_t len,
+                           uint16_t crc)
+{
+    memcpy(dest, src, len);
+    return crc16_poly8005(dest, len, crc);
+}
+
+static uint16_t run_copy(uint8_t *dest, const uint8_t *src, size_t len,
+                         uint16_t crc)
+{
+    return crc16_poly8005_copy(dest, src, len, crc);
+}
+
+static const struct bench_variant g_variants[] = {
+    { "byte table",     run_byte },
+    { "crc16_sw",       run_sw },
+    { "crc16",          run_default },
+    { "memcpy + crc16", run_memcpy },
+    { "crc16_copy",     run_copy },
+};
+
+#define BENCH_VARIANTS (sizeof(g_variants) / sizeof(g_variants[0]))
+
+static const size_t g_sizes[] = { 16, 64, 256, BENCH_MAX_SIZE };
+
+#define BENCH_SIZES (sizeof(g_sizes) / sizeof(g_sizes[0]))
+
+static int bench_check(void)
+{
+    size_t off;
+    size_t len;
+    size_t split;
+    uint16_t ref;
+    uint16_t crc;
+    int v;
+
+    /* Known check value of CRC-16/ARC */
+    crc = crc16_poly8005((const uint8_t *)"123456789", 9, CRC_INIT_VAL);
+    if (crc != 0xbb3d) {
+        printf("check value 0x%04x, expected 0xbb3d\n", crc);
+        return -1;
+    }
+
+    for (off = 0; off < 8; off++) {
+        for (len = 0; len <= BENCH_CHECK_SIZE; len++) {
+            ref = bench_bitwise(&g_src[off], len, 0x1d0f);
+
+            for (v = 0; v < BENCH_VARIANTS; v++) {
+                memset(g_dest, 0, sizeof(g_dest));
+                crc = g_variants[v].run(&g_dest[off], &g_src[off], len,
+                                        0x1d0f);
+                if (crc != ref) {
+                    printf("%s: 0x%04x, expected 0x%04x (offset %u, "
+                           "length %u)\n", g_variants[v].name, crc, ref,
+                           (unsigned)off, (unsigned)len);
+                    return -1;
+                }
+            }
+
+            if (memcmp(&g_dest[off], &g_src[off], len)) {
+                printf("crc16_copy: bad copy (offset %u, length %u)\n",
+                       (unsigned)off, (unsigned)len);
+                return -1;
+            }
+
+            /* Continuing from a previous CRC gives the CRC of the whole */
+            split = len / 3;
+            crc = crc16_poly8005_copy(g_dest, &g_src[off], split, 0x1d0f);
+            crc = crc16_poly8005(&g_src[off + split], len - split, crc);
+            if (crc != ref) {
+                printf("split at %u: 0x%04x, expected 0x%04x\n",
+                       (unsigned)split, crc, ref);
+                return -1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void bench_run(int kb)
+{
+    uint32_t start;
+    uint32_t us;
+    uint32_t rounds;
+    uint32_t r;
+    uint16_t crc;
+    int s;
+    int v;
+
+    printf("%-16s", "bytes/packet");
+    for (s = 0; s < BENCH_SIZES; s++)
+        printf("%10u", (unsigned)g_sizes[s]);
+    printf("   (KB/s)\n");
+
+    for (v = 0; v < BENCH_VARIANTS; v++) {
+        printf("%-16s", g_variants[v].name);
+
+        for (s = 0; s < BENCH_SIZES; s++) {
+            rounds = (uint32_t)kb * 1024 / g_sizes[s];
+            crc = CRC_INIT_VAL;
+
+            start = bench_now_us();
+            for (r = 0; r < rounds; r++)
+                crc = g_variants[v].run(g_dest, g_src, g_sizes[s], crc);
+            us = bench_now_us() - start;
+
+            /* Keep the result alive */
+            g_dest[0] ^= crc;
+
+            printf("%10lu", us ? (unsigned long)((uint64_t)kb * 1000000 / us)
+                               : 0UL);
+        }
+        printf("\n");
+    }
+}
+
+#ifdef CONFIG_BUILD_KERNEL
+int main(int argc, FAR char *argv[])
+#else
+int crc_bench_main(int argc, char *argv[])
+#endif
+{
+    int kb = BENCH_DEFAULT_KB;
+    int i;
+
+    if (argc > 1)
+        kb = atoi(argv[1]);
+    if (kb <= 0) {
+        printf("usage: crc_bench [KB per run]\n");
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < 256; i++) {
+        uint8_t byte = i;
+
+        g_byte_tab[i] = bench_bitwise(&byte, 1, 0);
+    }
+    for (i = 0; i < sizeof(g_src); i++)
+        g_src[i] = rand();
+
+    if (bench_check()) {
+        printf("FAILED\n");
+        return EXIT_FAILURE;
+    }
+    printf("all variants match the reference\n");
+
+    bench_run(kb);
+
+    return EXIT_SUCCESS;
+}
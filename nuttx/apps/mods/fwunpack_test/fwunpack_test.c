@@ -0,0 +1,255 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Round trip test of the firmware image encoders and streaming decoders.
+ *
+ * Firmware-like images are packed with fwpack_lz4() and fwpack_delta()
+ * and unpacked in place over a RAM copy of the old image, in chunks of
+ * varying size as they arrive over Greybus. The device accesses are
+ * checked the same way flash would need them: writes in order and 8-byte
+ * aligned, and no read of the old image after it has been overwritten.
+ * Corrupted images must be rejected without writing outside the image.
+ */
+
+#include <nuttx/config.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nuttx/fwunpack.h>
+#include <nuttx/util.h>
+
+#define TEST_MAX_SIZE       (64 * 1024)
+#define TEST_ITERATIONS     16
+#define TEST_CORRUPTIONS    256
+
+/* RAM stand-in for the flash, with room to catch writes past the image */
+static uint8_t g_dev[TEST_MAX_SIZE + 64];
+static size_t g_dev_size;
+static size_t g_written;
+static int g_dev_error;
+
+static uint8_t g_old[TEST_MAX_SIZE];
+static uint8_t g_new[TEST_MAX_SIZE];
+static uint8_t g_packed[2 * TEST_MAX_SIZE + 1024];
+static struct fwunpack_s g_unpack;
+
+static int dev_write(void *arg, uint32_t offset, const uint8_t *buf,
+                     size_t len)
+{
+    if (offset != g_written || (offset & 7) ||
+        offset + len > g_dev_size) {
+        g_dev_error = 1;
+        return -EINVAL;
+    }
+
+    memcpy(&g_dev[offset], buf, len);
+    g_written += len;
+    return 0;
+}
+
+/* Reads past the device fail, like the flash accessors of the targets */
+static int dev_read(void *arg, uint32_t offset, uint8_t *buf, size_t len)
+{
+    if (offset + len > sizeof(g_dev))
+        return -EINVAL;
+
+    memcpy(buf, &g_dev[offset], len);
+    return 0;
+}
+
+static const struct fwunpack_ops_s g_dev_ops = {
+    .write = dev_write,
+    .read = dev_read,
+};
+
+/* Instruction-like words with repeats, as in code sections */
+static void make_image(uint8_t *img, size_t len)
+{
+    size_t i;
+    size_t n;
+
+    for (i = 0; i < len; ) {
+        if (i > 64 && rand() % 3 == 0) {
+            n = MIN(4 + rand() % 60, len - i);
+            memmove(&img[i], &img[i - 64 + rand() % 32], n);
+        } else {
+            n = MIN(4, len - i);
+            memset(&img[i], rand() & 0x1f, n);
+            img[i] = rand();
+        }
+        i += n;
+    }
+}
+
+/* A new version of an image: a few bytes patched and some code moved */
+static void make_update(uint8_t *img, const uint8_t *old, size_t len)
+{
+    size_t i;
+    size_t at;
+
+    memcpy(img, old, len);
+    for (i = 0; i < 16; i++)
+        img[rand() % len] ^= 1 + rand() % 255;
+
+    at = rand() % (len / 2);
+    memmove(&img[at + 2048], &img[at], MIN(4096, len - at - 2048));
+}
+
+static int unpack(enum fwunpack_type_e type, const uint8_t *packed,
+                  size_t packed_len, size_t len, const uint8_t *old,
+                  size_t old_len, size_t chunk)
+{
+    size_t i;
+    int ret;
+
+    memset(g_dev, 0xff, sizeof(g_dev));
+    memcpy(g_dev, old, old_len);
+    g_dev_size = len;
+    g_written = 0;
+    g_dev_error = 0;
+
+    ret = fwunpack_init(&g_unpack, type, len, &g_dev_ops, NULL);
+    for (i = 0; !ret && i < packed_len; i += chunk)
+        ret = fwunpack_feed(&g_unpack, &packed[i], MIN(chunk, packed_len - i));
+    if (!ret)
+        ret = fwunpack_finish(&g_unpack);
+
+    return ret;
+}
+
+static int round_trip(enum fwunpack_type_e type, size_t len, size_t old_len,
+                      uint8_t shift)
+{
+    const char *name = (type == FWUNPACK_LZ4) ? "lz4" : "delta";
+    ssize_t packed_len;
+    size_t chunk = 1 + rand() % 2000;
+    int ret;
+
+    if (type == FWUNPACK_LZ4)
+        packed_len = fwpack_lz4(g_new, len, g_packed, sizeof(g_packed));
+    else
+        packed_len = fwpack_delta(g_new, len, g_old, old_len, shift, g_packed,
+                                  sizeof(g_packed));
+    if (packed_len < 0) {
+        printf("%s: packing %u bytes failed: %d\n", name, (unsigned)len,
+               (int)packed_len);
+        return -1;
+    }
+
+    ret = unpack(type, g_packed, packed_len, len, g_old, old_len, chunk);
+    if (ret || g_dev_error || g_written != len || memcmp(g_dev, g_new, len)) {
+        printf("%s: %u bytes from %d in chunks of %u: error %d%s\n", name,
+               (unsigned)len, (int)packed_len, (unsigned)chunk, ret,
+               g_dev_error ? ", bad device access" : "");
+        return -1;
+    }
+
+    printf("%-6s %6u bytes -> %6d\n", name, (unsigned)len, (int)packed_len);
+    return 0;
+}
+
+/* Flip bytes of a packed image: an error or a wrong image, nothing worse */
+static int corrupt(enum fwunpack_type_e type, size_t len)
+{
+    ssize_t packed_len;
+    int i;
+
+    if (type == FWUNPACK_LZ4)
+        packed_len = fwpack_lz4(g_new, len, g_packed, sizeof(g_packed));
+    else
+        packed_len = fwpack_delta(g_new, len, g_old, len, 8, g_packed,
+                                  sizeof(g_packed));
+    if (packed_len < 0)
+        return -1;
+
+    for (i = 0; i < TEST_CORRUPTIONS; i++) {
+        size_t at = rand() % packed_len;
+        uint8_t saved = g_packed[at];
+
+        g_packed[at] ^= 1 + rand() % 255;
+        unpack(type, g_packed, packed_len, len, g_old, len, 1 + rand() % 300);
+        g_packed[at] = saved;
+
+        if (g_dev_error || g_written > len) {
+            printf("corrupted image written out of bounds\n");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+#ifdef CONFIG_BUILD_KERNEL
+int main(int argc, FAR char *argv[])
+#else
+int fwunpack_test_main(int argc, char *argv[])
+#endif
+{
+    size_t len;
+    size_t old_len;
+    int i;
+
+    srand(1);
+
+    for (i = 0; i < TEST_ITERATIONS; i++) {
+        len = 8 * 1024 + rand() % (TEST_MAX_SIZE - 8 * 1024);
+        old_len = len - rand() % 4096;
+
+        make_image(g_old, old_len);
+        make_update(g_new, g_old, old_len);
+        make_image(&g_new[old_len], len - old_len);
+
+        if (round_trip(FWUNPACK_LZ4, len, old_len, 0) ||
+            round_trip(FWUNPACK_DELTA, len, old_len, 8 + rand() % 4)) {
+            printf("FAILED\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* Edge cases: tiny images and an image replacing nothing */
+    make_image(g_new, 16);
+    if (round_trip(FWUNPACK_LZ4, 1, 0, 0) ||
+        round_trip(FWUNPACK_LZ4, 13, 0, 0) ||
+        round_trip(FWUNPACK_DELTA, 5, 0, 3) ||
+        round_trip(FWUNPACK_DELTA, 16, 0, 11)) {
+        printf("FAILED\n");
+        return EXIT_FAILURE;
+    }
+
+    if (corrupt(FWUNPACK_LZ4, 4096) || corrupt(FWUNPACK_DELTA, 4096)) {
+        printf("FAILED\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("PASSED\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,487 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Greybus dispatch benchmark.
+ *
+ * Greybus is brought up on an in-memory transport that loops responses
+ * back to the benchmark. A ping driver is registered on a number of
+ * CPorts; the benchmark injects requests through greybus_rx_handler() and
+ * waits for all the responses. Each request carries a per-CPort sequence
+ * number so out of order handling is detected.
+ *
+ * Two loads are run: requests spread evenly over the CPorts, and a hot
+ * CPort receiving most of the traffic. The spread load is run again with
+ * the requests handed over in transport buffers, as a zero-copy data link
+ * does with greybus_rx_handler_take(). The dispatch footprint reported
+ * by the core gives the thread stack RAM used, and what one thread per
+ * CPort would have used.
+ *
+ * The other way around, bursts of requests are sent to the CPorts and
+ * answered in reverse order to time response matching with many requests
+ * outstanding. Last, unanswered requests with different timeouts check
+ * that each one expires on its own deadline.
+ */
+
+#include <nuttx/config.h>
+
+#include <errno.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arch/byteorder.h>
+#include <nuttx/arch.h>
+#include <nuttx/greybus/greybus.h>
+#include <nuttx/greybus/pool.h>
+
+#define BENCH_DEFAULT_CPORTS    8
+#define BENCH_DEFAULT_OPS       10000
+#define BENCH_DEFAULT_WORK_US   0
+#define BENCH_MAX_CPORTS        32
+#define BENCH_HOT_PERCENT       90
+#define BENCH_BURST             32
+#define BENCH_TIMEOUTS          8
+#define BENCH_TIMEOUT_SHORT_MS  30
+#define BENCH_TIMEOUT_LONG_MS   120
+#define BENCH_TIMEOUT_SLACK_MS  50
+
+#define BENCH_TYPE_PING         0x02
+
+struct bench_request {
+    __le32 seq;
+} __packed;
+
+struct bench_sent {
+    uint16_t cport;
+    __le16 id;
+};
+
+struct bench_ctx_s {
+    sem_t done;
+    volatile uint32_t responses;
+    uint32_t expected;
+    uint32_t out_of_order;
+    uint32_t failures;
+    uint32_t start;
+    struct bench_sent sent[BENCH_BURST];
+    int nsent;
+    uint32_t next_seq[BENCH_MAX_CPORTS];
+    uint32_t expect_seq[BENCH_MAX_CPORTS];
+    int work_us;
+};
+
+static struct bench_ctx_s g_bench;
+
+static uint32_t bench_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void bench_complete(void)
+{
+    sched_lock();
+    if (++g_bench.responses == g_bench.expected)
+        sem_post(&g_bench.done);
+    sched_unlock();
+}
+
+static uint8_t bench_ping(struct gb_operation *operation)
+{
+    struct bench_request *req = gb_operation_get_request_payload(operation);
+    unsigned int cport = operation->cport;
+
+    if (le32_to_cpu(req->seq) != g_bench.expect_seq[cport])
+        g_bench.out_of_order++;
+    g_bench.expect_seq[cport] = le32_to_cpu(req->seq) + 1;
+
+    if (g_bench.work_us)
+        up_udelay(g_bench.work_us);
+
+    return GB_OP_SUCCESS;
+}
+
+static struct gb_operation_handler bench_handlers[] = {
+    GB_HANDLER(BENCH_TYPE_PING, bench_ping),
+};
+
+static struct gb_driver bench_driver = {
+    .op_handlers = bench_handlers,
+    .op_handlers_count = ARRAY_SIZE(bench_handlers),
+};
+
+static void bench_transport_init(void)
+{
+}
+
+static int bench_transport_listen(unsigned int cport)
+{
+    return 0;
+}
+
+static int bench_transport_send(unsigned int cport, const void *buf,
+                                size_t len)
+{
+    const struct gb_operation_hdr *hdr = buf;
+
+    if (!(hdr->type & GB_TYPE_RESPONSE_FLAG)) {
+        /* Outgoing request, remember it to answer it later */
+        if (hdr->id && g_bench.nsent < BENCH_BURST) {
+            g_bench.sent[g_bench.nsent].cport = cport;
+            g_bench.sent[g_bench.nsent].id = hdr->id;
+            g_bench.nsent++;
+        }
+        return 0;
+    }
+
+    /* Responses come from several dispatch threads */
+    bench_complete();
+
+    return 0;
+}
+
+static void *bench_alloc_buf(size_t size)
+{
+#ifdef CONFIG_GREYBUS_POOL
+    return gb_pool_alloc(size);
+#else
+    return malloc(size);
+#endif
+}
+
+static void bench_free_buf(void *ptr)
+{
+#ifdef CONFIG_GREYBUS_POOL
+    gb_pool_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+static struct gb_transport_backend bench_transport = {
+    .init = bench_transport_init,
+    .listen = bench_transport_listen,
+    .stop_listening = bench_transport_listen,
+    .send = bench_transport_send,
+    .alloc_buf = bench_alloc_buf,
+    .free_buf = bench_free_buf,
+};
+
+static int bench_inject(int cport, void *msg, size_t size, bool take)
+{
+    void *buf;
+    int ret;
+
+    if (!take)
+        return greybus_rx_handler(cport, msg, size);
+
+    /* The buffer is consumed whatever the outcome */
+    buf = bench_alloc_buf(size);
+    if (!buf)
+        return -ENOMEM;
+    memcpy(buf, msg, size);
+
+    return greybus_rx_handler_take(cport, buf, size);
+}
+
+static int bench_run(const char *name, int cports, int ops, int hot_percent,
+                     bool take)
+{
+    struct {
+        struct gb_operation_hdr hdr;
+        struct bench_request req;
+    } __packed msg;
+    uint32_t start, elapsed;
+    int cport;
+    int i;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.hdr.size = cpu_to_le16(sizeof(msg));
+    msg.hdr.type = BENCH_TYPE_PING;
+
+    g_bench.responses = 0;
+    g_bench.expected = ops;
+    g_bench.out_of_order = 0;
+
+    start = bench_now_us();
+
+    for (i = 0; i < ops; i++) {
+        if (hot_percent && (rand() % 100) < hot_percent)
+            cport = 0;
+        else
+            cport = i % cports;
+
+        msg.hdr.id = cpu_to_le16((i % 0xffff) + 1);
+        msg.req.seq = cpu_to_le32(g_bench.next_seq[cport]++);
+
+        while (bench_inject(cport, &msg, sizeof(msg), take) == -ENOMEM)
+            usleep(1000);
+    }
+
+    while (sem_wait(&g_bench.done) != OK);
+    elapsed = bench_now_us() - start;
+
+    printf("%-8s %6d ops in %8lu us: %8lu ops/s, %lu out of order\n", name,
+           ops, (unsigned long)elapsed,
+           elapsed ? (unsigned long)((uint64_t)ops * 1000000 / elapsed) : 0,
+           (unsigned long)g_bench.out_of_order);
+
+    return g_bench.out_of_order ? -EIO : 0;
+}
+
+static void bench_request_done(struct gb_operation *operation)
+{
+    if (gb_operation_get_request_result(operation) != GB_OP_SUCCESS)
+        g_bench.failures++;
+    bench_complete();
+}
+
+static int bench_requests(int cports, int ops)
+{
+    struct gb_operation *op;
+    struct gb_operation_hdr resp;
+    uint32_t start, elapsed;
+    int sent = 0;
+    int i;
+
+    g_bench.responses = 0;
+    g_bench.failures = 0;
+
+    memset(&resp, 0, sizeof(resp));
+    resp.size = cpu_to_le16(sizeof(resp));
+    resp.type = BENCH_TYPE_PING | GB_TYPE_RESPONSE_FLAG;
+
+    start = bench_now_us();
+
+    while (sent < ops) {
+        g_bench.nsent = 0;
+
+        for (i = 0; i < BENCH_BURST && sent + i < ops; i++) {
+            op = gb_operation_create(i % cports, BENCH_TYPE_PING, 0);
+            if (!op)
+                break;
+            if (gb_operation_send_request(op, bench_request_done, true))
+                g_bench.failures++;
+            gb_operation_destroy(op);
+        }
+
+        if (!g_bench.nsent)
+            break;
+        sent += g_bench.nsent;
+        g_bench.expected = sent;
+
+        /* Answer the oldest request last */
+        for (i = g_bench.nsent - 1; i >= 0; i--) {
+            resp.id = g_bench.sent[i].id;
+            while (greybus_rx_handler(g_bench.sent[i].cport, &resp,
+                                      sizeof(resp)) == -ENOMEM)
+                usleep(1000);
+        }
+
+        while (sem_wait(&g_bench.done) != OK);
+    }
+
+    if (sent < ops) {
+        printf("burst: only %d requests out of %d sent\n", sent, ops);
+        return -EIO;
+    }
+
+    elapsed = bench_now_us() - start;
+
+    printf("%-8s %6d ops in %8lu us: %8lu ops/s, %lu failed\n", "burst",
+           ops, (unsigned long)elapsed,
+           elapsed ? (unsigned long)((uint64_t)ops * 1000000 / elapsed) : 0,
+           (unsigned long)g_bench.failures);
+
+    return g_bench.failures ? -EIO : 0;
+}
+
+static void bench_timeout_done(struct gb_operation *operation)
+{
+    uint32_t timeout_ms = (uint32_t)operation->priv_data;
+    uint32_t elapsed_ms = (bench_now_us() - g_bench.start) / 1000;
+
+    if (gb_operation_get_request_result(operation) != GB_OP_TIMEOUT ||
+        elapsed_ms < timeout_ms ||
+        elapsed_ms > timeout_ms + BENCH_TIMEOUT_SLACK_MS) {
+        printf("timeout: %lu ms request completed after %lu ms\n",
+               (unsigned long)timeout_ms, (unsigned long)elapsed_ms);
+        g_bench.failures++;
+    }
+    bench_complete();
+}
+
+static int bench_timeouts(int cports)
+{
+    struct gb_operation *op;
+    uint32_t timeout_ms;
+    int i;
+
+    g_bench.responses = 0;
+    g_bench.expected = BENCH_TIMEOUTS;
+    g_bench.failures = 0;
+    g_bench.start = bench_now_us();
+
+    for (i = 0; i < BENCH_TIMEOUTS; i++) {
+        op = gb_operation_create(i % cports, BENCH_TYPE_PING, 0);
+        if (!op)
+            return -ENOMEM;
+
+        timeout_ms = (i & 1) ? BENCH_TIMEOUT_LONG_MS : BENCH_TIMEOUT_SHORT_MS;
+        op->priv_data = (void *)timeout_ms;
+        if (gb_operation_send_request_timeout(op, bench_timeout_done, true,
+                                              timeout_ms)) {
+            g_bench.failures++;
+            bench_complete();
+        }
+        gb_operation_destroy(op);
+    }
+
+    while (sem_wait(&g_bench.done) != OK);
+
+    printf("%-8s %6d requests, %lu expired out of time\n", "timeout",
+           BENCH_TIMEOUTS, (unsigned long)g_bench.failures);
+
+    return g_bench.failures ? -EIO : 0;
+}
+
+#ifdef CONFIG_GREYBUS_POOL
+static void bench_pool_stats(void)
+{
+    static const char *names[GB_POOL_CLASS_COUNT] = {
+        "ops", "small", "mtu",
+    };
+    struct gb_pool_stats stats;
+    int i;
+
+    gb_pool_get_stats(&stats);
+
+    for (i = 0; i < GB_POOL_CLASS_COUNT; i++) {
+        printf("pool %-5s %4u x %4u bytes: %lu allocs, %lu fallbacks, "
+               "%u min free\n", names[i], stats.classes[i].count,
+               stats.classes[i].size,
+               (unsigned long)stats.classes[i].allocs,
+               (unsigned long)stats.classes[i].fallbacks,
+               stats.classes[i].min_free);
+    }
+    printf("pool heap: %lu allocs, %lu frees, %lu interrupt misses\n",
+           (unsigned long)stats.heap_allocs, (unsigned long)stats.heap_frees,
+           (unsigned long)stats.irq_misses);
+}
+#endif
+
+#ifdef CONFIG_BUILD_KERNEL
+int main(int argc, FAR char *argv[])
+#else
+int gb_bench_main(int argc, char *argv[])
+#endif
+{
+    struct gb_dispatch_info info;
+    int cports = BENCH_DEFAULT_CPORTS;
+    int ops = BENCH_DEFAULT_OPS;
+    int registered = 0;
+    int failed = 0;
+    int ret;
+    int i;
+
+    if (argc > 1)
+        cports = atoi(argv[1]);
+    if (argc > 2)
+        ops = atoi(argv[2]);
+    memset(&g_bench, 0, sizeof(g_bench));
+    g_bench.work_us = argc > 3 ? atoi(argv[3]) : BENCH_DEFAULT_WORK_US;
+
+    if (cports < 1 || cports > BENCH_MAX_CPORTS || ops < 1) {
+        printf("usage: %s [cports (1-%d)] [ops] [handler work us]\n",
+               argv[0], BENCH_MAX_CPORTS);
+        return EXIT_FAILURE;
+    }
+
+    sem_init(&g_bench.done, 0, 0);
+
+    ret = gb_init(&bench_transport);
+    if (ret) {
+        printf("gb_init failed: %d\n", ret);
+        return EXIT_FAILURE;
+    }
+
+    for (i = 0; i < cports; i++) {
+        ret = gb_register_driver(i, &bench_driver);
+        if (ret) {
+            printf("registering CP%d failed: %d\n", i, ret);
+            failed++;
+            break;
+        }
+        registered++;
+    }
+
+    gb_dispatch_get_info(&info);
+
+#ifdef CONFIG_GREYBUS_DISPATCH_POOL
+    printf("dispatch: pool of %d threads\n", CONFIG_GREYBUS_DISPATCH_THREADS);
+#else
+    printf("dispatch: one thread per CPort\n");
+#endif
+    printf("%u CPorts, %u threads, %lu bytes of stack "
+           "(%lu with one thread per CPort, %ld saved)\n",
+           info.cports, info.threads, (unsigned long)info.stack_bytes,
+           (unsigned long)info.per_cport_stack_bytes,
+           (long)info.per_cport_stack_bytes - (long)info.stack_bytes);
+
+    if (!failed) {
+        if (bench_run("spread", registered, ops, 0, false))
+            failed++;
+        if (bench_run("hot", registered, ops, BENCH_HOT_PERCENT, false))
+            failed++;
+        if (bench_run("take", registered, ops, 0, true))
+            failed++;
+        if (bench_requests(registered, ops))
+            failed++;
+        if (bench_timeouts(registered))
+            failed++;
+    }
+
+#ifdef CONFIG_GREYBUS_POOL
+    bench_pool_stats();
+#endif
+
+    for (i = 0; i < registered; i++)
+        gb_unregister_driver(i);
+    gb_deinit();
+    sem_destroy(&g_bench.done);
+
+    printf("%s\n", failed ? "FAILED" : "PASSED");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -289,6 +289,7 @@ void mhb_print_i2s_status(const char *header, struct i2s_tunnel_info_s *info)
     FROM_LE(info->i2s_tx_samples_dropped);
     FROM_LE(info->i2s_tx_samples_retransmitted);
     FROM_LE(info->i2s_tx_buffers_dropped);
+    FROM_LE(info->i2s_tx_drift_ppm);
 
     printf("%s:\n", header);
     printf("  Enabled:                      %u\n", info->enabled);
@@ -302,6 +303,7 @@ void mhb_print_i2s_status(const char *header, struct i2s_tunnel_info_s *info)
     printf("  Samples removed:              %u\n", info->i2s_tx_samples_dropped);
     printf("  Samples repeated:             %u\n", info->i2s_tx_samples_retransmitted);
     printf("  Packets dropped:              %u\n", info->i2s_tx_buffers_dropped);
+    printf("  Clock drift ppm:              %d\n", info->i2s_tx_drift_ppm);
 }
 
 static int mhb_handle_i2s_rx(struct device *dev, struct mhb_hdr *hdr,
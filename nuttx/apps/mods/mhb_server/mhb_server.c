@@ -1212,6 +1212,7 @@ static int mhb_handle_i2s_status_req(struct mhb_transaction *transaction)
             TO_LE(info->i2s_tx_samples_dropped);
             TO_LE(info->i2s_tx_samples_retransmitted);
             TO_LE(info->i2s_tx_buffers_dropped);
+            TO_LE(info->i2s_tx_drift_ppm);
 
             transaction->out_msg.hdr->addr = MHB_ADDR_I2S;
             transaction->out_msg.hdr->type = MHB_TYPE_I2S_STATUS_RSP;
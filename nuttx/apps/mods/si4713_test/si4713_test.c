@@ -0,0 +1,644 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Si4713 command engine test.
+ *
+ * A simulated Si4713 sits behind a fake I2C bus. Commands take a
+ * configurable number of ticks to raise CTS (and, for tune commands, STC),
+ * and the chip interrupt is delivered through si4713_interrupt(). The test
+ * checks ordering, the STC/INTACK sequence, error and timeout reporting,
+ * and reports submit cost, command latency and throughput.
+ *
+ * With the RDS scheduler enabled, the fake chip also drains its RDS FIFO at
+ * one group per tick and decodes what it "transmits", so the test can check
+ * that PS and RT arrive intact and that a small RT edit only re-encodes the
+ * affected groups.
+ */
+
+#include <nuttx/config.h>
+
+#include <errno.h>
+#include <semaphore.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <nuttx/clock.h>
+#include <nuttx/i2c.h>
+#include <nuttx/si4713.h>
+#include <nuttx/wdog.h>
+
+#define TEST_DEFAULT_COUNT      200
+#define TEST_DEFAULT_BUSY       0
+#define TEST_STC_TICKS          2
+#define TEST_FREQ               10110
+#define TEST_POWER              115
+
+#define TEST_RDS_PI             0x5678
+#define TEST_RDS_PS             "MOTO FM"
+#define TEST_RDS_RT             "Song title - Artist name"
+#define TEST_RDS_RT2            "Song title - Artist nane"
+#define TEST_RDS_GROUPS         200
+#define FAKE_RDS_FIFO_MAX       32
+
+struct fake_si4713_s {
+    struct i2c_dev_s dev;       /* must be first */
+    struct si4713_dev_s *si;
+    struct wdog_s wdog;
+
+    uint8_t status;
+    uint8_t cmd;
+    int busy_ticks;
+    bool fail_next;
+    bool mute_next;
+
+    uint16_t freq;
+    uint8_t power;
+    uint32_t commands;
+
+#ifdef CONFIG_AUDIO_SI4713_RDS
+    struct wdog_s xmit_wdog;
+    uint16_t fifo[FAKE_RDS_FIFO_MAX][3];
+    int fifo_size;
+    int fifo_head;
+    int fifo_used;
+    int xmit_remaining;
+    int xmit_empty;
+    char ps[SI4713_RDS_PS_LEN + 1];
+    char rt[SI4713_RDS_RT_LEN + 1];
+#endif
+};
+
+struct test_ctx_s {
+    sem_t done;
+    int expected;
+    int completed;
+    int errors;
+    int out_of_order;
+    uint32_t *submit_us;
+    uint32_t max_latency;
+    uint64_t total_latency;
+};
+
+static struct fake_si4713_s g_fake;
+
+static uint32_t test_now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void fake_raise(struct fake_si4713_s *fake)
+{
+    if (fake->si)
+        si4713_interrupt(fake->si);
+}
+
+static void fake_stc(int argc, uint32_t arg, ...)
+{
+    struct fake_si4713_s *fake = (struct fake_si4713_s *)arg;
+
+    fake->status |= SI4713_STATUS_STCINT;
+    fake_raise(fake);
+}
+
+static void fake_cts(int argc, uint32_t arg, ...)
+{
+    struct fake_si4713_s *fake = (struct fake_si4713_s *)arg;
+
+    fake->status |= SI4713_STATUS_CTS;
+    fake_raise(fake);
+
+    if (fake->cmd == SI4713_TX_TUNE_FREQ || fake->cmd == SI4713_TX_TUNE_POWER)
+        wd_start(&fake->wdog, TEST_STC_TICKS, fake_stc, 1, (uint32_t)fake);
+}
+
+#ifdef CONFIG_AUDIO_SI4713_RDS
+/* "Transmit" one FIFO group per tick and decode it */
+static void fake_xmit(int argc, uint32_t arg, ...)
+{
+    struct fake_si4713_s *fake = (struct fake_si4713_s *)arg;
+    uint16_t *grp;
+    int seg;
+
+    if (!fake->xmit_remaining)
+        return;
+
+    fake->xmit_remaining--;
+    wd_start(&fake->xmit_wdog, 1, fake_xmit, 1, (uint32_t)fake);
+
+    if (!fake->fifo_used) {
+        fake->xmit_empty++;
+        return;
+    }
+
+    grp = fake->fifo[fake->fifo_head];
+    fake->fifo_head = (fake->fifo_head + 1) % FAKE_RDS_FIFO_MAX;
+    fake->fifo_used--;
+
+    switch (grp[0] >> 11) {
+    case 0x0 << 1:      /* 0A */
+        seg = grp[0] & 0x3;
+        fake->ps[seg * 2] = grp[2] >> 8;
+        fake->ps[seg * 2 + 1] = grp[2] & 0xff;
+        break;
+    case 0x2 << 1:      /* 2A */
+        seg = grp[0] & 0xf;
+        fake->rt[seg * 4] = grp[1] >> 8;
+        fake->rt[seg * 4 + 1] = grp[1] & 0xff;
+        fake->rt[seg * 4 + 2] = grp[2] >> 8;
+        fake->rt[seg * 4 + 3] = grp[2] & 0xff;
+        break;
+    default:
+        break;
+    }
+
+    fake->status |= SI4713_STATUS_RDSINT;
+    fake_raise(fake);
+}
+
+static void fake_rds_buff(struct fake_si4713_s *fake, const uint8_t *buf)
+{
+    uint16_t *grp;
+
+    if (buf[1] & SI4713_RDS_BUFF_INTACK)
+        fake->status &= ~SI4713_STATUS_RDSINT;
+
+    if (buf[1] & SI4713_RDS_BUFF_MTBUFF)
+        fake->fifo_used = 0;
+
+    if (!(buf[1] & SI4713_RDS_BUFF_LDBUFF))
+        return;
+
+    if (fake->fifo_used >= fake->fifo_size) {
+        fake->status |= SI4713_STATUS_ERR;
+        return;
+    }
+
+    grp = fake->fifo[(fake->fifo_head + fake->fifo_used) % FAKE_RDS_FIFO_MAX];
+    grp[0] = (buf[2] << 8) | buf[3];
+    grp[1] = (buf[4] << 8) | buf[5];
+    grp[2] = (buf[6] << 8) | buf[7];
+    fake->fifo_used++;
+}
+#endif
+
+static void fake_command(struct fake_si4713_s *fake, const uint8_t *buf,
+                         int len)
+{
+    fake->cmd = buf[0];
+    fake->commands++;
+    fake->status &= SI4713_STATUS_STCINT | SI4713_STATUS_RDSINT;
+
+    switch (fake->cmd) {
+    case SI4713_TX_TUNE_FREQ:
+        fake->freq = (buf[2] << 8) | buf[3];
+        fake->status &= ~SI4713_STATUS_STCINT;
+        break;
+    case SI4713_TX_TUNE_POWER:
+        fake->power = buf[3];
+        fake->status &= ~SI4713_STATUS_STCINT;
+        break;
+    case SI4713_TX_TUNE_STATUS:
+        if (len > 1 && (buf[1] & SI4713_TUNE_STATUS_INTACK))
+            fake->status &= ~SI4713_STATUS_STCINT;
+        break;
+#ifdef CONFIG_AUDIO_SI4713_RDS
+    case SI4713_SET_PROPERTY:
+        if (len >= 6 && ((buf[2] << 8) | buf[3]) ==
+                        SI4713_PROP_TX_RDS_FIFO_SIZE) {
+            fake->fifo_size = MIN(((buf[4] << 8) | buf[5]) / 3,
+                                  FAKE_RDS_FIFO_MAX);
+        }
+        break;
+    case SI4713_TX_RDS_BUFF:
+        if (len >= 8)
+            fake_rds_buff(fake, buf);
+        break;
+#endif
+    default:
+        break;
+    }
+
+    if (fake->fail_next) {
+        fake->fail_next = false;
+        fake->status |= SI4713_STATUS_ERR;
+    }
+
+    if (fake->mute_next) {
+        /* Never raise CTS: the engine has to time out */
+        fake->mute_next = false;
+        return;
+    }
+
+    if (fake->busy_ticks)
+        wd_start(&fake->wdog, fake->busy_ticks, fake_cts, 1, (uint32_t)fake);
+    else
+        fake_cts(1, (uint32_t)fake);
+}
+
+static void fake_response(struct fake_si4713_s *fake, uint8_t *buf, int len)
+{
+    uint8_t resp[SI4713_MAX_RESP];
+
+    memset(resp, 0, sizeof(resp));
+    resp[0] = fake->status;
+
+    if (fake->cmd == SI4713_TX_TUNE_STATUS) {
+        resp[2] = fake->freq >> 8;
+        resp[3] = fake->freq & 0xff;
+        resp[5] = fake->power;
+    }
+
+#ifdef CONFIG_AUDIO_SI4713_RDS
+    if (fake->cmd == SI4713_TX_RDS_BUFF) {
+        resp[SI4713_RDS_BUFF_FIFOAVAIL] =
+            (fake->fifo_size - fake->fifo_used) * 3;
+        resp[SI4713_RDS_BUFF_FIFOUSED] = fake->fifo_used * 3;
+    }
+#endif
+
+    memcpy(buf, resp, MIN(len, sizeof(resp)));
+}
+
+static uint32_t fake_setfrequency(struct i2c_dev_s *dev, uint32_t frequency)
+{
+    return frequency;
+}
+
+static int fake_setaddress(struct i2c_dev_s *dev, int addr, int nbits)
+{
+    return OK;
+}
+
+static int fake_write(struct i2c_dev_s *dev, const uint8_t *buffer,
+                      int buflen)
+{
+    fake_command((struct fake_si4713_s *)dev, buffer, buflen);
+    return OK;
+}
+
+static int fake_read(struct i2c_dev_s *dev, uint8_t *buffer, int buflen)
+{
+    fake_response((struct fake_si4713_s *)dev, buffer, buflen);
+    return OK;
+}
+
+#ifdef CONFIG_I2C_WRITEREAD
+static int fake_writeread(struct i2c_dev_s *dev, const uint8_t *wbuffer,
+                          int wbuflen, uint8_t *rbuffer, int rbuflen)
+{
+    fake_write(dev, wbuffer, wbuflen);
+    return fake_read(dev, rbuffer, rbuflen);
+}
+#endif
+
+static int fake_transfer(struct i2c_dev_s *dev, struct i2c_msg_s *msgs,
+                         int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (msgs[i].addr != SI4713_I2C_ADDR)
+            return -ENXIO;
+
+        if (msgs[i].flags & I2C_M_READ)
+            fake_read(dev, msgs[i].buffer, msgs[i].length);
+        else
+            fake_write(dev, msgs[i].buffer, msgs[i].length);
+    }
+
+    return OK;
+}
+
+static const struct i2c_ops_s g_fake_ops = {
+    .setfrequency = fake_setfrequency,
+    .setaddress = fake_setaddress,
+    .write = fake_write,
+    .read = fake_read,
+#ifdef CONFIG_I2C_WRITEREAD
+    .writeread = fake_writeread,
+#endif
+#ifdef CONFIG_I2C_TRANSFER
+    .transfer = fake_transfer,
+#endif
+};
+
+static void test_callback(struct si4713_cmd_s *cmd, int status)
+{
+    struct test_ctx_s *ctx = cmd->priv;
+    uint16_t val = (cmd->args[3] << 8) | cmd->args[4];
+    uint32_t latency;
+
+    if (status)
+        ctx->errors++;
+
+    /* Property values are the submission index */
+    if (val != ctx->completed)
+        ctx->out_of_order++;
+
+    latency = test_now_us() - ctx->submit_us[val];
+
+    ctx->total_latency += latency;
+    if (latency > ctx->max_latency)
+        ctx->max_latency = latency;
+
+    if (++ctx->completed == ctx->expected)
+        sem_post(&ctx->done);
+}
+
+static int test_throughput(struct si4713_dev_s *si, int count)
+{
+    struct si4713_cmd_s *cmds;
+    struct test_ctx_s ctx;
+    uint32_t start, submitted, end;
+    int i;
+
+    memset(&ctx, 0, sizeof(ctx));
+
+    cmds = zalloc(count * sizeof(*cmds));
+    ctx.submit_us = zalloc(count * sizeof(*ctx.submit_us));
+    if (!cmds || !ctx.submit_us) {
+        free(cmds);
+        free(ctx.submit_us);
+        return -ENOMEM;
+    }
+
+    sem_init(&ctx.done, 0, 0);
+    ctx.expected = count;
+
+    start = test_now_us();
+    for (i = 0; i < count; i++) {
+        si4713_prep_set_property(&cmds[i], SI4713_PROP_TX_RDS_PI, i);
+        cmds[i].callback = test_callback;
+        cmds[i].priv = &ctx;
+        ctx.submit_us[i] = test_now_us();
+        si4713_submit(si, &cmds[i]);
+    }
+    submitted = test_now_us();
+
+    while (sem_wait(&ctx.done) != OK);
+    end = test_now_us();
+
+    printf("  %d commands: submit %lu us total, run %lu us\n", count,
+           (unsigned long)(submitted - start), (unsigned long)(end - start));
+    if (end != start) {
+        printf("  throughput %lu cmd/s\n",
+               (unsigned long)((uint64_t)count * 1000000 / (end - start)));
+    }
+    printf("  latency avg %lu us, max %lu us\n",
+           (unsigned long)(ctx.total_latency / count),
+           (unsigned long)ctx.max_latency);
+
+    sem_destroy(&ctx.done);
+    free(ctx.submit_us);
+    free(cmds);
+
+    if (ctx.errors || ctx.out_of_order) {
+        printf("  FAIL: %d errors, %d out of order\n", ctx.errors,
+               ctx.out_of_order);
+        return -EIO;
+    }
+
+    return 0;
+}
+
+static int test_tune(struct si4713_dev_s *si)
+{
+    struct si4713_cmd_s cmd;
+    uint16_t freq;
+    int ret;
+
+    memset(&cmd, 0, sizeof(cmd));
+    si4713_prep_tune_power(&cmd, TEST_POWER, 0);
+    ret = si4713_command(si, &cmd);
+    if (ret) {
+        printf("  FAIL: tune power %d\n", ret);
+        return ret;
+    }
+
+    si4713_prep_tune_freq(&cmd, TEST_FREQ);
+    ret = si4713_command(si, &cmd);
+    if (ret) {
+        printf("  FAIL: tune freq %d\n", ret);
+        return ret;
+    }
+
+    freq = (cmd.resp[2] << 8) | cmd.resp[3];
+    if (freq != TEST_FREQ || cmd.resp[5] != TEST_POWER ||
+        (g_fake.status & SI4713_STATUS_STCINT)) {
+        printf("  FAIL: tune status freq %u power %u stc %d\n", freq,
+               cmd.resp[5], g_fake.status & SI4713_STATUS_STCINT);
+        return -EIO;
+    }
+
+    return 0;
+}
+
+static int test_errors(struct si4713_dev_s *si)
+{
+    struct si4713_cmd_s cmd;
+    int ret;
+
+    memset(&cmd, 0, sizeof(cmd));
+    si4713_prep_set_property(&cmd, SI4713_PROP_TX_RDS_PI, 0x1234);
+
+    g_fake.fail_next = true;
+    ret = si4713_command(si, &cmd);
+    if (ret != -EIO) {
+        printf("  FAIL: expected -EIO, got %d\n", ret);
+        return -EIO;
+    }
+
+    g_fake.mute_next = true;
+    ret = si4713_command(si, &cmd);
+    if (ret != -ETIMEDOUT) {
+        printf("  FAIL: expected -ETIMEDOUT, got %d\n", ret);
+        return -EIO;
+    }
+
+    /* The engine must recover for the next command */
+    ret = si4713_command(si, &cmd);
+    if (ret) {
+        printf("  FAIL: command after timeout %d\n", ret);
+        return ret;
+    }
+
+    return 0;
+}
+
+#ifdef CONFIG_AUDIO_SI4713_RDS
+static void test_rds_xmit(int groups)
+{
+    g_fake.xmit_remaining = groups;
+    wd_start(&g_fake.xmit_wdog, 1, fake_xmit, 1, (uint32_t)&g_fake);
+
+    while (g_fake.xmit_remaining)
+        usleep(10000);
+}
+
+static bool test_rds_rt_equal(const char *expected)
+{
+    int len = strlen(expected);
+
+    return !strncmp(g_fake.rt, expected, len) && g_fake.rt[len] == '\r';
+}
+
+static int test_rds(struct si4713_dev_s *si)
+{
+    struct si4713_rds_stats_s before;
+    struct si4713_rds_stats_s stats;
+    struct si4713_rds_s *rds;
+    int ret = 0;
+
+    memset(g_fake.ps, 0, sizeof(g_fake.ps));
+    memset(g_fake.rt, 0, sizeof(g_fake.rt));
+
+    rds = si4713_rds_initialize(si, TEST_RDS_PI, 10);
+    if (!rds) {
+        printf("  FAIL: si4713_rds_initialize\n");
+        return -ENOMEM;
+    }
+
+    si4713_rds_set_ps(rds, TEST_RDS_PS);
+    si4713_rds_set_rt(rds, TEST_RDS_RT, true);
+
+    test_rds_xmit(TEST_RDS_GROUPS);
+
+    if (strcmp(g_fake.ps, TEST_RDS_PS " ") ||
+        !test_rds_rt_equal(TEST_RDS_RT)) {
+        printf("  FAIL: received PS '%s' RT '%s'\n", g_fake.ps, g_fake.rt);
+        ret = -EIO;
+    }
+
+    /* One character differs: exactly one RT group is re-encoded */
+    si4713_rds_get_stats(rds, &before);
+    si4713_rds_set_rt(rds, TEST_RDS_RT2, false);
+    si4713_rds_get_stats(rds, &stats);
+
+    if (stats.groups_encoded - before.groups_encoded != 1) {
+        printf("  FAIL: partial RT update encoded %lu groups\n",
+               (unsigned long)(stats.groups_encoded - before.groups_encoded));
+        ret = -EIO;
+    }
+
+    test_rds_xmit(TEST_RDS_GROUPS);
+
+    if (!test_rds_rt_equal(TEST_RDS_RT2)) {
+        printf("  FAIL: received RT '%s' after update\n", g_fake.rt);
+        ret = -EIO;
+    }
+
+    si4713_rds_get_stats(rds, &stats);
+    printf("  loaded %lu encoded %lu patched %lu topups %lu underruns %lu "
+           "errors %lu, fifo empty on %d of %d slots\n",
+           (unsigned long)stats.groups_loaded,
+           (unsigned long)stats.groups_encoded,
+           (unsigned long)stats.groups_patched,
+           (unsigned long)stats.topups, (unsigned long)stats.underruns,
+           (unsigned long)stats.load_errors, g_fake.xmit_empty,
+           2 * TEST_RDS_GROUPS);
+
+    si4713_rds_uninitialize(rds);
+    return ret;
+}
+#endif
+
+#ifdef CONFIG_BUILD_KERNEL
+int main(int argc, FAR char *argv[])
+#else
+int si4713_test_main(int argc, char *argv[])
+#endif
+{
+    struct si4713_stats_s stats;
+    struct si4713_dev_s *si;
+    int count = TEST_DEFAULT_COUNT;
+    int failed = 0;
+    int ret;
+
+    if (argc > 1)
+        count = atoi(argv[1]);
+
+    memset(&g_fake, 0, sizeof(g_fake));
+    g_fake.dev.ops = &g_fake_ops;
+    g_fake.busy_ticks = argc > 2 ? atoi(argv[2]) : TEST_DEFAULT_BUSY;
+    wd_static(&g_fake.wdog);
+#ifdef CONFIG_AUDIO_SI4713_RDS
+    wd_static(&g_fake.xmit_wdog);
+#endif
+
+    si = si4713_initialize(&g_fake.dev, SI4713_I2C_ADDR,
+                           SI4713_INT_EXTERNAL, -1);
+    if (!si) {
+        printf("si4713_initialize failed\n");
+        return EXIT_FAILURE;
+    }
+    g_fake.si = si;
+
+    printf("powerup\n");
+    ret = si4713_powerup(si, true);
+    if (ret) {
+        printf("  FAIL: %d\n", ret);
+        failed++;
+    }
+
+    printf("throughput (busy %d ticks)\n", g_fake.busy_ticks);
+    if (test_throughput(si, count))
+        failed++;
+
+    printf("tune\n");
+    if (test_tune(si))
+        failed++;
+
+    printf("errors\n");
+    if (test_errors(si))
+        failed++;
+
+#ifdef CONFIG_AUDIO_SI4713_RDS
+    printf("rds\n");
+    if (test_rds(si))
+        failed++;
+#endif
+
+    si4713_get_stats(si, &stats);
+    printf("stats: submitted %lu completed %lu errors %lu timeouts %lu "
+           "max depth %lu\n", (unsigned long)stats.submitted,
+           (unsigned long)stats.completed, (unsigned long)stats.errors,
+           (unsigned long)stats.timeouts, (unsigned long)stats.max_depth);
+
+    g_fake.si = NULL;
+    si4713_uninitialize(si);
+
+    printf("%s\n", failed ? "FAILED" : "PASSED");
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
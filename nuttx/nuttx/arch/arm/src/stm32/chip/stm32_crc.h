@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __ARCH_ARM_SRC_STM32_CHIP_STM32_CRC_H
+#define __ARCH_ARM_SRC_STM32_CHIP_STM32_CRC_H
+
+/************************************************************************************
+ * Included Files
+ ************************************************************************************/
+
+#include <nuttx/config.h>
+#include "chip.h"
+
+/************************************************************************************
+ * Pre-processor Definitions
+ ************************************************************************************/
+
+/* Register Offsets *****************************************************************/
+
+#define STM32_CRC_DR_OFFSET       0x0000  /* CRC Data Register */
+#define STM32_CRC_IDR_OFFSET      0x0004  /* CRC Independent Data Register */
+#define STM32_CRC_CR_OFFSET       0x0008  /* CRC Control Register */
+#define STM32_CRC_INIT_OFFSET     0x0010  /* CRC Initial Value (STM32L4) */
+#define STM32_CRC_POL_OFFSET      0x0014  /* CRC Polynomial (STM32L4) */
+
+/* Register Addresses ***************************************************************/
+
+#define STM32_CRC_DR              (STM32_CRC_BASE+STM32_CRC_DR_OFFSET)
+#define STM32_CRC_IDR             (STM32_CRC_BASE+STM32_CRC_IDR_OFFSET)
+#define STM32_CRC_CR              (STM32_CRC_BASE+STM32_CRC_CR_OFFSET)
+#define STM32_CRC_INIT            (STM32_CRC_BASE+STM32_CRC_INIT_OFFSET)
+#define STM32_CRC_POL             (STM32_CRC_BASE+STM32_CRC_POL_OFFSET)
+
+/* Register Bitfield Definitions ****************************************************/
+
+/* CRC Control Register */
+
+#define CRC_CR_RESET              (1 << 0)  /* Bit 0: Reset the CRC calculation */
+#define CRC_CR_POLYSIZE_SHIFT     (3)       /* Bits 3-4: Polynomial size */
+#define CRC_CR_POLYSIZE_MASK      (3 << CRC_CR_POLYSIZE_SHIFT)
+#  define CRC_CR_POLYSIZE_32      (0 << CRC_CR_POLYSIZE_SHIFT)
+#  define CRC_CR_POLYSIZE_16      (1 << CRC_CR_POLYSIZE_SHIFT)
+#  define CRC_CR_POLYSIZE_8       (2 << CRC_CR_POLYSIZE_SHIFT)
+#  define CRC_CR_POLYSIZE_7       (3 << CRC_CR_POLYSIZE_SHIFT)
+#define CRC_CR_REV_IN_SHIFT       (5)       /* Bits 5-6: Reverse input data */
+#define CRC_CR_REV_IN_MASK        (3 << CRC_CR_REV_IN_SHIFT)
+#  define CRC_CR_REV_IN_NONE      (0 << CRC_CR_REV_IN_SHIFT)
+#  define CRC_CR_REV_IN_BYTE      (1 << CRC_CR_REV_IN_SHIFT)
+#  define CRC_CR_REV_IN_HALFWORD  (2 << CRC_CR_REV_IN_SHIFT)
+#  define CRC_CR_REV_IN_WORD      (3 << CRC_CR_REV_IN_SHIFT)
+#define CRC_CR_REV_OUT            (1 << 7)  /* Bit 7: Reverse output data */
+
+#endif /* __ARCH_ARM_SRC_STM32_CHIP_STM32_CRC_H */
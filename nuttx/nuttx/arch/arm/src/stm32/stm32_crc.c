@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * CRC unit backend of crc16_poly8005(). The STM32L4 CRC unit takes a
+ * programmable polynomial, so it is set up for the reflected CRC-16 with
+ * polynomial 0x8005 used by the MHB and Mods data links.
+ */
+
+#include <nuttx/config.h>
+
+#include <debug.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <crc16_poly8005.h>
+#include <nuttx/hires_tmr.h>
+
+#include <arch/irq.h>
+
+#include "up_arch.h"
+#include "chip/stm32_crc.h"
+#include "stm32_crc.h"
+
+#define CRC16_POLY       (0x8005)
+#define CRC16_CR         (CRC_CR_POLYSIZE_16 | CRC_CR_REV_IN_BYTE | \
+                          CRC_CR_REV_OUT)
+
+/* Bytes fed with interrupts disabled at most, a multiple of 4 */
+#define CRC_CHUNK_SIZE   (64)
+
+/* Buffer used to compare the CRC unit with the tables at init */
+#define CRC_BENCH_SIZE   (256)
+#define CRC_BENCH_ROUNDS (8)
+
+static inline uint32_t crc_bitrev16(uint16_t val)
+{
+  uint32_t ret;
+
+  __asm__ ("rbit %0, %1" : "=r" (ret) : "r" ((uint32_t)val));
+
+  return ret >> 16;
+}
+
+/* Interrupts must be disabled: the unit is shared by all callers */
+static uint16_t stm32_crc16_chunk(FAR const uint8_t *src, size_t len,
+                                  uint16_t crc)
+{
+  uint32_t word;
+
+  /* The unit keeps the CRC not reflected, so is the value to continue from */
+  putreg32(crc_bitrev16(crc), STM32_CRC_INIT);
+  putreg32(CRC16_CR | CRC_CR_RESET, STM32_CRC_CR);
+
+  /* Words are fed MSB first, swap them to keep the order of the bytes */
+  for (; len >= 4; len -= 4, src += 4)
+    {
+      memcpy(&word, src, sizeof(word));
+      putreg32(__builtin_bswap32(word), STM32_CRC_DR);
+    }
+
+  for (; len > 0; len--)
+    {
+      putreg8(*src++, STM32_CRC_DR);
+    }
+
+  return getreg32(STM32_CRC_DR);
+}
+
+/*
+ * The buffer is fed in chunks, each one restarting the unit from the CRC of
+ * the previous ones, to bound the time spent with interrupts disabled.
+ */
+static uint16_t stm32_crc16_poly8005(FAR const uint8_t *src, size_t len,
+                                     uint16_t crc)
+{
+  irqstate_t flags;
+  size_t n;
+
+  while (len > 0)
+    {
+      n = len < CRC_CHUNK_SIZE ? len : CRC_CHUNK_SIZE;
+
+      flags = irqsave();
+      crc = stm32_crc16_chunk(src, n, crc);
+      irqrestore(flags);
+
+      src += n;
+      len -= n;
+    }
+
+  return crc;
+}
+
+int stm32_crc_initialize(void)
+{
+  uint8_t buf[CRC_BENCH_SIZE];
+  uint32_t start;
+  uint32_t hw_us;
+  uint32_t sw_us;
+  uint16_t hw;
+  uint16_t sw;
+  int i;
+
+  putreg32(CRC16_POLY, STM32_CRC_POL);
+
+  for (i = 0; i < CRC_BENCH_SIZE; i++)
+    {
+      buf[i] = i * 7 + 1;
+    }
+
+  /* Check an unaligned buffer with a tail of bytes as well */
+  hw = stm32_crc16_poly8005(buf, CRC_BENCH_SIZE, CRC_INIT_VAL);
+  hw = stm32_crc16_poly8005(&buf[1], CRC_BENCH_SIZE - 3, hw);
+  sw = crc16_poly8005_sw(buf, CRC_BENCH_SIZE, CRC_INIT_VAL);
+  sw = crc16_poly8005_sw(&buf[1], CRC_BENCH_SIZE - 3, sw);
+  if (hw != sw)
+    {
+      dbg("CRC unit mismatch: 0x%04x != 0x%04x\n", hw, sw);
+      return -EIO;
+    }
+
+  start = hrt_getusec();
+  for (i = 0; i < CRC_BENCH_ROUNDS; i++)
+    {
+      hw = stm32_crc16_poly8005(buf, CRC_BENCH_SIZE, hw);
+    }
+  hw_us = hrt_getusec() - start;
+
+  start = hrt_getusec();
+  for (i = 0; i < CRC_BENCH_ROUNDS; i++)
+    {
+      sw = crc16_poly8005_sw(buf, CRC_BENCH_SIZE, sw);
+    }
+  sw_us = hrt_getusec() - start;
+
+  dbg("CRC unit %u us, tables %u us\n", hw_us, sw_us);
+
+  if (hw_us >= sw_us)
+    {
+      return -ENODEV;
+    }
+
+  crc16_poly8005_backend(stm32_crc16_poly8005);
+
+  return OK;
+}
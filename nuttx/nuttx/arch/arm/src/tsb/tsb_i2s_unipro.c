@@ -29,12 +29,13 @@
  * from the general purpose I2S driver since it only moves data to and
  * from Unipro.  It also uses DMA for most operations.
  *
- * Instead of using a single circular buffer, it uses two buffers in
- * a ping pong configuration.  The fist buffer is receiving data while
- * the second is being used to transmit the data.  If the end of the
- * transmit buffer is reached before the next buffer is ready, the last
- * sample is repeated.  If a receive buffer is filled before the transmit
- * is completed then a sample is removed.
+ * Instead of using a single circular buffer, it uses a ring of buffers in
+ * each direction.  The DMA moves data directly between the ring and the
+ * Unipro buffers, so packets are never copied.  Received packets are queued
+ * behind the buffer being transmitted, the depth of the ring absorbing the
+ * jitter of the Unipro link.  If the end of the transmit buffer is reached
+ * before the next buffer is ready, the last sample is repeated.  If too many
+ * samples are queued when a packet is received then a sample is removed.
  *
  * In the case of I2S data being transmitted, the buffer will be empty once the
  * TSB I2S hardware buffer is filled.  This buffer is 256 bytes.  The hardware
@@ -57,6 +58,7 @@
 #include <nuttx/config.h>
 
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
@@ -99,8 +101,8 @@
  *
  * The bigger the buffers are the more robust the drivers handling of jitter
  * will be, but more audio latency will be introduced to the system.  The total
- * memory used is this number times 4 due to the ping and pong buffers for both
- * RX and TX.
+ * memory used is this number times 2 * CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_MAX_BUFS
+ * for the RX and TX rings.
  *
  * It is recommended to define TSB_I2S_UNIPRO_TUNNEL_QUEUE_UNIPRO_SEND if this
  * value exceeds 512.
@@ -125,31 +127,85 @@
  */
 #define TSB_I2S_UNIPRO_TUNNEL_BUF_ADJUST_THRESHOLD ((TSB_I2S_UNIPRO_TUNNEL_BUF_SZ - 256) / 4)
 
+#if defined(CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_ASRC)
+# ifndef CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_ASRC_MAX_PPM
+#  define CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_ASRC_MAX_PPM 1000
+# endif
+/**
+ * @brief The number of input frames kept from one packet to the next for the
+ *        cubic interpolation.
+ */
+# define TSB_I2S_UNIPRO_ASRC_HISTORY 3
+/**
+ * @brief The proportional gain of the resampling ratio control loop, in 1/256
+ *        ppm per frame of fill level error.
+ */
+# define TSB_I2S_UNIPRO_ASRC_KP_Q8 5120
+/**
+ * @brief The integral gain of the resampling ratio control loop, in 1/256 ppm
+ *        per frame of fill level error and per packet.
+ *
+ * With the proportional gain above this gives a critically damped loop settling
+ * within a few seconds, slow enough for the packet arrival jitter to be
+ * filtered out.
+ */
+# define TSB_I2S_UNIPRO_ASRC_KI_Q8 3
+/**
+ * @brief 32 bit samples are resampled at 27 bits so the interpolation fits in
+ *        32 bit arithmetic.
+ */
+# define TSB_I2S_UNIPRO_ASRC_SHIFT32 5
+# if (CPORT_BUF_SIZE < TSB_I2S_UNIPRO_TUNNEL_BUF_SZ + 12)
+#  error "CPORT_BUF_SIZE must leave room for a resampled frame in excess."
+# endif
+#endif
+
+#ifndef CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_MAX_BUFS
+# define CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_MAX_BUFS 8
+#endif
+#ifndef CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_JITTER_US
+# define CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_JITTER_US 5000
+#endif
+
+/**
+ * @brief The number of buffers allocated in each direction.
+ *
+ * Only the first g_i2s_unipro_tunnel.buf_num are used, see
+ * tsb_i2s_unipro_tunnel_buf_num().
+ */
+#define TSB_I2S_UNIPRO_TUNNEL_BUF_NUM CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_MAX_BUFS
+#if (TSB_I2S_UNIPRO_TUNNEL_BUF_NUM < 2) || \
+    (TSB_I2S_UNIPRO_TUNNEL_BUF_NUM & (TSB_I2S_UNIPRO_TUNNEL_BUF_NUM - 1))
+# error "CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_MAX_BUFS must be a power of two of at least 2."
+#endif
+
+/** @brief The index of the first buffer used in each direction. */
+#define TSB_I2S_UNIPRO_TUNNEL_BUF_PING 0
+
 /**
  * @brief Select the next buffer to be used.
  *
  * This marco is designed to execute quickly since it is called out of an
  * interrupt it relies on the fact that the number of buffers is a power of two.
  */
-#define TSB_I2S_UNIPRO_TUNNEL_NEXT_BUF(buf) ((buf + 1) & (TSB_I2S_UNIPRO_TUNNEL_BUF_NUM - 1))
-
-/** @brief Value used to show that the system has been initialized. */
-#define TSB_I2S_UNIPRO_TUNNEL_INIT 0xa5
+#define TSB_I2S_UNIPRO_TUNNEL_NEXT_BUF(buf) ((buf + 1) & (g_i2s_unipro_tunnel.buf_num - 1))
 
 /**
- * @brief Define a type used to index the ping pong buffers.
+ * @brief The number of bytes queued for the I2S TX FIFO aimed for when a packet
+ *        is received over Unipro.
  *
- * The number of entries in this enumeration must be a power of two.  Currently
- * this is not an issue since the buffers are in a ping pong configuration.
- * Should this change the macro TSB_I2S_UNIPRO_TUNNEL_NEXT_BUF will need to be
- * updated.
+ * This is half way through the buffers in use, so a packet can be early or late
+ * by the same amount before the queue overflows or runs dry.  With two buffers
+ * it is half of the buffer being sent.
  */
-typedef enum
-{
-    TSB_I2S_UNIPRO_TUNNEL_BUF_PING,
-    TSB_I2S_UNIPRO_TUNNEL_BUF_PONG,
-    TSB_I2S_UNIPRO_TUNNEL_BUF_NUM
-} TSB_I2S_UNIPRO_TUNNEL_BUF_T;
+#define TSB_I2S_UNIPRO_TUNNEL_TARGET_BACKLOG \
+    ((g_i2s_unipro_tunnel.buf_num - 1) * TSB_I2S_UNIPRO_TUNNEL_BUF_SZ / 2)
+
+/** @brief Value used to show that the system has been initialized. */
+#define TSB_I2S_UNIPRO_TUNNEL_INIT 0xa5
+
+/** @brief A type used to index the buffers. */
+typedef unsigned int TSB_I2S_UNIPRO_TUNNEL_BUF_T;
 
 /**
  * @brief Commands sent between the APBA and APBE via unipro.
@@ -330,6 +386,12 @@ struct tsb_i2s_unipro_tunnel_s
     struct tsb_i2s_unipro_tunnel_buf_s i2s_tx_unipro_rx_buf[TSB_I2S_UNIPRO_TUNNEL_BUF_NUM];
     /** @brief Index of the next RX buffer to be sent to the APBA/APBE. */
     TSB_I2S_UNIPRO_TUNNEL_BUF_T i2s_tx_buf;
+    /**
+     * @brief The number of buffers in use in each direction, a power of two.
+     *
+     * Set in i2s_unipro_tunnel_i2s_config() from the sample rate.
+     */
+    TSB_I2S_UNIPRO_TUNNEL_BUF_T buf_num;
     /**
      * @brief The number of APBE 48MHz timer ticks it takes to send a unipro
      *        message to the APBA and back.
@@ -358,8 +420,63 @@ struct tsb_i2s_unipro_tunnel_s
      *        driver operation.
      */
     unsigned int i2s_tx_buffers_dropped;
+#if defined(CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_ASRC)
+    /** @brief The number of channels in each frame. */
+    uint8_t asrc_channels;
+    /** @brief The number of bytes in each channel sample, 2 or 4. */
+    uint8_t asrc_sample_bytes;
+    /**
+     * @brief The frame of the work buffer after which the next output frame is
+     *        interpolated.
+     */
+    int asrc_index;
+    /** @brief The fractional position of the next output frame, Q32. */
+    uint32_t asrc_frac;
+    /**
+     * @brief The number of input frames per output frame minus one, Q32.
+     *
+     * Positive when the remote clock is faster than the local one.
+     */
+    int32_t asrc_step;
+    /** @brief The integral of the fill level error, in frames. */
+    int32_t asrc_integral;
+    /** @brief The clock drift estimated by the control loop, in ppm. */
+    int32_t asrc_drift_ppm;
+    /**
+     * @brief The last input frames of the previous packet followed by the
+     *        packet being resampled.
+     */
+    int32_t asrc_work[TSB_I2S_UNIPRO_ASRC_HISTORY * 2 +
+                      TSB_I2S_UNIPRO_TUNNEL_BUF_SZ / 2];
+#endif
 } g_i2s_unipro_tunnel;
 
+/*
+ * Select the number of buffers to use in each direction.  This is the smallest
+ * power of two leaving enough queued audio to cover
+ * CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_JITTER_US of late packets.  Only one buffer
+ * is ever partially queued, the one being sent.
+ *
+ * sample_rate      The sample rate in samples per second.
+ * bytes_per_sample The number of bytes in a sample for all channels.
+ */
+static TSB_I2S_UNIPRO_TUNNEL_BUF_T tsb_i2s_unipro_tunnel_buf_num(
+    unsigned int sample_rate,
+    unsigned int bytes_per_sample)
+{
+    TSB_I2S_UNIPRO_TUNNEL_BUF_T buf_num = 2;
+    uint32_t buf_us;
+
+    buf_us = (uint32_t)(((uint64_t)TSB_I2S_UNIPRO_TUNNEL_BUF_SZ * 1000000) /
+                        (sample_rate * bytes_per_sample));
+    while ((buf_num < TSB_I2S_UNIPRO_TUNNEL_BUF_NUM) &&
+           ((buf_num - 1) * buf_us < CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_JITTER_US))
+    {
+        buf_num <<= 1;
+    }
+    return buf_num;
+}
+
 /*
  * Clear all pending interrupts on an I2S block.
  *
@@ -441,7 +558,48 @@ static void tsb_i2s_unipro_i2s_restart(uint32_t i2s_base)
 }
 
 /*
- * Start the I2S TX DMA channel on the PING buffer.
+ * Allocate the buffers I2S receives into, and which are sent over Unipro,
+ * for the first buf_num buffers and free the others.  Unlike the buffers
+ * received from Unipro, these are kept from one stream to the next.
+ *
+ * buf_num The number of buffers used in each direction.
+ */
+static int tsb_i2s_unipro_tunnel_rx_buf_alloc(TSB_I2S_UNIPRO_TUNNEL_BUF_T buf_num)
+{
+    size_t alloc_size = TSB_I2S_UNIPRO_TUNNEL_BUF_SZ +
+        offsetof(struct tsb_i2s_unipro_msg_s, data.buf);
+    struct tsb_i2s_unipro_tunnel_buf_s *buf_p;
+    TSB_I2S_UNIPRO_TUNNEL_BUF_T i;
+
+    for (i = 0; i < TSB_I2S_UNIPRO_TUNNEL_BUF_NUM; i++)
+    {
+        buf_p = &g_i2s_unipro_tunnel.i2s_rx_unipro_tx_buf[i];
+        if (i >= buf_num)
+        {
+            if (buf_p->msg)
+            {
+                bufram_free(buf_p->msg);
+                buf_p->msg = NULL;
+            }
+            continue;
+        }
+        if (buf_p->msg == NULL)
+        {
+            buf_p->msg = (struct tsb_i2s_unipro_msg_s *)bufram_alloc(alloc_size);
+            if (buf_p->msg == NULL)
+            {
+                lldbg("I2S Unipro Tunnel: Insufficient memory to allocate buffers.\n");
+                return -ENOMEM;
+            }
+            memset(buf_p->msg, 0, alloc_size);
+        }
+        buf_p->len = TSB_I2S_UNIPRO_TUNNEL_BUF_SZ;
+    }
+    return OK;
+}
+
+/*
+ * Start the I2S TX DMA channel on the first buffer.
  *
  * tx_prime_bytes The number of bytes to copy into the tx buffer before
  *                DMA is started.
@@ -481,7 +639,7 @@ static int tsb_i2s_unipro_start_i2s_tx_dma(size_t tx_prime_bytes)
 }
 
 /*
- * Start the I2S RX DMA channel on the PING buffer.
+ * Start the I2S RX DMA channel on the first buffer.
  */
 static int tsb_i2s_unipro_start_i2s_rx_dma(void)
 {
@@ -761,6 +919,191 @@ static int tsb_i2s_unipro_i2s_in_data(int irq, void *context)
     return OK;
 }
 
+#if defined(CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_ASRC)
+/*
+ * Reset the resampler, done before the data starts flowing.
+ */
+static void tsb_i2s_unipro_asrc_reset(void)
+{
+    memset(g_i2s_unipro_tunnel.asrc_work, 0,
+           sizeof(g_i2s_unipro_tunnel.asrc_work));
+    g_i2s_unipro_tunnel.asrc_index = TSB_I2S_UNIPRO_ASRC_HISTORY - 2;
+    g_i2s_unipro_tunnel.asrc_frac = 0;
+    g_i2s_unipro_tunnel.asrc_step = 0;
+    g_i2s_unipro_tunnel.asrc_integral = 0;
+    g_i2s_unipro_tunnel.asrc_drift_ppm = 0;
+}
+
+/*
+ * Update the resampling ratio from the fill level of the TX buffers.  A PI
+ * controller steers it so TSB_I2S_UNIPRO_TUNNEL_TARGET_BACKLOG bytes are
+ * queued when a new packet arrives.
+ *
+ * backlog_error The number of bytes queued above the target, negative when
+ *               below it.
+ */
+static void tsb_i2s_unipro_asrc_update(int32_t backlog_error)
+{
+    const int32_t limit = CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_ASRC_MAX_PPM * 256;
+    int32_t error;
+    int32_t integral_term;
+    int32_t ppm_q8;
+
+    /* In frames, positive when there is a backlog. */
+    error = backlog_error / (int32_t)g_i2s_unipro_tunnel.bytes_per_sample;
+
+    g_i2s_unipro_tunnel.asrc_integral += error;
+    if (g_i2s_unipro_tunnel.asrc_integral > limit / TSB_I2S_UNIPRO_ASRC_KI_Q8)
+    {
+        g_i2s_unipro_tunnel.asrc_integral = limit / TSB_I2S_UNIPRO_ASRC_KI_Q8;
+    }
+    else if (g_i2s_unipro_tunnel.asrc_integral < -limit / TSB_I2S_UNIPRO_ASRC_KI_Q8)
+    {
+        g_i2s_unipro_tunnel.asrc_integral = -limit / TSB_I2S_UNIPRO_ASRC_KI_Q8;
+    }
+    integral_term = g_i2s_unipro_tunnel.asrc_integral * TSB_I2S_UNIPRO_ASRC_KI_Q8;
+
+    ppm_q8 = error * TSB_I2S_UNIPRO_ASRC_KP_Q8 + integral_term;
+    if (ppm_q8 > limit)
+    {
+        ppm_q8 = limit;
+    }
+    else if (ppm_q8 < -limit)
+    {
+        ppm_q8 = -limit;
+    }
+
+    /* The integral term alone is the steady state drift. */
+    g_i2s_unipro_tunnel.asrc_drift_ppm = integral_term / 256;
+    /* 2^32 / (256 * 10^6) is close to 2147 / 128. */
+    g_i2s_unipro_tunnel.asrc_step = ppm_q8 * 2147 / 128;
+    reglog_log(0x34, (uint32_t)g_i2s_unipro_tunnel.asrc_step);
+}
+
+/*
+ * Multiply by a Q16 fraction.  This is a single SMULL on Cortex-M.
+ */
+static inline int32_t tsb_i2s_unipro_asrc_mul(int32_t a, uint32_t t)
+{
+    return (int32_t)(((int64_t)a * t) >> 16);
+}
+
+/*
+ * Catmull-Rom cubic interpolation between x0 and x1.
+ *
+ * t The position between x0 and x1, Q16.
+ */
+static inline int32_t tsb_i2s_unipro_asrc_cubic(int32_t xm1, int32_t x0,
+                                                int32_t x1, int32_t x2,
+                                                uint32_t t)
+{
+    int32_t a = 3 * (x0 - x1) + x2 - xm1;
+    int32_t b = 2 * xm1 - 5 * x0 + 4 * x1 - x2;
+    int32_t c = x1 - xm1;
+    int32_t y;
+
+    y = tsb_i2s_unipro_asrc_mul(a, t) + b;
+    y = tsb_i2s_unipro_asrc_mul(y, t) + c;
+    return x0 + (tsb_i2s_unipro_asrc_mul(y, t) >> 1);
+}
+
+/*
+ * Resample a received packet in its buffer at the current ratio.  The output
+ * has one frame more or less than the input now and then, so the buffer must
+ * have room for a frame after the packet.
+ *
+ * buf The samples.
+ * len The number of bytes received.
+ *
+ * returns the number of bytes to send out.
+ */
+static size_t tsb_i2s_unipro_asrc_run(uint8_t *buf, size_t len)
+{
+    unsigned int channels = g_i2s_unipro_tunnel.asrc_channels;
+    unsigned int in_frames = len / g_i2s_unipro_tunnel.bytes_per_sample;
+    int last = TSB_I2S_UNIPRO_ASRC_HISTORY + in_frames - 3;
+    int32_t *work = g_i2s_unipro_tunnel.asrc_work;
+    int32_t *in = work + TSB_I2S_UNIPRO_ASRC_HISTORY * channels;
+    int index = g_i2s_unipro_tunnel.asrc_index;
+    uint32_t frac = g_i2s_unipro_tunnel.asrc_frac;
+    int32_t step = g_i2s_unipro_tunnel.asrc_step;
+    unsigned int out = 0;
+    unsigned int out_max = (in_frames + 1) * channels;
+    unsigned int i;
+
+    if (g_i2s_unipro_tunnel.asrc_sample_bytes == 2)
+    {
+        int16_t *sample_p = (int16_t *)buf;
+
+        for (i = 0; i < in_frames * channels; i++)
+        {
+            in[i] = sample_p[i];
+        }
+    }
+    else
+    {
+        int32_t *sample_p = (int32_t *)buf;
+
+        for (i = 0; i < in_frames * channels; i++)
+        {
+            in[i] = sample_p[i] >> TSB_I2S_UNIPRO_ASRC_SHIFT32;
+        }
+    }
+
+    while (index <= last && out < out_max)
+    {
+        int32_t *x = work + (index - 1) * channels;
+        uint32_t t = frac >> 16;
+        uint32_t next;
+
+        for (i = 0; i < channels; i++, x++, out++)
+        {
+            int32_t y = tsb_i2s_unipro_asrc_cubic(x[0], x[channels],
+                                                  x[2 * channels],
+                                                  x[3 * channels], t);
+
+            if (g_i2s_unipro_tunnel.asrc_sample_bytes == 2)
+            {
+                y = y > INT16_MAX ? INT16_MAX : y < INT16_MIN ? INT16_MIN : y;
+                ((int16_t *)buf)[out] = y;
+            }
+            else
+            {
+                const int32_t max = INT32_MAX >> TSB_I2S_UNIPRO_ASRC_SHIFT32;
+
+                y = y > max ? max : y < -max - 1 ? -max - 1 : y;
+                ((int32_t *)buf)[out] = y << TSB_I2S_UNIPRO_ASRC_SHIFT32;
+            }
+        }
+
+        /* Step one input frame plus the correction, carrying into the index. */
+        next = frac + (uint32_t)step;
+        if (step >= 0)
+        {
+            index += 1 + (next < frac);
+        }
+        else
+        {
+            index += 1 - (next > frac);
+        }
+        frac = next;
+    }
+
+    /* Keep the last input frames for the next packet. */
+    memcpy(work, work + in_frames * channels,
+           TSB_I2S_UNIPRO_ASRC_HISTORY * channels * sizeof(*work));
+    index -= in_frames;
+    if (index < 1)
+    {
+        index = 1;
+    }
+    g_i2s_unipro_tunnel.asrc_index = index;
+    g_i2s_unipro_tunnel.asrc_frac = frac;
+
+    return out / channels * g_i2s_unipro_tunnel.bytes_per_sample;
+}
+#endif
+
 /*
  * Called when a Unipro packet has been received.  The function then handles
  * checking to see if the packet can be transmitted over I2S based on the
@@ -787,11 +1130,12 @@ static int tsb_i2s_unipro_cmd_handle_data(
 {
     void *dma_dst;
     void *dma_src;
-    size_t prev_bytes_sent;
+    uint8_t *dma_end;
+    size_t backlog;
+    TSB_I2S_UNIPRO_TUNNEL_BUF_T i;
     struct tsb_i2s_unipro_tunnel_buf_s *i2s_tx_buf_p =
         &g_i2s_unipro_tunnel.i2s_tx_unipro_rx_buf[g_i2s_unipro_tunnel.i2s_tx_buf];
-    struct tsb_i2s_unipro_tunnel_buf_s *unipro_rx_buf_p =
-        &g_i2s_unipro_tunnel.i2s_tx_unipro_rx_buf[TSB_I2S_UNIPRO_TUNNEL_NEXT_BUF(g_i2s_unipro_tunnel.i2s_tx_buf)];
+    struct tsb_i2s_unipro_tunnel_buf_s *unipro_rx_buf_p = NULL;
 
     reglog_log(0x30, len);
     /* Do not send a response to the data command. */
@@ -805,18 +1149,28 @@ static int tsb_i2s_unipro_cmd_handle_data(
      */
     if (len == TSB_I2S_UNIPRO_TUNNEL_BUF_SZ)
     {
-        if (unipro_rx_buf_p->msg != NULL)
+        /*
+         * Find the end of the queue behind the buffer being sent, adding up
+         * what is left to send on the way.
+         */
+        backlog = 0;
+        for (i = 1; i < g_i2s_unipro_tunnel.buf_num; i++)
+        {
+            unipro_rx_buf_p =
+                &g_i2s_unipro_tunnel.i2s_tx_unipro_rx_buf[(g_i2s_unipro_tunnel.i2s_tx_buf + i) &
+                                                          (g_i2s_unipro_tunnel.buf_num - 1)];
+            if (unipro_rx_buf_p->msg == NULL)
+            {
+                break;
+            }
+            backlog += unipro_rx_buf_p->len;
+        }
+        if (i == g_i2s_unipro_tunnel.buf_num)
         {
             /*
              * All buffers are are full, so all that can be done is to take note
-             * of this and overwrite the last buffer.
-             *
-             * TODO: Wait a little while before tossing the packet.  Tossing a
-             * packet unless well on the way to the next one will stop
-             * everything.  This is an interrupt context, so do not wait to long.
-             * A better design might be to have a stack of incoming packets and
-             * toss one when 3 are on the stack.  However, this should be a
-             * rare event if the thresholds below are good.
+             * of this and toss the packet.  This should be a rare event if the
+             * thresholds below are good.
              */
             reglog_log(0x3e, g_i2s_unipro_tunnel.i2s_tx_buf);
             unipro_rxbuf_free(TSB_I2S_UNIPRO_TUNNEL_CPORTID, msg);
@@ -826,23 +1180,42 @@ static int tsb_i2s_unipro_cmd_handle_data(
         unipro_rx_buf_p->msg = msg;
         unipro_rx_buf_p->len = TSB_I2S_UNIPRO_TUNNEL_BUF_SZ;
         unipro_rx_buf_p->unipro_allocated = true;
-        prev_bytes_sent = TSB_I2S_UNIPRO_TUNNEL_BUF_SZ;
         /*
-         * If still transmitting, then figure out how many characters have gone out.
+         * If still transmitting, then figure out how many characters are still
+         * to go out.  Go by the DMA request rather than the buffer, since the
+         * request may not start at the beginning of the buffer, as for the
+         * primed first buffer or a repeated sample.
          */
         if (i2s_tx_buf_p->msg != NULL)
         {
             tsb_dma_get_chan_addr(g_i2s_unipro_tunnel.i2s_tx_dma_channel, &dma_src, &dma_dst);
-            prev_bytes_sent = (size_t)((uint8_t *)dma_src - i2s_tx_buf_p->msg->data.buf);
-            /* Adjust for the case when the length has been adjusted for repeated samples. */
-            prev_bytes_sent += TSB_I2S_UNIPRO_TUNNEL_BUF_SZ - i2s_tx_buf_p->len;
-            reglog_log(0x31, (uint32_t)prev_bytes_sent);
+            dma_end = (uint8_t *)i2s_tx_buf_p->dma_op->sg[0].src_addr +
+                      i2s_tx_buf_p->dma_op->sg[0].len;
+            if ((uint8_t *)dma_src < dma_end)
+            {
+                backlog += (size_t)(dma_end - (uint8_t *)dma_src);
+            }
+            reglog_log(0x31, (uint32_t)backlog);
+#if defined(CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_ASRC)
+            tsb_i2s_unipro_asrc_update((int32_t)backlog -
+                                       (int32_t)TSB_I2S_UNIPRO_TUNNEL_TARGET_BACKLOG);
+#endif
         }
+#if defined(CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_ASRC)
+        /*
+         * Resample the packet to track the drift between the two I2S clocks,
+         * rather than repeating or removing samples.
+         */
+        unipro_rx_buf_p->len = tsb_i2s_unipro_asrc_run(unipro_rx_buf_p->msg->data.buf,
+                                                       unipro_rx_buf_p->len);
+        reglog_log(0x35, unipro_rx_buf_p->len);
+#else
         /*
-         * If the number of samples sent so far is greater than the threshold,
-         * insert a sample from the data which will be sent out.
+         * If the number of samples queued is below the target by more than the
+         * threshold, insert a sample from the data which will be sent out.
          */
-        if (prev_bytes_sent > TSB_I2S_UNIPRO_TUNNEL_BUF_SZ - TSB_I2S_UNIPRO_TUNNEL_BUF_ADJUST_THRESHOLD)
+        if (backlog + TSB_I2S_UNIPRO_TUNNEL_BUF_SZ / 2 <
+            TSB_I2S_UNIPRO_TUNNEL_TARGET_BACKLOG + TSB_I2S_UNIPRO_TUNNEL_BUF_ADJUST_THRESHOLD)
         {
             memcpy(&unipro_rx_buf_p->msg->data.buf[unipro_rx_buf_p->len],
                    &unipro_rx_buf_p->msg->data.buf[unipro_rx_buf_p->len-g_i2s_unipro_tunnel.bytes_per_sample],
@@ -852,17 +1225,18 @@ static int tsb_i2s_unipro_cmd_handle_data(
             reglog_log(0x32, unipro_rx_buf_p->len);
         }
         /*
-         * If the number of samples left in the previous buffer is not within the
-         * threshold or fully copied into the FIFO by now, then a backlog of
-         * samples is starting.  Leave one sample off of the packet to allow the
-         * backlog to dissipate.
+         * If the number of samples queued is above the target by more than the
+         * threshold, then a backlog of samples is starting.  Leave one sample
+         * off of the packet to allow the backlog to dissipate.
          */
-        else if (prev_bytes_sent < TSB_I2S_UNIPRO_TUNNEL_BUF_ADJUST_THRESHOLD)
+        else if (backlog + TSB_I2S_UNIPRO_TUNNEL_BUF_ADJUST_THRESHOLD >
+                 TSB_I2S_UNIPRO_TUNNEL_TARGET_BACKLOG + TSB_I2S_UNIPRO_TUNNEL_BUF_SZ / 2)
         {
             unipro_rx_buf_p->len -= g_i2s_unipro_tunnel.bytes_per_sample;
             g_i2s_unipro_tunnel.i2s_tx_samples_dropped++;
             reglog_log(0x33, unipro_rx_buf_p->len);
         }
+#endif
     }
     else
     {
@@ -877,7 +1251,7 @@ static int tsb_i2s_unipro_cmd_handle_data(
  * I2S DMA RX callback.  This function is called when the DMA RX buffer is full.
  * As a result the following needs to be done:
  *
- *   1. Switch the DMA buffer to the PING or PONG buffer.
+ *   1. Switch the DMA buffer to the next buffer in the ring.
  *   2. Re-enable DMA for the data coming in.
  *   3. Send the data received over Unipro.
  *
@@ -970,7 +1344,7 @@ static int tsb_i2s_unipro_i2s_rx_dma_callback(
  *   1.1. If not or if too few samples are still in the previous buffer then
  *        repeat last sample in the previous buffer.
  *   1.2. If it has:
- *   1.2.1. Switch the DMA buffer to the PING or PONG buffer.
+ *   1.2.1. Switch the DMA buffer to the next buffer in the ring.
  *   1.2.2. Check to see if too few samples from the previous buffer were sent.
  *          If this is the case, remove a sample from the buffer.
  *   2. In either case re-enable DMA.
@@ -1454,8 +1828,10 @@ int i2s_unipro_tunnel_i2s_config(
     };
     void *p;
     unsigned int bytes_per_sample;
+    TSB_I2S_UNIPRO_TUNNEL_BUF_T buf_num;
     uint32_t reg_audioset;
     uint32_t reg_modeset;
+    int error;
 
     if (!g_i2s_unipro_tunnel.enabled)
     {
@@ -1492,7 +1868,26 @@ int i2s_unipro_tunnel_i2s_config(
      * Calculate the BCLK rate needed for the settings.  The clock rate will be
      * setup when I2S is enabled to save power.
      */
+#if defined(CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_ASRC)
+    g_i2s_unipro_tunnel.asrc_channels = mode_to_reg_ws_tb[mode].num_channels;
+    g_i2s_unipro_tunnel.asrc_sample_bytes = bytes_per_sample;
+#endif
     bytes_per_sample *= mode_to_reg_ws_tb[mode].num_channels;
+    buf_num = tsb_i2s_unipro_tunnel_buf_num(sample_rate, bytes_per_sample);
+    if (buf_num != g_i2s_unipro_tunnel.buf_num)
+    {
+        /* The buffers cannot change under a running stream. */
+        if (g_i2s_unipro_tunnel.armed)
+        {
+            return -EBUSY;
+        }
+        error = tsb_i2s_unipro_tunnel_rx_buf_alloc(buf_num);
+        if (error)
+        {
+            return error;
+        }
+        g_i2s_unipro_tunnel.buf_num = buf_num;
+    }
     g_i2s_unipro_tunnel.bytes_per_sample = bytes_per_sample;
     g_i2s_unipro_tunnel.bclk_rate = sample_rate*bytes_per_sample * 8;
     g_i2s_unipro_tunnel.is_master = ((flags & I2S_TUNNEL_I2S_FLAGS_MASTER) == I2S_TUNNEL_I2S_FLAGS_MASTER);
@@ -1560,6 +1955,9 @@ int i2s_unipro_tunnel_arm(bool enable)
 {
     int error = 0;
     unsigned int i;
+#if (defined(CONFIG_I2S_TUNNEL_LOCAL_LOOPBACK) || defined(CONFIG_I2S_TUNNEL_ROUNDTRIP_LOOPBACK))
+    unsigned int j;
+#endif
     uint32_t reg_clk_sel;
 
     reglog_log(0x50, (uint32_t)enable);
@@ -1580,14 +1978,19 @@ int i2s_unipro_tunnel_arm(bool enable)
         g_i2s_unipro_tunnel.i2s_tx_samples_retransmitted = 0;
         g_i2s_unipro_tunnel.i2s_tx_samples_dropped = 0;
         g_i2s_unipro_tunnel.i2s_tx_buffers_dropped = 0;
+#if defined(CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_ASRC)
+        tsb_i2s_unipro_asrc_reset();
+#endif
         reg_clk_sel = 0;
 
 #if !defined(CONFIG_I2S_TUNNEL_LOCAL_LOOPBACK)
         /*
-         * If necessary allocate a Unipro buffer for the initial transmit, since
-         * it will be freed in the TX DMA handler.
+         * If necessary allocate Unipro buffers for the initial transmit, since
+         * they will be freed in the TX DMA handler.  The buffer sent first and
+         * half of the others are filled with silence, so the queue starts at
+         * its target level and the rest are left for the packets received.
          */
-        for (i = 0; i < TSB_I2S_UNIPRO_TUNNEL_BUF_NUM; i++)
+        for (i = 0; i < g_i2s_unipro_tunnel.buf_num / 2 + 1; i++)
         {
             if (g_i2s_unipro_tunnel.i2s_tx_unipro_rx_buf[i].msg == NULL)
             {
@@ -1595,10 +1998,12 @@ int i2s_unipro_tunnel_arm(bool enable)
                     (struct tsb_i2s_unipro_msg_s *)unipro_rxbuf_alloc(TSB_I2S_UNIPRO_TUNNEL_CPORTID);
                 if (g_i2s_unipro_tunnel.i2s_tx_unipro_rx_buf[i].msg == NULL)
                 {
-                    while (--i)
+                    while (i-- > 0)
                     {
                         unipro_rxbuf_free(TSB_I2S_UNIPRO_TUNNEL_CPORTID,
                                           g_i2s_unipro_tunnel.i2s_tx_unipro_rx_buf[i].msg);
+                        g_i2s_unipro_tunnel.i2s_tx_unipro_rx_buf[i].msg = NULL;
+                        g_i2s_unipro_tunnel.i2s_tx_unipro_rx_buf[i].len = 0;
                         g_i2s_unipro_tunnel.i2s_tx_unipro_rx_buf[i].unipro_allocated = false;
                     }
                     return -ENOMEM;
@@ -1617,17 +2022,16 @@ int i2s_unipro_tunnel_arm(bool enable)
         }
 #endif
 #if (defined(CONFIG_I2S_TUNNEL_LOCAL_LOOPBACK) || defined(CONFIG_I2S_TUNNEL_ROUNDTRIP_LOOPBACK))
-        /* Prime the TX buffer with some data which can be monitored. */
+        /* Prime the TX buffers with some data which can be monitored. */
         for (i = 0; i < TSB_I2S_UNIPRO_TUNNEL_BUF_SZ; i += 2)
         {
-            g_i2s_unipro_tunnel.i2s_tx_unipro_rx_buf[TSB_I2S_UNIPRO_TUNNEL_BUF_PING].msg->data.buf[i + 1] =
-                (uint8_t)((i>>8)&0xff);
-            g_i2s_unipro_tunnel.i2s_tx_unipro_rx_buf[TSB_I2S_UNIPRO_TUNNEL_BUF_PONG].msg->data.buf[i + 1] =
-                (uint8_t)((i>>8)&0xff);
-            g_i2s_unipro_tunnel.i2s_tx_unipro_rx_buf[TSB_I2S_UNIPRO_TUNNEL_BUF_PING].msg->data.buf[i] =
-                (uint8_t)(i&0xff);
-            g_i2s_unipro_tunnel.i2s_tx_unipro_rx_buf[TSB_I2S_UNIPRO_TUNNEL_BUF_PONG].msg->data.buf[i] =
-                (uint8_t)(i&0xff);
+            for (j = 0; j < g_i2s_unipro_tunnel.buf_num / 2 + 1; j++)
+            {
+                g_i2s_unipro_tunnel.i2s_tx_unipro_rx_buf[j].msg->data.buf[i + 1] =
+                    (uint8_t)((i>>8)&0xff);
+                g_i2s_unipro_tunnel.i2s_tx_unipro_rx_buf[j].msg->data.buf[i] =
+                    (uint8_t)(i&0xff);
+            }
         }
 
 #endif
@@ -1825,6 +2229,10 @@ int i2s_unipro_tunnel_unipro_register(void)
                                  TSB_I2S_UNIPRO_TUNNEL_CPORTID);
     if (ret == 0)
     {
+        /* Keep the audio flowing ahead of bulk traffic on the bridge. */
+        unipro_set_tx_priority(TSB_I2S_UNIPRO_TUNNEL_CPORTID,
+                               UNIPRO_TX_PRIO_HIGH);
+
         /* Only one side needs to make the point to point connection. */
 #if defined(CONFIG_UNIPRO_P2P_APBA)
         unipro_p2p_setup_connection(TSB_I2S_UNIPRO_TUNNEL_CPORTID);
@@ -1897,6 +2305,11 @@ int i2s_unipro_tunnel_info(struct i2s_tunnel_info_s *info)
     info->i2s_tx_samples_dropped = g_i2s_unipro_tunnel.i2s_tx_samples_dropped;
     info->i2s_tx_samples_retransmitted = g_i2s_unipro_tunnel.i2s_tx_samples_retransmitted;
     info->i2s_tx_buffers_dropped = g_i2s_unipro_tunnel.i2s_tx_buffers_dropped;
+#if defined(CONFIG_ARCH_CHIP_TSB_I2S_TUNNEL_ASRC)
+    info->i2s_tx_drift_ppm = g_i2s_unipro_tunnel.asrc_drift_ppm;
+#else
+    info->i2s_tx_drift_ppm = 0;
+#endif
     return OK;
 }
 
@@ -1995,6 +2408,7 @@ int i2s_unipro_tunnel_init(void)
     {
         memset(&g_i2s_unipro_tunnel, 0, sizeof(g_i2s_unipro_tunnel));
         g_i2s_unipro_tunnel.initialized = TSB_I2S_UNIPRO_TUNNEL_INIT;
+        g_i2s_unipro_tunnel.buf_num = 2;
 
         /*
          * Disable the clock in case it was on from startup.  This is required to
@@ -2003,27 +2417,17 @@ int i2s_unipro_tunnel_init(void)
         tsb_clk_disable(TSB_CLK_I2SSYS);
         tsb_clk_disable(TSB_CLK_I2SBIT);
 
-        for (i = 0; i < TSB_I2S_UNIPRO_TUNNEL_BUF_NUM; i++)
+        /*
+         * Allocate the Unipro RX buffers for the default number of buffers,
+         * more are allocated if the I2S configuration needs them.  The TX
+         * buffers are allocated from Unipro memory when the transfer is started
+         * since they are freed after each packet is transmitted, unlike the
+         * receive buffers which are kept.
+         */
+        error = tsb_i2s_unipro_tunnel_rx_buf_alloc(g_i2s_unipro_tunnel.buf_num);
+        if (error != OK)
         {
-            /*
-             * Allocate the Unipro RX buffers.  The TX buffers are allocated from
-             * Unipro memory when the transfer is started since they are freed after
-             * each packet is transmitted, unlike the receive buffers which are kept.
-             */
-            size_t alloc_size = TSB_I2S_UNIPRO_TUNNEL_BUF_SZ +
-                offsetof(struct tsb_i2s_unipro_msg_s, data.buf);
-
-            g_i2s_unipro_tunnel.i2s_rx_unipro_tx_buf[i].msg =
-                (struct tsb_i2s_unipro_msg_s *)bufram_alloc(alloc_size);
-
-            g_i2s_unipro_tunnel.i2s_rx_unipro_tx_buf[i].len = TSB_I2S_UNIPRO_TUNNEL_BUF_SZ;
-            if (g_i2s_unipro_tunnel.i2s_rx_unipro_tx_buf[i].msg == NULL)
-            {
-                lldbg("I2S Unipro Tunnel: Insufficient memory to allocate buffers.\n");
-                error = -ENOMEM;
-                goto i2s_tunnel_init_error;
-            }
-            memset(g_i2s_unipro_tunnel.i2s_rx_unipro_tx_buf[i].msg, 0, alloc_size);
+            goto i2s_tunnel_init_error;
         }
 
         /* Allocate the I2S DMA channels. */
@@ -980,6 +980,26 @@ int unipro_reset_cport(unsigned int cportid, cport_reset_completion_cb_t cb,
     return 0;
 }
 
+/**
+ * @brief Set the priority of the asynchronous sends of a CPort
+ * @param cportid cport number
+ * @param prio priority class
+ * @return 0 on success, <0 on error
+ */
+int unipro_set_tx_priority(unsigned int cportid,
+                           enum unipro_tx_priority prio)
+{
+    struct cport *cport;
+
+    cport = cport_handle(cportid);
+    if (!cport || prio > UNIPRO_TX_PRIO_HIGH)
+        return -EINVAL;
+
+    cport->tx_priority = prio;
+
+    return 0;
+}
+
 /**
  * @brief Enable the cport registers
  * @param cportid cport number to associate this driver to
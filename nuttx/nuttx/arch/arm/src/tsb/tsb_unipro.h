@@ -66,6 +66,7 @@ struct cport {
     bool switch_buf_on_free;
 
     struct list_head tx_fifo;
+    enum unipro_tx_priority tx_priority;
 };
 
 struct cport *cport_handle(unsigned int cportid);
@@ -28,11 +28,15 @@
 
 #include <errno.h>
 #include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
 #include <string.h>
+#include <time.h>
 
 #include <nuttx/util.h>
 #include <nuttx/irq.h>
 #include <nuttx/arch.h>
+#include <nuttx/clock.h>
 #include <nuttx/list.h>
 #include <nuttx/unipro/unipro.h>
 
@@ -40,12 +44,15 @@
 #include "up_arch.h"
 #include "tsb_unipro.h"
 
-struct worker {
-    pthread_t thread;
-    sem_t tx_fifo_lock;
-};
+#ifndef CONFIG_ARCH_UNIPROTX_BUFFERS
+#define CONFIG_ARCH_UNIPROTX_BUFFERS 16
+#endif
 
-static struct worker worker;
+#ifndef CONFIG_ARCH_UNIPROTX_RETRY_US
+#define CONFIG_ARCH_UNIPROTX_RETRY_US 1000
+#endif
+
+#define UNIPRO_TX_PRIO_CLASSES (UNIPRO_TX_PRIO_HIGH + 1)
 
 struct unipro_buffer {
     struct list_head list;
@@ -57,9 +64,97 @@ struct unipro_buffer {
     const void *data;
 };
 
+struct worker {
+    pthread_t thread;
+    sem_t tx_fifo_lock;
+
+    /* CPorts with buffers queued or a reset pending, one bit each */
+    uint32_t *ready;
+    /* Last CPort served in each priority class */
+    unsigned int last[UNIPRO_TX_PRIO_CLASSES];
+
+    struct list_head free_buffers;
+    struct unipro_buffer buffers[CONFIG_ARCH_UNIPROTX_BUFFERS];
+};
+
+static struct worker worker;
+
 static int unipro_send_sync(unsigned int cportid,
                             const void *buf, size_t len, bool som);
 
+static struct unipro_buffer *unipro_buffer_alloc(void)
+{
+    struct unipro_buffer *buffer = NULL;
+    irqstate_t flags;
+
+    flags = irqsave();
+    if (!list_is_empty(&worker.free_buffers)) {
+        buffer = list_entry(worker.free_buffers.next, struct unipro_buffer,
+                            list);
+        list_del(&buffer->list);
+    }
+    irqrestore(flags);
+
+    if (!buffer) {
+        /* Pool exhausted, fall back on the heap */
+        return zalloc(sizeof(*buffer));
+    }
+
+    memset(buffer, 0, sizeof(*buffer));
+    return buffer;
+}
+
+static void unipro_buffer_free(struct unipro_buffer *buffer)
+{
+    irqstate_t flags;
+
+    if (buffer < worker.buffers ||
+        buffer >= worker.buffers + ARRAY_SIZE(worker.buffers)) {
+        free(buffer);
+        return;
+    }
+
+    flags = irqsave();
+    list_add(&worker.free_buffers, &buffer->list);
+    irqrestore(flags);
+}
+
+static inline bool unipro_tx_is_ready(unsigned int cportid)
+{
+    return worker.ready[cportid / 32] & (1U << (cportid % 32));
+}
+
+/**
+ * @brief           Flag a CPort as having work for the TX worker, and wake
+ *                  the worker up
+ * @param[in]       cportid: CPort ID
+ */
+static void unipro_tx_set_ready(unsigned int cportid)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    worker.ready[cportid / 32] |= 1U << (cportid % 32);
+    irqrestore(flags);
+
+    sem_post(&worker.tx_fifo_lock);
+}
+
+/**
+ * @brief           Clear the ready flag of a CPort if it has no work left
+ * @param[in]       cport: CPort handle
+ */
+static void unipro_tx_clear_ready(struct cport *cport)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    if (list_is_empty(&cport->tx_fifo) && !cport->pending_reset) {
+        worker.ready[cport->cportid / 32] &= ~(1U << (cport->cportid % 32));
+    }
+    irqrestore(flags);
+}
+
 /**
  * @brief           Set EOM (End Of Message) flag
  * @param[in]       cport: CPort handle
@@ -83,7 +178,7 @@ static void unipro_dequeue_tx_buffer(struct unipro_buffer *buffer, int status)
         buffer->callback(status, buffer->data, buffer->priv);
     }
 
-    free(buffer);
+    unipro_buffer_free(buffer);
 }
 
 static void unipro_flush_cport(struct cport *cport)
@@ -121,8 +216,10 @@ reset:
  * @return          0 on success, -EINVAL on invalid parameter,
  *                  -EBUSY when buffer could not be completely transferred
  *                  (unipro_send_tx_buffer() shall be called again until
- *                  buffer is entirely sent (return value == 0)).
- * @param[in]       operation: greybus loopback operation
+ *                  buffer is entirely sent (return value == 0)),
+ *                  -EAGAIN when nothing could be sent, the CPort Tx
+ *                  buffer being full.
+ * @param[in]       cport: CPort handle
  */
 static int unipro_send_tx_buffer(struct cport *cport)
 {
@@ -134,12 +231,14 @@ static int unipro_send_tx_buffer(struct cport *cport)
         return -EINVAL;
     }
 
+    if (cport->pending_reset) {
+        unipro_flush_cport(cport);
+        return 0;
+    }
+
     flags = irqsave();
 
     if (list_is_empty(&cport->tx_fifo)) {
-        if (cport->pending_reset) {
-            unipro_flush_cport(cport);
-        }
         irqrestore(flags);
         return 0;
     }
@@ -148,10 +247,6 @@ static int unipro_send_tx_buffer(struct cport *cport)
 
     irqrestore(flags);
 
-    if (cport->pending_reset) {
-        unipro_flush_cport(cport);
-    }
-
     retval = unipro_send_sync(cport->cportid,
                               buffer->data + buffer->byte_sent,
                               buffer->len - buffer->byte_sent, buffer->som);
@@ -161,7 +256,6 @@ static int unipro_send_tx_buffer(struct cport *cport)
         return -EINVAL;
     }
 
-    buffer->som = false;
     buffer->byte_sent += retval;
 
     if (buffer->byte_sent >= buffer->len) {
@@ -170,41 +264,127 @@ static int unipro_send_tx_buffer(struct cport *cport)
         return 0;
     }
 
+    if (!retval) {
+        return -EAGAIN;
+    }
+
+    buffer->som = false;
+
     return -EBUSY;
 }
 
+/**
+ * @brief           Send a chunk of the next ready CPort of a priority class,
+ *                  round robin within the class. CPorts whose Tx buffer is
+ *                  full are skipped.
+ * @return          true if a CPort made progress, false otherwise
+ * @param[in]       prio: priority class
+ */
+static bool unipro_tx_serve(unsigned int prio)
+{
+    unsigned int cport_count = unipro_cport_count();
+    unsigned int cportid;
+    unsigned int n;
+    struct cport *cport;
+    int retval;
+
+    for (n = 1; n <= cport_count; n++) {
+        cportid = (worker.last[prio] + n) % cport_count;
+
+        if (!worker.ready[cportid / 32]) {
+            /* Skip the rest of an idle bitmap word */
+            n += MIN(31 - cportid % 32, cport_count - 1 - cportid);
+            continue;
+        }
+
+        if (!unipro_tx_is_ready(cportid)) {
+            continue;
+        }
+
+        cport = cport_handle(cportid);
+        if (!cport || cport->tx_priority != prio) {
+            continue;
+        }
+
+        retval = unipro_send_tx_buffer(cport);
+        if (retval == -EAGAIN) {
+            continue;
+        }
+
+        if (retval != -EBUSY) {
+            unipro_tx_clear_ready(cport);
+        }
+
+        worker.last[prio] = cportid;
+        return true;
+    }
+
+    return false;
+}
+
+static bool unipro_tx_pending(void)
+{
+    unsigned int words = (unipro_cport_count() + 31) / 32;
+    unsigned int i;
+
+    for (i = 0; i < words; i++) {
+        if (worker.ready[i]) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
 /**
  * @brief           Send data buffer(s) on CPort whenever ready.
- *                  Ensure that TX queues are reinspected until
- *                  all CPorts have no work available.
- *                  Then suspend again until new data is available.
+ *                  Higher priority classes are served first, a CPort Tx
+ *                  buffer worth at a time. There is no interrupt on Tx
+ *                  buffer space, so when all the ready CPorts have their Tx
+ *                  buffer full, poll every CONFIG_ARCH_UNIPROTX_RETRY_US
+ *                  for up to a tick, then sleep a tick at a time until new
+ *                  data comes or the buffers drain.
  */
 static void *unipro_tx_worker(void *data)
 {
-    int i;
-    bool is_busy;
-    int retval;
-    unsigned int cport_count = unipro_cport_count();
+    struct timespec abstime;
+    unsigned int prio;
+    unsigned int polled_us = 0;
+    bool stalled = false;
 
     while (1) {
-        /* Block until a buffer is pending on any CPort */
-        sem_wait(&worker.tx_fifo_lock);
+        if (!stalled) {
+            /* Block until a buffer is pending on any CPort */
+            sem_wait(&worker.tx_fifo_lock);
+            polled_us = 0;
+        } else if (polled_us < USEC_PER_TICK) {
+            /* A Tx buffer drains far quicker than a tick */
+            up_udelay(CONFIG_ARCH_UNIPROTX_RETRY_US);
+            sched_yield();
+            polled_us += CONFIG_ARCH_UNIPROTX_RETRY_US;
+            sem_trywait(&worker.tx_fifo_lock);
+        } else {
+            /* The peer is not draining, stop hogging the CPU */
+            clock_gettime(CLOCK_REALTIME, &abstime);
+            abstime.tv_nsec += USEC_PER_TICK * 1000;
+            if (abstime.tv_nsec >= 1000000000) {
+                abstime.tv_sec++;
+                abstime.tv_nsec -= 1000000000;
+            }
+
+            sem_timedwait(&worker.tx_fifo_lock, &abstime);
+        }
 
         do {
-            is_busy = false;
-
-            for (i = 0; i < cport_count; i++) {
-                /* Browse all CPorts sending any pending buffers */
-                retval = unipro_send_tx_buffer(cport_handle(i));
-                if (retval == -EBUSY) {
-                    /*
-                     * Buffer only partially sent, have to try again for
-                     * remaining part.
-                     */
-                    is_busy = true;
+            for (prio = UNIPRO_TX_PRIO_CLASSES; prio-- > 0;) {
+                if (unipro_tx_serve(prio)) {
+                    polled_us = 0;
+                    break;
                 }
             }
-        } while (is_busy); /* exit when CPort(s) current pending buffer sent */
+        } while (prio < UNIPRO_TX_PRIO_CLASSES);
+
+        stalled = unipro_tx_pending();
     }
 
     return NULL;
@@ -216,7 +396,7 @@ void unipro_reset_notify(unsigned int cportid)
      * if the tx worker is blocked on the semaphore, post something on it
      * in order to unlock it and have the reset happen right away.
      */
-    sem_post(&worker.tx_fifo_lock);
+    unipro_tx_set_ready(cportid);
 }
 
 /**
@@ -255,7 +435,7 @@ int unipro_send_async(unsigned int cportid, const void *buf, size_t len,
 
     DEBUGASSERT(TRANSFER_MODE == 2);
 
-    buffer = zalloc(sizeof(*buffer));
+    buffer = unipro_buffer_alloc();
     if (!buffer) {
         return -ENOMEM;
     }
@@ -270,7 +450,7 @@ int unipro_send_async(unsigned int cportid, const void *buf, size_t len,
     list_add(&cport->tx_fifo, &buffer->list);
     irqrestore(flags);
 
-    sem_post(&worker.tx_fifo_lock);
+    unipro_tx_set_ready(cportid);
     return 0;
 }
 
@@ -375,12 +555,26 @@ static int unipro_send_sync(unsigned int cportid,
 int unipro_tx_init(void)
 {
     int retval;
+    int i;
+
+    worker.ready = zalloc(sizeof(*worker.ready) *
+                          ((unipro_cport_count() + 31) / 32));
+    if (!worker.ready) {
+        return -ENOMEM;
+    }
+
+    list_init(&worker.free_buffers);
+    for (i = 0; i < ARRAY_SIZE(worker.buffers); i++) {
+        list_add(&worker.free_buffers, &worker.buffers[i].list);
+    }
 
     sem_init(&worker.tx_fifo_lock, 0, 0);
 
     retval = pthread_create(&worker.thread, NULL, unipro_tx_worker, NULL);
     if (retval) {
         lldbg("Failed to create worker thread: %s.\n", strerror(errno));
+        free(worker.ready);
+        worker.ready = NULL;
         return retval;
     }
 
@@ -136,6 +136,10 @@
 #define GPIO_USBC_INT_N          CALC_GPIO_NUM('C', 7)
 #define GPIO_USBC_VBUS_ENA       CALC_GPIO_NUM('D', 6)
 
+/* FM transmitter */
+#define GPIO_SI4713_INT_N        CALC_GPIO_NUM('C', 7)
+#define GPIO_SI4713_RST_N        CALC_GPIO_NUM('D', 6)
+
 /* MODBOT */
 #define GPIO_MODBOT_STANDBY      CALC_GPIO_NUM('A', 10)
 #define GPIO_MODBOT_AIN1         CALC_GPIO_NUM('B', 10)
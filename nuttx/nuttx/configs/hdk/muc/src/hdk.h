@@ -65,4 +65,25 @@ void mods_init(void);
 
 void stm32_spiinitialize(void);
 
+/****************************************************************************
+ * Name: stm32_si4713_initialize
+ *
+ * Description:
+ *   Bring up the Si4713 FM transmitter and queue its power-up and tune
+ *   sequence. stm32_si4713_get() returns the command engine for submitting
+ *   further commands.
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_MODS_FM_SI4713
+struct si4713_dev_s;
+struct si4713_rds_s;
+
+int stm32_si4713_initialize(void);
+struct si4713_dev_s *stm32_si4713_get(void);
+#ifdef CONFIG_AUDIO_SI4713_RDS
+struct si4713_rds_s *stm32_si4713_get_rds(void);
+#endif
+#endif
+
 #endif /* __CONFIGS_HDK_MUC_SRC_HDK_H */
@@ -77,6 +77,7 @@
 #include "up_arch.h"
 #include "hdk.h"
 #include "stm32_adc_init.h"
+#include "stm32_crc.h"
 
 #include <nuttx/gpio/stm32_gpio_chip.h>
 
@@ -98,6 +99,9 @@ static const struct board_gpio_cfg_s board_gpio_cfgs[] =
   { GPIO_MODS_LED_DRV_2,     (GPIO_OPENDRAIN)             },
   { GPIO_MODS_LED_DRV_3,     (GPIO_OPENDRAIN)             },
   { GPIO_MODS_PCARD_DET_N,   (GPIO_PULLUP)                },
+#ifdef CONFIG_MODS_FM_SI4713
+  { GPIO_SI4713_INT_N,       (GPIO_INPUT|GPIO_PULLUP)     },
+#endif
 #ifdef CONFIG_MODS_MODBOT
   { GPIO_MODBOT_STANDBY,     (GPIO_PUSHPULL)              },
   { GPIO_MODBOT_AIN1,        (GPIO_PUSHPULL)              },
@@ -1015,6 +1019,10 @@ void board_initialize(void)
   stm32_lptim1_on();
 #endif
 
+#ifdef CONFIG_STM32_CRC16_POLY8005
+  stm32_crc_initialize();
+#endif
+
 #ifdef CONFIG_STM32_SPI
   stm32_spiinitialize();
 #endif
@@ -1038,6 +1046,10 @@ void board_initialize(void)
   fusb302_register(GPIO_MODS_FUSB302_INT_N, GPIO_MODS_VBUS_PWR_EN);
 #endif
 
+#ifdef CONFIG_MODS_FM_SI4713
+  stm32_si4713_initialize();
+#endif
+
 #ifdef CONFIG_FUSB302_USB_EXT
   extern struct device_driver fusb302_usb_ext_driver;
   device_register_driver(&fusb302_usb_ext_driver);
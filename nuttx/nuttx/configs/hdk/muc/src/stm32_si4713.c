@@ -0,0 +1,151 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Si4713 FM transmitter bring-up for the fm_xmitter mod.
+ *
+ * The power-up and tune sequence is queued on the Si4713 command engine at
+ * boot and runs asynchronously; board_initialize() does not wait for it.
+ */
+
+#include <debug.h>
+#include <errno.h>
+#include <string.h>
+
+#include <nuttx/config.h>
+#include <nuttx/i2c.h>
+#include <nuttx/si4713.h>
+#include <nuttx/util.h>
+
+#include <arch/board/mods.h>
+
+#include "hdk.h"
+
+enum {
+    FM_CMD_POWER_UP,
+    FM_CMD_GPO_IEN,
+    FM_CMD_TUNE_POWER,
+    FM_CMD_TUNE_FREQ,
+    FM_CMD_COUNT,
+};
+
+static struct si4713_dev_s *g_fm_dev;
+static struct si4713_cmd_s g_fm_boot_cmds[FM_CMD_COUNT];
+#ifdef CONFIG_AUDIO_SI4713_RDS
+static struct si4713_rds_s *g_fm_rds;
+#endif
+
+static void stm32_si4713_boot_done(struct si4713_cmd_s *cmd, int status)
+{
+    if (status) {
+        lldbg("boot cmd 0x%02x failed: %d\n", cmd->cmd, status);
+        return;
+    }
+
+    if (cmd == &g_fm_boot_cmds[FM_CMD_TUNE_FREQ]) {
+        llvdbg("tuned to %d0 kHz, power %d dBuV, antcap %d\n",
+               (cmd->resp[2] << 8) | cmd->resp[3], cmd->resp[5],
+               cmd->resp[6]);
+    }
+}
+
+/**
+ * @brief Return the Si4713 command engine, or NULL if not initialized
+ */
+struct si4713_dev_s *stm32_si4713_get(void)
+{
+    return g_fm_dev;
+}
+
+#ifdef CONFIG_AUDIO_SI4713_RDS
+/**
+ * @brief Return the RDS scheduler, or NULL if not initialized
+ */
+struct si4713_rds_s *stm32_si4713_get_rds(void)
+{
+    return g_fm_rds;
+}
+#endif
+
+int stm32_si4713_initialize(void)
+{
+    struct si4713_cmd_s *cmd;
+    struct i2c_dev_s *i2c;
+    int i;
+
+    i2c = up_i2cinitialize(CONFIG_MODS_FM_SI4713_I2C_BUS);
+    if (!i2c) {
+        dbg("failed to init i2c\n");
+        return -ENODEV;
+    }
+
+    I2C_SETFREQUENCY(i2c, CONFIG_MODS_FM_SI4713_I2C_BUS_SPEED);
+
+    g_fm_dev = si4713_initialize(i2c, SI4713_I2C_ADDR, GPIO_SI4713_INT_N,
+                                 GPIO_SI4713_RST_N);
+    if (!g_fm_dev) {
+        dbg("failed to init si4713\n");
+        return -ENODEV;
+    }
+
+    memset(g_fm_boot_cmds, 0, sizeof(g_fm_boot_cmds));
+
+    cmd = &g_fm_boot_cmds[FM_CMD_POWER_UP];
+    cmd->cmd = SI4713_POWER_UP;
+    cmd->nargs = 2;
+    cmd->args[0] = SI4713_PWUP_CTSIEN | SI4713_PWUP_GPO2OEN |
+                   SI4713_PWUP_FUNC_TX;
+    cmd->args[1] = SI4713_PWUP_OPMOD_ANALOG;
+    cmd->nresp = 1;
+
+    si4713_prep_set_property(&g_fm_boot_cmds[FM_CMD_GPO_IEN],
+                             SI4713_PROP_GPO_IEN,
+                             SI4713_GPO_IEN_STCIEN | SI4713_GPO_IEN_CTSIEN);
+    si4713_prep_tune_power(&g_fm_boot_cmds[FM_CMD_TUNE_POWER],
+                           CONFIG_MODS_FM_SI4713_TX_POWER, 0);
+    si4713_prep_tune_freq(&g_fm_boot_cmds[FM_CMD_TUNE_FREQ],
+                          CONFIG_MODS_FM_SI4713_FREQ);
+
+    /* The engine executes them in order, without blocking boot */
+    for (i = 0; i < FM_CMD_COUNT; i++) {
+        g_fm_boot_cmds[i].callback = stm32_si4713_boot_done;
+        si4713_submit(g_fm_dev, &g_fm_boot_cmds[i]);
+    }
+
+#ifdef CONFIG_AUDIO_SI4713_RDS
+    /* Queued behind the power-up sequence */
+    g_fm_rds = si4713_rds_initialize(g_fm_dev, CONFIG_MODS_FM_SI4713_RDS_PI,
+                                     CONFIG_MODS_FM_SI4713_RDS_PTY);
+    if (g_fm_rds)
+        si4713_rds_set_ps(g_fm_rds, CONFIG_MODS_FM_SI4713_RDS_PS);
+    else
+        dbg("failed to init RDS\n");
+#endif
+
+    return 0;
+}
@@ -0,0 +1,742 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Si4713 FM transmitter command engine.
+ *
+ * Commands are queued by the caller and executed from the high priority work
+ * queue. Once a command has been written to the chip, the engine does not
+ * wait for it: completion is driven by the chip's GPO2/INT line (CTS and
+ * STC interrupts), which schedules the next step of the state machine. No
+ * caller thread ever sleeps while the chip is busy, so tune and property
+ * writes can be issued from the Greybus handlers without blocking them.
+ *
+ * Boards without the interrupt line routed fall back to polling the status
+ * byte once per system tick from the work queue.
+ */
+
+#include <debug.h>
+#include <errno.h>
+#include <semaphore.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arch/irq.h>
+
+#include <nuttx/clock.h>
+#include <nuttx/gpio.h>
+#include <nuttx/hires_tmr.h>
+#include <nuttx/i2c.h>
+#include <nuttx/kmalloc.h>
+#include <nuttx/si4713.h>
+#include <nuttx/util.h>
+#include <nuttx/wdog.h>
+#include <nuttx/wqueue.h>
+
+#ifndef CONFIG_AUDIO_SI4713_CMD_TIMEOUT_MS
+#  define CONFIG_AUDIO_SI4713_CMD_TIMEOUT_MS 20
+#endif
+
+#ifndef CONFIG_AUDIO_SI4713_STC_TIMEOUT_MS
+#  define CONFIG_AUDIO_SI4713_STC_TIMEOUT_MS 150
+#endif
+
+#define SI4713_POWERUP_TIMEOUT_MS   200
+#define SI4713_RESET_DELAY_US       1000
+
+#define SI4713_POLL_DELAY           1
+
+enum si4713_state_e {
+    SI4713_STATE_IDLE,
+    SI4713_STATE_WAIT_CTS,      /* command written, waiting for CTS */
+    SI4713_STATE_WAIT_STC,      /* command accepted, waiting for STCINT */
+    SI4713_STATE_WAIT_ACK,      /* TX_TUNE_STATUS(INTACK) written */
+};
+
+struct si4713_dev_s {
+    struct i2c_dev_s *i2c;
+    uint8_t addr;
+    int int_gpio;
+    int rst_gpio;
+
+    enum si4713_state_e state;
+    struct list_head queue;
+    struct si4713_cmd_s *active;
+    uint32_t depth;
+
+    struct work_s work;
+    struct wdog_s wdog;
+    uint32_t start_ticks;
+    uint32_t timeout_ticks;
+
+    si4713_event_t event_cb;
+    void *event_priv;
+    bool event_pending;
+
+    uint8_t buf[SI4713_MAX_ARGS + 1];
+    struct si4713_stats_s stats;
+};
+
+#define SI4713_STATUS_EVENTS (SI4713_STATUS_RDSINT | SI4713_STATUS_ASQINT)
+
+/* GPIO interrupt handlers do not carry a context pointer */
+static struct si4713_dev_s *g_si4713;
+
+static int si4713_i2c_write(struct si4713_dev_s *dev, uint8_t *buf, int len)
+{
+    struct i2c_msg_s msg = {
+        .addr = dev->addr,
+        .flags = 0,
+        .buffer = buf,
+        .length = len,
+    };
+
+    return I2C_TRANSFER(dev->i2c, &msg, 1);
+}
+
+static int si4713_i2c_read(struct si4713_dev_s *dev, uint8_t *buf, int len)
+{
+    struct i2c_msg_s msg = {
+        .addr = dev->addr,
+        .flags = I2C_M_READ,
+        .buffer = buf,
+        .length = len,
+    };
+
+    return I2C_TRANSFER(dev->i2c, &msg, 1);
+}
+
+static void si4713_worker(void *arg);
+
+static void si4713_timeout(int argc, uint32_t arg, ...)
+{
+    struct si4713_dev_s *dev = (struct si4713_dev_s *)arg;
+
+    if (work_available(&dev->work))
+        work_queue(HPWORK, &dev->work, si4713_worker, dev, 0);
+}
+
+/*
+ * Arm the wait for the next chip event. With an interrupt line, the
+ * watchdog only exists to catch a lost interrupt; without one, poll.
+ */
+static void si4713_wait(struct si4713_dev_s *dev, int timeout_ms)
+{
+    dev->start_ticks = clock_systimer();
+    dev->timeout_ticks = MSEC2TICK(timeout_ms) + 1;
+
+    if (dev->int_gpio != SI4713_INT_NONE) {
+        wd_start(&dev->wdog, dev->timeout_ticks, si4713_timeout, 1,
+                 (uint32_t)dev);
+    } else if (work_available(&dev->work)) {
+        work_queue(HPWORK, &dev->work, si4713_worker, dev,
+                   SI4713_POLL_DELAY);
+    }
+}
+
+static bool si4713_expired(struct si4713_dev_s *dev)
+{
+    return (clock_systimer() - dev->start_ticks) >= dev->timeout_ticks;
+}
+
+/*
+ * Re-arm an interrupted wait without restarting its timeout. The
+ * interrupt cancelled the watchdog, so it is restarted for the ticks left.
+ */
+static void si4713_rewait(struct si4713_dev_s *dev)
+{
+    uint32_t elapsed;
+
+    if (dev->int_gpio != SI4713_INT_NONE) {
+        elapsed = clock_systimer() - dev->start_ticks;
+        wd_start(&dev->wdog, elapsed < dev->timeout_ticks ?
+                 dev->timeout_ticks - elapsed : 1,
+                 si4713_timeout, 1, (uint32_t)dev);
+    } else if (work_available(&dev->work)) {
+        work_queue(HPWORK, &dev->work, si4713_worker, dev,
+                   SI4713_POLL_DELAY);
+    }
+}
+
+static void si4713_complete(struct si4713_dev_s *dev, int status)
+{
+    struct si4713_cmd_s *cmd = dev->active;
+    irqstate_t flags;
+    uint32_t latency;
+    uint8_t status_byte = cmd->resp[0];
+
+    wd_cancel(&dev->wdog);
+
+    flags = irqsave();
+    dev->active = NULL;
+    dev->state = SI4713_STATE_IDLE;
+    dev->depth--;
+    irqrestore(flags);
+
+    latency = hrt_getusec() - cmd->submit_us;
+    dev->stats.completed++;
+    dev->stats.total_latency_us += latency;
+    if (latency > dev->stats.max_latency_us)
+        dev->stats.max_latency_us = latency;
+
+    if (status == -ETIMEDOUT)
+        dev->stats.timeouts++;
+    else if (status)
+        dev->stats.errors++;
+
+    if (status)
+        lldbg("cmd 0x%02x failed: %d (status 0x%02x)\n",
+              cmd->cmd, status, cmd->resp[0]);
+
+    if (cmd->callback)
+        cmd->callback(cmd, status);
+
+    /* Every response carries the status byte, no need to poll for events */
+    if (dev->event_cb && (status_byte & SI4713_STATUS_EVENTS))
+        dev->event_cb(dev->event_priv, status_byte);
+}
+
+/* Idle interrupt: not a command completion, check for chip events */
+static void si4713_handle_event(struct si4713_dev_s *dev)
+{
+    uint8_t status;
+
+    if (!dev->event_pending)
+        return;
+
+    dev->event_pending = false;
+
+    if (si4713_i2c_read(dev, &status, 1) < 0)
+        return;
+
+    if (dev->event_cb && (status & SI4713_STATUS_EVENTS))
+        dev->event_cb(dev->event_priv, status);
+}
+
+/* Write the next queued command to the chip, if the engine is idle */
+static void si4713_start_next(struct si4713_dev_s *dev)
+{
+    struct si4713_cmd_s *cmd;
+    irqstate_t flags;
+    int ret;
+
+    while (1) {
+        flags = irqsave();
+        if (dev->state != SI4713_STATE_IDLE || list_is_empty(&dev->queue)) {
+            irqrestore(flags);
+            return;
+        }
+
+        cmd = list_entry(dev->queue.next, struct si4713_cmd_s, list);
+        list_del(&cmd->list);
+        dev->active = cmd;
+        dev->state = SI4713_STATE_WAIT_CTS;
+        irqrestore(flags);
+
+        dev->buf[0] = cmd->cmd;
+        memcpy(&dev->buf[1], cmd->args, cmd->nargs);
+
+        ret = si4713_i2c_write(dev, dev->buf, cmd->nargs + 1);
+        if (ret < 0) {
+            si4713_complete(dev, ret);
+            continue;
+        }
+
+        si4713_wait(dev, cmd->cmd == SI4713_POWER_UP ?
+                    SI4713_POWERUP_TIMEOUT_MS :
+                    CONFIG_AUDIO_SI4713_CMD_TIMEOUT_MS);
+        return;
+    }
+}
+
+static void si4713_handle_cts(struct si4713_dev_s *dev)
+{
+    struct si4713_cmd_s *cmd = dev->active;
+    int ret;
+
+    ret = si4713_i2c_read(dev, cmd->resp, MAX(cmd->nresp, 1));
+    if (ret < 0) {
+        si4713_complete(dev, ret);
+        return;
+    }
+
+    if (!(cmd->resp[0] & SI4713_STATUS_CTS)) {
+        if (si4713_expired(dev))
+            si4713_complete(dev, -ETIMEDOUT);
+        else
+            si4713_rewait(dev);
+        return;
+    }
+
+    if (cmd->resp[0] & SI4713_STATUS_ERR) {
+        si4713_complete(dev, -EIO);
+        return;
+    }
+
+    if (!(cmd->flags & SI4713_CMD_F_STC)) {
+        si4713_complete(dev, 0);
+        return;
+    }
+
+    wd_cancel(&dev->wdog);
+    dev->state = SI4713_STATE_WAIT_STC;
+    if (cmd->resp[0] & SI4713_STATUS_STCINT) {
+        /* Tune already settled, no further interrupt will come */
+        dev->start_ticks = clock_systimer();
+        dev->timeout_ticks = MSEC2TICK(CONFIG_AUDIO_SI4713_STC_TIMEOUT_MS);
+        if (work_available(&dev->work))
+            work_queue(HPWORK, &dev->work, si4713_worker, dev, 0);
+    } else {
+        si4713_wait(dev, CONFIG_AUDIO_SI4713_STC_TIMEOUT_MS);
+    }
+}
+
+static void si4713_handle_stc(struct si4713_dev_s *dev)
+{
+    uint8_t status;
+    int ret;
+
+    ret = si4713_i2c_read(dev, &status, 1);
+    if (ret < 0) {
+        si4713_complete(dev, ret);
+        return;
+    }
+
+    if (!(status & SI4713_STATUS_STCINT)) {
+        if (si4713_expired(dev))
+            si4713_complete(dev, -ETIMEDOUT);
+        else
+            si4713_rewait(dev);
+        return;
+    }
+
+    /* Acknowledge STC; the status response completes the tune command */
+    dev->buf[0] = SI4713_TX_TUNE_STATUS;
+    dev->buf[1] = SI4713_TUNE_STATUS_INTACK;
+    dev->state = SI4713_STATE_WAIT_ACK;
+
+    ret = si4713_i2c_write(dev, dev->buf, 2);
+    if (ret < 0) {
+        si4713_complete(dev, ret);
+        return;
+    }
+
+    si4713_wait(dev, CONFIG_AUDIO_SI4713_CMD_TIMEOUT_MS);
+}
+
+static void si4713_handle_ack(struct si4713_dev_s *dev)
+{
+    struct si4713_cmd_s *cmd = dev->active;
+    int ret;
+
+    ret = si4713_i2c_read(dev, cmd->resp,
+                          MIN(SI4713_TUNE_STATUS_NRESP, SI4713_MAX_RESP));
+    if (ret < 0) {
+        si4713_complete(dev, ret);
+        return;
+    }
+
+    if (!(cmd->resp[0] & SI4713_STATUS_CTS)) {
+        if (si4713_expired(dev))
+            si4713_complete(dev, -ETIMEDOUT);
+        else
+            si4713_rewait(dev);
+        return;
+    }
+
+    si4713_complete(dev, cmd->resp[0] & SI4713_STATUS_ERR ? -EIO : 0);
+}
+
+static void si4713_worker(void *arg)
+{
+    struct si4713_dev_s *dev = arg;
+
+    switch (dev->state) {
+    case SI4713_STATE_WAIT_CTS:
+        si4713_handle_cts(dev);
+        break;
+    case SI4713_STATE_WAIT_STC:
+        si4713_handle_stc(dev);
+        break;
+    case SI4713_STATE_WAIT_ACK:
+        si4713_handle_ack(dev);
+        break;
+    case SI4713_STATE_IDLE:
+        si4713_handle_event(dev);
+        break;
+    default:
+        break;
+    }
+
+    si4713_start_next(dev);
+}
+
+static int si4713_isr(int irq, void *context)
+{
+    if (g_si4713)
+        si4713_interrupt(g_si4713);
+
+    return OK;
+}
+
+/**
+ * @brief Signal a chip interrupt (CTS, STC, RDS or ASQ) to the command engine
+ *
+ * Called from the GPO2/INT interrupt handler, or by boards that route the
+ * line through a different interrupt controller. Safe in interrupt context.
+ */
+void si4713_interrupt(struct si4713_dev_s *dev)
+{
+    wd_cancel(&dev->wdog);
+
+    if (dev->state == SI4713_STATE_IDLE) {
+        if (!dev->event_cb)
+            return;
+        dev->event_pending = true;
+    }
+
+    if (work_available(&dev->work))
+        work_queue(HPWORK, &dev->work, si4713_worker, dev, 0);
+}
+
+/**
+ * @brief Queue a command for execution
+ *
+ * Never blocks: the command is executed from the work queue and its
+ * callback is invoked on completion. Returns 0 or a negative errno if the
+ * command cannot be queued.
+ */
+int si4713_submit(struct si4713_dev_s *dev, struct si4713_cmd_s *cmd)
+{
+    irqstate_t flags;
+
+    if (!dev || !cmd || cmd->nargs > SI4713_MAX_ARGS ||
+        cmd->nresp > SI4713_MAX_RESP)
+        return -EINVAL;
+
+    cmd->submit_us = hrt_getusec();
+    memset(cmd->resp, 0, sizeof(cmd->resp));
+
+    flags = irqsave();
+
+    if (cmd->flags & SI4713_CMD_F_URGENT) {
+        /* list_add() inserts before the node it is given */
+        list_add(dev->queue.next, &cmd->list);
+    } else {
+        list_add(&dev->queue, &cmd->list);
+    }
+
+    dev->stats.submitted++;
+    if (++dev->depth > dev->stats.max_depth)
+        dev->stats.max_depth = dev->depth;
+
+    if (dev->state == SI4713_STATE_IDLE && work_available(&dev->work))
+        work_queue(HPWORK, &dev->work, si4713_worker, dev, 0);
+
+    irqrestore(flags);
+
+    return 0;
+}
+
+/**
+ * @brief Remove a queued command before the engine starts it
+ *
+ * The callback of a cancelled command is not invoked. Returns 0 if the
+ * command was removed, -EBUSY if it is being executed and -ENOENT if it
+ * is not queued.
+ */
+int si4713_cancel(struct si4713_dev_s *dev, struct si4713_cmd_s *cmd)
+{
+    struct list_head *iter;
+    irqstate_t flags;
+    int ret = -ENOENT;
+
+    flags = irqsave();
+
+    if (dev->active == cmd) {
+        ret = -EBUSY;
+    } else {
+        list_foreach(&dev->queue, iter) {
+            if (iter == &cmd->list) {
+                list_del(&cmd->list);
+                dev->depth--;
+                ret = 0;
+                break;
+            }
+        }
+    }
+
+    irqrestore(flags);
+
+    return ret;
+}
+
+struct si4713_sync_s {
+    sem_t sem;
+    int status;
+    si4713_callback_t callback;
+    void *priv;
+};
+
+static void si4713_sync_callback(struct si4713_cmd_s *cmd, int status)
+{
+    struct si4713_sync_s *sync = cmd->priv;
+
+    sync->status = status;
+    sem_post(&sync->sem);
+}
+
+/**
+ * @brief Execute a command and wait for its completion
+ *
+ * For initialization paths only; runtime callers should use si4713_submit().
+ * Must not be called from the work queue thread.
+ */
+int si4713_command(struct si4713_dev_s *dev, struct si4713_cmd_s *cmd)
+{
+    struct si4713_sync_s sync;
+    int ret;
+
+    sem_init(&sync.sem, 0, 0);
+    sync.status = -EIO;
+    sync.callback = cmd->callback;
+    sync.priv = cmd->priv;
+
+    cmd->callback = si4713_sync_callback;
+    cmd->priv = &sync;
+
+    ret = si4713_submit(dev, cmd);
+    if (!ret) {
+        while (sem_wait(&sync.sem) != OK);
+        ret = sync.status;
+    }
+
+    cmd->callback = sync.callback;
+    cmd->priv = sync.priv;
+    sem_destroy(&sync.sem);
+
+    return ret;
+}
+
+void si4713_get_stats(struct si4713_dev_s *dev, struct si4713_stats_s *stats)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    memcpy(stats, &dev->stats, sizeof(*stats));
+    irqrestore(flags);
+}
+
+/**
+ * @brief Register the handler for RDS and ASQ chip events
+ *
+ * The handler runs on the driver work queue whenever a status byte with
+ * RDSINT or ASQINT set is seen, either from a command response or from an
+ * interrupt while the engine is idle. It may submit commands.
+ */
+void si4713_set_event_callback(struct si4713_dev_s *dev, si4713_event_t cb,
+                               void *priv)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    dev->event_cb = cb;
+    dev->event_priv = priv;
+    irqrestore(flags);
+}
+
+void si4713_prep_set_property(struct si4713_cmd_s *cmd, uint16_t prop,
+                              uint16_t val)
+{
+    cmd->cmd = SI4713_SET_PROPERTY;
+    cmd->nargs = 5;
+    cmd->args[0] = 0;
+    cmd->args[1] = prop >> 8;
+    cmd->args[2] = prop & 0xff;
+    cmd->args[3] = val >> 8;
+    cmd->args[4] = val & 0xff;
+    cmd->nresp = 1;
+    cmd->flags &= ~SI4713_CMD_F_STC;
+}
+
+void si4713_prep_get_property(struct si4713_cmd_s *cmd, uint16_t prop)
+{
+    cmd->cmd = SI4713_GET_PROPERTY;
+    cmd->nargs = 3;
+    cmd->args[0] = 0;
+    cmd->args[1] = prop >> 8;
+    cmd->args[2] = prop & 0xff;
+    cmd->nresp = 4;
+    cmd->flags &= ~SI4713_CMD_F_STC;
+}
+
+void si4713_prep_tune_freq(struct si4713_cmd_s *cmd, uint16_t freq)
+{
+    cmd->cmd = SI4713_TX_TUNE_FREQ;
+    cmd->nargs = 3;
+    cmd->args[0] = 0;
+    cmd->args[1] = freq >> 8;
+    cmd->args[2] = freq & 0xff;
+    cmd->nresp = 1;
+    cmd->flags |= SI4713_CMD_F_STC;
+}
+
+void si4713_prep_tune_power(struct si4713_cmd_s *cmd, uint8_t power,
+                            uint8_t antcap)
+{
+    cmd->cmd = SI4713_TX_TUNE_POWER;
+    cmd->nargs = 4;
+    cmd->args[0] = 0;
+    cmd->args[1] = 0;
+    cmd->args[2] = power;
+    cmd->args[3] = antcap;
+    cmd->nresp = 1;
+    cmd->flags |= SI4713_CMD_F_STC;
+}
+
+int si4713_powerup(struct si4713_dev_s *dev, bool analog)
+{
+    struct si4713_cmd_s cmd;
+    int ret;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cmd = SI4713_POWER_UP;
+    cmd.nargs = 2;
+    cmd.args[0] = SI4713_PWUP_GPO2OEN | SI4713_PWUP_FUNC_TX;
+    if (dev->int_gpio != SI4713_INT_NONE)
+        cmd.args[0] |= SI4713_PWUP_CTSIEN;
+    cmd.args[1] = analog ? SI4713_PWUP_OPMOD_ANALOG :
+                           SI4713_PWUP_OPMOD_DIGITAL;
+    cmd.nresp = 1;
+
+    ret = si4713_command(dev, &cmd);
+    if (ret)
+        return ret;
+
+    if (dev->int_gpio == SI4713_INT_NONE)
+        return 0;
+
+    si4713_prep_set_property(&cmd, SI4713_PROP_GPO_IEN,
+                             SI4713_GPO_IEN_STCIEN | SI4713_GPO_IEN_CTSIEN);
+    return si4713_command(dev, &cmd);
+}
+
+int si4713_powerdown(struct si4713_dev_s *dev)
+{
+    struct si4713_cmd_s cmd;
+
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.cmd = SI4713_POWER_DOWN;
+    cmd.nresp = 1;
+
+    return si4713_command(dev, &cmd);
+}
+
+/**
+ * @brief Create the command engine for a Si4713 on the given bus
+ *
+ * int_gpio is the GPO2/INT line (active low), SI4713_INT_NONE to poll the
+ * status byte, or SI4713_INT_EXTERNAL if the board signals the interrupt
+ * itself through si4713_interrupt(). rst_gpio is the RST line or -1 if
+ * reset is handled by the board.
+ */
+struct si4713_dev_s *si4713_initialize(struct i2c_dev_s *i2c, uint8_t addr,
+                                       int int_gpio, int rst_gpio)
+{
+    struct si4713_dev_s *dev;
+    int ret;
+
+    if (!i2c || g_si4713)
+        return NULL;
+
+    dev = kmm_zalloc(sizeof(*dev));
+    if (!dev)
+        return NULL;
+
+    dev->i2c = i2c;
+    dev->addr = addr;
+    dev->int_gpio = int_gpio;
+    dev->rst_gpio = rst_gpio;
+    dev->state = SI4713_STATE_IDLE;
+    list_init(&dev->queue);
+    wd_static(&dev->wdog);
+
+    if (rst_gpio >= 0) {
+        gpio_direction_out(rst_gpio, 0);
+        usleep(SI4713_RESET_DELAY_US);
+        gpio_set_value(rst_gpio, 1);
+        usleep(SI4713_RESET_DELAY_US);
+    }
+
+    g_si4713 = dev;
+
+    if (int_gpio >= 0) {
+        gpio_direction_in(int_gpio);
+
+        ret = gpio_irqattach(int_gpio, si4713_isr);
+        if (ret) {
+            dbg("failed to attach irq: %d\n", ret);
+            goto err_free;
+        }
+
+        ret = set_gpio_triggering(int_gpio, IRQ_TYPE_EDGE_FALLING);
+        if (ret) {
+            dbg("failed to set irq edge: %d\n", ret);
+            goto err_free;
+        }
+
+        gpio_unmask_irq(int_gpio);
+    }
+
+    return dev;
+
+err_free:
+    g_si4713 = NULL;
+    kmm_free(dev);
+    return NULL;
+}
+
+void si4713_uninitialize(struct si4713_dev_s *dev)
+{
+    if (!dev)
+        return;
+
+    if (dev->int_gpio >= 0)
+        gpio_mask_irq(dev->int_gpio);
+
+    wd_cancel(&dev->wdog);
+    work_cancel(HPWORK, &dev->work);
+
+    if (dev->rst_gpio >= 0)
+        gpio_set_value(dev->rst_gpio, 0);
+
+    g_si4713 = NULL;
+    kmm_free(dev);
+}
@@ -0,0 +1,764 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Si4713 RDS group scheduler.
+ *
+ * PS (0A, carrying AF), RT (2A) and CT (4A) groups are encoded once, when
+ * the corresponding data changes, into a table with one entry per group
+ * segment. A scheduler interleaves the table entries into a ring of ready
+ * to send groups, and the chip's RDS FIFO is topped up from that ring
+ * whenever the chip reports that a FIFO group has been transmitted. A top-up
+ * queues a batch of TX_RDS_BUFF commands on the command engine at once, so
+ * they go out back to back on CTS interrupts without any thread waiting.
+ *
+ * Updates only re-encode the segments whose content changed, and rewrite
+ * the copies of those segments already waiting in the ring, so a partial
+ * radio text change costs a few table writes and no bus traffic.
+ */
+
+#include <debug.h>
+#include <errno.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arch/irq.h>
+
+#include <nuttx/clock.h>
+#include <nuttx/kmalloc.h>
+#include <nuttx/si4713.h>
+#include <nuttx/util.h>
+#include <nuttx/wdog.h>
+
+#ifndef CONFIG_AUDIO_SI4713_RDS_RING
+#  define CONFIG_AUDIO_SI4713_RDS_RING 32
+#endif
+
+#ifndef CONFIG_AUDIO_SI4713_RDS_BATCH
+#  define CONFIG_AUDIO_SI4713_RDS_BATCH 8
+#endif
+
+#ifndef CONFIG_AUDIO_SI4713_RDS_FIFO_BLOCKS
+#  define CONFIG_AUDIO_SI4713_RDS_FIFO_BLOCKS 24
+#endif
+
+#ifndef CONFIG_AUDIO_SI4713_RDS_POLL_MS
+#  define CONFIG_AUDIO_SI4713_RDS_POLL_MS 1000
+#endif
+
+#define RDS_BLOCKS_PER_GROUP    3
+
+/* Longest wait for the engine to finish the RDS commands on shutdown */
+#define RDS_STOP_TIMEOUT_MS     1000
+
+#define RDS_GROUP_0A            0x0
+#define RDS_GROUP_2A            0x2
+#define RDS_GROUP_4A            0x4
+
+#define RDS_PS_SEGS             (SI4713_RDS_PS_LEN / 2)
+#define RDS_RT_SEGS             (SI4713_RDS_RT_LEN / 4)
+
+#define RDS_AF_NONE             224     /* "no AF" / count base code */
+#define RDS_AF_FILLER           205
+#define RDS_AF_FREQ_BASE        8750    /* code 1 is 87.6 MHz */
+#define RDS_MJD_EPOCH           40587   /* MJD of 1970-01-01 */
+
+#define RDS_DI_STEREO           0x1
+
+/* Group table layout: one slot per segment */
+enum {
+    RDS_SLOT_PS = 0,
+    RDS_SLOT_RT = RDS_SLOT_PS + RDS_PS_SEGS,
+    RDS_SLOT_CT = RDS_SLOT_RT + RDS_RT_SEGS,
+    RDS_NSLOTS,
+    RDS_SLOT_NONE = 0xff,
+};
+
+enum {
+    RDS_CFG_GPO_IEN,
+    RDS_CFG_PI,
+    RDS_CFG_FIFO_SIZE,
+    RDS_CFG_INT_SOURCE,
+    RDS_CFG_COMPONENTS,
+    RDS_CFG_FLUSH,
+    RDS_CFG_COUNT,
+};
+
+struct rds_group_s {
+    uint16_t b;
+    uint16_t c;
+    uint16_t d;
+};
+
+struct rds_entry_s {
+    uint8_t slot;
+    struct rds_group_s grp;
+};
+
+struct si4713_rds_s {
+    struct si4713_dev_s *dev;
+    sem_t lock;                         /* serializes updates */
+
+    uint16_t pi;
+    uint8_t pty;
+    uint8_t di;
+    char ps[SI4713_RDS_PS_LEN];
+    char rt[SI4713_RDS_RT_LEN];
+    uint8_t rt_segs;
+    bool rt_ab;
+    uint8_t af[SI4713_RDS_MAX_AF + 1];  /* count code, then AF codes */
+    uint8_t naf;
+
+    struct rds_group_s groups[RDS_NSLOTS];
+
+    /* Scheduled groups, pre-encoded; protected by irqsave() */
+    struct rds_entry_s ring[CONFIG_AUDIO_SI4713_RDS_RING];
+    uint8_t head;
+    uint8_t count;
+    uint8_t next_ps;
+    uint8_t next_rt;
+    bool next_is_rt;
+
+    struct si4713_cmd_s cfg[RDS_CFG_COUNT];
+    struct si4713_cmd_s load[CONFIG_AUDIO_SI4713_RDS_BATCH];
+    uint8_t inflight;
+    uint8_t fifo_avail;
+    bool kick;
+    bool ready;
+    bool stopping;
+
+    struct wdog_s wdog;
+    struct si4713_rds_stats_s stats;
+};
+
+static void rds_load_done(struct si4713_cmd_s *cmd, int status);
+
+static uint16_t rds_block_b(struct si4713_rds_s *rds, uint8_t group,
+                            uint8_t low)
+{
+    return (group << 12) | ((rds->pty & 0x1f) << 5) | (low & 0x1f);
+}
+
+static void rds_encode_ps(struct si4713_rds_s *rds, int seg,
+                          struct rds_group_s *grp)
+{
+    int npairs = (rds->naf + 2) / 2;
+    int pair = seg % npairs;
+    uint8_t di = (rds->di >> (RDS_PS_SEGS - 1 - seg)) & 1;
+
+    /* Music, DI bit for this segment, segment address */
+    grp->b = rds_block_b(rds, RDS_GROUP_0A, (1 << 3) | (di << 2) | seg);
+
+    if (rds->naf) {
+        grp->c = rds->af[pair * 2] << 8;
+        grp->c |= pair * 2 + 1 <= rds->naf ? rds->af[pair * 2 + 1] :
+                                             RDS_AF_FILLER;
+    } else {
+        grp->c = (RDS_AF_NONE << 8) | RDS_AF_FILLER;
+    }
+
+    grp->d = ((uint8_t)rds->ps[seg * 2] << 8) |
+             (uint8_t)rds->ps[seg * 2 + 1];
+}
+
+static void rds_encode_rt(struct si4713_rds_s *rds, const char *text, int seg,
+                          struct rds_group_s *grp)
+{
+    const uint8_t *p = (const uint8_t *)&text[seg * 4];
+
+    grp->b = rds_block_b(rds, RDS_GROUP_2A, (rds->rt_ab << 4) | seg);
+    grp->c = (p[0] << 8) | p[1];
+    grp->d = (p[2] << 8) | p[3];
+}
+
+/* Next slot of the PS/RT interleave; called with interrupts disabled */
+static uint8_t rds_schedule(struct si4713_rds_s *rds)
+{
+    uint8_t slot;
+
+    if (rds->next_is_rt && rds->rt_segs) {
+        slot = RDS_SLOT_RT + rds->next_rt;
+        if (++rds->next_rt >= rds->rt_segs)
+            rds->next_rt = 0;
+    } else {
+        slot = RDS_SLOT_PS + rds->next_ps;
+        if (++rds->next_ps >= RDS_PS_SEGS)
+            rds->next_ps = 0;
+    }
+
+    rds->next_is_rt = !rds->next_is_rt;
+    return slot;
+}
+
+/* Called with interrupts disabled */
+static void rds_fill_ring(struct si4713_rds_s *rds)
+{
+    struct rds_entry_s *entry;
+    uint8_t slot;
+
+    while (rds->count < CONFIG_AUDIO_SI4713_RDS_RING) {
+        entry = &rds->ring[(rds->head + rds->count) %
+                           CONFIG_AUDIO_SI4713_RDS_RING];
+        slot = rds_schedule(rds);
+        entry->slot = slot;
+        entry->grp = rds->groups[slot];
+        rds->count++;
+    }
+}
+
+/* Called with interrupts disabled */
+static bool rds_pop(struct si4713_rds_s *rds, struct rds_group_s *grp)
+{
+    struct rds_entry_s *entry;
+
+    while (rds->count) {
+        entry = &rds->ring[rds->head];
+        rds->head = (rds->head + 1) % CONFIG_AUDIO_SI4713_RDS_RING;
+        rds->count--;
+
+        if (entry->slot != RDS_SLOT_NONE) {
+            *grp = entry->grp;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Store a re-encoded group and rewrite its queued copies. Called with
+ * interrupts disabled.
+ */
+static void rds_update_slot(struct si4713_rds_s *rds, uint8_t slot,
+                            const struct rds_group_s *grp)
+{
+    struct rds_entry_s *entry;
+    int i;
+
+    rds->groups[slot] = *grp;
+    rds->stats.groups_encoded++;
+
+    for (i = 0; i < rds->count; i++) {
+        entry = &rds->ring[(rds->head + i) % CONFIG_AUDIO_SI4713_RDS_RING];
+        if (entry->slot == slot) {
+            entry->grp = *grp;
+            rds->stats.groups_patched++;
+        }
+    }
+}
+
+static void rds_prep_load(struct si4713_cmd_s *cmd, uint8_t flags,
+                          const struct rds_group_s *grp)
+{
+    cmd->cmd = SI4713_TX_RDS_BUFF;
+    cmd->nargs = 7;
+    cmd->args[0] = SI4713_RDS_BUFF_FIFO | flags;
+    cmd->args[1] = grp ? grp->b >> 8 : 0;
+    cmd->args[2] = grp ? grp->b & 0xff : 0;
+    cmd->args[3] = grp ? grp->c >> 8 : 0;
+    cmd->args[4] = grp ? grp->c & 0xff : 0;
+    cmd->args[5] = grp ? grp->d >> 8 : 0;
+    cmd->args[6] = grp ? grp->d & 0xff : 0;
+    cmd->nresp = SI4713_RDS_BUFF_NRESP;
+    cmd->flags = 0;
+    cmd->callback = rds_load_done;
+}
+
+/*
+ * Queue up to n group loads as one batch. With n == 0, only query the FIFO
+ * state (and acknowledge RDSINT); the completion then sizes the next batch.
+ */
+static void rds_start_batch(struct si4713_rds_s *rds, int n)
+{
+    struct rds_group_s grp;
+    irqstate_t flags;
+    uint8_t ack = SI4713_RDS_BUFF_INTACK;
+    int i;
+
+    flags = irqsave();
+
+    if (!rds->ready || rds->stopping || rds->inflight) {
+        irqrestore(flags);
+        return;
+    }
+
+    rds->kick = false;
+
+    if (!n) {
+        rds_prep_load(&rds->load[0], ack, NULL);
+        rds->inflight = 1;
+    } else {
+        n = MIN(n, CONFIG_AUDIO_SI4713_RDS_BATCH);
+        for (i = 0; i < n; i++) {
+            if (!rds_pop(rds, &grp))
+                break;
+            rds_prep_load(&rds->load[i], SI4713_RDS_BUFF_LDBUFF | ack, &grp);
+            ack = 0;
+        }
+        rds->inflight = i;
+        rds_fill_ring(rds);
+    }
+
+    rds->stats.topups++;
+    n = rds->inflight;
+
+    irqrestore(flags);
+
+    /* The engine runs them in order, paced by CTS */
+    for (i = 0; i < n; i++) {
+        if (si4713_submit(rds->dev, &rds->load[i]))
+            rds_load_done(&rds->load[i], -EIO);
+    }
+}
+
+static void rds_load_done(struct si4713_cmd_s *cmd, int status)
+{
+    struct si4713_rds_s *rds = cmd->priv;
+    bool loaded = cmd->args[0] & SI4713_RDS_BUFF_LDBUFF;
+    bool first = cmd == &rds->load[0];
+    irqstate_t flags;
+    uint8_t avail;
+    bool kick;
+
+    if (status) {
+        rds->stats.load_errors++;
+        avail = 0;
+    } else {
+        avail = cmd->resp[SI4713_RDS_BUFF_FIFOAVAIL] / RDS_BLOCKS_PER_GROUP;
+        if (loaded)
+            rds->stats.groups_loaded++;
+
+        /* Only the group we just loaded is left: the FIFO had run dry */
+        if (first && loaded && cmd->resp[SI4713_RDS_BUFF_FIFOUSED] <=
+                               RDS_BLOCKS_PER_GROUP)
+            rds->stats.underruns++;
+    }
+
+    flags = irqsave();
+    rds->fifo_avail = avail;
+    if (--rds->inflight) {
+        irqrestore(flags);
+        return;
+    }
+    kick = rds->kick;
+    irqrestore(flags);
+
+    if (avail)
+        rds_start_batch(rds, avail);
+    else if (kick)
+        rds_start_batch(rds, 1);
+}
+
+/*
+ * A FIFO group went out (RDSINT with FIFOXMIT): at least one group fits,
+ * so load it right away along with the acknowledge.
+ */
+static void rds_event(void *priv, uint8_t status)
+{
+    struct si4713_rds_s *rds = priv;
+    irqstate_t flags;
+    bool busy;
+
+    if (!(status & SI4713_STATUS_RDSINT))
+        return;
+
+    /* A batch in flight picks this up when it completes */
+    flags = irqsave();
+    busy = rds->inflight != 0;
+    if (busy)
+        rds->kick = true;
+    irqrestore(flags);
+
+    if (!busy)
+        rds_start_batch(rds, 1);
+}
+
+/* Fallback for boards without the interrupt line, or a lost interrupt */
+static void rds_poll(int argc, uint32_t arg, ...)
+{
+    struct si4713_rds_s *rds = (struct si4713_rds_s *)arg;
+
+    if (rds->stopping)
+        return;
+
+    rds_start_batch(rds, 0);
+    wd_start(&rds->wdog, MSEC2TICK(CONFIG_AUDIO_SI4713_RDS_POLL_MS),
+             rds_poll, 1, (uint32_t)rds);
+}
+
+static void rds_cfg_done(struct si4713_cmd_s *cmd, int status)
+{
+    struct si4713_rds_s *rds = cmd->priv;
+
+    if (status)
+        lldbg("RDS setup cmd 0x%02x failed: %d\n", cmd->cmd, status);
+
+    if (cmd != &rds->cfg[RDS_CFG_COUNT - 1])
+        return;
+
+    rds->ready = true;
+    rds_start_batch(rds, 0);
+    wd_start(&rds->wdog, MSEC2TICK(CONFIG_AUDIO_SI4713_RDS_POLL_MS),
+             rds_poll, 1, (uint32_t)rds);
+}
+
+static void rds_lock(struct si4713_rds_s *rds)
+{
+    while (sem_wait(&rds->lock) != OK);
+}
+
+static void rds_unlock(struct si4713_rds_s *rds)
+{
+    sem_post(&rds->lock);
+}
+
+static void rds_reencode_ps(struct si4713_rds_s *rds, uint8_t mask)
+{
+    struct rds_group_s grp;
+    irqstate_t flags;
+    int seg;
+
+    for (seg = 0; seg < RDS_PS_SEGS; seg++) {
+        if (!(mask & (1 << seg)))
+            continue;
+
+        rds_encode_ps(rds, seg, &grp);
+        flags = irqsave();
+        rds_update_slot(rds, RDS_SLOT_PS + seg, &grp);
+        irqrestore(flags);
+    }
+}
+
+/**
+ * @brief Set the 8 character program service name
+ *
+ * Shorter names are padded with spaces. Only changed segments are
+ * re-encoded.
+ */
+int si4713_rds_set_ps(struct si4713_rds_s *rds, const char *ps)
+{
+    char text[SI4713_RDS_PS_LEN];
+    uint8_t mask = 0;
+    int len;
+    int seg;
+
+    if (!rds || !ps)
+        return -EINVAL;
+
+    len = strnlen(ps, SI4713_RDS_PS_LEN);
+    memset(text, ' ', sizeof(text));
+    memcpy(text, ps, len);
+
+    rds_lock(rds);
+
+    for (seg = 0; seg < RDS_PS_SEGS; seg++) {
+        if (memcmp(&text[seg * 2], &rds->ps[seg * 2], 2))
+            mask |= 1 << seg;
+    }
+
+    memcpy(rds->ps, text, sizeof(text));
+    rds_reencode_ps(rds, mask);
+
+    rds_unlock(rds);
+    return 0;
+}
+
+/**
+ * @brief Set the radio text
+ *
+ * Up to 64 characters; shorter texts are terminated with a carriage return.
+ * With clear set, the A/B flag toggles so receivers wipe their display and
+ * every segment is re-sent. Otherwise only the segments that differ from
+ * the current text are re-encoded, which is the cheap path for small edits.
+ */
+int si4713_rds_set_rt(struct si4713_rds_s *rds, const char *rt, bool clear)
+{
+    char text[SI4713_RDS_RT_LEN];
+    struct rds_group_s grp;
+    struct rds_entry_s *entry;
+    irqstate_t flags;
+    int len;
+    int segs;
+    int seg;
+    int i;
+
+    if (!rds || !rt)
+        return -EINVAL;
+
+    len = strnlen(rt, SI4713_RDS_RT_LEN);
+    memset(text, ' ', sizeof(text));
+    memcpy(text, rt, len);
+    if (len < SI4713_RDS_RT_LEN)
+        text[len++] = '\r';
+    segs = (len + 3) / 4;
+
+    rds_lock(rds);
+
+    if (clear)
+        rds->rt_ab = !rds->rt_ab;
+
+    for (seg = 0; seg < segs; seg++) {
+        if (!clear && seg < rds->rt_segs &&
+            !memcmp(&text[seg * 4], &rds->rt[seg * 4], 4))
+            continue;
+
+        rds_encode_rt(rds, text, seg, &grp);
+        flags = irqsave();
+        rds_update_slot(rds, RDS_SLOT_RT + seg, &grp);
+        irqrestore(flags);
+    }
+
+    flags = irqsave();
+
+    /* Segments past the new end must not go out anymore */
+    if (segs < rds->rt_segs) {
+        for (i = 0; i < rds->count; i++) {
+            entry = &rds->ring[(rds->head + i) %
+                               CONFIG_AUDIO_SI4713_RDS_RING];
+            if (entry->slot >= RDS_SLOT_RT + segs &&
+                entry->slot < RDS_SLOT_CT)
+                entry->slot = RDS_SLOT_NONE;
+        }
+    }
+
+    rds->rt_segs = segs;
+    if (rds->next_rt >= segs)
+        rds->next_rt = 0;
+
+    irqrestore(flags);
+
+    memcpy(rds->rt, text, sizeof(text));
+
+    rds_unlock(rds);
+    return 0;
+}
+
+/**
+ * @brief Set the alternative frequency list (method A)
+ *
+ * freqs are in 10 kHz units, 87.6 to 107.9 MHz on the 100 kHz raster. The
+ * list is carried in block C of the four PS groups, hence the limit of
+ * SI4713_RDS_MAX_AF entries. count == 0 clears the list.
+ */
+int si4713_rds_set_af(struct si4713_rds_s *rds, const uint16_t *freqs,
+                      int count)
+{
+    uint8_t af[SI4713_RDS_MAX_AF + 1];
+    int code;
+    int i;
+
+    if (!rds || count < 0 || count > SI4713_RDS_MAX_AF || (count && !freqs))
+        return -EINVAL;
+
+    af[0] = RDS_AF_NONE + count;
+    for (i = 0; i < count; i++) {
+        code = (freqs[i] - RDS_AF_FREQ_BASE) / 10;
+        if (freqs[i] % 10 || code < 1 || code >= RDS_AF_FILLER)
+            return -EINVAL;
+        af[i + 1] = code;
+    }
+
+    rds_lock(rds);
+
+    memcpy(rds->af, af, count + 1);
+    rds->naf = count;
+    rds_reencode_ps(rds, (1 << RDS_PS_SEGS) - 1);
+
+    rds_unlock(rds);
+    return 0;
+}
+
+/**
+ * @brief Send a clock time group
+ *
+ * utc is in seconds since the epoch, offset is the local time offset in
+ * half hours. The group is sent once, ahead of the scheduled groups, so
+ * call this at the start of each minute.
+ */
+int si4713_rds_set_ct(struct si4713_rds_s *rds, uint32_t utc, int8_t offset)
+{
+    struct rds_group_s grp;
+    struct rds_entry_s *entry;
+    irqstate_t flags;
+    uint32_t mjd;
+    uint32_t secs;
+    uint8_t hour;
+    uint8_t minute;
+
+    if (!rds)
+        return -EINVAL;
+
+    mjd = RDS_MJD_EPOCH + utc / 86400;
+    secs = utc % 86400;
+    hour = secs / 3600;
+    minute = (secs % 3600) / 60;
+
+    grp.b = rds_block_b(rds, RDS_GROUP_4A, (mjd >> 15) & 0x3);
+    grp.c = ((mjd & 0x7fff) << 1) | (hour >> 4);
+    grp.d = ((hour & 0xf) << 12) | (minute << 6) |
+            (offset < 0 ? 0x20 : 0) | (abs(offset) & 0x1f);
+
+    rds_lock(rds);
+
+    flags = irqsave();
+
+    rds->groups[RDS_SLOT_CT] = grp;
+    rds->stats.groups_encoded++;
+
+    /* Jump the queue, dropping the furthest scheduled group if full */
+    if (rds->count == CONFIG_AUDIO_SI4713_RDS_RING)
+        rds->count--;
+    rds->head = (rds->head + CONFIG_AUDIO_SI4713_RDS_RING - 1) %
+                CONFIG_AUDIO_SI4713_RDS_RING;
+    entry = &rds->ring[rds->head];
+    entry->slot = RDS_SLOT_CT;
+    entry->grp = grp;
+    rds->count++;
+
+    irqrestore(flags);
+
+    rds_unlock(rds);
+    return 0;
+}
+
+void si4713_rds_get_stats(struct si4713_rds_s *rds,
+                          struct si4713_rds_stats_s *stats)
+{
+    irqstate_t flags;
+
+    flags = irqsave();
+    memcpy(stats, &rds->stats, sizeof(*stats));
+    irqrestore(flags);
+}
+
+/**
+ * @brief Start RDS on a powered up Si4713
+ *
+ * The RDS setup is queued behind any pending commands, so this may be
+ * called right after queuing the power-up sequence. Groups start flowing
+ * once the setup has completed.
+ */
+struct si4713_rds_s *si4713_rds_initialize(struct si4713_dev_s *dev,
+                                           uint16_t pi, uint8_t pty)
+{
+    struct si4713_rds_s *rds;
+    struct si4713_cmd_s *cmd;
+    int i;
+
+    if (!dev)
+        return NULL;
+
+    rds = kmm_zalloc(sizeof(*rds));
+    if (!rds)
+        return NULL;
+
+    rds->dev = dev;
+    rds->pi = pi;
+    rds->pty = pty;
+    rds->di = RDS_DI_STEREO;
+    sem_init(&rds->lock, 0, 1);
+    wd_static(&rds->wdog);
+
+    memset(rds->ps, ' ', sizeof(rds->ps));
+    memset(rds->rt, ' ', sizeof(rds->rt));
+    rds_reencode_ps(rds, (1 << RDS_PS_SEGS) - 1);
+    rds_fill_ring(rds);
+
+    for (i = 0; i < CONFIG_AUDIO_SI4713_RDS_BATCH; i++)
+        rds->load[i].priv = rds;
+
+    si4713_prep_set_property(&rds->cfg[RDS_CFG_GPO_IEN], SI4713_PROP_GPO_IEN,
+                             SI4713_GPO_IEN_STCIEN | SI4713_GPO_IEN_CTSIEN |
+                             SI4713_GPO_IEN_RDSIEN);
+    si4713_prep_set_property(&rds->cfg[RDS_CFG_PI], SI4713_PROP_TX_RDS_PI,
+                             pi);
+    si4713_prep_set_property(&rds->cfg[RDS_CFG_FIFO_SIZE],
+                             SI4713_PROP_TX_RDS_FIFO_SIZE,
+                             CONFIG_AUDIO_SI4713_RDS_FIFO_BLOCKS);
+    si4713_prep_set_property(&rds->cfg[RDS_CFG_INT_SOURCE],
+                             SI4713_PROP_TX_RDS_INTERRUPT_SOURCE,
+                             SI4713_RDS_INT_FIFOXMIT);
+    si4713_prep_set_property(&rds->cfg[RDS_CFG_COMPONENTS],
+                             SI4713_PROP_TX_COMPONENT_ENABLE,
+                             SI4713_COMPONENT_PILOT | SI4713_COMPONENT_LMR |
+                             SI4713_COMPONENT_RDS);
+    rds_prep_load(&rds->cfg[RDS_CFG_FLUSH], SI4713_RDS_BUFF_MTBUFF |
+                  SI4713_RDS_BUFF_INTACK, NULL);
+
+    si4713_set_event_callback(dev, rds_event, rds);
+
+    for (i = 0; i < RDS_CFG_COUNT; i++) {
+        cmd = &rds->cfg[i];
+        cmd->callback = rds_cfg_done;
+        cmd->priv = rds;
+        si4713_submit(dev, cmd);
+    }
+
+    return rds;
+}
+
+void si4713_rds_uninitialize(struct si4713_rds_s *rds)
+{
+    bool busy = false;
+    int waited;
+    int i;
+
+    if (!rds)
+        return;
+
+    rds->stopping = true;
+    wd_cancel(&rds->wdog);
+    si4713_set_event_callback(rds->dev, NULL, NULL);
+
+    /* Command slots live in rds: wait for the engine to let go of them */
+    for (waited = 0; rds->inflight || !rds->ready; waited++) {
+        if (waited >= RDS_STOP_TIMEOUT_MS) {
+            lldbg("RDS commands stuck, cancelling\n");
+            for (i = 0; i < RDS_CFG_COUNT; i++)
+                busy |= si4713_cancel(rds->dev, &rds->cfg[i]) == -EBUSY;
+            for (i = 0; i < CONFIG_AUDIO_SI4713_RDS_BATCH; i++)
+                busy |= si4713_cancel(rds->dev, &rds->load[i]) == -EBUSY;
+            break;
+        }
+        usleep(1000);
+    }
+
+    wd_cancel(&rds->wdog);
+
+    /* The engine still owns a slot: leak rds rather than free it under it */
+    if (busy) {
+        lldbg("RDS command still active, not freeing\n");
+        return;
+    }
+
+    sem_destroy(&rds->lock);
+    kmm_free(rds);
+}
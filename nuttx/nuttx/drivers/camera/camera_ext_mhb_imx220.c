@@ -69,18 +69,8 @@ struct dev_private_s s_data;
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
-struct cam_i2c_reg_array {
-    const uint16_t reg_addr;
-    const uint8_t data;
-};
-
-struct cam_i2c_reg_setting {
-    const uint16_t size;
-    struct cam_i2c_reg_array const *regs;
-};
-
-static const struct cam_i2c_reg_array init_reg_array[] = {
-    { 0x0103, 0x01 },
+static const struct mhb_camera_reg init_reg_array[] = {
+    { 0x0103, 0x01, MHB_CAMERA_REG_BYTE, 1 }, /* reset, then wait 1 ms */
     /* External Clock Setting - 19.2 */
     { 0x011E, 0x13 },
     { 0x011F, 0x02 },
@@ -255,7 +245,7 @@ static const struct cam_i2c_reg_array init_reg_array[] = {
     { 0xAC3E, 0x70 },
 };
 
-static const struct cam_i2c_reg_array res_2624x1968_24fps_arrray[] = {
+static const struct mhb_camera_reg res_2624x1968_24fps_arrray[] = {
     /* V1/2 (4:3) 2624x1968 24fps  */
     /* Clock Setting */
     { 0x0301, 0x08 },
@@ -431,7 +421,7 @@ static const struct cam_i2c_reg_array res_2624x1968_24fps_arrray[] = {
     { 0x3522, 0x00 },
 };
 
-static const struct cam_i2c_reg_array res_5248x3936_12fps_array[] = {
+static const struct mhb_camera_reg res_5248x3936_12fps_array[] = {
     /* Full size 5248x3936 (4:3) 12fps */
     /* Clock Setting */
     { 0x0301, 0x08 },
@@ -608,7 +598,7 @@ static const struct cam_i2c_reg_array res_5248x3936_12fps_array[] = {
     { 0x3522, 0x00 },
 };
 
-static const struct cam_i2c_reg_array res_2624x1476_30fps_array[] = {
+static const struct mhb_camera_reg res_2624x1476_30fps_array[] = {
     /* V1/2 2624x1476 (16:9) 30fps  */
     /* Clock Setting */
     { 0x0301, 0x08 },
@@ -785,7 +775,7 @@ static const struct cam_i2c_reg_array res_2624x1476_30fps_array[] = {
     { 0x3522, 0x00 },
 };
 
-static const struct cam_i2c_reg_array res_3600x2024_24fps_arrays[] = {
+static const struct mhb_camera_reg res_3600x2024_24fps_arrays[] = {
     /* 4K UHDish (16:9) @ 24 fps */
     /* 3600 x 2024 */
     /* Clock Setting */
@@ -963,9 +953,31 @@ static const struct cam_i2c_reg_array res_3600x2024_24fps_arrays[] = {
     { 0x3522, 0x00 },
 };
 
-static const struct cam_i2c_reg_setting frmival_2624x1476_user_data = {
-    .size = ARRAY_SIZE(res_2624x1476_30fps_array),
-    .regs = res_2624x1476_30fps_array,
+/* sensor modes, diffed against each other at probe */
+enum {
+    MODE_2624x1476,
+    MODE_2624x1968,
+    MODE_3600x2024,
+    MODE_5248x3936,
+};
+
+static const struct mhb_camera_mode imx220_modes[] = {
+    [MODE_2624x1476] = {
+        .regs = res_2624x1476_30fps_array,
+        .count = ARRAY_SIZE(res_2624x1476_30fps_array),
+    },
+    [MODE_2624x1968] = {
+        .regs = res_2624x1968_24fps_arrray,
+        .count = ARRAY_SIZE(res_2624x1968_24fps_arrray),
+    },
+    [MODE_3600x2024] = {
+        .regs = res_3600x2024_24fps_arrays,
+        .count = ARRAY_SIZE(res_3600x2024_24fps_arrays),
+    },
+    [MODE_5248x3936] = {
+        .regs = res_5248x3936_12fps_array,
+        .count = ARRAY_SIZE(res_5248x3936_12fps_array),
+    },
 };
 
 //frame rate for 2624x1476 BGGR10
@@ -973,50 +985,35 @@ static const struct camera_ext_frmival_node frmival_2624x1476[] = {
     {
         .numerator = 1,
         .denominator = 30,
-        .user_data = &frmival_2624x1476_user_data,
+        .user_data = &imx220_modes[MODE_2624x1476],
     },
 };
 
-static const struct cam_i2c_reg_setting frmival_2624x1968_user_data = {
-    .size = ARRAY_SIZE(res_2624x1968_24fps_arrray),
-    .regs = res_2624x1968_24fps_arrray,
-};
-
 //frame rate for 2624x1968 BGGR10
 static const struct camera_ext_frmival_node frmival_2624x1968[] = {
     {
         .numerator = 1,
         .denominator = 24,
-        .user_data = &frmival_2624x1968_user_data,
+        .user_data = &imx220_modes[MODE_2624x1968],
     },
 };
 
-static const struct cam_i2c_reg_setting frmival_3600x2024_user_data = {
-    .size = ARRAY_SIZE(res_3600x2024_24fps_arrays),
-    .regs = res_3600x2024_24fps_arrays,
-};
-
 //frame rate for 3600x2024 BGGR10
 static const struct camera_ext_frmival_node frmival_3600x2024[] = {
 
     {
         .numerator = 1,
         .denominator = 24,
-        .user_data = &frmival_3600x2024_user_data,
+        .user_data = &imx220_modes[MODE_3600x2024],
     },
 };
 
-static const struct cam_i2c_reg_setting frmival_5248x3936_user_data = {
-    .size = ARRAY_SIZE(res_5248x3936_12fps_array),
-    .regs = res_5248x3936_12fps_array,
-};
-
 //frame rate for 5248x3936 BGGR10
 static const struct camera_ext_frmival_node frmival_5248x3936[] = {
     {
         .numerator = 1,
         .denominator = 12,
-        .user_data = &frmival_5248x3936_user_data,
+        .user_data = &imx220_modes[MODE_5248x3936],
     },
 };
 
@@ -1148,17 +1145,9 @@ int imx220_soc_enable(struct device *dev, uint8_t bootmode)
     usleep(CAMERA_POWER_DELAY_US);
 
     /* configure init registers */
-    size_t num = ARRAY_SIZE(init_reg_array);
-    int i;
-    int ret;
-    for (i = 0; i < num; i++) {
-        ret = mhb_camera_i2c_write_reg1_16(CAMERA_SENSOR_I2C_ADDR,
-                                        init_reg_array[i].reg_addr,
-                                        init_reg_array[i].data);
-        if (ret)
-            break;
-    }
-    return ret;
+    return mhb_camera_i2c_write_seq(CAMERA_SENSOR_I2C_ADDR, init_reg_array,
+                                    ARRAY_SIZE(init_reg_array),
+                                    MHB_CAMERA_REG_WIDTH_16, 0);
 }
 
 int imx220_soc_disable(struct device *dev)
@@ -1174,8 +1163,6 @@ int imx220_soc_disable(struct device *dev)
 
 int imx220_stream_configure(struct device *dev)
 {
-    int i;
-    int ret;
     const struct camera_ext_format_user_config *cfg = camera_ext_get_user_config();
     const struct camera_ext_frmival_node *ival;
 
@@ -1185,22 +1172,12 @@ int imx220_stream_configure(struct device *dev)
         return -1;
     }
 
-
-    const struct cam_i2c_reg_setting *udata = ival->user_data;
-    if (udata == NULL) {
+    if (ival->user_data == NULL) {
         CAM_ERR("Failed to get user data\n");
         return -1;
     }
 
-    for (i = 0; i < udata->size; i++) {
-        ret = mhb_camera_i2c_write_reg1_16(CAMERA_SENSOR_I2C_ADDR,
-                                        udata->regs[i].reg_addr,
-                                        udata->regs[i].data);
-        if (ret)
-            break;
-    }
-
-    return ret;
+    return mhb_camera_mode_set(ival->user_data);
 }
 
 int imx220_stream_enable(struct device *dev)
@@ -1261,6 +1238,8 @@ static int _dev_probe(struct device *dev)
     gpio_direction_out(s_data.dvdd_en, 0);
     gpio_direction_out(s_data.areg_en, 0);
 
+    mhb_camera_mode_register(CAMERA_SENSOR_I2C_ADDR, MHB_CAMERA_REG_WIDTH_16,
+                             imx220_modes, ARRAY_SIZE(imx220_modes));
     camera_ext_register_format_db(&mhb_camera_format_db);
     camera_ext_register_control_db(&mhb_camera_ctrl_db);
     init_metadata_task();
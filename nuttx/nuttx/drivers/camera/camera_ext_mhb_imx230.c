@@ -69,17 +69,7 @@ struct dev_private_s s_data;
 
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
-struct cam_i2c_reg_array {
-    const uint16_t reg_addr;
-    const uint8_t data;
-};
-
-struct cam_i2c_reg_setting {
-    const uint16_t size;
-    struct cam_i2c_reg_array const *regs;
-};
-
-static const struct cam_i2c_reg_array init_reg_array[] = {
+static const struct mhb_camera_reg init_reg_array[] = {
     /* External Clock Settings - 19.2*/
     { 0x0136, 0x13 },
     { 0x0137, 0x02 },
@@ -504,7 +494,7 @@ static const struct cam_i2c_reg_array init_reg_array[] = {
     { 0x3129, 0x01 },
 };
 
-static const struct cam_i2c_reg_array res0_array[] = {
+static const struct mhb_camera_reg res0_array[] = {
     /* Mode G1: 2136x1202 1080p 16:9 30 fps */
     /* Preset Settings*/
     { 0x9004, 0x00 },
@@ -626,7 +616,7 @@ static const struct cam_i2c_reg_array res0_array[] = {
 };
 
 #if 0  /* TODO: debug this resolution */
-static const struct cam_i2c_reg_array res1_array[] = {
+static const struct mhb_camera_reg res1_array[] = {
     /* Mode A1: 5344x4016 Full 24fps */
     /* Preset Settings*/
     { 0x9004, 0x00 },
@@ -748,9 +738,25 @@ static const struct cam_i2c_reg_array res1_array[] = {
 };
 #endif
 
-static const struct cam_i2c_reg_setting frmival_res0_user_data = {
-    .size = ARRAY_SIZE(res0_array),
-    .regs = res0_array,
+/* sensor modes, diffed against each other at probe */
+enum {
+    MODE_RES0,
+#if 0
+    MODE_RES1,
+#endif
+};
+
+static const struct mhb_camera_mode imx230_modes[] = {
+    [MODE_RES0] = {
+        .regs = res0_array,
+        .count = ARRAY_SIZE(res0_array),
+    },
+#if 0
+    [MODE_RES1] = {
+        .regs = res1_array,
+        .count = ARRAY_SIZE(res1_array),
+    },
+#endif
 };
 
 //frame rate for 2627x2008
@@ -758,22 +764,17 @@ static const struct camera_ext_frmival_node frmival_res0[] = {
     {
         .numerator = 1,
         .denominator = 30,
-        .user_data = &frmival_res0_user_data,
+        .user_data = &imx230_modes[MODE_RES0],
     },
 };
 
 #if 0
-static const struct cam_i2c_reg_setting frmival_res1_user_data = {
-    .size = ARRAY_SIZE(res1_array),
-    .regs = res1_array,
-};
-
 //frame rate for 5340 x 4016
 static const struct camera_ext_frmival_node frmival_res1[] = {
     {
         .numerator = 1,
         .denominator = 24,
-        .user_data = &frmival_res1_user_data,
+        .user_data = &imx230_modes[MODE_RES1],
     },
 };
 #endif
@@ -899,17 +900,9 @@ int imx230_soc_enable(struct device *dev, uint8_t bootmode)
     lldbg("Sensor ID: %02x %02x\n", id0, id1);
 
     /* configure init registers */
-    size_t num = ARRAY_SIZE(init_reg_array);
-    int i;
-    int ret;
-    for (i = 0; i < num; i++) {
-        ret = mhb_camera_i2c_write_reg1_16(CAMERA_SENSOR_I2C_ADDR,
-                                        init_reg_array[i].reg_addr,
-                                        init_reg_array[i].data);
-        if (ret)
-            break;
-    }
-    return ret;
+    return mhb_camera_i2c_write_seq(CAMERA_SENSOR_I2C_ADDR, init_reg_array,
+                                    ARRAY_SIZE(init_reg_array),
+                                    MHB_CAMERA_REG_WIDTH_16, 0);
 }
 
 int imx230_soc_disable(struct device *dev)
@@ -925,8 +918,6 @@ int imx230_soc_disable(struct device *dev)
 
 int imx230_stream_configure(struct device *dev)
 {
-    int i;
-    int ret;
     const struct camera_ext_format_user_config *cfg = camera_ext_get_user_config();
     const struct camera_ext_frmival_node *ival;
 
@@ -936,22 +927,12 @@ int imx230_stream_configure(struct device *dev)
         return -1;
     }
 
-
-    const struct cam_i2c_reg_setting *udata = ival->user_data;
-    if (udata == NULL) {
+    if (ival->user_data == NULL) {
         CAM_ERR("Failed to get user data\n");
         return -1;
     }
 
-    for (i = 0; i < udata->size; i++) {
-        ret = mhb_camera_i2c_write_reg1_16(CAMERA_SENSOR_I2C_ADDR,
-                                        udata->regs[i].reg_addr,
-                                        udata->regs[i].data);
-        if (ret)
-            break;
-    }
-
-    return ret;
+    return mhb_camera_mode_set(ival->user_data);
 }
 
 int imx230_stream_enable(struct device *dev)
@@ -1011,6 +992,8 @@ static int _dev_probe(struct device *dev)
     gpio_direction_out(s_data.dvdd_en, 0);
     gpio_direction_out(s_data.areg_en, 0);
 
+    mhb_camera_mode_register(CAMERA_SENSOR_I2C_ADDR, MHB_CAMERA_REG_WIDTH_16,
+                             imx230_modes, ARRAY_SIZE(imx230_modes));
     camera_ext_register_format_db(&mhb_camera_format_db);
     camera_ext_register_control_db(&mhb_camera_ctrl_db);
     init_metadata_task();
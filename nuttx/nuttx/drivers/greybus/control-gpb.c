@@ -243,6 +243,7 @@ static struct gb_operation_handler gb_control_handlers[] = {
 struct gb_driver control_driver = {
     .op_handlers = (struct gb_operation_handler*) gb_control_handlers,
     .op_handlers_count = ARRAY_SIZE(gb_control_handlers),
+    .tx_priority = GB_TX_PRIO_HIGH,
 };
 
 void gb_control_register(int cport)
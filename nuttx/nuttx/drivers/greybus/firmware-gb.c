@@ -34,6 +34,7 @@
 #include <arch/byteorder.h>
 #include <nuttx/bootmode.h>
 #include <nuttx/clock.h>
+#include <nuttx/fwunpack.h>
 #include <nuttx/progmem.h>
 #include <nuttx/greybus/debug.h>
 #include <nuttx/greybus/greybus.h>
@@ -106,6 +107,7 @@ struct gb_firmware_ready_to_boot_request {
 #define TFTF_SECTION_TYPE_MANIFEST        (0x0005)
 #define TFTF_SECTION_TYPE_SIGNATURE       (0x0006)
 #define TFTF_SECTION_TYPE_CERTIFICATE     (0x0007)
+#define TFTF_SECTION_TYPE_DELTA_CODE      (0x0008)
 #define TFTF_SECTION_TYPE_END             (0x00fe)
 
 struct section_descriptor {
@@ -172,6 +174,13 @@ static inline void dump_header(struct gb_firmware_tftf_header *hdr)
 
 #define GB_FIRMWARE_FLASH_DELAY_MS 1000
 
+/* Flash is programmed a double word at a time */
+#define GB_FIRMWARE_CHUNK_ALIGN    8
+
+#ifndef CONFIG_FIRMWARE_PIPELINE_DEPTH
+# define CONFIG_FIRMWARE_PIPELINE_DEPTH 1
+#endif
+
 #if !defined(CONFIG_SCHED_WORKQUEUE) || !defined(CONFIG_SCHED_LPWORK)
 # error  "requires low priority workqueue"
 #endif
@@ -183,6 +192,26 @@ struct gb_firmware_info {
     uint32_t firmware_size;
     struct work_s flash_work;
     struct work_s reset_work;
+#ifdef CONFIG_GREYBUS_FIRMWARE_UNPACK
+    struct gb_firmware_unpack *unpack;  /* NULL for raw code sections */
+#endif
+};
+
+#ifdef CONFIG_GREYBUS_FIRMWARE_UNPACK
+/* Compressed or delta code section being unpacked to flash */
+struct gb_firmware_unpack {
+    struct fwunpack_s state;
+    size_t load_address;
+    size_t image_size;
+    ssize_t erased_page;    /* last page erased before a delta block */
+};
+#endif
+
+/* Firmware chunk requested from the AP and where it goes in flash */
+struct gb_firmware_chunk {
+    struct gb_operation *operation;
+    uint32_t write_offset;
+    uint32_t size;
 };
 
 static struct gb_firmware_info *g_firmware_info = NULL;
@@ -313,6 +342,204 @@ static int gb_firmware_flash_chunk(size_t flash_address, uint8_t *data, size_t s
     return (int)err;
 }
 
+#ifdef CONFIG_GREYBUS_FIRMWARE_UNPACK
+static int gb_firmware_unpack_write(void *arg, uint32_t offset,
+                                    const uint8_t *buf, size_t len)
+{
+    struct gb_firmware_unpack *unpack = arg;
+    size_t address = unpack->load_address + offset;
+    ssize_t page;
+    ssize_t erased;
+
+    /*
+     * A delta image is built over the one being replaced, so its pages are
+     * only erased when reached. Erasing more than the block would destroy
+     * the base of blocks still to come.
+     */
+    if (unpack->state.type == FWUNPACK_DELTA) {
+        for (page = up_progmem_getpage(address);
+             page >= 0 && up_progmem_getaddress(page) < address + len;
+             page++) {
+            if (page <= unpack->erased_page)
+                continue;
+
+            if (up_progmem_getaddress(page) < address ||
+                (up_progmem_getaddress(page) + up_progmem_pagesize(page) >
+                     address + len &&
+                 offset + len < unpack->image_size)) {
+                gb_error("delta blocks smaller than flash pages\n");
+                return -EINVAL;
+            }
+
+            erased = up_progmem_erasepage(page);
+            if (erased != up_progmem_pagesize(page)) {
+                gb_error("failed to erase page %d err = %d\n", page, erased);
+                return erased < 0 ? erased : -EIO;
+            }
+
+            unpack->erased_page = page;
+        }
+    }
+
+    return gb_firmware_flash_chunk(address, (uint8_t *)buf, len);
+}
+
+static int gb_firmware_unpack_read(void *arg, uint32_t offset, uint8_t *buf,
+                                   size_t len)
+{
+    struct gb_firmware_unpack *unpack = arg;
+    size_t address = unpack->load_address + offset;
+
+    if (up_progmem_getpage(address + len - 1) < 0)
+        return -EINVAL;
+
+    /* flash is memory mapped */
+    memcpy(buf, (const void *)address, len);
+    return 0;
+}
+
+static const struct fwunpack_ops_s gb_firmware_unpack_ops = {
+    .write = gb_firmware_unpack_write,
+    .read = gb_firmware_unpack_read,
+};
+
+/* prepare the flash and the decoder for a compressed or delta section */
+static int gb_firmware_setup_unpack(size_t load_address, size_t image_size,
+                                    enum fwunpack_type_e type)
+{
+    struct gb_firmware_unpack *unpack;
+    int ret;
+
+    if (up_progmem_getpage(load_address) < 0 ||
+        up_progmem_getpage(load_address + image_size - 1) < 0) {
+        gb_error("attempt to flash invalid address 0x%08x\n", load_address);
+        return -EINVAL;
+    }
+
+    /* matches of a compressed image only reach back into the new image */
+    if (type == FWUNPACK_LZ4) {
+        ret = gb_firmware_setup_flash(load_address, image_size);
+        if (ret)
+            return ret;
+    }
+
+    unpack = zalloc(sizeof(*unpack));
+    if (!unpack)
+        return -ENOMEM;
+
+    unpack->load_address = load_address;
+    unpack->image_size = image_size;
+    unpack->erased_page = -1;
+
+    ret = fwunpack_init(&unpack->state, type, image_size,
+                        &gb_firmware_unpack_ops, unpack);
+    if (ret) {
+        free(unpack);
+        return ret;
+    }
+
+    g_firmware_info->unpack = unpack;
+    return 0;
+}
+#endif
+
+static void gb_firmware_chunk_callback(struct gb_operation *operation)
+{
+    sem_post(&operation->sync_sem);
+}
+
+/*
+ * Size of the next chunk to request. Trimmed down so the response fills the
+ * last packet of the transport instead of leaving it mostly empty.
+ */
+static uint32_t gb_firmware_chunk_size(size_t remaining)
+{
+    size_t size;
+
+    size = gb_fit_payload_size(g_firmware_info->chunk_size);
+    size &= ~(GB_FIRMWARE_CHUNK_ALIGN - 1);
+    if (!size)
+        size = g_firmware_info->chunk_size;
+
+    return MIN(size, remaining);
+}
+
+/* request a chunk without waiting for the response */
+static int gb_firmware_fetch_chunk(struct gb_firmware_chunk *chunk,
+        uint32_t fetch_offset, uint32_t write_offset, uint32_t size)
+{
+    struct gb_operation *operation;
+    struct gb_firmware_get_firmware_request *request;
+    int ret;
+
+    operation = gb_operation_create(g_firmware_info->cport,
+            GB_FIRMWARE_TYPE_GET_FIRMWARE, sizeof(*request));
+    if (!operation)
+        return -ENOMEM;
+
+    request = gb_operation_get_request_payload(operation);
+    request->offset = cpu_to_le32(fetch_offset);
+    request->size = cpu_to_le32(size);
+
+    sem_init(&operation->sync_sem, 0, 0);
+
+    ret = gb_operation_send_request(operation, gb_firmware_chunk_callback,
+                                    true);
+    if (ret) {
+        gb_error("failed to send firmware request\n");
+        gb_operation_destroy(operation);
+        return -EIO;
+    }
+
+    chunk->operation = operation;
+    chunk->write_offset = write_offset;
+    chunk->size = size;
+
+    return 0;
+}
+
+/* wait for a requested chunk and write it to flash */
+static int gb_firmware_flash_fetched(struct gb_firmware_chunk *chunk)
+{
+    struct gb_operation *operation = chunk->operation;
+    struct gb_firmware_get_firmware_response *response;
+    int ret;
+
+    do {
+        ret = sem_wait(&operation->sync_sem);
+    } while (ret < 0 && errno == EINTR);
+
+    chunk->operation = NULL;
+
+    if (!operation->response ||
+        gb_operation_get_response_result(operation) != GB_OP_SUCCESS ||
+        gb_operation_get_request_payload_size(operation->response) <
+            chunk->size) {
+        gb_error("No firmware received\n");
+        ret = -EIO;
+        goto out;
+    }
+
+    response = gb_operation_get_request_payload(operation->response);
+
+#ifdef CONFIG_GREYBUS_FIRMWARE_UNPACK
+    if (g_firmware_info->unpack)
+        ret = fwunpack_feed(&g_firmware_info->unpack->state, response->data,
+                            chunk->size);
+    else
+#endif
+    ret = gb_firmware_flash_chunk(chunk->write_offset, response->data,
+                                  chunk->size);
+    if (ret) {
+        /* well this isn't good!  what can we really do */
+        gb_error("FLASHING FAILED!!!\n")
+    }
+
+out:
+    gb_operation_destroy(operation);
+    return ret;
+}
+
 static int gb_firmware_get_header(
         size_t firmware_size,
         struct gb_firmware_tftf_header *hdr)
@@ -373,10 +600,17 @@ out:
 
 static int gb_firmware_get_firmware(size_t size)
 {
-    struct gb_operation *operation;
-    struct gb_firmware_get_firmware_request *request;
-    struct gb_firmware_get_firmware_response *response;
+    struct gb_firmware_chunk chunks[CONFIG_FIRMWARE_PIPELINE_DEPTH];
+    struct gb_firmware_chunk *chunk;
+    unsigned int issued = 0;
+    unsigned int flashed = 0;
+    uint32_t chunk_size;
+    ssize_t to_fetch;
     ssize_t remaining;
+#ifdef CONFIG_GREYBUS_FIRMWARE_UNPACK
+    size_t image_size = 0;
+    enum fwunpack_type_e unpack_type = FWUNPACK_LZ4;
+#endif
     uint32_t fetch_offset;
     uint32_t write_offset;
     struct gb_firmware_tftf_header *hdr;
@@ -408,6 +642,17 @@ static int gb_firmware_get_firmware(size_t size)
                 remaining = hdr->desc[section].section_length;
                 found_code_section = true;
                 break;
+#ifdef CONFIG_GREYBUS_FIRMWARE_UNPACK
+            } else if (section_type == TFTF_SECTION_TYPE_COMPRESSED_CODE ||
+                       section_type == TFTF_SECTION_TYPE_DELTA_CODE) {
+                write_offset = hdr->desc[section].section_load_address;
+                remaining = hdr->desc[section].section_length;
+                image_size = hdr->desc[section].section_expanded_length;
+                unpack_type = (section_type == TFTF_SECTION_TYPE_DELTA_CODE) ?
+                        FWUNPACK_DELTA : FWUNPACK_LZ4;
+                found_code_section = true;
+                break;
+#endif
             } else {
                 fetch_offset += hdr->desc[section].section_length;
             }
@@ -431,61 +676,68 @@ static int gb_firmware_get_firmware(size_t size)
         goto out;
     }
 
-    /* erase program memory */
-    ret = gb_firmware_setup_flash(write_offset, remaining);
-    if (ret)
-        goto out;
+#ifdef CONFIG_GREYBUS_FIRMWARE_UNPACK
+    if (image_size) {
+        ret = gb_firmware_setup_unpack(write_offset, image_size, unpack_type);
+        if (ret)
+            goto out;
+    } else
+#endif
+    {
+        /* erase program memory */
+        ret = gb_firmware_setup_flash(write_offset, remaining);
+        if (ret)
+            goto out;
+    }
 
+    /*
+     * Keep up to CONFIG_FIRMWARE_PIPELINE_DEPTH chunks in flight and program
+     * each one, in order, while the next ones are still being transferred.
+     * The responses of the requests in flight are the ring of chunk buffers.
+     */
+    to_fetch = remaining;
     while (remaining > 0) {
-        operation = gb_operation_create(g_firmware_info->cport,
-                GB_FIRMWARE_TYPE_GET_FIRMWARE, sizeof(*request));
-        if (!operation) {
-            ret = -ENOMEM;
-            break;
-        }
-
-        request = gb_operation_get_request_payload(operation);
-        if (!request) {
-            gb_operation_destroy(operation);
-            ret = -EIO;
-            break;
-        }
-
-        request->offset = fetch_offset;
-        request->size = MIN(g_firmware_info->chunk_size, remaining);
+        while (issued - flashed < CONFIG_FIRMWARE_PIPELINE_DEPTH &&
+               to_fetch > 0) {
+            chunk_size = gb_firmware_chunk_size(to_fetch);
+
+            ret = gb_firmware_fetch_chunk(
+                    &chunks[issued % CONFIG_FIRMWARE_PIPELINE_DEPTH],
+                    fetch_offset, write_offset, chunk_size);
+            if (ret)
+                break;
 
-        ret = gb_operation_send_request_sync(operation);
-        if (ret != GB_OP_SUCCESS) {
-            gb_error("failed to send firmware request\n");
-            gb_operation_destroy(operation);
-            ret = -EIO;
-            break;
+            fetch_offset += chunk_size;
+            write_offset += chunk_size;
+            to_fetch -= chunk_size;
+            issued++;
         }
 
-        if (!operation->response) {
-            gb_error("No firmware received\n");
-            gb_operation_destroy(operation);
-            ret = -EIO;
+        if (ret)
             break;
-        }
-
-        response = gb_operation_get_request_payload(operation->response);
 
-        ret = gb_firmware_flash_chunk(write_offset, response->data, request->size);
-        if (ret) {
-            /* well this isn't good!  what can we really do */
-            gb_error("FLASHING FAILED!!!\n")
-            gb_operation_destroy(operation);
+        chunk = &chunks[flashed++ % CONFIG_FIRMWARE_PIPELINE_DEPTH];
+        ret = gb_firmware_flash_fetched(chunk);
+        if (ret)
             break;
-        }
 
-        fetch_offset += request->size;
-        write_offset += request->size;
-        remaining -= request->size;
+        remaining -= chunk->size;
         gb_debug("remaining bytes = %d\n", remaining);
+    }
 
-        gb_operation_destroy(operation);
+    /* give up on the chunks still in flight after a failure */
+    while (flashed != issued)
+        gb_operation_destroy(
+                chunks[flashed++ % CONFIG_FIRMWARE_PIPELINE_DEPTH].operation);
+
+#ifdef CONFIG_GREYBUS_FIRMWARE_UNPACK
+    if (g_firmware_info->unpack) {
+        if (!ret)
+            ret = fwunpack_finish(&g_firmware_info->unpack->state);
+        free(g_firmware_info->unpack);
+        g_firmware_info->unpack = NULL;
     }
+#endif
 
     if (!ret) {
         ret = gb_bootmode_set(BOOTMODE_NORMAL);
@@ -328,15 +328,15 @@ static struct gb_operation_handler gb_gpio_handlers[] = {
     GB_HANDLER(GB_GPIO_TYPE_LINE_COUNT, gb_gpio_line_count),
     GB_HANDLER(GB_GPIO_TYPE_ACTIVATE, gb_gpio_activate),
     GB_HANDLER(GB_GPIO_TYPE_DEACTIVATE, gb_gpio_deactivate),
-    GB_HANDLER(GB_GPIO_TYPE_GET_DIRECTION, gb_gpio_get_direction),
-    GB_HANDLER(GB_GPIO_TYPE_DIRECTION_IN, gb_gpio_direction_in),
-    GB_HANDLER(GB_GPIO_TYPE_DIRECTION_OUT, gb_gpio_direction_out),
-    GB_HANDLER(GB_GPIO_TYPE_GET_VALUE, gb_gpio_get_value),
-    GB_HANDLER(GB_GPIO_TYPE_SET_VALUE, gb_gpio_set_value),
+    GB_INLINE_HANDLER(GB_GPIO_TYPE_GET_DIRECTION, gb_gpio_get_direction),
+    GB_INLINE_HANDLER(GB_GPIO_TYPE_DIRECTION_IN, gb_gpio_direction_in),
+    GB_INLINE_HANDLER(GB_GPIO_TYPE_DIRECTION_OUT, gb_gpio_direction_out),
+    GB_INLINE_HANDLER(GB_GPIO_TYPE_GET_VALUE, gb_gpio_get_value),
+    GB_INLINE_HANDLER(GB_GPIO_TYPE_SET_VALUE, gb_gpio_set_value),
     GB_HANDLER(GB_GPIO_TYPE_SET_DEBOUNCE, gb_gpio_set_debounce),
     GB_HANDLER(GB_GPIO_TYPE_IRQ_TYPE, gb_gpio_irq_type),
-    GB_HANDLER(GB_GPIO_TYPE_IRQ_MASK, gb_gpio_irq_mask),
-    GB_HANDLER(GB_GPIO_TYPE_IRQ_UNMASK, gb_gpio_irq_unmask),
+    GB_INLINE_HANDLER(GB_GPIO_TYPE_IRQ_MASK, gb_gpio_irq_mask),
+    GB_INLINE_HANDLER(GB_GPIO_TYPE_IRQ_UNMASK, gb_gpio_irq_unmask),
 };
 
 struct gb_driver gpio_driver = {
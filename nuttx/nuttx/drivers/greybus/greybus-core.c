@@ -29,12 +29,16 @@
  */
 
 #include <nuttx/config.h>
+#include <nuttx/arch.h>
+#include <nuttx/clock.h>
 #include <nuttx/list.h>
 #include <nuttx/unipro/unipro.h>
 #include <nuttx/greybus/greybus.h>
 #include <nuttx/greybus/tape.h>
 #include <nuttx/greybus/debug.h>
 #include <nuttx/greybus/mods-ctrl.h>
+#include <nuttx/greybus/pool.h>
+#include <nuttx/hires_tmr.h>
 #include <nuttx/wdog.h>
 #include <loopback-gb.h>
 
@@ -44,30 +48,99 @@
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
+#include <unistd.h>
 
 #include "rtr.h"
 
+#ifndef CONFIG_GREYBUS_PENDING_REQUESTS
+#define CONFIG_GREYBUS_PENDING_REQUESTS     64
+#endif
+
+#ifndef CONFIG_GREYBUS_TIMER_WHEEL_SLOTS
+#define CONFIG_GREYBUS_TIMER_WHEEL_SLOTS    32
+#endif
+
+#ifndef CONFIG_GREYBUS_TIMER_WHEEL_MS
+#define CONFIG_GREYBUS_TIMER_WHEEL_MS       10
+#endif
+
+#ifndef CONFIG_GREYBUS_INLINE_RESPONSE_SIZE
+#define CONFIG_GREYBUS_INLINE_RESPONSE_SIZE 32
+#endif
+
+#ifndef CONFIG_GREYBUS_INLINE_MAX_US
+#define CONFIG_GREYBUS_INLINE_MAX_US        200
+#endif
+
+#if CONFIG_GREYBUS_PENDING_REQUESTS & (CONFIG_GREYBUS_PENDING_REQUESTS - 1)
+#error CONFIG_GREYBUS_PENDING_REQUESTS must be a power of two
+#endif
+
+#if CONFIG_GREYBUS_TIMER_WHEEL_SLOTS & (CONFIG_GREYBUS_TIMER_WHEEL_SLOTS - 1)
+#error CONFIG_GREYBUS_TIMER_WHEEL_SLOTS must be a power of two
+#endif
+
 #define DEFAULT_STACK_SIZE      CONFIG_PTHREAD_STACK_DEFAULT
 #define TIMEOUT_IN_MS           1000
 #define GB_INVALID_TYPE         0
 
-#define ONE_SEC_IN_MSEC         1000
-#define ONE_MSEC_IN_NSEC        1000000
+#ifdef CONFIG_GREYBUS_POOL
+#define gb_operation_zalloc()   gb_pool_alloc_operation()
+#define gb_operation_free(op)   gb_pool_free(op)
+#else
+#define gb_operation_zalloc()   zalloc(sizeof(struct gb_operation))
+#define gb_operation_free(op)   free(op)
+#endif
 
-#define TIMEOUT_WD_DELAY    (TIMEOUT_IN_MS * CLOCKS_PER_SEC) / ONE_SEC_IN_MSEC
+#define GB_PENDING_MASK         (CONFIG_GREYBUS_PENDING_REQUESTS - 1)
+#define GB_WHEEL_MASK           (CONFIG_GREYBUS_TIMER_WHEEL_SLOTS - 1)
+#define GB_WHEEL_DELAY \
+    (MSEC2TICK(CONFIG_GREYBUS_TIMER_WHEEL_MS) > 0 ? \
+     MSEC2TICK(CONFIG_GREYBUS_TIMER_WHEEL_MS) : 1)
 
 struct gb_cport_driver {
     struct gb_driver *driver;
-    struct list_head tx_fifo;
+    struct list_head expired;   /* timed out requests to complete */
     struct list_head rx_fifo;
     sem_t rx_fifo_lock;
     pthread_t thread;
     volatile bool exit_worker;
-    struct wdog_s timeout_wd;
     struct gb_operation timedout_operation;
     uint16_t cport;
+    enum gb_tx_priority tx_priority;
+#ifdef CONFIG_GREYBUS_STATS
+    struct gb_cport_stats stats;
+#endif
+#ifdef CONFIG_GREYBUS_INLINE_HANDLERS
+    uint16_t pending;           /* messages queued or being handled */
+    uint32_t inline_off;        /* handlers demoted to the queued path */
+#endif
+#ifdef CONFIG_GREYBUS_DISPATCH_POOL
+    struct list_head ready;     /* node in a dispatcher ready list */
+    bool scheduled;             /* ready or being handled by a dispatcher */
+    bool dedicated;             /* driver needs its own thread */
+#endif
+};
+
+#ifdef CONFIG_GREYBUS_DISPATCH_POOL
+/*
+ * Shared dispatcher pool. A CPort with pending messages is queued on the
+ * ready list of its home dispatcher (cport % threads). A dispatcher serves
+ * its own list first and steals the oldest pending CPort of another one
+ * when it runs dry. A CPort is only ever on one list or in one dispatcher
+ * at a time, so its messages are still handled one by one, in order.
+ */
+struct gb_dispatcher {
+    pthread_t thread;
+    struct list_head ready;
 };
 
+static struct gb_dispatcher gb_dispatchers[CONFIG_GREYBUS_DISPATCH_THREADS];
+static sem_t gb_dispatch_sem;
+static volatile bool gb_dispatch_exit;
+static int gb_dispatch_threads;
+#endif
+
 struct gb_tape_record_header {
     uint16_t size;
     uint16_t cport;
@@ -75,6 +148,23 @@ struct gb_tape_record_header {
 
 static atomic_t request_id;
 
+/*
+ * Requests waiting for a response. An id is only handed out if its slot is
+ * free, so a response is matched with a single lookup.
+ */
+static struct gb_operation *gb_pending[CONFIG_GREYBUS_PENDING_REQUESTS];
+
+/*
+ * Hashed timer wheel of the pending requests. The wheel moves by one slot
+ * every GB_WHEEL_DELAY ticks, only while requests are pending. A request
+ * is linked in the slot of its deadline and expires when the wheel gets
+ * there on the right turn, so timeouts longer than a turn work as well.
+ */
+static struct list_head gb_wheel[CONFIG_GREYBUS_TIMER_WHEEL_SLOTS];
+static struct wdog_s gb_wheel_wd;
+static uint32_t gb_wheel_now;
+static unsigned int gb_wheel_count;
+
 static void **cport_tbl;
 
 static struct gb_cport_driver *_g_cport(unsigned int cport)
@@ -98,6 +188,10 @@ static struct gb_tape_mechanism *gb_tape;
 static int gb_tape_fd = -EBADFD;
 static struct gb_operation_hdr *timedout_hdr;
 static struct gb_operation_hdr *oom_hdr;
+#ifdef CONFIG_GREYBUS_INLINE_HANDLERS
+static void *gb_inline_resp;    /* response buffer of inline handlers */
+static bool gb_inline_busy;
+#endif
 
 static void g_cport_add_entry(uint16_t cport, struct gb_driver *driver)
 {
@@ -106,12 +200,14 @@ static void g_cport_add_entry(uint16_t cport, struct gb_driver *driver)
     if (entry) {
         sem_init(&entry->rx_fifo_lock, 0, 0);
         list_init(&entry->rx_fifo);
-        list_init(&entry->tx_fifo);
-        wd_static(&entry->timeout_wd);
+        list_init(&entry->expired);
         entry->timedout_operation.request_buffer = timedout_hdr;
         list_init(&entry->timedout_operation.list);
         entry->driver = driver;
         entry->cport = cport;
+#ifdef CONFIG_GREYBUS_DISPATCH_POOL
+        list_init(&entry->ready);
+#endif
 
         rtr_add_value(cport_tbl, cport, (void *)entry);
     }
@@ -127,9 +223,111 @@ static inline void g_cport_remove_entry(uint16_t cport)
 	}
 }
 
-static void gb_operation_timeout(int argc, uint32_t cport, ...);
+static void gb_cport_kick(struct gb_cport_driver *entry);
 static struct gb_operation *_gb_operation_create(unsigned int cport);
 
+#ifdef CONFIG_GREYBUS_STATS
+static void gb_stats_rx(struct gb_cport_driver *entry, size_t size,
+                        bool dropped)
+{
+    irqstate_t flags = irqsave();
+
+    entry->stats.rx_msgs++;
+    entry->stats.rx_bytes += size;
+    if (dropped)
+        entry->stats.rx_drops++;
+    irqrestore(flags);
+}
+
+static void gb_stats_tx(unsigned int cport, size_t size, int retval)
+{
+    struct gb_cport_driver *entry = _g_cport(cport);
+    irqstate_t flags;
+
+    if (!entry)
+        return;
+
+    flags = irqsave();
+    if (retval) {
+        entry->stats.tx_errors++;
+    } else {
+        entry->stats.tx_msgs++;
+        entry->stats.tx_bytes += size;
+    }
+    irqrestore(flags);
+}
+
+/* Must be called with interrupts disabled */
+static void gb_stats_enqueue(struct gb_cport_driver *entry)
+{
+    if (++entry->stats.rx_queue_depth > entry->stats.rx_queue_hwm)
+        entry->stats.rx_queue_hwm = entry->stats.rx_queue_depth;
+}
+
+/* Must be called with interrupts disabled */
+static void gb_stats_dequeue(struct gb_cport_driver *entry)
+{
+    entry->stats.rx_queue_depth--;
+}
+
+#ifdef CONFIG_ARCH_HAVE_HIRES_TIMER
+static unsigned int gb_stats_bucket(uint32_t us)
+{
+    unsigned int bucket = us ? 32 - __builtin_clz(us) : 0;
+
+    return bucket < GB_STATS_HIST_BUCKETS ? bucket : GB_STATS_HIST_BUCKETS - 1;
+}
+
+static void gb_stats_handled(unsigned int cport, uint32_t start_us,
+                             uint32_t recv_us)
+{
+    struct gb_cport_driver *entry = _g_cport(cport);
+    uint32_t now = hrt_getusec();
+    uint32_t handler_us = now - start_us;
+    irqstate_t flags;
+
+    flags = irqsave();
+    entry->stats.handler_hist[gb_stats_bucket(handler_us)]++;
+    entry->stats.latency_hist[gb_stats_bucket(now - recv_us)]++;
+    if (handler_us > entry->stats.handler_max_us)
+        entry->stats.handler_max_us = handler_us;
+    irqrestore(flags);
+}
+
+#define gb_stats_now()  hrt_getusec()
+#else
+/* Without a high resolution timer, the timing fields stay at 0 */
+#define gb_stats_handled(cport, start_us, recv_us) ((void)(start_us))
+#define gb_stats_now()  0
+#endif
+
+#define gb_stats_inc(entry, counter) ((entry)->stats.counter++)
+#else
+#define gb_stats_rx(entry, size, dropped)
+#define gb_stats_tx(cport, size, retval)
+#define gb_stats_enqueue(entry)
+#define gb_stats_dequeue(entry)
+#define gb_stats_handled(cport, start_us, recv_us) ((void)(start_us))
+#define gb_stats_inc(entry, counter)
+#define gb_stats_now()  0
+#endif
+
+#ifdef CONFIG_GREYBUS_INLINE_HANDLERS
+/* Must be called with interrupts disabled */
+#define gb_inline_hold(entry)   ((entry)->pending++)
+
+static void gb_inline_release(struct gb_cport_driver *entry)
+{
+    irqstate_t flags = irqsave();
+
+    entry->pending--;
+    irqrestore(flags);
+}
+#else
+#define gb_inline_hold(entry)
+#define gb_inline_release(entry)
+#endif
+
 uint8_t gb_errno_to_op_result(int err)
 {
     switch (err) {
@@ -234,6 +432,7 @@ static void gb_process_request(struct gb_operation_hdr *hdr,
                                struct gb_operation *operation)
 {
     struct gb_operation_handler *op_handler;
+    uint32_t start_us;
     uint8_t result;
 
     op_handler = find_operation_handler(hdr->type, operation->cport);
@@ -244,75 +443,136 @@ static void gb_process_request(struct gb_operation_hdr *hdr,
         return;
     }
 
+    start_us = gb_stats_now();
     result = op_handler->handler(operation);
     gb_debug("%s: %u\n", gb_handler_name(op_handler), result);
 
     if (hdr->id)
         gb_operation_send_response(operation, result);
     op_mark_send_time(operation);
+    gb_stats_handled(operation->cport, start_us, operation->recv_us);
 }
 
-static bool gb_operation_has_timedout(struct gb_operation *operation)
+/*
+ * Take a request out of the pending table and of the timer wheel. Must be
+ * called with interrupts disabled.
+ */
+static void gb_pending_del(struct gb_operation *operation)
 {
-    struct timespec current_time;
-    struct timespec timeout_time;
+    struct gb_operation_hdr *hdr = operation->request_buffer;
 
-    timeout_time.tv_sec = operation->time.tv_sec +
-                          TIMEOUT_IN_MS / ONE_SEC_IN_MSEC;
-    timeout_time.tv_nsec = operation->time.tv_nsec +
-                          (TIMEOUT_IN_MS % ONE_SEC_IN_MSEC) * ONE_MSEC_IN_NSEC;
-    clock_gettime(CLOCK_MONOTONIC, &current_time);
+    gb_pending[le16_to_cpu(hdr->id) & GB_PENDING_MASK] = NULL;
+    list_del(&operation->list);
 
-    if (current_time.tv_sec > timeout_time.tv_sec)
-        return true;
+    if (--gb_wheel_count == 0)
+        wd_cancel(&gb_wheel_wd);
+}
 
-    if (current_time.tv_sec < timeout_time.tv_sec)
-        return false;
+/*
+ * Hand the timed out requests of a CPort to its worker. Must be called with
+ * interrupts disabled.
+ */
+static void gb_cport_timeout(struct gb_cport_driver *entry)
+{
+    /* timedout operation could potentially already been queued */
+    if (!list_is_empty(&entry->timedout_operation.list))
+        return;
 
-    return current_time.tv_nsec > timeout_time.tv_nsec;
+    list_add(&entry->rx_fifo, &entry->timedout_operation.list);
+    gb_stats_enqueue(entry);
+    gb_inline_hold(entry);
+    gb_cport_kick(entry);
 }
 
-/**
- * Update watchdog state
- *
- * Cancel cport watchdog if there is no outgoing message waiting for a response,
- * or update the watchdog if there is still outgoing messages.
- *
- * TODO use fine-grain timeout delay when doing the update
- *
- * @note This function should be called from an atomic context
- */
-static void gb_watchdog_update(unsigned int cport)
+static void gb_wheel_tick(int argc, uint32_t arg, ...)
 {
+    struct list_head *iter, *iter_next;
+    struct gb_cport_driver *entry;
+    struct gb_operation *op;
     irqstate_t flags;
 
     flags = irqsave();
 
-    if (list_is_empty(&g_cport(cport).tx_fifo)) {
-        wd_cancel(&g_cport(cport).timeout_wd);
-    } else {
-        wd_start(&g_cport(cport).timeout_wd, TIMEOUT_WD_DELAY,
-                 gb_operation_timeout, 1, cport);
+    gb_wheel_now++;
+
+    list_foreach_safe(&gb_wheel[gb_wheel_now & GB_WHEEL_MASK],
+                      iter, iter_next) {
+        op = list_entry(iter, struct gb_operation, list);
+
+        /* Not on this turn of the wheel */
+        if (op->expires != gb_wheel_now)
+            continue;
+
+        gb_pending_del(op);
+
+        entry = _g_cport(op->cport);
+        gb_stats_inc(entry, timeouts);
+        list_add(&entry->expired, &op->list);
+        gb_cport_timeout(entry);
     }
 
+    if (gb_wheel_count)
+        wd_start(&gb_wheel_wd, GB_WHEEL_DELAY, gb_wheel_tick, 0);
+
     irqrestore(flags);
 }
 
+/*
+ * Give a request an id with a free pending slot and arm its timeout. Must
+ * be called with interrupts disabled.
+ */
+static int gb_pending_add(struct gb_operation *operation,
+                          unsigned int timeout_ms)
+{
+    struct gb_operation_hdr *hdr = operation->request_buffer;
+    uint32_t slots;
+    uint16_t id;
+    int i;
+
+    for (i = 0; i < CONFIG_GREYBUS_PENDING_REQUESTS; i++) {
+        id = atomic_inc(&request_id);
+        if (id == 0) /* ID 0 is for request with no response */
+            id = atomic_inc(&request_id);
+
+        if (!gb_pending[id & GB_PENDING_MASK])
+            break;
+    }
+
+    if (i == CONFIG_GREYBUS_PENDING_REQUESTS)
+        return -EBUSY;
+
+    hdr->id = cpu_to_le16(id);
+    gb_pending[id & GB_PENDING_MASK] = operation;
+
+    /*
+     * Round up, plus one slot as the wheel may be about to move: a request
+     * never times out early.
+     */
+    slots = (MSEC2TICK(timeout_ms) + GB_WHEEL_DELAY - 1) / GB_WHEEL_DELAY;
+    operation->expires = gb_wheel_now + slots + 1;
+    list_add(&gb_wheel[operation->expires & GB_WHEEL_MASK], &operation->list);
+
+    if (gb_wheel_count++ == 0)
+        wd_start(&gb_wheel_wd, GB_WHEEL_DELAY, gb_wheel_tick, 0);
+
+    return 0;
+}
+
 static void gb_clean_timedout_operation(unsigned int cport)
 {
+    struct gb_cport_driver *entry = _g_cport(cport);
     irqstate_t flags;
-    struct list_head *iter, *iter_next;
     struct gb_operation *op;
 
-    list_foreach_safe(&g_cport(cport).tx_fifo, iter, iter_next) {
-        op = list_entry(iter, struct gb_operation, list);
-
-        if (!gb_operation_has_timedout(op)) {
-            continue;
+    while (1) {
+        flags = irqsave();
+        if (list_is_empty(&entry->expired)) {
+            irqrestore(flags);
+            break;
         }
 
-        flags = irqsave();
-        list_del(iter);
+        op = list_entry(entry->expired.next, struct gb_operation, list);
+        list_del(&op->list);
         irqrestore(flags);
 
         if (op->callback) {
@@ -320,42 +580,58 @@ static void gb_clean_timedout_operation(unsigned int cport)
         }
         gb_operation_unref(op);
     }
-
-    gb_watchdog_update(cport);
 }
 
 static void gb_process_response(struct gb_operation_hdr *hdr,
                                 struct gb_operation *operation)
 {
     irqstate_t flags;
-    struct list_head *iter, *iter_next;
     struct gb_operation *op;
     struct gb_operation_hdr *op_hdr;
 
-    list_foreach_safe(&g_cport(operation->cport).tx_fifo, iter, iter_next) {
-        op = list_entry(iter, struct gb_operation, list);
+    flags = irqsave();
+
+    op = gb_pending[le16_to_cpu(hdr->id) & GB_PENDING_MASK];
+    if (op) {
         op_hdr = op->request_buffer;
+        if (op->cport == operation->cport && op_hdr->id == hdr->id)
+            gb_pending_del(op);
+        else
+            op = NULL;
+    }
 
-        if (hdr->id != op_hdr->id)
-            continue;
+    irqrestore(flags);
 
-        flags = irqsave();
-        list_del(iter);
-        gb_watchdog_update(operation->cport);
-        irqrestore(flags);
+    if (!op) {
+        gb_error("CPort %u: cannot find matching request for response %hu. Dropping message.\n",
+                 operation->cport, le16_to_cpu(hdr->id));
+        return;
+    }
 
-        /* attach this response with the original request */
-        gb_operation_ref(operation);
-        op->response = operation;
-        op_mark_recv_time(op);
-        if (op->callback)
-            op->callback(op);
-        gb_operation_unref(op);
+    /* attach this response with the original request */
+    gb_operation_ref(operation);
+    op->response = operation;
+    op_mark_recv_time(op);
+    if (op->callback)
+        op->callback(op);
+    gb_operation_unref(op);
+}
+
+static void gb_process_message(unsigned int cportid,
+                               struct gb_operation *operation)
+{
+    struct gb_operation_hdr *hdr = operation->request_buffer;
+
+    if (hdr == timedout_hdr) {
+        gb_clean_timedout_operation(cportid);
         return;
     }
 
-    gb_error("CPort %u: cannot find matching request for response %hu. Dropping message.\n",
-             operation->cport, le16_to_cpu(hdr->id));
+    if (hdr->type & GB_TYPE_RESPONSE_FLAG)
+        gb_process_response(hdr, operation);
+    else
+        gb_process_request(hdr, operation);
+    gb_operation_destroy(operation);
 }
 
 static void *gb_pending_message_worker(void *data)
@@ -364,7 +640,6 @@ static void *gb_pending_message_worker(void *data)
     irqstate_t flags;
     struct gb_operation *operation;
     struct list_head *head;
-    struct gb_operation_hdr *hdr;
     int retval;
 
     while (1) {
@@ -380,26 +655,218 @@ static void *gb_pending_message_worker(void *data)
         flags = irqsave();
         head = g_cport(cportid).rx_fifo.next;
         list_del(g_cport(cportid).rx_fifo.next);
+        gb_stats_dequeue(_g_cport(cportid));
         irqrestore(flags);
 
         operation = list_entry(head, struct gb_operation, list);
-        hdr = operation->request_buffer;
+        gb_process_message(cportid, operation);
+        gb_inline_release(_g_cport(cportid));
+    }
 
-        if (hdr == timedout_hdr) {
-            gb_clean_timedout_operation(cportid);
+    return NULL;
+}
+
+#ifdef CONFIG_GREYBUS_DISPATCH_POOL
+/* Must be called with interrupts disabled */
+static struct gb_cport_driver *gb_dispatch_pick(struct gb_dispatcher *self)
+{
+    struct gb_dispatcher *dispatcher;
+    struct gb_cport_driver *entry;
+    int first = self - gb_dispatchers;
+    int i;
+
+    for (i = 0; i < gb_dispatch_threads; i++) {
+        dispatcher = &gb_dispatchers[(first + i) % gb_dispatch_threads];
+        if (list_is_empty(&dispatcher->ready))
+            continue;
+
+        entry = list_entry(dispatcher->ready.next, struct gb_cport_driver,
+                           ready);
+        list_del(&entry->ready);
+        return entry;
+    }
+
+    return NULL;
+}
+
+/* Whether the caller is one of the dispatcher threads */
+static inline bool gb_dispatch_is_worker(void)
+{
+    pthread_t self = pthread_self();
+    int i;
+
+    for (i = 0; i < gb_dispatch_threads; i++) {
+        if (pthread_equal(gb_dispatchers[i].thread, self))
+            return true;
+    }
+
+    return false;
+}
+
+static void *gb_dispatch_worker(void *data)
+{
+    struct gb_dispatcher *self = data;
+    struct gb_cport_driver *entry;
+    struct gb_operation *operation;
+    struct list_head *head;
+    irqstate_t flags;
+    int n;
+
+    while (1) {
+        if (sem_wait(&gb_dispatch_sem) < 0)
+            continue;
+
+        if (gb_dispatch_exit)
+            break;
+
+        flags = irqsave();
+        entry = gb_dispatch_pick(self);
+        irqrestore(flags);
+
+        if (!entry)
             continue;
+
+        for (n = 0; n < CONFIG_GREYBUS_DISPATCH_BATCH; n++) {
+            flags = irqsave();
+            if (list_is_empty(&entry->rx_fifo)) {
+                irqrestore(flags);
+                break;
+            }
+            head = entry->rx_fifo.next;
+            list_del(head);
+            gb_stats_dequeue(entry);
+            irqrestore(flags);
+
+            operation = list_entry(head, struct gb_operation, list);
+            gb_process_message(entry->cport, operation);
+            gb_inline_release(entry);
         }
 
-        if (hdr->type & GB_TYPE_RESPONSE_FLAG)
-            gb_process_response(hdr, operation);
-        else
-            gb_process_request(hdr, operation);
-        gb_operation_destroy(operation);
+        /* Still busy: go to the back of the line to let others run */
+        flags = irqsave();
+        if (list_is_empty(&entry->rx_fifo)) {
+            entry->scheduled = false;
+        } else {
+            list_add(&gb_dispatchers[entry->cport % gb_dispatch_threads].ready,
+                     &entry->ready);
+            sem_post(&gb_dispatch_sem);
+        }
+        irqrestore(flags);
     }
 
     return NULL;
 }
 
+static int gb_dispatch_init(void)
+{
+    pthread_attr_t thread_attr;
+    int retval;
+    int i;
+
+    sem_init(&gb_dispatch_sem, 0, 0);
+    gb_dispatch_exit = false;
+
+    retval = pthread_attr_init(&thread_attr);
+    if (retval)
+        return -retval;
+
+    retval = pthread_attr_setstacksize(&thread_attr,
+                                       CONFIG_GREYBUS_DISPATCH_STACK_SIZE);
+    if (retval)
+        goto out;
+
+    for (i = 0; i < CONFIG_GREYBUS_DISPATCH_THREADS; i++) {
+        list_init(&gb_dispatchers[i].ready);
+        retval = pthread_create(&gb_dispatchers[i].thread, &thread_attr,
+                                gb_dispatch_worker, &gb_dispatchers[i]);
+        if (retval)
+            break;
+        gb_dispatch_threads++;
+    }
+
+    /* Run degraded rather than not at all */
+    if (gb_dispatch_threads)
+        retval = 0;
+
+out:
+    pthread_attr_destroy(&thread_attr);
+    return -retval;
+}
+
+static void gb_dispatch_deinit(void)
+{
+    int i;
+
+    gb_dispatch_exit = true;
+    for (i = 0; i < gb_dispatch_threads; i++)
+        sem_post(&gb_dispatch_sem);
+    for (i = 0; i < gb_dispatch_threads; i++)
+        pthread_join(gb_dispatchers[i].thread, NULL);
+
+    gb_dispatch_threads = 0;
+    sem_destroy(&gb_dispatch_sem);
+}
+#endif
+
+/*
+ * Hand a CPort with new messages in its rx_fifo to its worker. Must be
+ * called with interrupts disabled.
+ */
+static void gb_cport_kick(struct gb_cport_driver *entry)
+{
+#ifdef CONFIG_GREYBUS_DISPATCH_POOL
+    if (!entry->dedicated) {
+        if (!entry->scheduled) {
+            entry->scheduled = true;
+            list_add(&gb_dispatchers[entry->cport % gb_dispatch_threads].ready,
+                     &entry->ready);
+            sem_post(&gb_dispatch_sem);
+        }
+        return;
+    }
+#endif
+
+    sem_post(&entry->rx_fifo_lock);
+}
+
+void gb_dispatch_get_info(struct gb_dispatch_info *info)
+{
+    struct gb_cport_driver *drv;
+    size_t stack_size;
+    void *v;
+
+    memset(info, 0, sizeof(*info));
+
+#ifdef CONFIG_GREYBUS_DISPATCH_POOL
+    info->threads = gb_dispatch_threads;
+    info->stack_bytes = gb_dispatch_threads *
+                        CONFIG_GREYBUS_DISPATCH_STACK_SIZE;
+#endif
+
+    if (!cport_tbl)
+        return;
+
+    for (v = rtr_get_first_value(cport_tbl);
+         v != NULL;
+         v = rtr_get_next_value(cport_tbl, drv->cport)) {
+
+        drv = (struct gb_cport_driver *) v;
+        if (!drv->driver)
+            continue;
+
+        stack_size = drv->driver->stack_size;
+        info->cports++;
+        info->per_cport_stack_bytes += stack_size;
+
+#ifdef CONFIG_GREYBUS_DISPATCH_POOL
+        if (!drv->dedicated)
+            continue;
+#endif
+        info->threads++;
+        info->stack_bytes += stack_size;
+    }
+}
+
 #if defined(CONFIG_UNIPRO_ZERO_COPY)
 static struct gb_operation *gb_rx_create_operation(unsigned cport, void *data,
                                                    size_t size)
@@ -437,35 +904,129 @@ static struct gb_operation *gb_rx_create_operation(unsigned cport, void *data,
 }
 #endif
 
-int greybus_rx_handler(unsigned int cport, void *data, size_t size)
+#ifdef CONFIG_GREYBUS_INLINE_HANDLERS
+/*
+ * Answer a request straight from the receive thread of the transport, with
+ * an operation on the stack and the response buffer set aside at init: no
+ * allocation and no thread switch. Only done when nothing else of the CPort
+ * is queued or being handled, to keep its messages in order. Return false
+ * if the request has to be queued instead.
+ */
+static bool gb_inline_request(struct gb_cport_driver *entry,
+                              struct gb_operation_handler *op_handler,
+                              struct gb_operation_hdr *hdr, uint32_t recv_us)
+{
+    struct gb_operation operation;
+    irqstate_t flags;
+    uint32_t start_us;
+    uint32_t elapsed;
+    uint32_t bit;
+    int index;
+    uint8_t result;
+
+    if (!transport_backend->send_inline || up_interrupt_context())
+        return false;
+
+    /* Demotions are per CPort, handlers past the 32nd share the last bit */
+    index = op_handler - entry->driver->op_handlers;
+    bit = 1 << (index < 31 ? index : 31);
+    if (entry->inline_off & bit)
+        return false;
+
+    flags = irqsave();
+    if (entry->pending || gb_inline_busy) {
+        irqrestore(flags);
+        return false;
+    }
+    gb_inline_busy = true;
+    irqrestore(flags);
+
+    memset(&operation, 0, sizeof(operation));
+    operation.cport = entry->cport;
+    operation.request_buffer = hdr;
+    operation.is_inline = true;
+    list_init(&operation.list);
+    atomic_init(&operation.ref_count, 1);
+
+    start_us = hrt_getusec();
+    result = op_handler->handler(&operation);
+    gb_debug("%s: %u\n", gb_handler_name(op_handler), result);
+
+    if (hdr->id)
+        gb_operation_send_response(&operation, result);
+    elapsed = hrt_getusec() - start_us;
+
+    DEBUGASSERT(atomic_get(&operation.ref_count) == 1);
+    gb_inline_busy = false;
+
+    gb_stats_handled(entry->cport, start_us, recv_us);
+
+    /* The response did not fit, see gb_operation_alloc_response() */
+    if (operation.response_headroom &&
+        operation.response_headroom != gb_inline_resp) {
+        transport_backend->free_buf(operation.response_headroom);
+        gb_error("%s response too large, queue it from now on\n",
+                 gb_handler_name(op_handler));
+        entry->inline_off |= bit;
+    }
+
+    if (elapsed > CONFIG_GREYBUS_INLINE_MAX_US) {
+        gb_error("%s took %u us, queue it from now on\n",
+                 gb_handler_name(op_handler), elapsed);
+        entry->inline_off |= bit;
+    }
+
+    return true;
+}
+#endif
+
+/*
+ * Queue a received message. If buf is set, it is a transport buffer holding
+ * the message after the headroom: the new operation takes it over instead
+ * of copying the message, and it is freed if the message is not queued.
+ */
+static int gb_rx_handler(unsigned int cport, void *buf, void *data,
+                         size_t size)
 {
     irqstate_t flags;
     struct gb_operation *op;
     struct gb_operation_hdr *hdr = data;
     struct gb_operation_handler *op_handler;
+    struct gb_cport_driver *entry = NULL;
+    bool dropped = true;
+    uint32_t recv_us = 0;
     size_t hdr_size;
+    int retval = 0;
 
     gb_loopback_log_entry(cport);
     if ((!gb_is_valid_cport(cport) || (!_g_cport(cport)) || !data)) {
         gb_error("Invalid cport number: %u\n", cport);
-        return -EINVAL;
+        retval = -EINVAL;
+        goto out;
     }
 
+    entry = _g_cport(cport);
+#if defined(CONFIG_GREYBUS_STATS) || defined(CONFIG_GREYBUS_INLINE_HANDLERS)
+    recv_us = hrt_getusec();
+#endif
+
     if (!g_cport(cport).driver || !g_cport(cport).driver->op_handlers) {
         gb_error("Cport %u does not have a valid driver registered\n", cport);
-        return 0;
+        goto out;
     }
 
     if (sizeof(*hdr) > size) {
         gb_error("Dropping garbage request\n");
-        return -EINVAL; /* Dropping garbage request */
+        retval = -EINVAL; /* Dropping garbage request */
+        goto out;
     }
 
     hdr_size = le16_to_cpu(hdr->size);
 
     if (hdr_size > size || sizeof(*hdr) > hdr_size) {
         gb_error("Dropping garbage request\n");
-        return -EINVAL; /* Dropping garbage request */
+        retval = -EINVAL; /* Dropping garbage request */
+        goto out;
     }
 
     gb_dump(data, size);
@@ -484,28 +1045,102 @@ int greybus_rx_handler(unsigned int cport, void *data, size_t size)
     if (op_handler && op_handler->fast_handler) {
         gb_debug("%s\n", gb_handler_name(op_handler));
         op_handler->fast_handler(cport, data);
-        return 0;
+        gb_stats_handled(cport, recv_us, recv_us);
+        dropped = false;
+        goto out;
     }
 
-    op = gb_rx_create_operation(cport, data, hdr_size);
-    if (!op)
-        return -ENOMEM;
+#ifdef CONFIG_GREYBUS_INLINE_HANDLERS
+    if (op_handler && op_handler->nonblocking &&
+        gb_inline_request(entry, op_handler, hdr, recv_us)) {
+        dropped = false;
+        goto out;
+    }
+#endif
+
+    if (buf) {
+        op = _gb_operation_create(cport);
+        if (op) {
+            op->request_headroom = buf;
+            op->request_buffer = data;
+            buf = NULL;
+        }
+    } else {
+        op = gb_rx_create_operation(cport, data, hdr_size);
+    }
+
+    if (!op) {
+        retval = -ENOMEM;
+        goto out;
+    }
 
     op_mark_recv_time(op);
+#ifdef CONFIG_GREYBUS_STATS
+    op->recv_us = recv_us;
+#endif
+    dropped = false;
 
     flags = irqsave();
-    list_add(&g_cport(cport).rx_fifo, &op->list);
-    sem_post(&g_cport(cport).rx_fifo_lock);
+    list_add(&entry->rx_fifo, &op->list);
+    gb_stats_enqueue(entry);
+    gb_inline_hold(entry);
+    gb_cport_kick(entry);
     irqrestore(flags);
 
-    return 0;
+out:
+    if (entry)
+        gb_stats_rx(entry, size, dropped);
+    if (buf)
+        transport_backend->free_buf(buf);
+    return retval;
+}
+
+int greybus_rx_handler(unsigned int cport, void *data, size_t size)
+{
+    return gb_rx_handler(cport, NULL, data, size);
+}
+
+/**
+ * Queue a received message held in a transport buffer
+ *
+ * The message starts after the transport headroom. The buffer is handed
+ * over to the Greybus core and must not be used by the caller anymore,
+ * whatever the outcome.
+ */
+int greybus_rx_handler_take(unsigned int cport, void *buf, size_t size)
+{
+    DEBUGASSERT(buf);
+    DEBUGASSERT(transport_backend);
+
+    return gb_rx_handler(cport, buf,
+                         (char *)buf + transport_backend->headroom, size);
+}
+
+static void gb_flush_pending(unsigned int cport)
+{
+    struct gb_operation *op;
+    irqstate_t flags;
+    int i;
+
+    for (i = 0; i < CONFIG_GREYBUS_PENDING_REQUESTS; i++) {
+        flags = irqsave();
+        op = gb_pending[i];
+        if (op && op->cport == cport)
+            gb_pending_del(op);
+        else
+            op = NULL;
+        irqrestore(flags);
+
+        if (op)
+            gb_operation_unref(op);
+    }
 }
 
-static void gb_flush_tx_fifo(unsigned int cport)
+static void gb_flush_expired(unsigned int cport)
 {
     struct list_head *iter, *iter_next;
 
-    list_foreach_safe(&_g_cport(cport)->tx_fifo, iter, iter_next) {
+    list_foreach_safe(&_g_cport(cport)->expired, iter, iter_next) {
         struct gb_operation *op = list_entry(iter, struct gb_operation, list);
 
         list_del(iter);
@@ -522,13 +1157,23 @@ int gb_unregister_driver(unsigned int cport)
     if (transport_backend->stop_listening)
         transport_backend->stop_listening(cport);
 
-    wd_cancel(&g_cport(cport).timeout_wd);
-
     g_cport(cport).exit_worker = true;
-    sem_post(&g_cport(cport).rx_fifo_lock);
-    pthread_join(g_cport(cport).thread, NULL);
 
-    gb_flush_tx_fifo(cport);
+    /* Nothing of this CPort may time out once its worker is gone */
+    gb_flush_pending(cport);
+#ifdef CONFIG_GREYBUS_DISPATCH_POOL
+    if (!g_cport(cport).dedicated) {
+        /* Let the pool drain what is already queued */
+        while (g_cport(cport).scheduled)
+            usleep(1000);
+    } else
+#endif
+    {
+        sem_post(&g_cport(cport).rx_fifo_lock);
+        pthread_join(g_cport(cport).thread, NULL);
+    }
+
+    gb_flush_expired(cport);
 
     if (g_cport(cport).driver->exit)
         g_cport(cport).driver->exit(cport);
@@ -583,11 +1228,26 @@ int _gb_register_driver(unsigned int cport, struct gb_driver *driver)
               sizeof(*driver->op_handlers), gb_compare_handlers);
     }
 
-    g_cport(cport).exit_worker = false;
-
     if (!driver->stack_size)
         driver->stack_size = DEFAULT_STACK_SIZE;
 
+#ifdef CONFIG_GREYBUS_DISPATCH_POOL
+    if (driver->stack_size <= CONFIG_GREYBUS_DISPATCH_STACK_SIZE &&
+        !driver->blocking) {
+        gb_debug("add cport %d to the dispatcher pool\n", cport);
+        g_cport_add_entry(cport, NULL);
+        if (!_g_cport(cport)) {
+            retval = -ENOMEM;
+            goto pthread_attr_init_error;
+        }
+
+        g_cport(cport).exit_worker = false;
+        g_cport(cport).tx_priority = driver->tx_priority;
+        _g_cport(cport)->driver = driver;
+        return 0;
+    }
+#endif
+
     retval = pthread_attr_init(&thread_attr);
     if (retval)
         goto pthread_attr_init_error;
@@ -598,6 +1258,10 @@ int _gb_register_driver(unsigned int cport, struct gb_driver *driver)
 
     gb_debug("add cport %d\n", cport);
     g_cport_add_entry(cport, NULL);
+    g_cport(cport).exit_worker = false;
+#ifdef CONFIG_GREYBUS_DISPATCH_POOL
+    g_cport(cport).dedicated = true;
+#endif
 
     retval = pthread_create(&g_cport(cport).thread, &thread_attr,
                             gb_pending_message_worker, (unsigned*) cport);
@@ -607,6 +1271,7 @@ int _gb_register_driver(unsigned int cport, struct gb_driver *driver)
     pthread_attr_destroy(&thread_attr);
     thread_attr_ptr = NULL;
 
+    g_cport(cport).tx_priority = driver->tx_priority;
     _g_cport(cport)->driver = driver;
 
     return 0;
@@ -622,6 +1287,78 @@ pthread_attr_init_error:
     return retval;
 }
 
+int gb_set_tx_priority(unsigned int cport, enum gb_tx_priority prio)
+{
+    struct gb_cport_driver *entry = _g_cport(cport);
+
+    if (!entry || !entry->driver)
+        return -EINVAL;
+
+    entry->tx_priority = prio;
+    return 0;
+}
+
+enum gb_tx_priority gb_get_tx_priority(unsigned int cport)
+{
+    struct gb_cport_driver *entry = _g_cport(cport);
+
+    return entry ? entry->tx_priority : GB_TX_PRIO_NORMAL;
+}
+
+#ifdef CONFIG_GREYBUS_STATS
+int gb_stats_get(unsigned int cport, struct gb_cport_stats *stats)
+{
+    struct gb_cport_driver *entry;
+    irqstate_t flags;
+
+    if (!cport_tbl || !(entry = _g_cport(cport)))
+        return -EINVAL;
+
+    flags = irqsave();
+    memcpy(stats, &entry->stats, sizeof(*stats));
+    irqrestore(flags);
+
+    return 0;
+}
+
+/*
+ * Return the first CPort above the given one that has statistics, or a
+ * negative value once they have all been seen. Start with -1.
+ */
+int gb_stats_next_cport(int cport)
+{
+    struct gb_cport_driver *entry;
+
+    if (!cport_tbl)
+        return -ENOENT;
+
+    if (cport < 0)
+        entry = rtr_get_first_value(cport_tbl);
+    else
+        entry = rtr_get_next_value(cport_tbl, cport);
+
+    return entry ? entry->cport : -ENOENT;
+}
+
+void gb_stats_reset(unsigned int cport)
+{
+    struct gb_cport_driver *entry;
+    irqstate_t flags;
+    uint16_t depth;
+
+    if (!cport_tbl || !(entry = _g_cport(cport)))
+        return;
+
+    /* Messages still queued are not history */
+    flags = irqsave();
+    depth = entry->stats.rx_queue_depth;
+    memset(&entry->stats, 0, sizeof(entry->stats));
+    entry->stats.rx_queue_depth = depth;
+    entry->stats.rx_queue_hwm = depth;
+    irqrestore(flags);
+}
+#endif
+
 int gb_listen(unsigned int cport)
 {
     DEBUGASSERT(transport_backend);
@@ -659,26 +1396,32 @@ int gb_stop_listening(unsigned int cport)
     return transport_backend->stop_listening(cport);
 }
 
-static void gb_operation_timeout(int argc, uint32_t cport, ...)
+/*
+ * Largest operation payload, not above size, whose message fills the last
+ * packet the transport carries it in. Returns size if the transport does
+ * not fragment messages or size is below a single packet.
+ */
+size_t gb_fit_payload_size(size_t size)
 {
-    irqstate_t flags;
+    size_t hdr_size = sizeof(struct gb_operation_hdr);
+    size_t fitted;
 
-    flags = irqsave();
+    DEBUGASSERT(transport_backend);
 
-    /* timedout operation could potentially already been queued */
-    if (!list_is_empty(&g_cport(cport).timedout_operation.list)) {
-        irqrestore(flags);
-        return;
-    }
+    if (!transport_backend->fit_size)
+        return size;
 
-    list_add(&g_cport(cport).rx_fifo, &g_cport(cport).timedout_operation.list);
-    sem_post(&g_cport(cport).rx_fifo_lock);
-    irqrestore(flags);
+    fitted = transport_backend->fit_size(size + hdr_size);
+    if (fitted <= hdr_size)
+        return size;
+
+    return fitted - hdr_size;
 }
 
-int gb_operation_send_request(struct gb_operation *operation,
-                              gb_operation_callback callback,
-                              bool need_response)
+int gb_operation_send_request_timeout(struct gb_operation *operation,
+                                      gb_operation_callback callback,
+                                      bool need_response,
+                                      unsigned int timeout_ms)
 {
     struct gb_operation_hdr *hdr = operation->request_buffer;
     int retval = 0;
@@ -696,17 +1439,16 @@ int gb_operation_send_request(struct gb_operation *operation,
     flags = irqsave();
 
     if (need_response) {
-        hdr->id = cpu_to_le16(atomic_inc(&request_id));
-        if (hdr->id == 0) /* ID 0 is for request with no response */
-            hdr->id = cpu_to_le16(atomic_inc(&request_id));
-        clock_gettime(CLOCK_MONOTONIC, &operation->time);
+        retval = gb_pending_add(operation, timeout_ms);
+        if (retval) {
+            irqrestore(flags);
+            gb_error("CPort %u: too many pending requests\n",
+                     operation->cport);
+            return retval;
+        }
+
         operation->callback = callback;
         gb_operation_ref(operation);
-        list_add(&g_cport(operation->cport).tx_fifo, &operation->list);
-        if (!WDOG_ISACTIVE(&g_cport(operation->cport).timeout_wd)) {
-            wd_start(&g_cport(operation->cport).timeout_wd, TIMEOUT_WD_DELAY,
-                     gb_operation_timeout, 1, operation->cport);
-        }
     }
 
     gb_dump(operation->request_buffer, hdr->size);
@@ -714,9 +1456,9 @@ int gb_operation_send_request(struct gb_operation *operation,
                                      operation->request_buffer,
                                      le16_to_cpu(hdr->size));
     op_mark_send_time(operation);
+    gb_stats_tx(operation->cport, le16_to_cpu(hdr->size), retval);
     if (need_response && retval) {
-        list_del(&operation->list);
-        gb_watchdog_update(operation->cport);
+        gb_pending_del(operation);
         gb_operation_unref(operation);
     }
 
@@ -725,6 +1467,14 @@ int gb_operation_send_request(struct gb_operation *operation,
     return retval;
 }
 
+int gb_operation_send_request(struct gb_operation *operation,
+                              gb_operation_callback callback,
+                              bool need_response)
+{
+    return gb_operation_send_request_timeout(operation, callback,
+                                             need_response, TIMEOUT_IN_MS);
+}
+
 static void gb_operation_callback_sync(struct gb_operation *operation)
 {
     sem_post(&operation->sync_sem);
@@ -734,6 +1484,11 @@ int gb_operation_send_request_sync(struct gb_operation *operation)
 {
     int retval;
 
+#ifdef CONFIG_GREYBUS_DISPATCH_POOL
+    /* Only drivers flagged as blocking may wait from their handlers */
+    DEBUGASSERT(!gb_dispatch_is_worker());
+#endif
+
     sem_init(&operation->sync_sem, 0, 0);
 
     retval =
@@ -748,6 +1503,16 @@ int gb_operation_send_request_sync(struct gb_operation *operation)
     return retval;
 }
 
+static int gb_transport_send(struct gb_operation *operation, const void *buf,
+                             size_t len)
+{
+#ifdef CONFIG_GREYBUS_INLINE_HANDLERS
+    if (operation->is_inline)
+        return transport_backend->send_inline(operation->cport, buf, len);
+#endif
+    return transport_backend->send(operation->cport, buf, len);
+}
+
 static int gb_operation_send_oom_response(struct gb_operation *operation)
 {
     int retval;
@@ -762,8 +1527,9 @@ static int gb_operation_send_oom_response(struct gb_operation *operation)
     oom_hdr->id = req_hdr->id;
     oom_hdr->type = GB_TYPE_RESPONSE_FLAG | req_hdr->type;
 
-    retval = transport_backend->send(operation->cport, oom_hdr,
-                                     sizeof(*oom_hdr));
+    retval = gb_transport_send(operation, oom_hdr, sizeof(*oom_hdr));
+    gb_stats_tx(operation->cport, sizeof(*oom_hdr), retval);
+    gb_stats_inc(_g_cport(operation->cport), oom_responses);
 
     irqrestore(flags);
 
@@ -799,12 +1565,12 @@ int gb_operation_send_response(struct gb_operation *operation, uint8_t result)
 
     gb_dump(operation->response_buffer, resp_hdr->size);
     gb_loopback_log_exit(operation->cport, operation, resp_hdr->size);
-    retval = transport_backend->send(operation->cport,
-                                     operation->response_buffer,
-                                     le16_to_cpu(resp_hdr->size));
+    retval = gb_transport_send(operation, operation->response_buffer,
+                               le16_to_cpu(resp_hdr->size));
+    gb_stats_tx(operation->cport, le16_to_cpu(resp_hdr->size), retval);
     if (retval) {
         gb_error("Greybus backend failed to send: error %d\n", retval);
-        if (has_allocated_response) {
+        if (has_allocated_response && !operation->is_inline) {
             gb_debug("Free the response buffer\n");
             transport_backend->free_buf(operation->response_headroom);
             operation->response_headroom = NULL;
@@ -824,6 +1590,15 @@ void *gb_operation_alloc_response(struct gb_operation *operation, size_t size)
 
     DEBUGASSERT(operation);
 
+#ifdef CONFIG_GREYBUS_INLINE_HANDLERS
+    /*
+     * A larger inline response comes from the transport like any other.
+     * gb_inline_request() frees it once sent.
+     */
+    if (operation->is_inline && size <= CONFIG_GREYBUS_INLINE_RESPONSE_SIZE)
+        operation->response_headroom = gb_inline_resp;
+    else
+#endif
     operation->response_headroom =
         transport_backend->alloc_buf(
                 size + sizeof(*resp_hdr) + transport_backend->headroom);
@@ -877,7 +1652,7 @@ void gb_operation_unref(struct gb_operation *operation)
     if (operation->response) {
         gb_operation_unref(operation->response);
     }
-    free(operation);
+    gb_operation_free(operation);
 }
 
 static struct gb_operation *_gb_operation_create(unsigned int cport)
@@ -887,11 +1662,10 @@ static struct gb_operation *_gb_operation_create(unsigned int cport)
     if (!gb_is_valid_cport(cport))
         return NULL;
 
-    operation = malloc(sizeof(*operation));
+    operation = gb_operation_zalloc();
     if (!operation)
         return NULL;
 
-    memset(operation, 0, sizeof(*operation));
     operation->cport = cport;
 
     list_init(&operation->list);
@@ -928,7 +1702,7 @@ struct gb_operation *gb_operation_create(unsigned int cport, uint8_t type,
 
     return operation;
 malloc_error:
-    free(operation);
+    gb_operation_free(operation);
     return NULL;
 }
 
@@ -970,6 +1744,8 @@ uint8_t gb_operation_get_request_result(struct gb_operation *operation)
 
 int gb_init(struct gb_transport_backend *transport)
 {
+    int i;
+
     if (!transport)
         return -EINVAL;
 
@@ -978,6 +1754,13 @@ int gb_init(struct gb_transport_backend *transport)
         return -EINVAL;
     }
 
+#ifdef CONFIG_GREYBUS_POOL
+    if (gb_pool_init(transport->headroom)) {
+        dbg("Can not allocate the Greybus pools\n");
+        return -ENOMEM;
+    }
+#endif
+
     timedout_hdr = zalloc(sizeof(struct gb_operation_hdr) + transport->headroom);
     if (!timedout_hdr)
         return -ENOMEM;
@@ -1000,10 +1783,29 @@ int gb_init(struct gb_transport_backend *transport)
     oom_hdr->result = GB_OP_NO_MEMORY;
     oom_hdr->type = GB_TYPE_RESPONSE_FLAG;
 
+#ifdef CONFIG_GREYBUS_INLINE_HANDLERS
+    gb_inline_resp = zalloc(CONFIG_GREYBUS_INLINE_RESPONSE_SIZE +
+                            sizeof(struct gb_operation_hdr) +
+                            transport->headroom);
+    if (!gb_inline_resp)
+        return -ENOMEM;
+#endif
+
     cport_tbl = rtr_alloc_table();
 
     atomic_init(&request_id, (uint32_t) 0);
 
+    for (i = 0; i < CONFIG_GREYBUS_TIMER_WHEEL_SLOTS; i++)
+        list_init(&gb_wheel[i]);
+    wd_static(&gb_wheel_wd);
+
+#ifdef CONFIG_GREYBUS_DISPATCH_POOL
+    if (gb_dispatch_init()) {
+        dbg("Can not start the Greybus dispatcher pool\n");
+        return -ENOMEM;
+    }
+#endif
+
     transport_backend = transport;
     transport_backend->init();
 
@@ -1028,7 +1830,6 @@ void gb_deinit(void)
 
         gb_unregister_driver(i);
 
-        wd_delete(&drv->timeout_wd);
         sem_destroy(&drv->rx_fifo_lock);
 
         g_cport_remove_entry(i);
@@ -1037,6 +1838,17 @@ void gb_deinit(void)
     rtr_free_table(cport_tbl);
     cport_tbl = NULL;
 
+    wd_cancel(&gb_wheel_wd);
+
+#ifdef CONFIG_GREYBUS_DISPATCH_POOL
+    gb_dispatch_deinit();
+#endif
+
+#ifdef CONFIG_GREYBUS_INLINE_HANDLERS
+    free(gb_inline_resp);
+    gb_inline_resp = NULL;
+#endif
+
     if (transport_backend->exit)
         transport_backend->exit();
     transport_backend = NULL;
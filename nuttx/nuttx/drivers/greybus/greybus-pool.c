@@ -0,0 +1,315 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Fixed-size block pools for the Greybus hot path.
+ *
+ * Operations and message buffers are carved at init time out of one
+ * allocation per size class and kept on freelists. Taking or returning a
+ * block is a pop or a push in a short critical section: it is safe from
+ * interrupt context and never takes the heap lock. When a class runs dry
+ * the next larger one is tried, then the heap, and these misses are
+ * counted so the pools can be sized from the statistics.
+ *
+ * The heap cannot be used from an interrupt: there a miss fails instead,
+ * and heap blocks freed are handed to the work queue to be released.
+ */
+
+#include <nuttx/config.h>
+#include <nuttx/greybus/greybus.h>
+#include <nuttx/greybus/pool.h>
+
+#include <nuttx/arch.h>
+#include <nuttx/wqueue.h>
+
+#include <arch/irq.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GB_POOL_ALIGN(size)     (((size) + 7) & ~7)
+
+#ifdef CONFIG_SCHED_LPWORK
+#define GB_POOL_WORK            LPWORK
+#else
+#define GB_POOL_WORK            HPWORK
+#endif
+
+struct gb_pool_block {
+    struct gb_pool_block *next;
+};
+
+struct gb_pool {
+    uint8_t *base;
+    uint8_t *end;
+    struct gb_pool_block *free_list;
+    struct gb_pool_class_stats stats;
+};
+
+static struct gb_pool gb_pools[GB_POOL_CLASS_COUNT];
+static uint32_t gb_pool_heap_allocs;
+static uint32_t gb_pool_heap_frees;
+static uint32_t gb_pool_irq_misses;
+
+/* Heap blocks freed from interrupt context, linked through their first word */
+static struct gb_pool_block *gb_pool_deferred;
+static struct work_s gb_pool_free_work;
+
+static void gb_pool_free_worker(void *arg)
+{
+    struct gb_pool_block *block;
+    struct gb_pool_block *next;
+    irqstate_t flags;
+
+    flags = irqsave();
+    block = gb_pool_deferred;
+    gb_pool_deferred = NULL;
+    irqrestore(flags);
+
+    while (block) {
+        next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+static int gb_pool_setup(struct gb_pool *pool, size_t size, int count)
+{
+    struct gb_pool_block *block;
+    int i;
+
+    if (!count)
+        return 0;
+
+    size = GB_POOL_ALIGN(size);
+    pool->base = zalloc(size * count);
+    if (!pool->base)
+        return -ENOMEM;
+    pool->end = pool->base + size * count;
+
+    for (i = count - 1; i >= 0; i--) {
+        block = (struct gb_pool_block *)(pool->base + i * size);
+        block->next = pool->free_list;
+        pool->free_list = block;
+    }
+
+    pool->stats.size = size;
+    pool->stats.count = count;
+    pool->stats.free = count;
+    pool->stats.min_free = count;
+
+    return 0;
+}
+
+/**
+ * @brief Carve the pools
+ *
+ * Message classes are grown by the transport headroom so a full message
+ * still fits. Calling it again once the pools exist does nothing.
+ *
+ * @param headroom transport headroom added in front of every message
+ * @return 0 on success, -ENOMEM if a pool cannot be allocated
+ */
+int gb_pool_init(size_t headroom)
+{
+    int retval;
+    int i;
+
+    if (gb_pools[GB_POOL_OPERATION].stats.count ||
+        gb_pools[GB_POOL_SMALL].stats.count ||
+        gb_pools[GB_POOL_MTU].stats.count)
+        return 0;
+
+    retval = gb_pool_setup(&gb_pools[GB_POOL_OPERATION],
+                           sizeof(struct gb_operation),
+                           CONFIG_GREYBUS_POOL_OPERATIONS);
+    if (retval)
+        goto error;
+
+    retval = gb_pool_setup(&gb_pools[GB_POOL_SMALL],
+                           CONFIG_GREYBUS_POOL_SMALL_SIZE + headroom,
+                           CONFIG_GREYBUS_POOL_SMALL_COUNT);
+    if (retval)
+        goto error;
+
+    retval = gb_pool_setup(&gb_pools[GB_POOL_MTU],
+                           CONFIG_GREYBUS_POOL_MTU_SIZE + headroom,
+                           CONFIG_GREYBUS_POOL_MTU_COUNT);
+    if (retval)
+        goto error;
+
+    return 0;
+
+error:
+    for (i = 0; i < GB_POOL_CLASS_COUNT; i++)
+        free(gb_pools[i].base);
+    memset(gb_pools, 0, sizeof(gb_pools));
+    return retval;
+}
+
+static void *gb_pool_take(int first, int last, size_t size)
+{
+    struct gb_pool_block *block = NULL;
+    struct gb_pool *pool;
+    irqstate_t flags;
+    void *ptr;
+    int i;
+
+    flags = irqsave();
+
+    for (i = first; i <= last; i++) {
+        pool = &gb_pools[i];
+        if (size > pool->stats.size)
+            continue;
+
+        block = pool->free_list;
+        if (block) {
+            pool->free_list = block->next;
+            pool->stats.allocs++;
+            if (--pool->stats.free < pool->stats.min_free)
+                pool->stats.min_free = pool->stats.free;
+            break;
+        }
+
+        pool->stats.fallbacks++;
+    }
+
+    if (!block && up_interrupt_context()) {
+        gb_pool_irq_misses++;
+        irqrestore(flags);
+        return NULL;
+    }
+
+    irqrestore(flags);
+
+    if (block) {
+        memset(block, 0, size);
+        return block;
+    }
+
+    ptr = zalloc(size);
+    if (ptr) {
+        flags = irqsave();
+        gb_pool_heap_allocs++;
+        irqrestore(flags);
+    }
+
+    return ptr;
+}
+
+/**
+ * @brief Allocate a zeroed operation
+ *
+ * @return the operation, or NULL if both the pool and the heap are empty,
+ *         or if the pool is empty in interrupt context
+ */
+struct gb_operation *gb_pool_alloc_operation(void)
+{
+    return gb_pool_take(GB_POOL_OPERATION, GB_POOL_OPERATION,
+                        sizeof(struct gb_operation));
+}
+
+/**
+ * @brief Allocate a zeroed message buffer
+ *
+ * Drop-in replacement for zalloc() as a transport alloc_buf().
+ *
+ * @param size buffer size, headroom included
+ * @return the buffer, or NULL if both the pools and the heap are empty,
+ *         or if the pools are empty in interrupt context
+ */
+void *gb_pool_alloc(size_t size)
+{
+    return gb_pool_take(GB_POOL_SMALL, GB_POOL_MTU, size);
+}
+
+/**
+ * @brief Free an operation or a message buffer
+ *
+ * Blocks go back to their pool, anything else to the heap, through the
+ * work queue when called from an interrupt. NULL is ignored.
+ *
+ * @param ptr block to free
+ */
+void gb_pool_free(void *ptr)
+{
+    struct gb_pool_block *block = ptr;
+    struct gb_pool *pool;
+    irqstate_t flags;
+    int i;
+
+    if (!ptr)
+        return;
+
+    flags = irqsave();
+
+    for (i = 0; i < GB_POOL_CLASS_COUNT; i++) {
+        pool = &gb_pools[i];
+        if ((uint8_t *)ptr < pool->base || (uint8_t *)ptr >= pool->end)
+            continue;
+
+        block->next = pool->free_list;
+        pool->free_list = block;
+        pool->stats.free++;
+        irqrestore(flags);
+        return;
+    }
+
+    gb_pool_heap_frees++;
+
+    if (up_interrupt_context()) {
+        block->next = gb_pool_deferred;
+        gb_pool_deferred = block;
+        if (work_available(&gb_pool_free_work))
+            work_queue(GB_POOL_WORK, &gb_pool_free_work, gb_pool_free_worker,
+                       NULL, 0);
+        irqrestore(flags);
+        return;
+    }
+
+    irqrestore(flags);
+
+    free(ptr);
+}
+
+void gb_pool_get_stats(struct gb_pool_stats *stats)
+{
+    irqstate_t flags;
+    int i;
+
+    flags = irqsave();
+
+    for (i = 0; i < GB_POOL_CLASS_COUNT; i++)
+        stats->classes[i] = gb_pools[i].stats;
+    stats->heap_allocs = gb_pool_heap_allocs;
+    stats->heap_frees = gb_pool_heap_frees;
+    stats->irq_misses = gb_pool_irq_misses;
+
+    irqrestore(flags);
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * /proc/greybus: the per-CPort counters and latency histograms kept by the
+ * Greybus core, one block per CPort.
+ */
+
+#include <nuttx/config.h>
+#include <nuttx/kmalloc.h>
+#include <nuttx/fs/fs.h>
+#include <nuttx/fs/procfs.h>
+#include <nuttx/greybus/greybus.h>
+
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(CONFIG_FS_PROCFS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_GREYBUS)
+
+#define GB_STATS_BUFSIZE    512
+
+struct gb_stats_file {
+    struct procfs_file_s base;  /* must be first */
+    int cport;                  /* last CPort formatted, -1 for none */
+    bool started;               /* header formatted */
+    size_t len;                 /* formatted text in buf */
+    size_t pos;                 /* part of it already read */
+    char buf[GB_STATS_BUFSIZE];
+};
+
+static int gb_stats_format_hist(char *buf, size_t size, const char *name,
+                                const uint32_t *hist)
+{
+    int len;
+    int i;
+
+    len = snprintf(buf, size, "  %s:", name);
+    for (i = 0; i < GB_STATS_HIST_BUCKETS && len < size; i++)
+        len += snprintf(buf + len, size - len, " %u", hist[i]);
+    if (len < size)
+        len += snprintf(buf + len, size - len, "\n");
+
+    return len;
+}
+
+/* Format the next block of text, return false at the end of the file */
+static bool gb_stats_format(struct gb_stats_file *priv)
+{
+    struct gb_cport_stats stats;
+    size_t size = sizeof(priv->buf);
+    char *buf = priv->buf;
+    int len;
+    int cport;
+
+    priv->pos = 0;
+
+    if (!priv->started) {
+        priv->started = true;
+#ifdef CONFIG_ARCH_HAVE_HIRES_TIMER
+        priv->len = snprintf(buf, size,
+                             "Histogram bucket n: [2^(n-1), 2^n) us\n");
+#else
+        priv->len = snprintf(buf, size,
+                             "No timings without a high resolution timer\n");
+#endif
+        return true;
+    }
+
+    do {
+        cport = gb_stats_next_cport(priv->cport);
+        if (cport < 0)
+            return false;
+        priv->cport = cport;
+    } while (gb_stats_get(cport, &stats));
+
+    len = snprintf(buf, size,
+                   "CPort %d:\n"
+                   "  rx: %u msgs %u bytes %u drops, queue %u max %u\n"
+                   "  tx: %u msgs %u bytes %u errors, %u oom, %u timeouts\n",
+                   cport,
+                   stats.rx_msgs, stats.rx_bytes, stats.rx_drops,
+                   stats.rx_queue_depth, stats.rx_queue_hwm,
+                   stats.tx_msgs, stats.tx_bytes, stats.tx_errors,
+                   stats.oom_responses, stats.timeouts);
+#ifdef CONFIG_ARCH_HAVE_HIRES_TIMER
+    if (len < size)
+        len += snprintf(buf + len, size - len, "  handler max: %u us\n",
+                        stats.handler_max_us);
+    if (len < size)
+        len += gb_stats_format_hist(buf + len, size - len, "handler",
+                                    stats.handler_hist);
+    if (len < size)
+        len += gb_stats_format_hist(buf + len, size - len, "latency",
+                                    stats.latency_hist);
+#endif
+
+    /* snprintf() returns what it would have written */
+    priv->len = len < size ? len : size - 1;
+    return true;
+}
+
+static int gb_stats_open(struct file *filep, const char *relpath,
+                         int oflags, mode_t mode)
+{
+    struct gb_stats_file *priv;
+
+    if ((oflags & O_WRONLY) != 0 || (oflags & O_RDONLY) == 0)
+        return -EACCES;
+
+    priv = kmm_zalloc(sizeof(*priv));
+    if (!priv)
+        return -ENOMEM;
+
+    priv->cport = -1;
+    filep->f_priv = priv;
+
+    return 0;
+}
+
+static int gb_stats_close(struct file *filep)
+{
+    kmm_free(filep->f_priv);
+    filep->f_priv = NULL;
+
+    return 0;
+}
+
+static ssize_t gb_stats_read(struct file *filep, char *buffer, size_t buflen)
+{
+    struct gb_stats_file *priv = filep->f_priv;
+    size_t total = 0;
+    size_t len;
+
+    DEBUGASSERT(priv);
+
+    while (total < buflen) {
+        if (priv->pos == priv->len && !gb_stats_format(priv))
+            break;
+
+        len = priv->len - priv->pos;
+        if (len > buflen - total)
+            len = buflen - total;
+
+        memcpy(buffer + total, priv->buf + priv->pos, len);
+        priv->pos += len;
+        total += len;
+    }
+
+    filep->f_pos += total;
+    return total;
+}
+
+static int gb_stats_dup(const struct file *oldp, struct file *newp)
+{
+    struct gb_stats_file *priv;
+
+    priv = kmm_malloc(sizeof(*priv));
+    if (!priv)
+        return -ENOMEM;
+
+    memcpy(priv, oldp->f_priv, sizeof(*priv));
+    newp->f_priv = priv;
+
+    return 0;
+}
+
+static int gb_stats_stat(const char *relpath, struct stat *buf)
+{
+    buf->st_mode = S_IFREG | S_IROTH | S_IRGRP | S_IRUSR;
+    buf->st_size = 0;
+    buf->st_blksize = 0;
+    buf->st_blocks = 0;
+
+    return 0;
+}
+
+/* Listed in fs/procfs/fs_procfs.c */
+const struct procfs_operations gb_stats_procfsoperations = {
+    .open = gb_stats_open,
+    .close = gb_stats_close,
+    .read = gb_stats_read,
+    .dup = gb_stats_dup,
+    .stat = gb_stats_stat,
+};
+
+#endif
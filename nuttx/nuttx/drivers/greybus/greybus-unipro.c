@@ -50,6 +50,13 @@ static struct unipro_driver greybus_driver = {
 
 static int gb_unipro_listen(unsigned int cport)
 {
+#ifdef CONFIG_ARCH_CHIP_TSB
+    /* Let control and input replies overtake bulk transfers */
+    unipro_set_tx_priority(cport,
+                           gb_get_tx_priority(cport) == GB_TX_PRIO_HIGH ?
+                           UNIPRO_TX_PRIO_HIGH : UNIPRO_TX_PRIO_NORMAL);
+#endif
+
     return unipro_driver_register(&greybus_driver, cport);
 }
 
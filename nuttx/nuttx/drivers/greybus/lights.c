@@ -609,10 +609,10 @@ static struct gb_operation_handler gb_lights_handlers[] = {
     GB_HANDLER(GB_LIGHTS_TYPE_GET_CHANNEL_CONFIG, gb_lights_get_channel_config),
     GB_HANDLER(GB_LIGHTS_TYPE_GET_CHANNEL_FLASH_CONFIG,
                gb_lights_get_channel_flash_config),
-    GB_HANDLER(GB_LIGHTS_TYPE_SET_BRIGHTNESS, gb_lights_set_brightness),
-    GB_HANDLER(GB_LIGHTS_TYPE_SET_BLINK, gb_lights_set_blink),
-    GB_HANDLER(GB_LIGHTS_TYPE_SET_COLOR, gb_lights_set_color),
-    GB_HANDLER(GB_LIGHTS_TYPE_SET_FADE, gb_lights_set_fade),
+    GB_INLINE_HANDLER(GB_LIGHTS_TYPE_SET_BRIGHTNESS, gb_lights_set_brightness),
+    GB_INLINE_HANDLER(GB_LIGHTS_TYPE_SET_BLINK, gb_lights_set_blink),
+    GB_INLINE_HANDLER(GB_LIGHTS_TYPE_SET_COLOR, gb_lights_set_color),
+    GB_INLINE_HANDLER(GB_LIGHTS_TYPE_SET_FADE, gb_lights_set_fade),
     GB_HANDLER(GB_LIGHTS_TYPE_SET_FLASH_INTENSITY,
                gb_lights_set_flash_intensity),
     GB_HANDLER(GB_LIGHTS_TYPE_SET_FLASH_STROBE, gb_lights_set_flash_strobe),
@@ -135,6 +135,21 @@ struct i2c_msg_hdr
   __le16 bitmask;                /* See HDR_BIT_* defines for values */
 } __packed;
 
+/*
+ * Producer side of a queue of packets. The TX ring buffer has one, and with
+ * CONFIG_GREYBUS_MODS_TX_PRIORITY so does each priority class: its packets
+ * are moved to the TX ring buffer one at a time, see tx_feed().
+ */
+struct i2c_txq
+{
+  struct ring_buf *txp_rb;       /* Producer ring buffer entry */
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  struct ring_buf *txm_rb;       /* First packet of the oldest message */
+  struct ring_buf *txf_rb;       /* Next packet to move to the TX ring */
+  bool preempted;                /* Oldest message was preempted already */
+#endif
+};
+
 struct mods_i2c_dl_s
 {
   struct mods_dl_s dl;           /* Externally visible part of the data link interface */
@@ -149,9 +164,13 @@ struct mods_i2c_dl_s
   enum dl_state_e txn_state;     /* Current transaction state */
   uint8_t tx_tries_remaining;    /* Send attempts remaining before giving up */
 
-  struct ring_buf *txp_rb;       /* Producer TX ring buffer */
+  struct i2c_txq txq;            /* Producer side of the TX ring buffer */
   struct ring_buf *txc_rb;       /* Consumer TX ring buffer */
 
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  struct i2c_txq prio_txq[MODS_DL_PRIO_COUNT]; /* Waiting for the TX ring */
+#endif
+
   __u8 *rx_buf;                  /* Buffer for received packets */
   uint32_t stop_err_cnt;         /* Count of stop errors seen since last success */
   uint32_t crc_err_cnt;          /* Count of CRC errors seen since last success */
@@ -199,14 +218,59 @@ struct state_funcs
   int (*stop_error)(FAR struct mods_i2c_dl_s *priv);
 };
 
+static struct ring_buf *alloc_ring(size_t pl_size)
+{
+  struct ring_buf *rb;
+
+  rb = ring_buf_alloc_ring(INITIAL_RB_ENTRIES,
+      HDR_SIZE /* headroom */, pl_size /* data_len */,
+      CRC_SIZE /* tailroom */, NULL /* alloc_callback */,
+      NULL /* free_callback */, NULL /* arg */);
+  ASSERT(rb);
+
+  return rb;
+}
+
+/* True when no packet is waiting to be sent */
+static bool tx_is_empty(FAR struct mods_i2c_dl_s *priv)
+{
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  int prio;
+
+  for (prio = 0; prio < MODS_DL_PRIO_COUNT; prio++)
+    {
+      if (ring_buf_is_consumers(priv->prio_txq[prio].txm_rb))
+          return false;
+    }
+#endif
+
+  return (priv->txq.txp_rb == priv->txc_rb) &&
+         ring_buf_is_producers(priv->txq.txp_rb);
+}
+
+/* Queue to put the messages of the given priority in */
+static inline FAR struct i2c_txq *tx_queue(FAR struct mods_i2c_dl_s *priv,
+                                           enum mods_dl_prio prio)
+{
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  return &priv->prio_txq[prio];
+#else
+  return &priv->txq;
+#endif
+}
+
 static void set_pl_size(FAR struct mods_i2c_dl_s *priv, size_t pl_size)
 {
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  FAR struct i2c_txq *q;
+  int prio;
+#endif
+
   /*
    * Immediately return if payload size is not changing and ring buffer is
    * in a good state.
    */
-  if ((pl_size == priv->pl_size) && (priv->txp_rb == priv->txc_rb) &&
-      ring_buf_is_producers(priv->txp_rb))
+  if ((pl_size == priv->pl_size) && tx_is_empty(priv))
       return;
 
   /* Free any existing RX buffer (if any) */
@@ -214,19 +278,28 @@ static void set_pl_size(FAR struct mods_i2c_dl_s *priv, size_t pl_size)
       free(priv->rx_buf);
 
   /* Free existing TX ring buffer (if any) */
-  ring_buf_free_ring(priv->txp_rb, NULL /* free_callback */, NULL /* arg */);
+  ring_buf_free_ring(priv->txq.txp_rb, NULL /* free_callback */, NULL /* arg */);
 
   /* Allocate RX buffer */
   priv->rx_buf = malloc(PKT_SIZE(pl_size));
   ASSERT(priv->rx_buf);
 
   /* Allocate TX ring buffer */
-  priv->txp_rb = ring_buf_alloc_ring(INITIAL_RB_ENTRIES,
-      HDR_SIZE /* headroom */, pl_size /* data_len */,
-      CRC_SIZE /* tailroom */, NULL /* alloc_callback */,
-      NULL /* free_callback */, NULL /* arg */);
-  ASSERT(priv->txp_rb);
-  priv->txc_rb = priv->txp_rb;
+  priv->txq.txp_rb = alloc_ring(pl_size);
+  priv->txc_rb = priv->txq.txp_rb;
+
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  /* Same for the priority classes, which grow as needed as well */
+  for (prio = 0; prio < MODS_DL_PRIO_COUNT; prio++)
+    {
+      q = &priv->prio_txq[prio];
+      ring_buf_free_ring(q->txp_rb, NULL /* free_callback */, NULL /* arg */);
+      q->txp_rb = alloc_ring(pl_size);
+      q->txm_rb = q->txp_rb;
+      q->txf_rb = q->txp_rb;
+      q->preempted = false;
+    }
+#endif
 
   /* Save new packet size */
   priv->pl_size = pl_size;
@@ -245,7 +318,7 @@ static struct ring_buf *find_prev_rb_entry(struct ring_buf *next_rb)
   return rb;
 }
 
-static int add_rb_entry(FAR struct mods_i2c_dl_s *priv)
+static int add_rb_entry(FAR struct mods_i2c_dl_s *priv, FAR struct i2c_txq *q)
 {
   struct ring_buf *rb;
   struct ring_buf *prev_rb;
@@ -255,36 +328,36 @@ static int add_rb_entry(FAR struct mods_i2c_dl_s *priv)
   if (!rb)
       return -ENOMEM;
 
-  prev_rb = find_prev_rb_entry(priv->txp_rb);
+  prev_rb = find_prev_rb_entry(q->txp_rb);
 
   /* Insert new ring buffer entry */
-  rb->next = priv->txp_rb;
+  rb->next = q->txp_rb;
   prev_rb->next = rb;
 
   /* Set producer pointer to newly added entry */
-  priv->txp_rb = rb;
+  q->txp_rb = rb;
 
   llvdbg("RB entry added\n");
 
   return OK;
 }
 
-static inline void set_txp_hdr(FAR struct mods_i2c_dl_s *priv, uint16_t bits)
+static inline void set_txp_hdr(FAR struct i2c_txq *q, uint16_t bits)
 {
-  struct i2c_msg_hdr *hdr = ring_buf_get_buf(priv->txp_rb);
+  struct i2c_msg_hdr *hdr = ring_buf_get_buf(q->txp_rb);
   hdr->bitmask = cpu_to_le16(bits);
 }
 
-static inline void next_txp(FAR struct mods_i2c_dl_s *priv)
+static inline void next_txp(FAR struct i2c_txq *q)
 {
-  ring_buf_pass(priv->txp_rb);
-  priv->txp_rb = ring_buf_get_next(priv->txp_rb);
+  ring_buf_pass(q->txp_rb);
+  q->txp_rb = ring_buf_get_next(q->txp_rb);
 }
 
 static inline void setup_for_dummy_tx(FAR struct mods_i2c_dl_s *priv)
 {
-  set_txp_hdr(priv, HDR_BIT_DUMMY);
-  next_txp(priv);
+  set_txp_hdr(&priv->txq, HDR_BIT_DUMMY);
+  next_txp(&priv->txq);
 }
 
 static inline void set_ack_txc_hdr(FAR struct mods_i2c_dl_s *priv)
@@ -306,9 +379,103 @@ static void set_crc(FAR struct mods_i2c_dl_s *priv)
   *((uint16_t *)priv->txc_rb->tailroom) = cpu_to_le16(crc);
 }
 
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+/* Release the packets of the oldest message of a class, all moved by now */
+static void txq_release(FAR struct mods_i2c_dl_s *priv, FAR struct i2c_txq *q)
+{
+  struct i2c_msg_hdr *hdr = ring_buf_get_buf(q->txm_rb);
+  int packets = (le16_to_cpu(hdr->bitmask) & HDR_BIT_PKTS) + 1;
+
+  while (packets-- > 0)
+    {
+      memset(ring_buf_get_buf(q->txm_rb), 0, PKT_SIZE(priv->pl_size));
+      ring_buf_set_owner(q->txm_rb, RING_BUF_OWNER_PRODUCER);
+      q->txm_rb = ring_buf_get_next(q->txm_rb);
+    }
+
+  q->txf_rb = q->txm_rb;
+  q->preempted = false;
+}
+
+/*
+ * Pick the class to move the next packet from. A message partly moved is
+ * normally finished first, since the base reassembles one message at a
+ * time. When a class of higher priority has a message waiting, the one in
+ * progress is preempted instead: the base drops the packets it already got
+ * when the first packet of the other message arrives, and the preempted
+ * message is sent again from its first packet afterwards. A message is
+ * preempted at most once, so bulk traffic keeps moving.
+ */
+static FAR struct i2c_txq *txq_pick(FAR struct mods_i2c_dl_s *priv)
+{
+  FAR struct i2c_txq *cur = NULL;
+  FAR struct i2c_txq *q;
+  int prio;
+
+  for (prio = 0; prio < MODS_DL_PRIO_COUNT; prio++)
+    {
+      q = &priv->prio_txq[prio];
+      if (q->txf_rb != q->txm_rb)
+          cur = q;
+    }
+
+  for (prio = MODS_DL_PRIO_COUNT - 1; prio >= 0; prio--)
+    {
+      q = &priv->prio_txq[prio];
+      if (q == cur)
+          return cur;
+
+      if (!ring_buf_is_consumers(q->txf_rb))
+          continue;
+
+      if (cur && cur->preempted)
+          return cur;
+
+      if (cur)
+        {
+          llvdbg("preempt class %d\n", (int)(cur - priv->prio_txq));
+          cur->txf_rb = cur->txm_rb;
+          cur->preempted = true;
+        }
+
+      return q;
+    }
+
+  return NULL;
+}
+
+/*
+ * Move the next packet from the priority classes to the TX ring buffer once
+ * it is empty, so a message of higher priority never waits for more than
+ * the packet being sent.
+ */
+static void tx_feed(FAR struct mods_i2c_dl_s *priv)
+{
+  FAR struct i2c_txq *q;
+  struct i2c_msg_hdr *hdr;
+
+  if (ring_buf_is_consumers(priv->txc_rb))
+      return;
+
+  q = txq_pick(priv);
+  if (!q)
+      return;
+
+  hdr = ring_buf_get_buf(q->txf_rb);
+  memcpy(ring_buf_get_buf(priv->txq.txp_rb), hdr,
+         HDR_SIZE + priv->pl_size);
+  next_txp(&priv->txq);
+
+  q->txf_rb = ring_buf_get_next(q->txf_rb);
+  if (!(le16_to_cpu(hdr->bitmask) & HDR_BIT_PKTS))
+      txq_release(priv, q);
+}
+#endif
+
 static void reset_txc_rb_entry(FAR struct mods_i2c_dl_s *priv)
 {
-  if ((priv->txp_rb == priv->txc_rb) && ring_buf_is_producers(priv->txp_rb))
+  if ((priv->txq.txp_rb == priv->txc_rb) &&
+      ring_buf_is_producers(priv->txq.txp_rb))
     {
       lldbg("skip\n");
       return;
@@ -317,6 +484,10 @@ static void reset_txc_rb_entry(FAR struct mods_i2c_dl_s *priv)
   memset(ring_buf_get_buf(priv->txc_rb), 0, PKT_SIZE(priv->pl_size));
   ring_buf_set_owner(priv->txc_rb, RING_BUF_OWNER_PRODUCER);
   priv->txc_rb = ring_buf_get_next(priv->txc_rb);
+
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  tx_feed(priv);
+#endif
 }
 
 #ifdef CONFIG_DEBUG_VERBOSE
@@ -366,7 +537,10 @@ static int attach_cb(FAR void *arg, const void *data)
       /* Cancel I2C transaction */
       I2C_CANCEL(priv->i2c);
 
-      /* Cleanup any unsent messages */
+      /*
+       * Cleanup any unsent messages (including those still waiting in a
+       * priority class, moved to the TX ring buffer as it drains).
+       */
       while (ring_buf_is_consumers(priv->txc_rb))
         {
           reset_txc_rb_entry(priv);
@@ -400,8 +574,8 @@ static int attach_cb(FAR void *arg, const void *data)
   return OK;
 }
 
-static int queue_data(FAR struct mods_i2c_dl_s *priv, __u8 msg_type,
-                      const void *buf, size_t len)
+static int queue_data(FAR struct mods_i2c_dl_s *priv, FAR struct i2c_txq *q,
+                      __u8 msg_type, const void *buf, size_t len)
 {
   int remaining = len;
   __u8 *dbuf = (__u8 *)buf;
@@ -424,10 +598,10 @@ static int queue_data(FAR struct mods_i2c_dl_s *priv, __u8 msg_type,
       int this_pl;
 
       /* Check if the ring buffer is full */
-      if (ring_buf_is_consumers(priv->txp_rb))
+      if (ring_buf_is_consumers(q->txp_rb))
         {
           /* Try to grow the ring buffer */
-          ASSERT(add_rb_entry(priv) == OK);
+          ASSERT(add_rb_entry(priv, q) == OK);
         }
 
       /* Determine the payload size of this packet */
@@ -441,15 +615,19 @@ static int queue_data(FAR struct mods_i2c_dl_s *priv, __u8 msg_type,
           bitmask |= HDR_BIT_PKT1;
 
       /* Populate the I2C message */
-      set_txp_hdr(priv, bitmask);
-      memcpy(ring_buf_get_data(priv->txp_rb), dbuf, this_pl);
+      set_txp_hdr(q, bitmask);
+      memcpy(ring_buf_get_data(q->txp_rb), dbuf, this_pl);
 
       remaining -= this_pl;
       dbuf += this_pl;
 
-      next_txp(priv);
+      next_txp(q);
     }
 
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  tx_feed(priv);
+#endif
+
   set_int_if_needed(priv);
 
   return OK;
@@ -515,7 +693,8 @@ static int dl_recv(FAR struct mods_dl_s *dl, FAR const void *buf, size_t len)
   resp.bus_resp.version = PROTO_VER;
   resp.bus_resp.features = 0;
 
-  ret = queue_data(priv, MSG_TYPE_DL, &resp, sizeof(resp));
+  ret = queue_data(priv, tx_queue(priv, MODS_DL_PRIO_HIGH), MSG_TYPE_DL,
+                   &resp, sizeof(resp));
   if (ret)
     {
       /* Abort packet size change due to the send error */
@@ -614,7 +793,7 @@ static int rx_stop_success(FAR struct mods_i2c_dl_s *priv)
       /* Change packet size if needed */
       if (priv->new_pl_size > 0)
         {
-          DEBUGASSERT(priv->txp_rb == priv->txc_rb);
+          DEBUGASSERT(tx_is_empty(priv));
           set_pl_size(priv, priv->new_pl_size);
           priv->new_pl_size = 0;
         }
@@ -928,22 +1107,29 @@ static const struct i2c_cb_ops_s cb_ops =
 };
 
 /* Called by network layer when there is data to be sent to base */
-static int queue_data_nw(FAR struct mods_dl_s *dl, const void *buf, size_t len)
+static int queue_data_prio(FAR struct mods_dl_s *dl, const void *buf,
+                           size_t len, enum mods_dl_prio prio)
 {
   FAR struct mods_i2c_dl_s *priv = (FAR struct mods_i2c_dl_s *)dl;
   int ret;
   irqstate_t flags;
 
   flags = irqsave();
-  ret = queue_data(priv, MSG_TYPE_NW, buf, len);
+  ret = queue_data(priv, tx_queue(priv, prio), MSG_TYPE_NW, buf, len);
   irqrestore(flags);
 
   return ret;
 }
 
+static int queue_data_nw(FAR struct mods_dl_s *dl, const void *buf, size_t len)
+{
+  return queue_data_prio(dl, buf, len, MODS_DL_PRIO_NORMAL);
+}
+
 static struct mods_dl_ops_s mods_dl_ops =
 {
   .send = queue_data_nw,
+  .send_prio = queue_data_prio,
 };
 
 static struct mods_i2c_dl_s mods_i2c_dl =
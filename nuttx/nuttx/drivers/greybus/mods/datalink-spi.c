@@ -36,6 +36,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <arch/board/mods.h>
 #include <arch/byteorder.h>
@@ -93,6 +94,8 @@
 #define MAX_NUM_RB_ENTRIES (160)
 
 /* SPI packet header bit definitions */
+#define HDR_BIT_SYNC   (0x01 << 11) /* 1 = sequence restarts at this packet */
+#define HDR_BIT_BATCH  (0x01 << 10) /* 1 = payload holds batched messages */
 #define HDR_BIT_DUMMY  (0x01 << 9)  /* 1 = dummy packet */
 #define HDR_BIT_PKT1   (0x01 << 8)  /* 1 = first packet of message */
 #define HDR_BIT_VALID  (0x01 << 7)  /* 1 = packet has valid payload */
@@ -104,6 +107,9 @@
 
 /* Possible values for bus config features */
 #define DL_BIT_ACK     (1 << 0)     /* Flag to indicate ACKing is supported */
+#define DL_BIT_BATCH   (1 << 1)     /* Flag to indicate batching is supported */
+#define DL_BIT_WINDOW  (1 << 2)     /* Flag to indicate windows are supported */
+#define DL_BIT_RESIZE  (1 << 3)     /* Flag to indicate resizing is supported */
 
 /* SPI packet CRC size (in bytes) */
 #define CRC_SIZE       (2)
@@ -120,6 +126,41 @@
 /* Size of the header in bytes */
 #define HDR_SIZE       sizeof(struct spi_msg_hdr)
 
+/* Size of the header of each message in a batch packet */
+#define BATCH_HDR_SIZE sizeof(struct spi_batch_hdr)
+
+/* Size of the sequence header following the packet header in window mode */
+#define WIN_HDR_SIZE   sizeof(struct spi_win_hdr)
+
+#ifdef CONFIG_GREYBUS_MODS_ADAPTIVE_PKT_SIZE
+#  ifndef CONFIG_GREYBUS_MODS_ADAPT_PERIOD
+#    define CONFIG_GREYBUS_MODS_ADAPT_PERIOD 64
+#  endif
+#  ifndef CONFIG_GREYBUS_MODS_ADAPT_TXN_COST
+#    define CONFIG_GREYBUS_MODS_ADAPT_TXN_COST 32
+#  endif
+#endif
+
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+#  if (CONFIG_GREYBUS_MODS_WINDOW_SIZE < 1) || \
+      (CONFIG_GREYBUS_MODS_WINDOW_SIZE > 127)
+#    error "CONFIG_GREYBUS_MODS_WINDOW_SIZE must be between 1 and 127"
+#  endif
+#endif
+
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+/*
+ * Most packets held by the TX ring buffer at once. Anything more waits in
+ * the queue of its priority class, so that a message of higher priority
+ * never has more than that many packets to wait for.
+ */
+#  ifdef CONFIG_GREYBUS_MODS_WINDOW
+#    define TX_RING_DEPTH  CONFIG_GREYBUS_MODS_WINDOW_SIZE
+#  else
+#    define TX_RING_DEPTH  (1)
+#  endif
+#endif
+
 /* Macro to determine the payload size from the packet size */
 #define PL_SIZE(pkt_size)  (pkt_size - HDR_SIZE - CRC_SIZE)
 
@@ -143,7 +184,9 @@ enum ack
 enum dl_msg_id
 {
   DL_MSG_ID_BUS_CFG_REQ         = 0x00,
+  DL_MSG_ID_PKT_SIZE_REQ        = 0x01,
   DL_MSG_ID_BUS_CFG_RESP        = 0x80,
+  DL_MSG_ID_PKT_SIZE_RESP       = 0x81,
 };
 
 struct spi_msg_hdr
@@ -151,6 +194,47 @@ struct spi_msg_hdr
   __le16 bitmask;                /* See HDR_BIT_* defines for values */
 } __packed;
 
+/*
+ * A batch packet is a single packet (HDR_BIT_PKT1 set, no additional
+ * packets) carrying several network messages, each one preceded by this
+ * header. A zero length or the end of the payload ends the batch.
+ */
+struct spi_batch_hdr
+{
+  __le16 len;                    /* Length of the following message */
+} __packed;
+
+/*
+ * Once a window has been negotiated, every packet carries this header right
+ * after spi_msg_hdr. Valid packets are numbered and every packet reports
+ * the sequence number of the last packet received in order from the other
+ * side, which ACKs it and all the packets sent before it.
+ */
+struct spi_win_hdr
+{
+  __u8 seq;                      /* Sequence number of a valid packet */
+  __u8 ack;                      /* Last sequence number received in order */
+} __packed;
+
+/*
+ * Producer side of a queue of packets. The TX ring buffer has one, and with
+ * CONFIG_GREYBUS_MODS_TX_PRIORITY so does each priority class: its packets
+ * are moved to the TX ring buffer as it drains, see tx_feed().
+ */
+struct spi_txq
+{
+  struct ring_buf *txp_rb;       /* Producer ring buffer entry */
+#ifdef CONFIG_GREYBUS_MODS_BATCH
+  struct ring_buf *batch_rb;     /* Last queued packet, if still open batch */
+  size_t batch_len;              /* Bytes used in the batch_rb payload */
+#endif
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  struct ring_buf *txm_rb;       /* First packet of the oldest message */
+  struct ring_buf *txf_rb;       /* Next packet to move to the TX ring */
+  bool preempted;                /* Oldest message was preempted already */
+#endif
+};
+
 struct spi_work_s
 {
   struct dq_entry_s dq;          /* Implements a doubly linked list */
@@ -184,9 +268,42 @@ struct mods_spi_dl_s
   uint8_t tx_tries_remaining;    /* Send attempts remaining before giving up */
 #endif
 
-  struct ring_buf *txp_rb;       /* Producer TX ring buffer */
+#ifdef CONFIG_GREYBUS_MODS_BATCH
+  bool batch_supported;          /* Base supports batch packets */
+#endif
+
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+  uint8_t win_size;              /* Packets that can be sent before an ACK */
+  uint8_t new_win_size;          /* Window to use next time TX queue empty */
+  bool new_win_pending;          /* Flag to indicate new_win_size is valid */
+  struct ring_buf *txs_rb;       /* Next entry to send (txc_rb: oldest) */
+  uint8_t win_inflight;          /* Entries sent since txc_rb */
+  uint8_t win_sent;              /* Entries sent at least once since txc_rb */
+  uint8_t tx_seq;                /* Sequence number of the next new packet */
+  uint8_t rx_seq;                /* Sequence number expected from the base */
+  uint32_t win_ack_us;           /* Time of the last progress of the window */
+  bool win_sync;                 /* Next txc_rb packet restarts sequence */
+  __u8 *win_dummy;               /* Dummy packet sent when nothing to send */
+#endif
+
+#ifdef CONFIG_GREYBUS_MODS_ADAPTIVE_PKT_SIZE
+  bool resize_supported;         /* Base accepts packet size requests */
+  bool resize_pending;           /* Waiting for the base to reply */
+  uint32_t adapt_msgs;           /* Messages seen in the current period */
+  uint32_t adapt_hist[MODS_DL_SIZE_BUCKETS]; /* Message size distribution */
+  uint32_t adapt_txns;           /* Transactions in the current period */
+  uint32_t adapt_errs;           /* Failed transactions in current period */
+  struct mods_dl_pkt_stats stats; /* Outcome of the last evaluation */
+#endif
+
+  struct spi_txq txq;            /* Producer side of the TX ring buffer */
   struct ring_buf *txc_rb;       /* Consumer TX ring buffer */
 
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  struct spi_txq prio_txq[MODS_DL_PRIO_COUNT]; /* Waiting for the TX ring */
+  uint8_t tx_queued;             /* Entries in the TX ring, dummies included */
+#endif
+
   __u8 *rx_buf;                  /* Buffer for received packets */
 
   /*
@@ -194,6 +311,7 @@ struct mods_spi_dl_s
    * multiple packets)
    */
   __u8 rcvd_payload[MODS_DL_PAYLOAD_MAX_SZ];
+  __u8 *rcvd_buf;                /* rcvd_payload or a network layer buffer */
   uint32_t rcvd_payload_idx;
   uint8_t pkts_remaining;        /* Number of packets needed to complete msg */
 };
@@ -203,6 +321,7 @@ struct spi_dl_msg_bus_config_req
   __le16 max_pl_size;            /* Maximum payload size supported by base */
   __u8   features;               /* See DL_BIT_* defines for values */
   __u8   version;                /* SPI msg format version of base */
+  __u8   window;                 /* Maximum window size supported by base */
 } __packed;
 
 struct spi_dl_msg_bus_config_resp
@@ -211,6 +330,22 @@ struct spi_dl_msg_bus_config_resp
   __le16 pl_size;                /* Payload size that mod has selected to use */
   __u8   features;               /* See DL_BIT_* defines for values */
   __u8   version;                /* SPI msg format version supported by mod */
+  __u8   window;                 /* Window size that mod has selected to use */
+} __packed;
+
+/*
+ * Sent by the mod to switch to another payload size. The base replies with
+ * the payload size it switches to, or 0 to keep the current one. Both sides
+ * switch once their TX queue is empty, as after a bus configuration.
+ */
+struct spi_dl_msg_pkt_size_req
+{
+  __le16 pl_size;                /* Payload size requested by the mod */
+} __packed;
+
+struct spi_dl_msg_pkt_size_resp
+{
+  __le16 pl_size;                /* Payload size selected by the base */
 } __packed;
 
 struct spi_dl_msg
@@ -220,11 +355,13 @@ struct spi_dl_msg
     {
       struct spi_dl_msg_bus_config_req     bus_req;
       struct spi_dl_msg_bus_config_resp    bus_resp;
+      struct spi_dl_msg_pkt_size_req       size_req;
+      struct spi_dl_msg_pkt_size_resp      size_resp;
     };
 } __packed;
 
-static int queue_data(FAR struct mods_spi_dl_s *priv, __u8 msg_type,
-                      const void *buf, size_t len);
+static int queue_data(FAR struct mods_spi_dl_s *priv, FAR struct spi_txq *q,
+                      __u8 msg_type, const void *buf, size_t len);
 
 static void dl_work_queue(FAR struct mods_spi_dl_s *priv,
                           struct spi_work_s *work, worker_t worker)
@@ -267,6 +404,36 @@ static inline bool txc_rb_is_valid(FAR struct mods_spi_dl_s *priv)
   return (le16_to_cpu(hdr->bitmask) & HDR_BIT_VALID) != 0;
 }
 
+/* Size of the header of the packets currently exchanged */
+static inline size_t pkt_hdr_size(FAR struct mods_spi_dl_s *priv)
+{
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+  if (priv->win_size)
+      return HDR_SIZE + WIN_HDR_SIZE;
+#endif
+
+  return HDR_SIZE;
+}
+
+/* Size of the payload of the packets currently exchanged */
+static inline size_t pkt_pl_size(FAR struct mods_spi_dl_s *priv)
+{
+  return priv->pkt_size - pkt_hdr_size(priv) - CRC_SIZE;
+}
+
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+/*
+ * A message spans at most HDR_BIT_PKTS + 1 packets. Window mode can only be
+ * used with packets of pkt_size if, after the window header, that is still
+ * enough for the largest message.
+ */
+static inline bool win_fits(size_t pkt_size)
+{
+  return (HDR_BIT_PKTS + 1) * (PL_SIZE(pkt_size) - WIN_HDR_SIZE) >=
+         MODS_DL_PAYLOAD_MAX_SZ;
+}
+#endif
+
 static int alloc_callback(struct ring_buf *rb, void *arg)
 {
   int *header = ring_buf_get_buf(rb);
@@ -277,6 +444,92 @@ static int alloc_callback(struct ring_buf *rb, void *arg)
   return OK;
 }
 
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+/* (Re)allocate the ring buffer of a priority class, dropping its packets */
+static void txq_alloc(FAR struct spi_txq *q, unsigned int entries,
+                      size_t pkt_size)
+{
+  int rb_num = 0;
+
+  ring_buf_free_ring(q->txp_rb, NULL /* free_callback */, NULL /* arg */);
+
+  q->txp_rb = ring_buf_alloc_ring(entries /* entries */,
+      sizeof(rb_num) /* headroom */, pkt_size /* data len */,
+      0 /* tailroom */, alloc_callback /* alloc_callback */,
+      NULL /* free_callback */, &rb_num /* arg */);
+  ASSERT(q->txp_rb);
+  q->txm_rb = q->txp_rb;
+  q->txf_rb = q->txp_rb;
+  q->preempted = false;
+#ifdef CONFIG_GREYBUS_MODS_BATCH
+  q->batch_rb = NULL;
+#endif
+}
+#endif
+
+/* Queue to put the messages of the given priority in */
+static inline FAR struct spi_txq *tx_queue(FAR struct mods_spi_dl_s *priv,
+                                           enum mods_dl_prio prio)
+{
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  return &priv->prio_txq[prio];
+#else
+  return &priv->txq;
+#endif
+}
+
+/* True when no packet is waiting to be sent */
+static bool tx_is_empty(FAR struct mods_spi_dl_s *priv)
+{
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  int prio;
+
+  for (prio = 0; prio < MODS_DL_PRIO_COUNT; prio++)
+    {
+      if (ring_buf_is_consumers(priv->prio_txq[prio].txm_rb))
+          return false;
+    }
+#endif
+
+  return priv->txq.txp_rb == priv->txc_rb;
+}
+
+/* Drop the partially received message (if any) */
+static void rx_reset(FAR struct mods_spi_dl_s *priv)
+{
+#ifdef CONFIG_GREYBUS_MODS_ZERO_COPY_RX
+  if (priv->rcvd_buf != priv->rcvd_payload)
+    {
+      priv->cb->rx_free(priv->rcvd_buf);
+      priv->rcvd_buf = priv->rcvd_payload;
+    }
+#endif
+
+  priv->rcvd_payload_idx = 0;
+  priv->pkts_remaining = 0;
+}
+
+#ifdef CONFIG_GREYBUS_MODS_ZERO_COPY_RX
+/*
+ * Reassemble a network message directly in a buffer of the network layer,
+ * sized from the packet count of its first packet. Messages that would not
+ * fit in MODS_DL_PAYLOAD_MAX_SZ, or if no buffer is available, go through
+ * rcvd_payload as usual.
+ */
+static void rx_start_zero_copy(FAR struct mods_spi_dl_s *priv, size_t pl_size)
+{
+  size_t len = (priv->pkts_remaining + 1) * pl_size;
+  __u8 *buf;
+
+  if (!priv->cb->rx_alloc || len > MODS_DL_PAYLOAD_MAX_SZ)
+      return;
+
+  buf = priv->cb->rx_alloc(len);
+  if (buf)
+      priv->rcvd_buf = buf;
+}
+#endif
+
 static void set_pkt_size(FAR struct mods_spi_dl_s *priv, size_t pkt_size)
 {
   int rb_num;
@@ -286,33 +539,66 @@ static void set_pkt_size(FAR struct mods_spi_dl_s *priv, size_t pkt_size)
    * Immediately return if packet size is not changing and ring buffer is
    * in a good state.
    */
-  if ((pkt_size == priv->pkt_size) && (priv->txp_rb == priv->txc_rb))
+  if ((pkt_size == priv->pkt_size) && tx_is_empty(priv))
       return;
 
   /* Free any existing RX buffer (if any) */
   if (priv->rx_buf)
     free(priv->rx_buf);
 
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+  if (priv->win_dummy)
+    free(priv->win_dummy);
+#endif
+
   /* Free existing TX ring buffer (if any) */
-  ring_buf_free_ring(priv->txp_rb, NULL /* free_callback */, NULL /* arg */);
+  ring_buf_free_ring(priv->txq.txp_rb, NULL /* free_callback */, NULL /* arg */);
+#ifdef CONFIG_GREYBUS_MODS_BATCH
+  priv->txq.batch_rb = NULL;
+#endif
 
   /* Calculate the number of ring buffer entries are needed */
   rb_entries  = (MODS_DL_PAYLOAD_MAX_SZ / PL_SIZE(pkt_size));
   rb_entries *= unipro_cport_count();
   rb_entries  = MIN(rb_entries, MAX_NUM_RB_ENTRIES);
 
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  /*
+   * The normal class gets the entries the TX ring buffer would otherwise
+   * have, the high one room for two messages of the maximum size.
+   */
+  txq_alloc(&priv->prio_txq[MODS_DL_PRIO_NORMAL], rb_entries, pkt_size);
+  txq_alloc(&priv->prio_txq[MODS_DL_PRIO_HIGH],
+            MIN(rb_entries, 2 * ((MODS_DL_PAYLOAD_MAX_SZ +
+                                  PL_SIZE(pkt_size) - 1) / PL_SIZE(pkt_size))),
+            pkt_size);
+
+  /* One more entry than held at once, so a full ring is never empty */
+  rb_entries = TX_RING_DEPTH + 1;
+  priv->tx_queued = 0;
+#endif
+
   /* Allocate RX buffer */
   priv->rx_buf = malloc(pkt_size);
   ASSERT(priv->rx_buf);
 
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+  /* Allocate the dummy packet, which is not part of the ring in window mode */
+  priv->win_dummy = zalloc(pkt_size);
+  ASSERT(priv->win_dummy);
+#endif
+
   /* Allocate TX ring buffer */
   rb_num = 0;
-  priv->txp_rb = ring_buf_alloc_ring(rb_entries /* entries */,
+  priv->txq.txp_rb = ring_buf_alloc_ring(rb_entries /* entries */,
       sizeof(rb_num) /* headroom */, pkt_size /* data len */,
       0 /* tailroom */, alloc_callback /* alloc_callback */,
       NULL /* free_callback */, &rb_num /* arg */);
-  ASSERT(priv->txp_rb);
-  priv->txc_rb = priv->txp_rb;
+  ASSERT(priv->txq.txp_rb);
+  priv->txc_rb = priv->txq.txp_rb;
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+  priv->txs_rb = priv->txq.txp_rb;
+#endif
 
   /* Save new packet size */
   priv->pkt_size = pkt_size;
@@ -320,6 +606,167 @@ static void set_pkt_size(FAR struct mods_spi_dl_s *priv, size_t pkt_size)
   dbg("%d bytes, %d entries\n", priv->pkt_size, rb_entries);
 }
 
+#ifdef CONFIG_GREYBUS_MODS_ADAPTIVE_PKT_SIZE
+/* Start a new statistics period */
+static void adapt_reset(FAR struct mods_spi_dl_s *priv)
+{
+  priv->adapt_msgs = 0;
+  priv->adapt_txns = 0;
+  priv->adapt_errs = 0;
+  memset(priv->adapt_hist, 0, sizeof(priv->adapt_hist));
+}
+
+/* Account for a message sent or received */
+static void adapt_count(FAR struct mods_spi_dl_s *priv, size_t len)
+{
+  unsigned int i = 0;
+
+  if (!priv->resize_supported)
+      return;
+
+  while ((i < MODS_DL_SIZE_BUCKETS - 1) && (((size_t)1 << i) < len))
+      i++;
+
+  priv->adapt_hist[i]++;
+  priv->adapt_msgs++;
+}
+
+/*
+ * Pick the payload size that would have carried the messages of the last
+ * period with the fewest bytes on the wire. Each packet costs its size plus
+ * CONFIG_GREYBUS_MODS_ADAPT_TXN_COST, scaled up by the chance of having to
+ * send it again. That chance is derived from the rate of failed
+ * transactions at the current size, assuming errors grow with the length of
+ * the packet. In window mode, the window header is not counted as payload
+ * and sizes too small for the largest message are skipped. The base is
+ * asked to switch only if it saves at least 1/8th.
+ */
+/* Caller must hold semaphore before calling this function! */
+static void adapt_evaluate(FAR struct mods_spi_dl_s *priv)
+{
+  struct mods_dl_pkt_stats *st = &priv->stats;
+  struct spi_dl_msg req;
+  size_t cur_pl = PL_SIZE(priv->pkt_size);
+  size_t best_pl = cur_pl;
+  uint64_t best_cost = UINT64_MAX;
+  uint64_t cur_cost = 0;
+  uint64_t cost;
+  uint32_t fail;
+  unsigned int i;
+  unsigned int j;
+  size_t pl;
+  size_t msg_pl;
+
+  if (priv->resize_pending || priv->new_pkt_size)
+      return;
+
+  memcpy(st->msgs, priv->adapt_hist, sizeof(st->msgs));
+  st->txns = priv->adapt_txns;
+  st->txn_errs = priv->adapt_errs;
+  adapt_reset(priv);
+
+  for (i = 0; i < MODS_DL_SIZE_BUCKETS; i++)
+    {
+      pl = (size_t)1 << i;
+      st->cost[i] = 0;
+
+      if ((pl < DEFAULT_PAYLOAD_SZ) || (pl > st->max_pl_size))
+          continue;
+
+      /* Part of the payload left for messages once in a packet */
+      msg_pl = pl;
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+      if (priv->win_size)
+        {
+          if (!win_fits(PKT_SIZE(pl)))
+              continue;
+
+          msg_pl -= WIN_HDR_SIZE;
+        }
+#endif
+
+      cost = 0;
+      for (j = 0; j < MODS_DL_SIZE_BUCKETS; j++)
+          cost += (uint64_t)st->msgs[j] *
+                  ((((size_t)1 << j) + msg_pl - 1) / msg_pl) *
+                  (PKT_SIZE(pl) + CONFIG_GREYBUS_MODS_ADAPT_TXN_COST);
+
+      /* Failure probability as a Q16 fraction, capped to 90% */
+      fail = 0;
+      if (st->txns)
+          fail = MIN((uint64_t)st->txn_errs * PKT_SIZE(pl) * 65536 /
+                     ((uint64_t)st->txns * priv->pkt_size), 58982);
+      cost = cost * 65536 / (65536 - fail);
+
+      st->cost[i] = MIN(cost, UINT32_MAX);
+
+      if (pl == cur_pl)
+          cur_cost = cost;
+
+      if (cost < best_cost)
+        {
+          best_cost = cost;
+          best_pl = pl;
+        }
+    }
+
+  st->chosen_pl_size = best_pl;
+
+  vdbg("pl_size %d: cost %u, best %d: cost %u, %u/%u txn errors\n",
+       cur_pl, (uint32_t)cur_cost, best_pl, (uint32_t)best_cost,
+       st->txn_errs, st->txns);
+
+  if ((best_pl == cur_pl) || (best_cost >= cur_cost - cur_cost / 8))
+      return;
+
+  dbg("Request pl_size %d (was %d)\n", best_pl, cur_pl);
+
+  req.id = DL_MSG_ID_PKT_SIZE_REQ;
+  req.size_req.pl_size = cpu_to_le16(best_pl);
+  if (queue_data(priv, tx_queue(priv, MODS_DL_PRIO_HIGH), MSG_TYPE_DL, &req,
+                 sizeof(req.id) + sizeof(req.size_req)) == OK)
+    {
+      priv->resize_pending = true;
+      st->resizes++;
+    }
+}
+
+/* Caller must hold semaphore before calling this function! */
+static int adapt_resp(FAR struct mods_spi_dl_s *priv,
+                      FAR struct spi_dl_msg_pkt_size_resp *resp)
+{
+  uint16_t pl_size = le16_to_cpu(resp->pl_size);
+
+  priv->resize_pending = false;
+
+  if (!pl_size)
+    {
+      dbg("Base kept the payload size\n");
+      return OK;
+    }
+
+  if (!IS_PWR_OF_TWO(pl_size) || (pl_size < DEFAULT_PAYLOAD_SZ) ||
+      (pl_size > priv->stats.max_pl_size))
+    {
+      dbg("Invalid payload size (%d)\n", pl_size);
+      return -EINVAL;
+    }
+
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+  if (priv->win_size && !win_fits(PKT_SIZE(pl_size)))
+    {
+      dbg("Payload size too small for window (%d)\n", pl_size);
+      return -EINVAL;
+    }
+#endif
+
+  /* Same as after a bus configuration, switch once TX queue is empty */
+  priv->new_pkt_size = PKT_SIZE(pl_size);
+
+  return OK;
+}
+#endif
+
 /* Caller must hold semaphore before calling this function! */
 static int dl_recv(FAR struct mods_dl_s *dl, FAR const void *buf, size_t len)
 {
@@ -327,6 +774,7 @@ static int dl_recv(FAR struct mods_dl_s *dl, FAR const void *buf, size_t len)
   struct spi_dl_msg req;
   struct spi_dl_msg resp;
   uint16_t pl_size;
+  size_t resp_len;
 
   /*
    * To support bases running firmware with fewer values in the
@@ -335,6 +783,11 @@ static int dl_recv(FAR struct mods_dl_s *dl, FAR const void *buf, size_t len)
   memset(&req, 0, sizeof(req));
   memcpy(&req, buf, MIN(len, sizeof(req)));
 
+#ifdef CONFIG_GREYBUS_MODS_ADAPTIVE_PKT_SIZE
+  if (req.id == DL_MSG_ID_PKT_SIZE_RESP)
+      return adapt_resp(priv, &req.size_resp);
+#endif
+
   /* Only BUS_CFG_REQ is supported */
   if (req.id != DL_MSG_ID_BUS_CFG_REQ)
     {
@@ -379,6 +832,7 @@ static int dl_recv(FAR struct mods_dl_s *dl, FAR const void *buf, size_t len)
 
   resp.bus_resp.version = PROTO_VER;
   resp.bus_resp.features = 0;
+  resp.bus_resp.window = 0;
 
 #ifdef CONFIG_GREYBUS_MODS_ACK
   if (req.bus_req.features & DL_BIT_ACK)
@@ -390,28 +844,82 @@ static int dl_recv(FAR struct mods_dl_s *dl, FAR const void *buf, size_t len)
   vdbg("ack_supported = %d\n", priv->ack_supported);
 #endif
 
-  return queue_data(priv, MSG_TYPE_DL, &resp, sizeof(resp));
+#ifdef CONFIG_GREYBUS_MODS_BATCH
+  if (req.bus_req.features & DL_BIT_BATCH)
+    {
+      priv->batch_supported = true;
+      resp.bus_resp.features |= DL_BIT_BATCH;
+    }
+
+  vdbg("batch_supported = %d\n", priv->batch_supported);
+#endif
+
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+  /*
+   * Like the packet size, the window only takes effect once the reply has
+   * been sent and the TX queue is empty.
+   */
+  priv->new_win_size = 0;
+  if ((req.bus_req.features & DL_BIT_WINDOW) && req.bus_req.window &&
+      win_fits(priv->new_pkt_size ? priv->new_pkt_size : priv->pkt_size))
+    {
+      priv->new_win_size = MIN(CONFIG_GREYBUS_MODS_WINDOW_SIZE,
+                               req.bus_req.window);
+      resp.bus_resp.features |= DL_BIT_WINDOW;
+      resp.bus_resp.window = priv->new_win_size;
+    }
+  priv->new_win_pending = true;
+
+  vdbg("new_win_size = %d\n", priv->new_win_size);
+#endif
+
+#ifdef CONFIG_GREYBUS_MODS_ADAPTIVE_PKT_SIZE
+  priv->resize_supported = false;
+  priv->resize_pending = false;
+  if (req.bus_req.features & DL_BIT_RESIZE)
+    {
+      priv->resize_supported = true;
+      resp.bus_resp.features |= DL_BIT_RESIZE;
+    }
+
+  priv->stats.max_pl_size = MIN(le16_to_cpu(req.bus_req.max_pl_size),
+                                MODS_DL_PAYLOAD_MAX_SZ);
+  adapt_reset(priv);
+
+  vdbg("resize_supported = %d\n", priv->resize_supported);
+#endif
+
+  /* Bases without window support expect the shorter, original reply */
+  resp_len = sizeof(resp.id) + sizeof(resp.bus_resp);
+  if (!(resp.bus_resp.features & DL_BIT_WINDOW))
+      resp_len -= sizeof(resp.bus_resp.window);
+
+  return queue_data(priv, tx_queue(priv, MODS_DL_PRIO_HIGH), MSG_TYPE_DL,
+                    &resp, resp_len);
 }
 
 /* Caller must hold semaphore before calling this function! */
-static inline void set_txp_hdr(FAR struct mods_spi_dl_s *priv, uint16_t bits)
+static inline void set_txp_hdr(FAR struct spi_txq *q, uint16_t bits)
 {
-  struct spi_msg_hdr *hdr = ring_buf_get_data(priv->txp_rb);
+  struct spi_msg_hdr *hdr = ring_buf_get_data(q->txp_rb);
   hdr->bitmask = cpu_to_le16(bits);
 }
 
 /* Caller must hold semaphore before calling this function! */
-static inline void next_txp(FAR struct mods_spi_dl_s *priv)
+static inline void next_txp(FAR struct spi_txq *q)
 {
-  ring_buf_pass(priv->txp_rb);
-  priv->txp_rb = ring_buf_get_next(priv->txp_rb);
+  ring_buf_pass(q->txp_rb);
+  q->txp_rb = ring_buf_get_next(q->txp_rb);
 }
 
 /* Caller must hold semaphore before calling this function! */
 static inline void setup_for_dummy_tx(FAR struct mods_spi_dl_s *priv)
 {
-  set_txp_hdr(priv, HDR_BIT_DUMMY);
-  next_txp(priv);
+  set_txp_hdr(&priv->txq, HDR_BIT_DUMMY);
+  next_txp(&priv->txq);
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  priv->tx_queued++;
+#endif
 }
 
 static inline void deassert_rfr_int(void)
@@ -420,11 +928,182 @@ static inline void deassert_rfr_int(void)
   mods_host_int_set(false);
 }
 
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+/*
+ * Pick the packet to send in window mode: the next entry not sent yet (or
+ * to be sent again after a timeout) if the window allows it, otherwise a
+ * dummy packet. Either way, the packet ACKs what was received so far.
+ */
+/* Caller must hold semaphore before calling this function! */
+static __u8 *win_next_tx(FAR struct mods_spi_dl_s *priv)
+{
+  struct ring_buf *rb = priv->txs_rb;
+  struct spi_msg_hdr *hdr;
+  struct spi_win_hdr *whdr;
+  __u8 *data;
+
+  if ((priv->win_inflight < priv->win_size) && ring_buf_is_consumers(rb))
+    {
+      data = ring_buf_get_data(rb);
+      hdr = (struct spi_msg_hdr *)data;
+      whdr = (struct spi_win_hdr *)&data[HDR_SIZE];
+
+      /* Sequence numbers are kept when packets are sent again */
+      if (priv->win_inflight == priv->win_sent)
+        {
+          if (!priv->win_sent)
+              priv->win_ack_us = hrt_getusec();
+
+          whdr->seq = priv->tx_seq++;
+          priv->win_sent++;
+        }
+
+      if (priv->win_sync && (rb == priv->txc_rb))
+        {
+          hdr->bitmask = cpu_to_le16(le16_to_cpu(hdr->bitmask) | HDR_BIT_SYNC);
+          priv->win_sync = false;
+        }
+
+#ifdef CONFIG_GREYBUS_MODS_BATCH
+      /* Nothing more can be packed once the packet is in the hands of SPI */
+      if (rb == priv->txq.batch_rb)
+          priv->txq.batch_rb = NULL;
+#endif
+
+      vdbg("%d RX/TX seq=%d\n", *((int *)ring_buf_get_buf(rb)), whdr->seq);
+
+      priv->win_inflight++;
+      priv->txs_rb = ring_buf_get_next(rb);
+    }
+  else
+    {
+      vdbg("RX\n");
+
+      data = priv->win_dummy;
+      hdr = (struct spi_msg_hdr *)data;
+      whdr = (struct spi_win_hdr *)&data[HDR_SIZE];
+      hdr->bitmask = cpu_to_le16(HDR_BIT_DUMMY);
+    }
+
+  whdr->ack = priv->rx_seq - 1;
+
+  return data;
+}
+#endif
+
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+/* Release the packets of the oldest message of a class, all moved by now */
+static void txq_release(FAR struct mods_spi_dl_s *priv, FAR struct spi_txq *q)
+{
+  struct spi_msg_hdr *hdr = ring_buf_get_data(q->txm_rb);
+  int packets = (le16_to_cpu(hdr->bitmask) & HDR_BIT_PKTS) + 1;
+
+  while (packets-- > 0)
+    {
+      memset(ring_buf_get_data(q->txm_rb), 0, priv->pkt_size);
+      ring_buf_reset(q->txm_rb);
+      ring_buf_pass(q->txm_rb);
+      q->txm_rb = ring_buf_get_next(q->txm_rb);
+    }
+
+  q->txf_rb = q->txm_rb;
+  q->preempted = false;
+}
+
+/*
+ * Pick the class to move the next packet from. A message partly moved is
+ * normally finished first, since the base reassembles one message at a
+ * time. When a class of higher priority has a message waiting, the one in
+ * progress is preempted instead: the base drops the packets it already got
+ * when the first packet of the other message arrives, and the preempted
+ * message is sent again from its first packet afterwards. A message is
+ * preempted at most once, so bulk traffic keeps moving.
+ */
+static FAR struct spi_txq *txq_pick(FAR struct mods_spi_dl_s *priv)
+{
+  FAR struct spi_txq *cur = NULL;
+  FAR struct spi_txq *q;
+  int prio;
+
+  for (prio = 0; prio < MODS_DL_PRIO_COUNT; prio++)
+    {
+      q = &priv->prio_txq[prio];
+      if (q->txf_rb != q->txm_rb)
+          cur = q;
+    }
+
+  for (prio = MODS_DL_PRIO_COUNT - 1; prio >= 0; prio--)
+    {
+      q = &priv->prio_txq[prio];
+      if (q == cur)
+          return cur;
+
+      if (!ring_buf_is_consumers(q->txf_rb))
+          continue;
+
+      if (cur && cur->preempted)
+          return cur;
+
+      if (cur)
+        {
+          vdbg("preempt class %d\n", (int)(cur - priv->prio_txq));
+          cur->txf_rb = cur->txm_rb;
+          cur->preempted = true;
+        }
+
+      return q;
+    }
+
+  return NULL;
+}
+
+/*
+ * Move packets from the priority classes to the TX ring buffer, keeping no
+ * more in there than can be in flight at once.
+ */
+/* Caller must hold semaphore before calling this function! */
+static void tx_feed(FAR struct mods_spi_dl_s *priv)
+{
+  FAR struct spi_txq *q;
+  struct spi_msg_hdr *hdr;
+  uint8_t depth = 1;
+
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+  if (priv->win_size)
+      depth = priv->win_size;
+#endif
+
+  while ((priv->tx_queued < depth) && (q = txq_pick(priv)))
+    {
+      hdr = ring_buf_get_data(q->txf_rb);
+      memcpy(ring_buf_get_data(priv->txq.txp_rb), hdr, priv->pkt_size);
+      ring_buf_put(priv->txq.txp_rb, priv->pkt_size);
+      next_txp(&priv->txq);
+      priv->tx_queued++;
+
+#ifdef CONFIG_GREYBUS_MODS_BATCH
+      /* Nothing more can be packed once the packet is in the TX ring */
+      if (q->txf_rb == q->batch_rb)
+          q->batch_rb = NULL;
+#endif
+
+      q->txf_rb = ring_buf_get_next(q->txf_rb);
+      if (!(le16_to_cpu(hdr->bitmask) & HDR_BIT_PKTS))
+          txq_release(priv, q);
+    }
+}
+#endif
+
 /* Caller must hold semaphore before calling this function! */
 static void xfer(FAR struct mods_spi_dl_s *priv)
 {
   struct ring_buf *rb;
   bool set_int = false;
+  void *tx;
+
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  tx_feed(priv);
+#endif
 
   rb = priv->txc_rb;
 
@@ -446,6 +1125,18 @@ static void xfer(FAR struct mods_spi_dl_s *priv)
   /* Set flag to indicate a transfer is setup */
   priv->xfer_setup = true;
 
+  tx = ring_buf_get_data(rb);
+
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+  if (priv->win_size)
+    {
+      tx = win_next_tx(priv);
+
+      /* Entries not ACK'd yet also need the base to send a packet */
+      set_int = ring_buf_is_consumers(rb);
+    }
+  else
+#endif
   if (ring_buf_is_producers(rb))
     {
       vdbg("%d RX\n", *((int *)ring_buf_get_buf(rb)));
@@ -455,6 +1146,12 @@ static void xfer(FAR struct mods_spi_dl_s *priv)
     {
       vdbg("%d RX/TX\n", *((int *)ring_buf_get_buf(rb)));
       set_int = true;
+
+#ifdef CONFIG_GREYBUS_MODS_BATCH
+      /* Nothing more can be packed once the packet is in the hands of SPI */
+      if (rb == priv->txq.batch_rb)
+          priv->txq.batch_rb = NULL;
+#endif
     }
 
 #ifdef CONFIG_GREYBUS_MODS_ACK
@@ -468,7 +1165,7 @@ static void xfer(FAR struct mods_spi_dl_s *priv)
     }
 #endif
 
-  SPI_EXCHANGE(priv->spi, ring_buf_get_data(rb), priv->rx_buf, priv->pkt_size);
+  SPI_EXCHANGE(priv->spi, tx, priv->rx_buf, priv->pkt_size);
 
   /* Signal to base that we're ready to transceive */
   mods_rfr_set(1);
@@ -479,7 +1176,8 @@ static void xfer(FAR struct mods_spi_dl_s *priv)
 
 static void reset_txc_rb_entry(FAR struct mods_spi_dl_s *priv)
 {
-  if ((priv->txp_rb == priv->txc_rb) && ring_buf_is_producers(priv->txp_rb))
+  if ((priv->txq.txp_rb == priv->txc_rb) &&
+      ring_buf_is_producers(priv->txq.txp_rb))
     {
       vdbg("skip\n");
       return;
@@ -487,6 +1185,21 @@ static void reset_txc_rb_entry(FAR struct mods_spi_dl_s *priv)
 
   vdbg("%d\n", *((int *)ring_buf_get_buf(priv->txc_rb)));
 
+#ifdef CONFIG_GREYBUS_MODS_BATCH
+  if (priv->txc_rb == priv->txq.batch_rb)
+      priv->txq.batch_rb = NULL;
+#endif
+
+#ifdef CONFIG_GREYBUS_MODS_TX_PRIORITY
+  priv->tx_queued--;
+#endif
+
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+  /* The next entry to send is never behind the oldest entry */
+  if (priv->txs_rb == priv->txc_rb)
+      priv->txs_rb = ring_buf_get_next(priv->txc_rb);
+#endif
+
   memset(ring_buf_get_data(priv->txc_rb), 0, priv->pkt_size);
   ring_buf_reset(priv->txc_rb);
   ring_buf_pass(priv->txc_rb);
@@ -529,6 +1242,20 @@ static int attach_cb(FAR void *arg, const void *data)
       priv->tx_tries_remaining = NUM_TRIES;
 #endif
 
+#ifdef CONFIG_GREYBUS_MODS_BATCH
+      priv->batch_supported = false;
+#endif
+
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+      priv->win_size = 0;
+      priv->new_win_pending = false;
+#endif
+
+#ifdef CONFIG_GREYBUS_MODS_ADAPTIVE_PKT_SIZE
+      priv->resize_supported = false;
+      priv->resize_pending = false;
+#endif
+
       if (priv->xfer_setup)
         {
           /* Cancel SPI transaction */
@@ -549,6 +1276,11 @@ static int attach_cb(FAR void *arg, const void *data)
           reset_txc_rb_entry(priv);
         }
 
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+      priv->win_inflight = 0;
+      priv->win_sent = 0;
+#endif
+
       /* Return packet size back to default */
       set_pkt_size(priv, PKT_SIZE(DEFAULT_PAYLOAD_SZ));
 
@@ -645,12 +1377,177 @@ static bool ack_handler(FAR struct mods_spi_dl_s *priv, enum ack ack_req)
   return true;
 }
 
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+/* Switch to the window negotiated with the base. TX queue must be empty! */
+static void win_apply(FAR struct mods_spi_dl_s *priv)
+{
+  priv->win_size = priv->new_win_size;
+  priv->new_win_pending = false;
+
+  if (priv->win_size && !win_fits(priv->pkt_size))
+    {
+      dbg("window not usable with %d byte packets\n", priv->pkt_size);
+      priv->win_size = 0;
+    }
+
+  priv->txs_rb = priv->txc_rb;
+  priv->win_inflight = 0;
+  priv->win_sent = 0;
+  priv->win_sync = false;
+  priv->tx_seq = 0;
+  priv->rx_seq = 0;
+
+  dbg("window = %d\n", priv->win_size);
+}
+
+/* Release the oldest entry sent */
+static void win_release(FAR struct mods_spi_dl_s *priv)
+{
+  if (priv->win_inflight)
+      priv->win_inflight--;
+  priv->win_sent--;
+
+  reset_txc_rb_entry(priv);
+}
+
+/* Release the entries up to and including the one ACK'd by the base */
+static void win_ack(FAR struct mods_spi_dl_s *priv, uint8_t ack)
+{
+  struct spi_win_hdr *whdr;
+  bool progress = false;
+
+  while (priv->win_sent)
+    {
+      whdr = (struct spi_win_hdr *)
+          ((__u8 *)ring_buf_get_data(priv->txc_rb) + HDR_SIZE);
+      if ((int8_t)(whdr->seq - ack) > 0)
+          break;
+
+      win_release(priv);
+      progress = true;
+    }
+
+  if (!progress)
+      return;
+
+  if (priv->tx_tries_remaining != NUM_TRIES)
+    {
+      dbg("Retry successful\n");
+      priv->tx_tries_remaining = NUM_TRIES;
+    }
+
+  priv->win_ack_us = hrt_getusec();
+}
+
+/*
+ * When the window has not moved for too long, send again the entries not
+ * ACK'd yet, starting from the oldest one. After NUM_TRIES attempts, the
+ * oldest entry is dropped and the next packet tells the base to restart
+ * its sequence from there.
+ */
+static void win_check_timeout(FAR struct mods_spi_dl_s *priv)
+{
+  if (!priv->win_sent || ((hrt_getusec() - priv->win_ack_us) < ACK_TIMEOUT_US))
+      return;
+
+  if (--priv->tx_tries_remaining > 0)
+    {
+      dbg("Retry: No ACK received\n");
+    }
+  else
+    {
+      dbg("Abort: No ACK received\n");
+      priv->tx_tries_remaining = NUM_TRIES;
+      win_release(priv);
+      priv->win_sync = true;
+    }
+
+  priv->txs_rb = priv->txc_rb;
+  priv->win_inflight = 0;
+  priv->win_ack_us = hrt_getusec();
+}
+
+/*
+ * Check a valid packet from the base is the next one in sequence. Packets
+ * received twice or after a lost one are dropped, the base sends them again.
+ */
+static bool win_rx(FAR struct mods_spi_dl_s *priv, uint16_t bitmask,
+                   uint8_t seq)
+{
+  if ((bitmask & HDR_BIT_SYNC) && ((int8_t)(seq - priv->rx_seq) > 0))
+    {
+      dbg("Resync: seq=%d, expected=%d\n", seq, priv->rx_seq);
+
+      /* The message being received lost at least one packet */
+      rx_reset(priv);
+      priv->rx_seq = seq;
+    }
+
+  if (seq != priv->rx_seq)
+    {
+      vdbg("Drop: seq=%d, expected=%d\n", seq, priv->rx_seq);
+      return false;
+    }
+
+  priv->rx_seq++;
+
+  return true;
+}
+#endif
+
+#ifdef CONFIG_GREYBUS_MODS_BATCH
+/* Hand the messages of a batch packet one by one to the upper layer */
+static void recv_batch(FAR struct mods_spi_dl_s *priv, buf_t recv,
+                       uint16_t bitmask, __u8 *payload, size_t pl_size)
+{
+  struct spi_batch_hdr *bhdr;
+  size_t offset = 0;
+  size_t len;
+
+  if ((bitmask & (HDR_BIT_PKT1 | HDR_BIT_PKTS)) != HDR_BIT_PKT1)
+    {
+      dbg("Batch packet must be a single packet\n");
+      return;
+    }
+
+  /* A batch packet does not belong to any message being reassembled */
+  if (priv->rcvd_payload_idx)
+    {
+      dbg("Batch pkt recv'd before prev msg complete\n");
+      rx_reset(priv);
+    }
+
+  while (offset + BATCH_HDR_SIZE <= pl_size)
+    {
+      bhdr = (struct spi_batch_hdr *)&payload[offset];
+      len = le16_to_cpu(bhdr->len);
+      offset += BATCH_HDR_SIZE;
+
+      if (!len)
+          break;
+
+      if (offset + len > pl_size)
+        {
+          dbg("Batched message overflows packet\n");
+          break;
+        }
+
+#ifdef CONFIG_GREYBUS_MODS_ADAPTIVE_PKT_SIZE
+      adapt_count(priv, len);
+#endif
+      recv(&priv->dl, &payload[offset], len);
+      offset += len;
+    }
+}
+#endif
+
 static void txn_finished_worker(FAR void *arg)
 {
   FAR struct mods_spi_dl_s *priv = arg;
   struct spi_msg_hdr *hdr = (struct spi_msg_hdr *)priv->rx_buf;
   uint16_t bitmask = le16_to_cpu(hdr->bitmask);
-  size_t pl_size = PL_SIZE(priv->pkt_size);
+  size_t hdr_size = pkt_hdr_size(priv);
+  size_t pl_size = pkt_pl_size(priv);
   buf_t recv = priv->cb->recv;
   int ret;
   enum ack ack_req;
@@ -665,6 +1562,10 @@ static void txn_finished_worker(FAR void *arg)
 
   deassert_rfr_int();
 
+#ifdef CONFIG_GREYBUS_MODS_ADAPTIVE_PKT_SIZE
+  priv->adapt_txns++;
+#endif
+
   switch (bitmask & (HDR_BIT_VALID | HDR_BIT_DUMMY))
     {
       case HDR_BIT_VALID:
@@ -684,6 +1585,21 @@ static void txn_finished_worker(FAR void *arg)
         break;
     }
 
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+  if (priv->win_size)
+    {
+      struct spi_win_hdr *whdr = (struct spi_win_hdr *)&priv->rx_buf[HDR_SIZE];
+
+      if (ack_req != ACK_ERROR)
+          win_ack(priv, whdr->ack);
+
+      win_check_timeout(priv);
+
+      if ((ack_req == ACK_NEEDED) && !win_rx(priv, bitmask, whdr->seq))
+          ack_req = ACK_NOT_NEEDED;
+    }
+  else
+#endif
   if (ack_handler(priv, ack_req))
     {
       /* Reset TX consumer ring buffer entry */
@@ -698,24 +1614,42 @@ static void txn_finished_worker(FAR void *arg)
       /* Received a dummy or garbage packet - no processing to do! */
 
       /* Only change packet size if TX buffer is empty */
-      if ((priv->new_pkt_size > 0) && (priv->txp_rb == priv->txc_rb))
+      if ((priv->new_pkt_size > 0) && tx_is_empty(priv))
         {
           set_pkt_size(priv, priv->new_pkt_size);
           priv->new_pkt_size = 0;
         }
 
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+      if (priv->new_win_pending && tx_is_empty(priv))
+          win_apply(priv);
+#endif
+
       goto done;
     }
 
   if ((bitmask & HDR_BIT_TYPE) == MSG_TYPE_DL)
       recv = dl_recv;
 
+#ifdef CONFIG_GREYBUS_MODS_BATCH
+  if (bitmask & HDR_BIT_BATCH)
+    {
+      recv_batch(priv, recv, bitmask, &priv->rx_buf[hdr_size], pl_size);
+      goto done;
+    }
+#endif
+
 #if CONFIG_GREYBUS_MODS_DESIRED_PKT_SIZE == MODS_DL_PAYLOAD_MAX_SZ
   /* Check if un-packetizing is not required */
   if (MODS_DL_PAYLOAD_MAX_SZ == pl_size)
     {
       if (bitmask & HDR_BIT_PKT1)
-          recv(&priv->dl, &priv->rx_buf[HDR_SIZE], pl_size);
+        {
+#ifdef CONFIG_GREYBUS_MODS_ADAPTIVE_PKT_SIZE
+          adapt_count(priv, pl_size);
+#endif
+          recv(&priv->dl, &priv->rx_buf[hdr_size], pl_size);
+        }
       else
           dbg("1st pkt bit not set\n");
       goto done;
@@ -728,10 +1662,15 @@ static void txn_finished_worker(FAR void *arg)
       if (priv->rcvd_payload_idx)
         {
           dbg("1st pkt recv'd before prev msg complete\n");
-          priv->rcvd_payload_idx = 0;
+          rx_reset(priv);
         }
 
       priv->pkts_remaining = bitmask & HDR_BIT_PKTS;
+
+#ifdef CONFIG_GREYBUS_MODS_ZERO_COPY_RX
+      if (recv != dl_recv)
+          rx_start_zero_copy(priv, pl_size);
+#endif
     }
   else /* not first packet of message */
     {
@@ -747,8 +1686,7 @@ static void txn_finished_worker(FAR void *arg)
           dbg("Packets remaining out of sync\n");
 
           /* Drop the entire message */
-          priv->rcvd_payload_idx = 0;
-          priv->pkts_remaining = 0;
+          rx_reset(priv);
           goto done;
         }
     }
@@ -758,13 +1696,18 @@ static void txn_finished_worker(FAR void *arg)
       dbg("Too many packets received\n");
 
       /* Drop the entire message */
-      priv->rcvd_payload_idx = 0;
-      priv->pkts_remaining = 0;
+      rx_reset(priv);
       goto done;
     }
 
-  memcpy(&priv->rcvd_payload[priv->rcvd_payload_idx],
-         &priv->rx_buf[HDR_SIZE], pl_size);
+  /*
+   * The window header keeps the payload from dividing the maximum message
+   * size, so do not copy the padding past the end of the last packet.
+   */
+  pl_size = MIN(pl_size, MODS_DL_PAYLOAD_MAX_SZ - priv->rcvd_payload_idx);
+
+  memcpy(&priv->rcvd_buf[priv->rcvd_payload_idx],
+         &priv->rx_buf[hdr_size], pl_size);
   priv->rcvd_payload_idx += pl_size;
 
   if (bitmask & HDR_BIT_PKTS)
@@ -773,10 +1716,32 @@ static void txn_finished_worker(FAR void *arg)
       goto done;
     }
 
+#ifdef CONFIG_GREYBUS_MODS_ADAPTIVE_PKT_SIZE
+  adapt_count(priv, priv->rcvd_payload_idx);
+#endif
+
+#ifdef CONFIG_GREYBUS_MODS_ZERO_COPY_RX
+  if (priv->rcvd_buf != priv->rcvd_payload)
+    {
+      /* The network layer owns the buffer from now on */
+      __u8 *buf = priv->rcvd_buf;
+
+      priv->rcvd_buf = priv->rcvd_payload;
+      priv->cb->rx_buf(&priv->dl, buf, priv->rcvd_payload_idx);
+      priv->rcvd_payload_idx = 0;
+      goto done;
+    }
+#endif
+
   recv(&priv->dl, priv->rcvd_payload, priv->rcvd_payload_idx);
   priv->rcvd_payload_idx = 0;
 
 done:
+#ifdef CONFIG_GREYBUS_MODS_ADAPTIVE_PKT_SIZE
+  if (priv->adapt_msgs >= CONFIG_GREYBUS_MODS_ADAPT_PERIOD)
+      adapt_evaluate(priv);
+#endif
+
   xfer(priv);
 
   sem_post(&priv->sem);
@@ -814,15 +1779,33 @@ static void txn_error_worker(FAR void *arg)
 
   deassert_rfr_int();
 
-  if (ack_handler(priv, ACK_ERROR))
+#ifdef CONFIG_GREYBUS_MODS_ADAPTIVE_PKT_SIZE
+  priv->adapt_txns++;
+  priv->adapt_errs++;
+#endif
+
+#ifdef CONFIG_GREYBUS_MODS_WINDOW
+  if (priv->win_size)
     {
-      /* Reset TX consumer ring buffer entry */
-      reset_txc_rb_entry(priv);
+      /*
+       * The packet lost is sent again by the base, so the message being
+       * received is kept. The packet sent is either ACK'd later or sent
+       * again on timeout.
+       */
+      win_check_timeout(priv);
     }
+  else
+#endif
+    {
+      if (ack_handler(priv, ACK_ERROR))
+        {
+          /* Reset TX consumer ring buffer entry */
+          reset_txc_rb_entry(priv);
+        }
 
-  /* Ignore any received payload from previous packets */
-  priv->rcvd_payload_idx = 0;
-  priv->pkts_remaining = 0;
+      /* Ignore any received payload from previous packets */
+      rx_reset(priv);
+    }
 
   /* Clear transfer setup flag */
   priv->xfer_setup = false;
@@ -855,13 +1838,30 @@ static const struct spi_cb_ops_s cb_ops =
   .txn_err = txn_error_cb,
 };
 
+/* Check the ring buffer has room for the given number of packets */
+static bool txq_has_room(FAR struct spi_txq *q, int packets)
+{
+  struct ring_buf *rb = q->txp_rb;
+
+  while (packets-- > 0)
+    {
+      if (ring_buf_is_consumers(rb))
+          return false;
+
+      rb = ring_buf_get_next(rb);
+    }
+
+  return true;
+}
+
 /* Caller must hold semaphore before calling this function! */
-static int queue_data(FAR struct mods_spi_dl_s *priv, __u8 msg_type,
-                      const void *buf, size_t len)
+static int queue_data(FAR struct mods_spi_dl_s *priv, FAR struct spi_txq *q,
+                      __u8 msg_type, const void *buf, size_t len)
 {
   int remaining = len;
   __u8 *dbuf = (__u8 *)buf;
-  size_t pl_size = PL_SIZE(priv->pkt_size);
+  size_t hdr_size = pkt_hdr_size(priv);
+  size_t pl_size = pkt_pl_size(priv);
   int packets;
 
   /* Calculate how many packets are required to send whole payload */
@@ -875,19 +1875,29 @@ static int queue_data(FAR struct mods_spi_dl_s *priv, __u8 msg_type,
   if (len > MODS_DL_PAYLOAD_MAX_SZ)
       return -E2BIG;
 
+  /* The header counts at most HDR_BIT_PKTS packets after the first */
+  if (packets > HDR_BIT_PKTS + 1)
+      return -E2BIG;
+
+  /* Messages are queued whole or not at all */
+  if (!txq_has_room(q, packets))
+    {
+      dbg("Ring buffer is full!\n");
+      return -ENOMEM;
+    }
+
+#ifdef CONFIG_GREYBUS_MODS_BATCH
+  /* Later messages must not be packed ahead of this one */
+  q->batch_rb = NULL;
+#endif
+
   while ((remaining > 0) && (packets > 0))
     {
       uint16_t bitmask;
       __u8 *payload;
       int this_pl;
 
-      if (ring_buf_is_consumers(priv->txp_rb))
-        {
-          dbg("Ring buffer is full!\n");
-          return -ENOMEM;
-        }
-
-      payload = ((__u8 *)ring_buf_get_data(priv->txp_rb)) + HDR_SIZE;
+      payload = ((__u8 *)ring_buf_get_data(q->txp_rb)) + hdr_size;
 
       /* Determine the payload size of this packet */
       this_pl = MIN(remaining, pl_size);
@@ -900,21 +1910,90 @@ static int queue_data(FAR struct mods_spi_dl_s *priv, __u8 msg_type,
           bitmask |= HDR_BIT_PKT1;
 
       /* Populate the SPI message */
-      set_txp_hdr(priv, bitmask);
+      set_txp_hdr(q, bitmask);
       memcpy(payload, dbuf, this_pl);
 
       remaining -= this_pl;
       dbuf += this_pl;
 
-      ring_buf_put(priv->txp_rb, priv->pkt_size);
-      next_txp(priv);
+      ring_buf_put(q->txp_rb, priv->pkt_size);
+      next_txp(q);
     }
 
   return OK;
 }
 
+#ifdef CONFIG_GREYBUS_MODS_BATCH
+/*
+ * Pack a short network message in a batch packet. It is appended to the
+ * last queued packet if that one is a batch packet with room left, and is
+ * not yet handed to SPI. Otherwise a new batch packet is queued.
+ */
+/* Caller must hold semaphore before calling this function! */
+static int queue_batch(FAR struct mods_spi_dl_s *priv, FAR struct spi_txq *q,
+                       const void *buf, size_t len)
+{
+  size_t pl_size = pkt_pl_size(priv);
+  struct spi_batch_hdr *bhdr;
+  __u8 *payload;
+
+  if (priv->bstate != BASE_ATTACHED)
+      return -ENODEV;
+
+  if (!q->batch_rb || (q->batch_len + BATCH_HDR_SIZE + len > pl_size))
+    {
+      if (ring_buf_is_consumers(q->txp_rb))
+        {
+          dbg("Ring buffer is full!\n");
+          return -ENOMEM;
+        }
+
+      set_txp_hdr(q, HDR_BIT_VALID | MSG_TYPE_NW | HDR_BIT_PKT1 |
+                     HDR_BIT_BATCH);
+      q->batch_rb = q->txp_rb;
+      q->batch_len = 0;
+
+      ring_buf_put(q->txp_rb, priv->pkt_size);
+      next_txp(q);
+    }
+
+  payload = (__u8 *)ring_buf_get_data(q->batch_rb) + pkt_hdr_size(priv);
+  bhdr = (struct spi_batch_hdr *)&payload[q->batch_len];
+  bhdr->len = cpu_to_le16(len);
+  memcpy(&payload[q->batch_len + BATCH_HDR_SIZE], buf, len);
+  q->batch_len += BATCH_HDR_SIZE + len;
+
+  return OK;
+}
+#endif
+
+/* Must be called with priv->sem held */
+static int queue_data_locked(FAR struct mods_spi_dl_s *priv,
+                             const void *buf, size_t len,
+                             enum mods_dl_prio prio)
+{
+  FAR struct spi_txq *q = tx_queue(priv, prio);
+  int ret;
+
+#ifdef CONFIG_GREYBUS_MODS_BATCH
+  if (priv->batch_supported &&
+      (len + BATCH_HDR_SIZE <= pkt_pl_size(priv)))
+      ret = queue_batch(priv, q, buf, len);
+  else
+#endif
+  ret = queue_data(priv, q, MSG_TYPE_NW, buf, len);
+
+#ifdef CONFIG_GREYBUS_MODS_ADAPTIVE_PKT_SIZE
+  if (!ret)
+      adapt_count(priv, len);
+#endif
+
+  return ret;
+}
+
 /* Called by network layer when there is data to be sent to base */
-static int queue_data_nw(FAR struct mods_dl_s *dl, const void *buf, size_t len)
+static int queue_data_prio(FAR struct mods_dl_s *dl, const void *buf,
+                           size_t len, enum mods_dl_prio prio)
 {
   FAR struct mods_spi_dl_s *priv = (FAR struct mods_spi_dl_s *)dl;
   int ret;
@@ -925,21 +2004,48 @@ static int queue_data_nw(FAR struct mods_dl_s *dl, const void *buf, size_t len)
     }
   while (ret < 0 && errno == EINTR);
 
-  ret = queue_data(priv, MSG_TYPE_NW, buf, len);
-  if (ret)
-      goto err;
-
-  xfer(priv);
+  ret = queue_data_locked(priv, buf, len, prio);
+  if (!ret)
+      xfer(priv);
 
-err:
   sem_post(&priv->sem);
 
   return ret;
 }
 
+/*
+ * Called by network layer from within the recv callback, on the worker
+ * thread which already holds priv->sem. The worker sets up the transfer
+ * once done with the received packet.
+ */
+static int queue_data_inline(FAR struct mods_dl_s *dl, const void *buf,
+                             size_t len, enum mods_dl_prio prio)
+{
+  FAR struct mods_spi_dl_s *priv = (FAR struct mods_spi_dl_s *)dl;
+
+  DEBUGASSERT(getpid() == priv->pid);
+
+  return queue_data_locked(priv, buf, len, prio);
+}
+
+static int queue_data_nw(FAR struct mods_dl_s *dl, const void *buf, size_t len)
+{
+  return queue_data_prio(dl, buf, len, MODS_DL_PRIO_NORMAL);
+}
+
+static size_t get_pl_size(FAR struct mods_dl_s *dl)
+{
+  FAR struct mods_spi_dl_s *priv = (FAR struct mods_spi_dl_s *)dl;
+
+  return priv->pkt_size ? pkt_pl_size(priv) : 0;
+}
+
 static struct mods_dl_ops_s mods_dl_ops =
 {
   .send = queue_data_nw,
+  .send_prio = queue_data_prio,
+  .send_inline = queue_data_inline,
+  .get_pl_size = get_pl_size,
 };
 
 static struct mods_spi_dl_s mods_spi_dl =
@@ -947,6 +2053,27 @@ static struct mods_spi_dl_s mods_spi_dl =
   .dl  = { &mods_dl_ops },
 };
 
+#ifdef CONFIG_GREYBUS_MODS_ADAPTIVE_PKT_SIZE
+int mods_dl_get_pkt_stats(FAR struct mods_dl_pkt_stats *stats)
+{
+  FAR struct mods_spi_dl_s *priv = &mods_spi_dl;
+  int ret;
+
+  do
+    {
+      ret = sem_wait(&priv->sem);
+    }
+  while (ret < 0 && errno == EINTR);
+
+  *stats = priv->stats;
+  stats->pl_size = PL_SIZE(priv->pkt_size);
+
+  sem_post(&priv->sem);
+
+  return OK;
+}
+#endif
+
 #ifdef CONFIG_PM
 static int pm_prepare(struct pm_callback_s *cb, enum pm_state_e state)
 {
@@ -1080,6 +2207,7 @@ FAR struct mods_dl_s *mods_dl_init(struct mods_dl_cb_s *cb)
 
   mods_spi_dl.cb = cb;
   mods_spi_dl.spi = spi;
+  mods_spi_dl.rcvd_buf = mods_spi_dl.rcvd_payload;
   sem_init(&mods_spi_dl.sem, 0, 0);
 
   mods_spi_dl.pid = kernel_thread("dl-spi", CONFIG_SCHED_WORKPRIORITY - 1,
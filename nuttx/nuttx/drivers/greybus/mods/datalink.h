@@ -53,6 +53,69 @@
 
 #define MODS_DL_SEND(d,b,l) ((d)->ops->send(d,b,l))
 
+/****************************************************************************
+ * Name: MODS_DL_SEND_PRIO
+ *
+ * Description:
+ *   Send data over physical layer to the base, ahead of the data queued
+ *   with a lower priority. Optional, falls back to MODS_DL_SEND.
+ *
+ * Input Parameters:
+ *   dev - Device-specific state data
+ *   buf - A pointer to the buffer of data to be sent
+ *   len - The length of the buffer to send
+ *   prio - Priority class of the data (enum mods_dl_prio)
+ *
+ * Returned Value:
+ *   0 on success, negative errno on failure.
+ *
+ ****************************************************************************/
+
+#define MODS_DL_SEND_PRIO(d,b,l,p) \
+  ((d)->ops->send_prio ? (d)->ops->send_prio(d,b,l,p) : (d)->ops->send(d,b,l))
+
+/****************************************************************************
+ * Name: MODS_DL_SEND_INLINE
+ *
+ * Description:
+ *   Same as MODS_DL_SEND_PRIO, but called from within the recv callback of
+ *   the data link. Optional, falls back to MODS_DL_SEND_PRIO for data links
+ *   that can send from there anyway.
+ *
+ ****************************************************************************/
+
+#define MODS_DL_SEND_INLINE(d,b,l,p) \
+  ((d)->ops->send_inline ? (d)->ops->send_inline(d,b,l,p) : \
+   MODS_DL_SEND_PRIO(d,b,l,p))
+
+/****************************************************************************
+ * Name: MODS_DL_GET_PL_SIZE
+ *
+ * Description:
+ *   Get the number of bytes of a message carried by each packet on the
+ *   physical layer. Optional.
+ *
+ * Input Parameters:
+ *   dev - Device-specific state data
+ *
+ * Returned Value:
+ *   Payload size of the packets in use, 0 if unknown.
+ *
+ ****************************************************************************/
+
+#define MODS_DL_GET_PL_SIZE(d) \
+  ((d)->ops->get_pl_size ? (d)->ops->get_pl_size(d) : 0)
+
+/* Priority classes of the data sent to the base */
+enum mods_dl_prio
+{
+  MODS_DL_PRIO_NORMAL,
+  MODS_DL_PRIO_HIGH,
+
+  /* Add new classes above here */
+  MODS_DL_PRIO_COUNT,
+};
+
 struct mods_dl_s;
 
 typedef int (*buf_t)(FAR struct mods_dl_s *dev, FAR const void *buf, size_t len);
@@ -60,11 +123,26 @@ typedef int (*buf_t)(FAR struct mods_dl_s *dev, FAR const void *buf, size_t len)
 struct mods_dl_ops_s
 {
   buf_t send;
+  int (*send_prio)(FAR struct mods_dl_s *dev, FAR const void *buf,
+                   size_t len, enum mods_dl_prio prio);
+  int (*send_inline)(FAR struct mods_dl_s *dev, FAR const void *buf,
+                     size_t len, enum mods_dl_prio prio);
+  size_t (*get_pl_size)(FAR struct mods_dl_s *dev);
 };
 
 struct mods_dl_cb_s
 {
   buf_t recv;
+
+  /*
+   * Optional zero-copy receive. rx_alloc() returns a buffer for an incoming
+   * message of up to len bytes, rx_buf() hands a filled buffer over to the
+   * network layer, which then owns it, and rx_free() releases a buffer the
+   * data link could not complete.
+   */
+  FAR void *(*rx_alloc)(size_t len);
+  buf_t rx_buf;
+  void (*rx_free)(FAR void *buf);
 };
 
 /*
@@ -785,6 +785,7 @@ struct gb_driver mb_control_driver = {
     .exit = mb_control_exit,
     .op_handlers = (struct gb_operation_handler*) mb_control_handlers,
     .op_handlers_count = ARRAY_SIZE(mb_control_handlers),
+    .tx_priority = GB_TX_PRIO_HIGH,
 };
 
 int mods_cport_valid(int c)
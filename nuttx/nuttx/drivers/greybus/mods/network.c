@@ -32,6 +32,7 @@
 #include <string.h>
 
 #include <nuttx/greybus/greybus.h>
+#include <nuttx/greybus/pool.h>
 #include <nuttx/greybus/types.h>
 #include <nuttx/util.h>
 
@@ -50,6 +51,16 @@ struct mods_msg
   __u8                 gb_msg[0];
 } __packed;
 
+#define NETWORK_HEADROOM    ((sizeof(struct mods_msg_hdr) + 3) & ~0x0003)
+
+#ifdef CONFIG_GREYBUS_POOL
+#  define network_alloc_buf gb_pool_alloc
+#  define network_free_buf  gb_pool_free
+#else
+#  define network_alloc_buf zalloc
+#  define network_free_buf  free
+#endif
+
 
 /* Handle to Mods data link layer */
 static struct mods_dl_s *dl;
@@ -62,9 +73,44 @@ static int network_recv(FAR struct mods_dl_s *dev, const void *buf, size_t len)
                             (len - sizeof(m->hdr)));
 }
 
+#ifdef CONFIG_GREYBUS_MODS_ZERO_COPY_RX
+/*
+ * Offset of the Mods message in a Greybus buffer, so the Greybus message
+ * lands right after the transport headroom.
+ */
+#define NETWORK_RX_OFFSET   (NETWORK_HEADROOM - sizeof(struct mods_msg_hdr))
+
+static FAR void *network_rx_alloc(size_t len)
+{
+  __u8 *buf = network_alloc_buf(NETWORK_RX_OFFSET + len);
+
+  return buf ? buf + NETWORK_RX_OFFSET : NULL;
+}
+
+static int network_rx_buf(FAR struct mods_dl_s *dev, const void *buf,
+                          size_t len)
+{
+  struct mods_msg *m = (struct mods_msg *)buf;
+
+  return greybus_rx_handler_take(le16_to_cpu(m->hdr.cport),
+                                 (__u8 *)buf - NETWORK_RX_OFFSET,
+                                 len - sizeof(m->hdr));
+}
+
+static void network_rx_free(FAR void *buf)
+{
+  network_free_buf((__u8 *)buf - NETWORK_RX_OFFSET);
+}
+#endif
+
 struct mods_dl_cb_s mods_dl_cb =
 {
   .recv = network_recv,
+#ifdef CONFIG_GREYBUS_MODS_ZERO_COPY_RX
+  .rx_alloc = network_rx_alloc,
+  .rx_buf = network_rx_buf,
+  .rx_free = network_rx_free,
+#endif
 };
 
 static void network_init(void)
@@ -72,6 +118,14 @@ static void network_init(void)
   dl = mods_dl_init(&mods_dl_cb);
 }
 
+static enum mods_dl_prio network_prio(unsigned int cport)
+{
+  if (gb_get_tx_priority(cport) == GB_TX_PRIO_HIGH)
+      return MODS_DL_PRIO_HIGH;
+
+  return MODS_DL_PRIO_NORMAL;
+}
+
 static int network_send(unsigned int cport, const void *buf, size_t len)
 {
   struct mods_msg *m =
@@ -79,7 +133,33 @@ static int network_send(unsigned int cport, const void *buf, size_t len)
 
   m->hdr.cport = cpu_to_le16(cport);
 
-  return MODS_DL_SEND(dl, m, len + sizeof(struct mods_msg_hdr));
+  return MODS_DL_SEND_PRIO(dl, m, len + sizeof(struct mods_msg_hdr),
+                           network_prio(cport));
+}
+
+/* Called from within the receive callbacks above */
+static int network_send_inline(unsigned int cport, const void *buf,
+                               size_t len)
+{
+  struct mods_msg *m =
+    (struct mods_msg *)((char *)buf - sizeof(struct mods_msg_hdr));
+
+  m->hdr.cport = cpu_to_le16(cport);
+
+  return MODS_DL_SEND_INLINE(dl, m, len + sizeof(struct mods_msg_hdr),
+                             network_prio(cport));
+}
+
+static size_t network_fit_size(size_t len)
+{
+  size_t hdr_size = sizeof(struct mods_msg_hdr);
+  size_t pl_size = MODS_DL_GET_PL_SIZE(dl);
+
+  /* Trim the message so the last packet carrying it is full */
+  if (!pl_size || (len + hdr_size < pl_size))
+      return len;
+
+  return ((len + hdr_size) / pl_size) * pl_size - hdr_size;
 }
 
 static int network_listen(unsigned int cport)
@@ -96,13 +176,15 @@ static int network_stop_listening(unsigned int cport)
 
 const static struct gb_transport_backend mods_network =
 {
-  .headroom = (sizeof(struct mods_msg_hdr) + 3) & ~0x0003,
+  .headroom = NETWORK_HEADROOM,
   .init = network_init,
   .send = network_send,
+  .send_inline = network_send_inline,
+  .fit_size = network_fit_size,
   .listen = network_listen,
   .stop_listening = network_stop_listening,
-  .alloc_buf = zalloc,
-  .free_buf = free,
+  .alloc_buf = network_alloc_buf,
+  .free_buf = network_free_buf,
 };
 
 int mods_network_init(void)
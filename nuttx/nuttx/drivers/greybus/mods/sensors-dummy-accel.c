@@ -57,10 +57,7 @@
 #define ACCEL_MAX_RANGE     1024 * 16
 #define ACCEL_MIN_DELAY     4000
 #define ACCEL_MAX_DELAY     1000000
-#define ACCEL_FIFO_REC      0
-#define ACCEL_FIFO_MEC      0
 #define ACCEL_FLAGS        SENSOR_EXT_FLAG_CONTINUOUS_MODE
-#define REPORTING_SENSORS   1
 
 
 struct sensor_accel_info {
@@ -68,7 +65,8 @@ struct sensor_accel_info {
     uint32_t flags;
     sensors_ext_event_callback callback;
     uint8_t sensor_id;
-    int latency_ms;
+    useconds_t period_us;
+    struct sensors_ext_batch batch;
     pthread_t tx_thread;
     pthread_mutex_t run_mutex;
     bool should_run;
@@ -77,76 +75,41 @@ struct sensor_accel_info {
 /*
  * event fields for accelerometer in bytes
  * [ time_delta (2) | data_value x (4) | data_value y (4) |data_value z (4) ]
+ * the time_delta is filled in by the batch.
 */
-struct sensor_event_data {
-    uint16_t    time_delta;
-    uint32_t    data_value[ACCEL_CHANNEL_SIZE];
-} __packed;
-
-#ifdef BATCH_PROCESS_ENABLED
-#define ACCEL_READING_NUM 2
-#else
-#define ACCEL_READING_NUM 1
-#endif
-#define TX_PROCESSING_DELAY     1 /* processing and tx delay (mS)*/
+#define ACCEL_EVENT_SIZE        (ACCEL_CHANNEL_SIZE * sizeof(uint32_t))
+#define TX_PROCESSING_DELAY     1000 /* processing and tx delay (uS)*/
 
 static int data = 1000;
 static atomic_t txn;       /* Flag to indicate reporting in progress */
 
-static void *sensor_tx_thread(void *arg)
+static int sensor_accel_sample(struct sensor_accel_info *info)
 {
-    struct sensor_accel_info *info;
-    struct report_info *rinfo;
-    struct report_info_data *rinfo_data;
-    struct sensor_event_data *event_data;
+    uint32_t data_value[ACCEL_CHANNEL_SIZE];
     struct timespec ts;
-    uint16_t payload_size;
 
-    info = arg;
-    payload_size = (ACCEL_READING_NUM * sizeof(struct sensor_event_data))
-                    + (REPORTING_SENSORS * sizeof(struct report_info));
+    data_value[0] = data++;
+    data_value[1] = data++;
+    data_value[2] = data++;
+    up_rtc_gettime(&ts);
 
-    rinfo_data = malloc(sizeof(struct report_info_data) + payload_size);
-    if (!rinfo_data)
-        return (void *)-ENOMEM;
+    return sensors_ext_batch_add(&info->batch, timespec_to_nsec(&ts),
+                                 data_value);
+}
+
+static void *sensor_tx_thread(void *arg)
+{
+    struct sensor_accel_info *info = arg;
 
     while(1) {
-        memset(rinfo_data, 0, sizeof(struct report_info_data) + payload_size);
-
-        if (info->callback) {
-            rinfo_data->num_sensors_reporting = REPORTING_SENSORS;
-            rinfo = rinfo_data->reportinfo;
-            rinfo->id = info->sensor_id;
-            rinfo->flags = 0;
-            event_data = (struct sensor_event_data *)&rinfo->data_payload[0];
-
-            up_rtc_gettime(&ts);
-            rinfo->reference_time = timespec_to_nsec(&ts);
-#ifdef BATCH_PROCESS_ENABLED
-            /*
-             * Batch sensor data values and its time_deltas
-             * until max fifo event count
-            */
-#else
-            /* Single sensor event data */
-            rinfo->readings = ACCEL_READING_NUM;
-            event_data->time_delta = 0;
-            event_data->data_value[0] = data++;
-            event_data->data_value[1] = data++;
-            event_data->data_value[2] = data++;
-#endif
-            gb_debug("report sensor: %d\n", rinfo->id);
-            info->callback(info->sensor_id, rinfo_data, payload_size);
-        }
+        sensor_accel_sample(info);
 
         if (!info->should_run)
             break;
 
-        up_mdelay(info->latency_ms);
+        usleep(info->period_us);
     }
 
-    free(rinfo_data);
-
     return NULL;
 }
 
@@ -168,18 +131,8 @@ static int sensor_accel_op_get_sensor_info(struct device *dev,
     sinfo->resolution = 1;
     sinfo->min_delay = ACCEL_MIN_DELAY;
     sinfo->max_delay = ACCEL_MAX_DELAY;
-#ifdef BATCH_PROCESS_ENABLED
-    /*
-     * Example to calculate number of sensor events that can be batched in the
-     * payload. Each event consists of time_delta and sensor data fields.
-     * Reading size provides the number of sensor data fields reported.
-    */
-    sinfo->fifo_rec = ACCEL_READING_NUM;
+    sinfo->fifo_rec = sensors_ext_batch_max_events(ACCEL_EVENT_SIZE);
     sinfo->fifo_mec = sinfo->fifo_rec;
-#else
-    sinfo->fifo_rec = ACCEL_FIFO_REC;
-    sinfo->fifo_mec = ACCEL_FIFO_MEC;
-#endif
     sinfo->flags = ACCEL_FLAGS;
     sinfo->scale_int = ACCEL_SCALE_INT;
     sinfo->scale_nano = ACCEL_SCALE_NANO;
@@ -209,9 +162,15 @@ static int sensor_accel_op_start_reporting(struct device *dev,
     }
     info = device_get_private(dev);
 
-    info->latency_ms = sampling_period/1000000;
-    if (info->latency_ms > TX_PROCESSING_DELAY) {
-        info->latency_ms -= TX_PROCESSING_DELAY;
+    ret = sensors_ext_batch_start(&info->batch, info->sensor_id,
+                                  info->callback, sampling_period,
+                                  max_report_latency);
+    if (ret)
+        return ret;
+
+    info->period_us = sampling_period / NSEC_PER_USEC;
+    if (info->period_us > TX_PROCESSING_DELAY) {
+        info->period_us -= TX_PROCESSING_DELAY;
     }
     data = 1000;
     info->should_run = true;
@@ -232,15 +191,7 @@ static int sensor_accel_op_start_reporting(struct device *dev,
 
 static int sensor_accel_op_flush(struct device *dev, uint8_t id)
 {
-    struct sensor_event_data *event_data;
     struct sensor_accel_info *info;
-    struct report_info_data *rinfo_data;
-    struct report_info *rinfo;
-    struct timespec ts;
-    uint16_t payload_size;
-
-    payload_size = (ACCEL_READING_NUM * sizeof(struct sensor_event_data))
-                    + (REPORTING_SENSORS * sizeof(struct report_info));
 
     gb_debug("%s:\n", __func__);
 
@@ -250,35 +201,9 @@ static int sensor_accel_op_flush(struct device *dev, uint8_t id)
     info = device_get_private(dev);
 
     if (info->callback) {
-        rinfo_data = malloc(sizeof(struct report_info) + payload_size);
-        if (!rinfo_data)
-            return -ENOMEM;
-
-        rinfo_data->num_sensors_reporting = REPORTING_SENSORS;
-        rinfo = rinfo_data->reportinfo;
-        rinfo->id = info->sensor_id;
-        event_data = (struct sensor_event_data *)&rinfo->data_payload[0];
-
-        up_rtc_gettime(&ts);
-        rinfo->reference_time = timespec_to_nsec(&ts);
-        gb_debug("[%u.%03u]\n", ts.tv_sec, (ts.tv_nsec / 1000000));
-        rinfo->flags = REPORT_INFO_FLAG_FLUSHING | REPORT_INFO_FLAG_FLUSH_COMPLETE;
-#ifdef BATCH_PROCESS_ENABLED
-        /*
-         * Batch sensor data values and its time_deltas
-         * until max fifo event count
-        */
-#else
-        /* Single sensor event data */
-        rinfo->readings = ACCEL_READING_NUM;
-        event_data->time_delta = 0;
-        event_data->data_value[0] = data++;
-        event_data->data_value[1] = data++;
-        event_data->data_value[2] = data++;
-#endif
-        info->callback(info->sensor_id, rinfo_data, payload_size);
-
-        free(rinfo_data);
+        sensor_accel_sample(info);
+        return sensors_ext_batch_flush(&info->batch,
+                REPORT_INFO_FLAG_FLUSHING | REPORT_INFO_FLAG_FLUSH_COMPLETE);
     }
 
     return OK;
@@ -311,6 +236,7 @@ static int sensor_accel_op_stop_reporting(struct device *dev,
     }
     info = device_get_private(dev);
     sensor_accel_kill_pthread(info);
+    sensors_ext_batch_stop(&info->batch);
 
     atomic_dec(&txn);
 
@@ -331,6 +257,7 @@ static int sensor_accel_op_register_callback(struct device *dev,
 
     info->callback = callback;
     info->sensor_id = se_id;
+    sensors_ext_batch_set_callback(&info->batch, se_id, callback);
 
     return 0;
 }
@@ -410,6 +337,7 @@ static int sensor_accel_dev_probe(struct device *dev)
 
     atomic_init(&txn, 0);
     pthread_mutex_init(&info->run_mutex, NULL);
+    sensors_ext_batch_init(&info->batch, ACCEL_EVENT_SIZE);
 
 #ifdef CONFIG_PM
     if (pm_register(&pm_callback) != OK)
@@ -438,6 +366,7 @@ static void sensor_accel_dev_remove(struct device *dev)
     }
     info->flags = 0;
 
+    sensors_ext_batch_deinit(&info->batch);
     free(info);
     device_set_private(dev, NULL);
 }
@@ -449,10 +449,10 @@ static struct gb_operation_handler gb_pwm_handlers[] = {
     GB_HANDLER(GB_PWM_PROTOCOL_COUNT, gb_pwm_protocol_count),
     GB_HANDLER(GB_PWM_PROTOCOL_ACTIVATE, gb_pwm_protocol_activate),
     GB_HANDLER(GB_PWM_PROTOCOL_DEACTIVATE, gb_pwm_protocol_deactivate),
-    GB_HANDLER(GB_PWM_PROTOCOL_CONFIG, gb_pwm_protocol_config),
-    GB_HANDLER(GB_PWM_PROTOCOL_POLARITY, gb_pwm_protocol_polarity),
-    GB_HANDLER(GB_PWM_PROTOCOL_ENABLE, gb_pwm_protocol_enable),
-    GB_HANDLER(GB_PWM_PROTOCOL_DISABLE, gb_pwm_protocol_disable),
+    GB_INLINE_HANDLER(GB_PWM_PROTOCOL_CONFIG, gb_pwm_protocol_config),
+    GB_INLINE_HANDLER(GB_PWM_PROTOCOL_POLARITY, gb_pwm_protocol_polarity),
+    GB_INLINE_HANDLER(GB_PWM_PROTOCOL_ENABLE, gb_pwm_protocol_enable),
+    GB_INLINE_HANDLER(GB_PWM_PROTOCOL_DISABLE, gb_pwm_protocol_disable),
 };
 
 
@@ -0,0 +1,302 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+
+#include <nuttx/clock.h>
+#include <nuttx/device.h>
+#include <nuttx/device_sensors_ext.h>
+#include <nuttx/kmalloc.h>
+
+#ifndef CONFIG_GREYBUS_SENSORS_EXT_BATCH_BYTES
+#define CONFIG_GREYBUS_SENSORS_EXT_BATCH_BYTES  512
+#endif
+
+#define BATCH_BYTES         CONFIG_GREYBUS_SENSORS_EXT_BATCH_BYTES
+#define MAX_TIME_DELTA      ((uint64_t)UINT16_MAX * NSEC_PER_USEC)
+
+static inline uint16_t batch_event_size(struct sensors_ext_batch *batch)
+{
+    return sizeof(uint16_t) + batch->data_size;
+}
+
+/* called with batch->lock held */
+static int batch_send(struct sensors_ext_batch *batch, uint8_t flags)
+{
+    struct report_info_data *rinfo_data = batch->rinfo_data;
+    int ret = OK;
+
+    if (!rinfo_data)
+        return -ENODEV;
+
+    if (flags && !batch->rinfo) {
+        /* nothing pending, the flags go out in an empty report */
+        batch->rinfo = rinfo_data->reportinfo;
+        batch->rinfo->id = batch->sensor_id;
+        batch->rinfo->flags = 0;
+        batch->rinfo->readings = 0;
+        batch->rinfo->reference_time = batch->last_time;
+        batch->payload_size = sizeof(struct report_info);
+        rinfo_data->num_sensors_reporting = 1;
+    }
+
+    if (!batch->rinfo)
+        return OK;
+
+    batch->rinfo->flags |= flags;
+    if (batch->callback)
+        ret = batch->callback(batch->sensor_id, rinfo_data,
+                              batch->payload_size);
+
+    rinfo_data->num_sensors_reporting = 0;
+    batch->rinfo = NULL;
+    batch->payload_size = 0;
+
+    return ret;
+}
+
+void sensors_ext_batch_init(struct sensors_ext_batch *batch, uint16_t data_size)
+{
+    memset(batch, 0, sizeof(*batch));
+    pthread_mutex_init(&batch->lock, NULL);
+    batch->data_size = data_size;
+}
+
+void sensors_ext_batch_deinit(struct sensors_ext_batch *batch)
+{
+    pthread_mutex_lock(&batch->lock);
+    kmm_free(batch->rinfo_data);
+    batch->rinfo_data = NULL;
+    batch->rinfo = NULL;
+    batch->callback = NULL;
+    batch->started = false;
+    pthread_mutex_unlock(&batch->lock);
+    pthread_mutex_destroy(&batch->lock);
+}
+
+/**
+ * @brief Number of events of data_size bytes a single report can carry
+ */
+uint32_t sensors_ext_batch_max_events(uint16_t data_size)
+{
+    return (BATCH_BYTES - sizeof(struct report_info)) /
+           (sizeof(uint16_t) + data_size);
+}
+
+/**
+ * @brief Start collecting events for a sensor
+ *
+ * Any events still pending from a previous run are dropped. The buffer is
+ * allocated on first start and kept until sensors_ext_batch_deinit().
+ *
+ * @param batch batch to start
+ * @param sensor_id id reported to the host
+ * @param callback sensors-ext event callback the reports are sent through
+ * @param sampling_period time between events, in ns
+ * @param max_report_latency time an event may be held back, in ns
+ * @return 0 on success, negative errno on error
+ */
+int sensors_ext_batch_start(struct sensors_ext_batch *batch, uint8_t sensor_id,
+                            sensors_ext_event_callback callback,
+                            uint64_t sampling_period,
+                            uint64_t max_report_latency)
+{
+    int ret = OK;
+
+    pthread_mutex_lock(&batch->lock);
+
+    if (!batch->rinfo_data) {
+        batch->rinfo_data = kmm_malloc(sizeof(struct report_info_data) +
+                                       BATCH_BYTES);
+        if (!batch->rinfo_data) {
+            ret = -ENOMEM;
+            goto out;
+        }
+    }
+
+    batch->rinfo_data->num_sensors_reporting = 0;
+    batch->rinfo_data->reserved = 0;
+    batch->rinfo = NULL;
+    batch->payload_size = 0;
+    batch->sensor_id = sensor_id;
+    batch->callback = callback;
+    batch->sampling_period = sampling_period;
+    batch->max_report_latency = max_report_latency;
+    batch->started = true;
+
+out:
+    pthread_mutex_unlock(&batch->lock);
+    return ret;
+}
+
+/**
+ * @brief Stop reporting, dropping any pending events
+ *
+ * The callback is kept to answer flushes.
+ */
+void sensors_ext_batch_stop(struct sensors_ext_batch *batch)
+{
+    pthread_mutex_lock(&batch->lock);
+    if (batch->rinfo_data)
+        batch->rinfo_data->num_sensors_reporting = 0;
+    batch->rinfo = NULL;
+    batch->payload_size = 0;
+    batch->started = false;
+    pthread_mutex_unlock(&batch->lock);
+}
+
+/**
+ * @brief Set the callback flushes are answered through
+ *
+ * Lets a flush be answered before the sensor is first started.
+ *
+ * @param batch batch of the sensor
+ * @param sensor_id id reported to the host
+ * @param callback sensors-ext event callback
+ */
+void sensors_ext_batch_set_callback(struct sensors_ext_batch *batch,
+                                    uint8_t sensor_id,
+                                    sensors_ext_event_callback callback)
+{
+    pthread_mutex_lock(&batch->lock);
+    batch->sensor_id = sensor_id;
+    batch->callback = callback;
+    pthread_mutex_unlock(&batch->lock);
+}
+
+/**
+ * @brief Add an event to the batch
+ *
+ * The pending events are sent when the next one would be held longer than
+ * max_report_latency, or when there is no room left for another event.
+ *
+ * @param batch batch to add to
+ * @param time time of the event, in ns
+ * @param data data_size bytes of event data
+ * @return 0 on success, negative errno on error
+ */
+int sensors_ext_batch_add(struct sensors_ext_batch *batch, uint64_t time,
+                          const void *data)
+{
+    struct report_info *rinfo;
+    uint16_t event_size = batch_event_size(batch);
+    uint16_t needed;
+    uint16_t time_delta;
+    uint8_t *event;
+    int ret = OK;
+
+    pthread_mutex_lock(&batch->lock);
+
+    if (!batch->started) {
+        ret = -ENODEV;
+        goto out;
+    }
+
+    /* a report can only date its events up to 65535us after its reference */
+    rinfo = batch->rinfo;
+    if (rinfo && (time < rinfo->reference_time ||
+                  time - rinfo->reference_time > MAX_TIME_DELTA ||
+                  rinfo->readings == UINT16_MAX)) {
+        rinfo = NULL;
+    }
+
+    needed = event_size + (rinfo ? 0 : sizeof(struct report_info));
+    if (batch->payload_size + needed > BATCH_BYTES ||
+        (!rinfo && batch->rinfo_data->num_sensors_reporting == UINT8_MAX)) {
+        ret = batch_send(batch, 0);
+        rinfo = NULL;
+    }
+
+    if (!rinfo) {
+        if (!batch->payload_size)
+            batch->first_time = time;
+
+        rinfo = (struct report_info *)
+                ((uint8_t *)batch->rinfo_data->reportinfo + batch->payload_size);
+        rinfo->id = batch->sensor_id;
+        rinfo->flags = 0;
+        rinfo->readings = 0;
+        rinfo->reference_time = time;
+        batch->payload_size += sizeof(struct report_info);
+        batch->rinfo_data->num_sensors_reporting++;
+        batch->rinfo = rinfo;
+    }
+
+    event = (uint8_t *)batch->rinfo_data->reportinfo + batch->payload_size;
+    time_delta = (time - rinfo->reference_time) / NSEC_PER_USEC;
+    memcpy(event, &time_delta, sizeof(time_delta));
+    memcpy(event + sizeof(time_delta), data, batch->data_size);
+    rinfo->readings++;
+    batch->payload_size += event_size;
+    batch->last_time = time;
+
+    if (time + batch->sampling_period - batch->first_time >=
+        batch->max_report_latency) {
+        ret = batch_send(batch, 0);
+    }
+
+out:
+    pthread_mutex_unlock(&batch->lock);
+    return ret;
+}
+
+/**
+ * @brief Send the pending events now
+ *
+ * @param batch batch to flush
+ * @param flags REPORT_INFO_FLAG_* set on the last report; an empty report
+ * carries them when no event is pending, or when the sensor is not started
+ * @return 0 on success, negative errno on error
+ */
+int sensors_ext_batch_flush(struct sensors_ext_batch *batch, uint8_t flags)
+{
+    uint8_t buf[sizeof(struct report_info_data) + sizeof(struct report_info)];
+    struct report_info_data *rinfo_data = (struct report_info_data *)buf;
+    int ret = OK;
+
+    pthread_mutex_lock(&batch->lock);
+
+    if (batch->started) {
+        ret = batch_send(batch, flags);
+    } else if (flags && batch->callback) {
+        rinfo_data->num_sensors_reporting = 1;
+        rinfo_data->reserved = 0;
+        rinfo_data->reportinfo->id = batch->sensor_id;
+        rinfo_data->reportinfo->flags = flags;
+        rinfo_data->reportinfo->readings = 0;
+        rinfo_data->reportinfo->reference_time = batch->last_time;
+        ret = batch->callback(batch->sensor_id, rinfo_data,
+                              sizeof(struct report_info));
+    }
+
+    pthread_mutex_unlock(&batch->lock);
+
+    return ret;
+}
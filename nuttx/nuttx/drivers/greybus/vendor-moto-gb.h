@@ -41,6 +41,7 @@
 #define GB_VENDOR_MOTO_GET_PWR_UP_REASON  0x04
 #define GB_VENDOR_MOTO_GET_DMESG_SIZE     0x05
 #define GB_VENDOR_MOTO_GET_UPTIME         0x06
+#define GB_VENDOR_MOTO_GET_GB_STATS       0x07
 
 #define GB_VENDOR_MOTO_DMESG_SIZE \
             MIN_SZ(CONFIG_RAMLOG_BUFSIZE, GB_MAX_PAYLOAD_SIZE)
@@ -72,4 +73,28 @@ struct gb_vendor_moto_get_uptime_response {
     __le32 secs;
 } __packed;
 
+#define GB_VENDOR_MOTO_GB_STATS_RESET     0x01    /* clear once read */
+
+struct gb_vendor_moto_get_gb_stats_request {
+    __le16  cport;
+    __u8    flags;
+} __packed;
+
+/* see struct gb_cport_stats */
+struct gb_vendor_moto_get_gb_stats_response {
+    __le32  rx_msgs;
+    __le32  rx_bytes;
+    __le32  rx_drops;
+    __le32  tx_msgs;
+    __le32  tx_bytes;
+    __le32  tx_errors;
+    __le32  oom_responses;
+    __le32  timeouts;
+    __le16  rx_queue_depth;
+    __le16  rx_queue_hwm;
+    __le32  handler_max_us;
+    __le32  handler_hist[GB_STATS_HIST_BUCKETS];
+    __le32  latency_hist[GB_STATS_HIST_BUCKETS];
+} __packed;
+
 #endif /* _GREYBUS_VENDOR_MOTO_H_ */
@@ -44,7 +44,7 @@
 #include "vendor-moto-gb.h"
 
 #define GB_VENDOR_MOTO_VERSION_MAJOR     0
-#define GB_VENDOR_MOTO_VERSION_MINOR     3
+#define GB_VENDOR_MOTO_VERSION_MINOR     4
 
 static uint8_t gb_vendor_moto_protocol_version(struct gb_operation *operation)
 {
@@ -162,6 +162,52 @@ static uint8_t gb_vendor_moto_get_uptime(struct gb_operation *operation)
     return GB_OP_SUCCESS;
 }
 
+static uint8_t gb_vendor_moto_get_gb_stats(struct gb_operation *operation)
+{
+#ifdef CONFIG_GREYBUS_STATS
+    struct gb_vendor_moto_get_gb_stats_request *request =
+        gb_operation_get_request_payload(operation);
+    struct gb_vendor_moto_get_gb_stats_response *response;
+    struct gb_cport_stats stats;
+    unsigned int cport;
+    int i;
+
+    if (gb_operation_get_request_payload_size(operation) < sizeof(*request))
+        return GB_OP_INVALID;
+
+    cport = le16_to_cpu(request->cport);
+    if (gb_stats_get(cport, &stats))
+        return GB_OP_INVALID;
+
+    if (request->flags & GB_VENDOR_MOTO_GB_STATS_RESET)
+        gb_stats_reset(cport);
+
+    response = gb_operation_alloc_response(operation, sizeof(*response));
+    if (!response)
+        return GB_OP_NO_MEMORY;
+
+    response->rx_msgs = cpu_to_le32(stats.rx_msgs);
+    response->rx_bytes = cpu_to_le32(stats.rx_bytes);
+    response->rx_drops = cpu_to_le32(stats.rx_drops);
+    response->tx_msgs = cpu_to_le32(stats.tx_msgs);
+    response->tx_bytes = cpu_to_le32(stats.tx_bytes);
+    response->tx_errors = cpu_to_le32(stats.tx_errors);
+    response->oom_responses = cpu_to_le32(stats.oom_responses);
+    response->timeouts = cpu_to_le32(stats.timeouts);
+    response->rx_queue_depth = cpu_to_le16(stats.rx_queue_depth);
+    response->rx_queue_hwm = cpu_to_le16(stats.rx_queue_hwm);
+    response->handler_max_us = cpu_to_le32(stats.handler_max_us);
+    for (i = 0; i < GB_STATS_HIST_BUCKETS; i++) {
+        response->handler_hist[i] = cpu_to_le32(stats.handler_hist[i]);
+        response->latency_hist[i] = cpu_to_le32(stats.latency_hist[i]);
+    }
+
+    return GB_OP_SUCCESS;
+#else
+    return GB_OP_NONEXISTENT;
+#endif
+}
+
 static struct gb_operation_handler gb_vendor_moto_handlers[] = {
     GB_HANDLER(GB_VENDOR_MOTO_PROTOCOL_VERSION, gb_vendor_moto_protocol_version),
     GB_HANDLER(GB_VENDOR_MOTO_GET_DMESG, gb_vendor_moto_get_dmesg),
@@ -169,6 +215,7 @@ static struct gb_operation_handler gb_vendor_moto_handlers[] = {
     GB_HANDLER(GB_VENDOR_MOTO_GET_PWR_UP_REASON, gb_vendor_moto_pwr_up_reason),
     GB_HANDLER(GB_VENDOR_MOTO_GET_DMESG_SIZE, gb_vendor_moto_get_dmesg_size),
     GB_HANDLER(GB_VENDOR_MOTO_GET_UPTIME, gb_vendor_moto_get_uptime),
+    GB_HANDLER(GB_VENDOR_MOTO_GET_GB_STATS, gb_vendor_moto_get_gb_stats),
 };
 
 static struct gb_driver gb_vendor_moto_driver = {
@@ -31,6 +31,7 @@
 
 #include <errno.h>
 #include <debug.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -49,6 +50,7 @@
 #include <nuttx/mhb/mhb_protocol.h>
 #include <nuttx/mhb/mhb_csi_camera.h>
 #include <nuttx/power/pm.h>
+#include <nuttx/wqueue.h>
 #include <nuttx/camera/v4l2_camera_ext_ctrls.h>
 #include <nuttx/camera/camera_ext.h>
 
@@ -84,12 +86,23 @@ enum soc_status {
     SOC_ENABLED,
 };
 
-struct cached_ctrls_node {
-    struct list_head node;
+#ifndef CONFIG_MHB_CAMERA_CTRL_CACHE_SLOTS
+#define CONFIG_MHB_CAMERA_CTRL_CACHE_SLOTS 64
+#endif
+
+#define MHB_CAM_CTRL_INLINE_SIZE 16
+
+/*
+ * Last value set for a control and not applied yet. Values larger than
+ * val go to buf, which is kept for the next values of the control.
+ */
+struct cached_ctrl {
     struct device *dev;
-    uint32_t idx;
-    uint8_t *ctrl_val;
+    bool pending;
     uint32_t ctrl_val_size;
+    uint32_t buf_size;
+    uint8_t *buf;
+    uint8_t val[MHB_CAM_CTRL_INLINE_SIZE];
 };
 
 struct mhb_camera_s
@@ -115,9 +128,17 @@ struct mhb_camera_s
 };
 
 static struct mhb_camera_s s_mhb_camera;
-static LIST_DECLARE(cached_ctrl_list);
+/* indexed by control, applied in the order they were first cached */
+static struct cached_ctrl s_ctrl_cache[CONFIG_MHB_CAMERA_CTRL_CACHE_SLOTS];
+static uint8_t s_ctrl_order[CONFIG_MHB_CAMERA_CTRL_CACHE_SLOTS];
+static int s_ctrl_pending;
+#ifdef CONFIG_MHB_CAMERA_CTRL_BATCH
+static struct work_s s_ctrl_work;
+#endif
 
 static void mhb_cam_error_cb(int err);
+static void mhb_camera_mode_check_write(uint16_t i2c_addr,
+                                        const uint8_t *buf, int len);
 
 #ifdef CONFIG_PM
 static int mhb_camera_pm_prepare(struct pm_callback_s *cb,
@@ -227,6 +248,7 @@ int mhb_camera_i2c_write(uint16_t i2c_addr, uint8_t *addr, int addr_len)
     msg.length = addr_len;
 
     mhb_camera_i2c_lock();
+    mhb_camera_mode_check_write(i2c_addr, addr, addr_len);
     do {
         ret = I2C_TRANSFER(s_mhb_camera.cam_i2c, &msg, 1);
         if (ret) {
@@ -356,6 +378,514 @@ int mhb_camera_i2c_write_reg(uint16_t i2c_addr, uint16_t regaddr,
     return ret;
 }
 
+/*
+ * Register sequences. Runs of consecutive registers are written as one
+ * burst, relying on the address auto-increment of the sensors, and the
+ * bursts are queued as the messages of a single I2C_TRANSFER until the
+ * buffer is full or the sequence asks for a delay.
+ */
+
+#ifndef CONFIG_MHB_CAMERA_I2C_SEQ_BUFSIZE
+#define CONFIG_MHB_CAMERA_I2C_SEQ_BUFSIZE 128
+#endif
+
+#define MHB_CAMERA_SEQ_MSGS 8
+
+struct mhb_camera_seq {
+    uint16_t i2c_addr;
+    uint8_t reg_width;
+    uint32_t flags;
+    int retries;                /* left for the whole sequence */
+    int nmsgs;
+    size_t used;
+    uint16_t next_addr;         /* register extending the last burst */
+    struct i2c_msg_s msgs[MHB_CAMERA_SEQ_MSGS];
+    uint8_t buf[CONFIG_MHB_CAMERA_I2C_SEQ_BUFSIZE];
+    uint8_t verify[CONFIG_MHB_CAMERA_I2C_SEQ_BUFSIZE];
+};
+
+/* only used with the I2C lock held */
+static struct mhb_camera_seq s_seq;
+
+static int mhb_camera_seq_transfer(struct i2c_msg_s *msgs, int count)
+{
+    int ret;
+
+    while (1) {
+        ret = I2C_TRANSFER(s_mhb_camera.cam_i2c, msgs, count);
+        if (!ret || s_seq.retries <= 1)
+            break;
+
+        s_seq.retries--;
+        usleep(CONFIG_MHB_CAMERA_I2C_RETRY_DELAY_US);
+        CAM_DBG("i2c err %d\n", ret);
+    }
+
+    return ret;
+}
+
+/* read back the registers written by a burst */
+static int mhb_camera_seq_verify(struct i2c_msg_s *burst)
+{
+    struct i2c_msg_s msg[2];
+    int ret;
+
+    msg[0].addr   = s_seq.i2c_addr;
+    msg[0].flags  = 0;
+    msg[0].buffer = burst->buffer;
+    msg[0].length = 2;
+
+    msg[1].addr   = s_seq.i2c_addr;
+    msg[1].flags  = I2C_M_READ;
+    msg[1].buffer = s_seq.verify;
+    msg[1].length = burst->length - 2;
+
+    ret = mhb_camera_seq_transfer(msg, 2);
+    if (ret)
+        return ret;
+
+    if (memcmp(s_seq.verify, burst->buffer + 2, burst->length - 2)) {
+        CAM_ERR("Read back mismatch at %02x%02x\n",
+                burst->buffer[0], burst->buffer[1]);
+        return -EIO;
+    }
+
+    return 0;
+}
+
+static int mhb_camera_seq_flush(void)
+{
+    int ret = 0;
+    int i;
+
+    if (s_seq.nmsgs) {
+        ret = mhb_camera_seq_transfer(s_seq.msgs, s_seq.nmsgs);
+
+        for (i = 0; !ret && (s_seq.flags & MHB_CAMERA_SEQ_VERIFY) &&
+                    i < s_seq.nmsgs; i++) {
+            ret = mhb_camera_seq_verify(&s_seq.msgs[i]);
+        }
+    }
+
+    s_seq.nmsgs = 0;
+    s_seq.used = 0;
+
+    return ret;
+}
+
+static int mhb_camera_seq_add(const struct mhb_camera_reg *reg)
+{
+    uint8_t size = reg->size ? reg->size : MHB_CAMERA_REG_BYTE;
+    struct i2c_msg_s *msg;
+    uint8_t *p;
+    int ret;
+
+    if (size != MHB_CAMERA_REG_BYTE && size != MHB_CAMERA_REG_WORD)
+        return -EINVAL;
+
+    /* extend the last burst or start a new one */
+    if (!s_seq.nmsgs || reg->addr != s_seq.next_addr ||
+        s_seq.used + size > sizeof(s_seq.buf)) {
+        if (s_seq.nmsgs == MHB_CAMERA_SEQ_MSGS ||
+            s_seq.used + 2 + size > sizeof(s_seq.buf)) {
+            ret = mhb_camera_seq_flush();
+            if (ret)
+                return ret;
+        }
+
+        msg = &s_seq.msgs[s_seq.nmsgs++];
+        msg->addr   = s_seq.i2c_addr;
+        msg->flags  = 0;
+        msg->buffer = &s_seq.buf[s_seq.used];
+        msg->length = 2;
+
+        if (s_seq.reg_width == MHB_CAMERA_REG_WIDTH_16) {
+            msg->buffer[0] = (reg->addr >> 8) & 0xFF;
+            msg->buffer[1] = reg->addr & 0xFF;
+        } else {
+            msg->buffer[0] = reg->addr & 0xFF;
+            msg->buffer[1] = (reg->addr >> 8) & 0xFF;
+        }
+        s_seq.used += 2;
+    } else {
+        msg = &s_seq.msgs[s_seq.nmsgs - 1];
+    }
+
+    p = &s_seq.buf[s_seq.used];
+    if (size == MHB_CAMERA_REG_BYTE) {
+        p[0] = reg->value & 0xFF;
+    } else if (s_seq.reg_width == MHB_CAMERA_REG_WIDTH_16) {
+        p[0] = (reg->value >> 8) & 0xFF;
+        p[1] = reg->value & 0xFF;
+    } else {
+        p[0] = reg->value & 0xFF;
+        p[1] = (reg->value >> 8) & 0xFF;
+    }
+
+    msg->length += size;
+    s_seq.used += size;
+    s_seq.next_addr = reg->addr + size;
+
+    if (reg->delay_ms) {
+        ret = mhb_camera_seq_flush();
+        if (ret)
+            return ret;
+        usleep(reg->delay_ms * 1000);
+    }
+
+    return 0;
+}
+
+/* write a table of registers, with the I2C lock held */
+static int mhb_camera_seq_write(uint16_t i2c_addr,
+                                const struct mhb_camera_reg *regs,
+                                size_t count, uint8_t reg_width,
+                                uint32_t flags)
+{
+    int ret = 0;
+    size_t i;
+
+    s_seq.i2c_addr = i2c_addr;
+    s_seq.reg_width = reg_width;
+    s_seq.flags = flags;
+    s_seq.retries = CONFIG_MHB_CAMERA_I2C_RETRY;
+    s_seq.nmsgs = 0;
+    s_seq.used = 0;
+
+    for (i = 0; !ret && i < count; i++)
+        ret = mhb_camera_seq_add(&regs[i]);
+
+    if (!ret)
+        ret = mhb_camera_seq_flush();
+
+    if (ret || s_seq.retries != CONFIG_MHB_CAMERA_I2C_RETRY)
+        CAM_ERR("%s I2C sequence of %d registers retried %d of %d : ret %d\n",
+                ret ? "FAIL":"INFO", (int)count,
+                CONFIG_MHB_CAMERA_I2C_RETRY - s_seq.retries,
+                CONFIG_MHB_CAMERA_I2C_RETRY, ret);
+
+    return ret;
+}
+
+/*
+ * Sensor modes. The mode last written to the sensor is remembered and
+ * switching to another mode only writes the registers whose values
+ * differ, using the diffs computed when the modes are registered. Any
+ * other write to a register used by the modes forgets the current mode.
+ */
+
+struct mhb_camera_mode_diff {
+    struct mhb_camera_reg *regs;
+    size_t count;
+};
+
+struct mhb_camera_modes {
+    const struct mhb_camera_mode *modes;
+    size_t count;
+    uint16_t i2c_addr;
+    uint8_t reg_width;
+    int current;                        /* mode in the sensor or -1 */
+    struct mhb_camera_mode_diff *diffs; /* [from * count + to] */
+    uint16_t *addrs;                    /* sorted registers of the modes */
+    size_t num_addrs;
+};
+
+static struct mhb_camera_modes s_modes = {
+    .current = -1,
+};
+
+/* value of a register byte once a mode is written, -1 if it is not */
+static int mhb_camera_mode_byte(const struct mhb_camera_mode *mode,
+                                uint16_t addr)
+{
+    const struct mhb_camera_reg *reg;
+    bool msb_first = s_modes.reg_width == MHB_CAMERA_REG_WIDTH_16;
+    size_t i = mode->count;
+
+    while (i--) {
+        reg = &mode->regs[i];
+        if (reg->size != MHB_CAMERA_REG_WORD) {
+            if (reg->addr == addr)
+                return reg->value & 0xFF;
+        } else if (reg->addr == addr) {
+            return msb_first ? reg->value >> 8 : reg->value & 0xFF;
+        } else if (reg->addr + 1 == addr) {
+            return msb_first ? reg->value & 0xFF : reg->value >> 8;
+        }
+    }
+
+    return -1;
+}
+
+/* whether writing a register of mode "to" changes the image of "from" */
+static bool mhb_camera_mode_changes(const struct mhb_camera_mode *from,
+                                    const struct mhb_camera_mode *to,
+                                    const struct mhb_camera_reg *reg)
+{
+    uint16_t addr = reg->addr;
+    uint16_t end = addr + (reg->size == MHB_CAMERA_REG_WORD ? 2 : 1);
+
+    for (; addr != end; addr++) {
+        if (mhb_camera_mode_byte(from, addr) != mhb_camera_mode_byte(to, addr))
+            return true;
+    }
+
+    return false;
+}
+
+static int mhb_camera_mode_build_diff(struct mhb_camera_mode_diff *diff,
+                                      const struct mhb_camera_mode *from,
+                                      const struct mhb_camera_mode *to)
+{
+    size_t count = 0;
+    size_t i;
+
+    for (i = 0; i < to->count; i++) {
+        if (mhb_camera_mode_changes(from, to, &to->regs[i]))
+            count++;
+    }
+
+    diff->count = 0;
+    diff->regs = NULL;
+    if (count == 0)
+        return 0;
+
+    diff->regs = kmm_malloc(count * sizeof(*diff->regs));
+    if (diff->regs == NULL)
+        return -ENOMEM;
+
+    for (i = 0; i < to->count; i++) {
+        if (mhb_camera_mode_changes(from, to, &to->regs[i]))
+            diff->regs[diff->count++] = to->regs[i];
+    }
+
+    return 0;
+}
+
+static int mhb_camera_mode_addr_cmp(const void *a, const void *b)
+{
+    return (int)*(const uint16_t *)a - (int)*(const uint16_t *)b;
+}
+
+static int mhb_camera_mode_build_addrs(void)
+{
+    const struct mhb_camera_reg *reg;
+    size_t count = 0;
+    size_t i, j, n;
+
+    for (i = 0; i < s_modes.count; i++)
+        count += 2 * s_modes.modes[i].count;
+
+    s_modes.addrs = kmm_malloc(count * sizeof(*s_modes.addrs));
+    if (s_modes.addrs == NULL)
+        return -ENOMEM;
+
+    n = 0;
+    for (i = 0; i < s_modes.count; i++) {
+        for (j = 0; j < s_modes.modes[i].count; j++) {
+            reg = &s_modes.modes[i].regs[j];
+            s_modes.addrs[n++] = reg->addr;
+            if (reg->size == MHB_CAMERA_REG_WORD)
+                s_modes.addrs[n++] = reg->addr + 1;
+        }
+    }
+
+    qsort(s_modes.addrs, n, sizeof(*s_modes.addrs), mhb_camera_mode_addr_cmp);
+
+    s_modes.num_addrs = 0;
+    for (i = 0; i < n; i++) {
+        if (!s_modes.num_addrs ||
+            s_modes.addrs[s_modes.num_addrs - 1] != s_modes.addrs[i])
+            s_modes.addrs[s_modes.num_addrs++] = s_modes.addrs[i];
+    }
+
+    return 0;
+}
+
+static void mhb_camera_mode_free(void)
+{
+    size_t i;
+
+    if (s_modes.diffs) {
+        for (i = 0; i < s_modes.count * s_modes.count; i++)
+            kmm_free(s_modes.diffs[i].regs);
+        kmm_free(s_modes.diffs);
+        s_modes.diffs = NULL;
+    }
+
+    kmm_free(s_modes.addrs);
+    s_modes.addrs = NULL;
+    s_modes.num_addrs = 0;
+}
+
+/*
+ * forget the current mode if a write touches one of its registers,
+ * with the I2C lock held
+ */
+static void mhb_camera_mode_check(uint16_t i2c_addr, uint16_t regaddr,
+                                  uint16_t size)
+{
+    uint16_t addr;
+
+    if (s_modes.current < 0 || i2c_addr != s_modes.i2c_addr)
+        return;
+
+    if (s_modes.addrs == NULL) {
+        s_modes.current = -1;
+        return;
+    }
+
+    for (addr = regaddr; addr != (uint16_t)(regaddr + size); addr++) {
+        if (bsearch(&addr, s_modes.addrs, s_modes.num_addrs,
+                    sizeof(*s_modes.addrs), mhb_camera_mode_addr_cmp)) {
+            s_modes.current = -1;
+            return;
+        }
+    }
+}
+
+/* same for a raw write: register address then data, I2C lock held */
+static void mhb_camera_mode_check_write(uint16_t i2c_addr,
+                                        const uint8_t *buf, int len)
+{
+    uint16_t regaddr;
+
+    if (s_modes.current < 0 || len < 2)
+        return;
+
+    if (s_modes.reg_width == MHB_CAMERA_REG_WIDTH_16)
+        regaddr = (buf[0] << 8) | buf[1];
+    else
+        regaddr = buf[0] | (buf[1] << 8);
+
+    mhb_camera_mode_check(i2c_addr, regaddr, len - 2);
+}
+
+int mhb_camera_mode_register(uint16_t i2c_addr, uint8_t reg_width,
+                             const struct mhb_camera_mode *modes,
+                             size_t count)
+{
+    size_t from, to;
+    int ret;
+
+    mhb_camera_i2c_lock();
+
+    mhb_camera_mode_free();
+    s_modes.modes = modes;
+    s_modes.count = count;
+    s_modes.i2c_addr = i2c_addr;
+    s_modes.reg_width = reg_width;
+    s_modes.current = -1;
+
+    ret = mhb_camera_mode_build_addrs();
+    if (ret)
+        goto out;
+
+    s_modes.diffs = kmm_zalloc(count * count * sizeof(*s_modes.diffs));
+    if (s_modes.diffs == NULL) {
+        ret = -ENOMEM;
+        goto out;
+    }
+
+    for (from = 0; !ret && from < count; from++) {
+        for (to = 0; !ret && to < count; to++) {
+            if (from != to)
+                ret = mhb_camera_mode_build_diff(
+                            &s_modes.diffs[from * count + to],
+                            &modes[from], &modes[to]);
+        }
+    }
+
+out:
+    if (ret) {
+        /* modes are still written, but always in full */
+        CAM_ERR("No memory for the mode diffs\n");
+        mhb_camera_mode_free();
+    }
+
+    mhb_camera_i2c_unlock();
+
+    return ret;
+}
+
+/*
+ * Write a registered mode to the sensor. Only the registers differing
+ * from the current mode are written, nothing when the mode is current.
+ */
+int mhb_camera_mode_set(const struct mhb_camera_mode *mode)
+{
+    const struct mhb_camera_reg *regs = mode->regs;
+    size_t count = mode->count;
+    struct mhb_camera_mode_diff *diff;
+    int next;
+    int ret = 0;
+
+    mhb_camera_i2c_lock();
+
+    if (mode < s_modes.modes || mode >= s_modes.modes + s_modes.count) {
+        mhb_camera_i2c_unlock();
+        return -EINVAL;
+    }
+
+    next = mode - s_modes.modes;
+
+    if (s_modes.current >= 0 && s_modes.diffs) {
+        if (s_modes.current == next) {
+            count = 0;
+        } else {
+            diff = &s_modes.diffs[s_modes.current * s_modes.count + next];
+            regs = diff->regs;
+            count = diff->count;
+        }
+    }
+
+    CAM_DBG("mode %d -> %d: %d of %d registers\n", s_modes.current, next,
+            (int)count, (int)mode->count);
+
+    s_modes.current = -1;
+    if (count)
+        ret = mhb_camera_seq_write(s_modes.i2c_addr, regs, count,
+                                   s_modes.reg_width, 0);
+    if (!ret)
+        s_modes.current = next;
+
+    mhb_camera_i2c_unlock();
+
+    return ret;
+}
+
+void mhb_camera_mode_invalidate(void)
+{
+    mhb_camera_i2c_lock();
+    s_modes.current = -1;
+    mhb_camera_i2c_unlock();
+}
+
+/*
+ * Write a table of registers in one locked transaction, retrying failed
+ * transfers up to CONFIG_MHB_CAMERA_I2C_RETRY times for the whole table.
+ */
+int mhb_camera_i2c_write_seq(uint16_t i2c_addr,
+                             const struct mhb_camera_reg *regs, size_t count,
+                             uint8_t reg_width, uint32_t flags)
+{
+    size_t i;
+    int ret;
+
+    mhb_camera_i2c_lock();
+
+    for (i = 0; i < count && s_modes.current >= 0; i++)
+        mhb_camera_mode_check(i2c_addr, regs[i].addr,
+                              regs[i].size ? regs[i].size :
+                                             MHB_CAMERA_REG_BYTE);
+
+    ret = mhb_camera_seq_write(i2c_addr, regs, count, reg_width, flags);
+
+    mhb_camera_i2c_unlock();
+
+    return ret;
+}
+
 static void mhb_csi_camera_callback(uint8_t event)
 {
     int i;
@@ -641,38 +1171,82 @@ static int _mhb_csi_camera_stop_stream(void)
 
 }
 
+static inline uint8_t *mhb_camera_ctrl_val(struct cached_ctrl *ctrl)
+{
+    return ctrl->ctrl_val_size > sizeof(ctrl->val) ? ctrl->buf : ctrl->val;
+}
+
 void mhb_camera_process_ctrl_cache(int dump)
 {
-    struct cached_ctrls_node *item;
+    struct cached_ctrl *ctrl;
     uint8_t soc_status;
+    int i;
 
     pthread_mutex_lock(&s_mhb_camera.ctrl_mutex);
     soc_status = s_mhb_camera.soc_status;
 
-    while (!list_is_empty(&cached_ctrl_list)) {
-        item = list_entry(cached_ctrl_list.next,
-                          struct cached_ctrls_node, node);
+#ifdef CONFIG_MHB_CAMERA_CTRL_BATCH
+    work_cancel(LPWORK, &s_ctrl_work);
+#endif
+
+    for (i = 0; i < s_ctrl_pending; i++) {
+        ctrl = &s_ctrl_cache[s_ctrl_order[i]];
 
         if ((soc_status == SOC_ENABLED) && !dump) {
             int ret = 0, retries = CTRL_RETRIES;
             do {
-                ret = camera_ext_ctrl_set(item->dev, item->idx,
-                                          item->ctrl_val, item->ctrl_val_size);
+                ret = camera_ext_ctrl_set(ctrl->dev, s_ctrl_order[i],
+                                          mhb_camera_ctrl_val(ctrl),
+                                          ctrl->ctrl_val_size);
             } while (ret == -EAGAIN && --retries);
 
             if (ret || (CTRL_RETRIES - retries))
                 CAM_ERR("%s camera_ext_ctrl_set 0x%08x retries %d/%d\n",
-                    ret ? "FAIL":"INFO", item->idx,
+                    ret ? "FAIL":"INFO", s_ctrl_order[i],
                     CTRL_RETRIES - retries, CTRL_RETRIES);
         }
-        list_del(&item->node);
-        kmm_free(item->ctrl_val);
-        kmm_free(item);
+        ctrl->pending = false;
+    }
+    s_ctrl_pending = 0;
+
+    /* give back the large value buffers when the camera goes away */
+    for (i = 0; dump && i < CONFIG_MHB_CAMERA_CTRL_CACHE_SLOTS; i++) {
+        kmm_free(s_ctrl_cache[i].buf);
+        s_ctrl_cache[i].buf = NULL;
+        s_ctrl_cache[i].buf_size = 0;
     }
     pthread_mutex_unlock(&s_mhb_camera.ctrl_mutex);
 
 }
 
+#ifdef CONFIG_MHB_CAMERA_CTRL_BATCH
+static void mhb_camera_ctrl_worker(FAR void *arg)
+{
+    /* Leave the controls to power on if the camera went away meanwhile */
+    if (s_mhb_camera.soc_status == SOC_ENABLED)
+        mhb_camera_process_ctrl_cache(FALSE);
+}
+
+/* Apply the cached controls after a frame of the current stream. */
+static void mhb_camera_schedule_ctrl_cache(void)
+{
+    const struct camera_ext_frmival_node *ival;
+    uint32_t delay = 1;
+
+    if (!work_available(&s_ctrl_work))
+        return;
+
+    ival = get_current_frmival_node(camera_ext_get_format_db(),
+                                    camera_ext_get_user_config());
+    if (ival != NULL && ival->denominator)
+        delay = (uint32_t)(((uint64_t)ival->numerator * CLK_TCK +
+                            ival->denominator - 1) / ival->denominator);
+
+    work_queue(LPWORK, &s_ctrl_work, mhb_camera_ctrl_worker, NULL,
+               delay ? delay : 1);
+}
+#endif
+
 mhb_camera_sm_event_t mhb_camera_power_on(void)
 {
     uint8_t bootmode = s_mhb_camera.bootmode;
@@ -699,6 +1273,7 @@ mhb_camera_sm_event_t mhb_camera_power_on(void)
         if (bootmode == CAMERA_EXT_BOOTMODE_DFU) {
             mhb_csi_camera_callback(MHB_CAMERA_NOTIFY_POWERED_OFF);
             MHB_CAM_DEV_OP(s_mhb_camera.cam_device, soc_disable);
+            mhb_camera_mode_invalidate();
             s_mhb_camera.soc_status = SOC_DISABLED;
         } else {
             return MHB_CAMERA_EV_POWERED_ON;
@@ -712,6 +1287,7 @@ mhb_camera_sm_event_t mhb_camera_power_on(void)
     }
     s_mhb_camera.apbe_enabled = 1;
 
+    mhb_camera_mode_invalidate();
     if (MHB_CAM_DEV_OP(s_mhb_camera.cam_device, soc_enable,
                        s_mhb_camera.bootmode)) {
         CAM_ERR("Failed to turn on Camera SOC\n");
@@ -758,6 +1334,7 @@ mhb_camera_sm_event_t mhb_camera_power_off(void)
         s_mhb_camera.soc_status = SOC_DISABLING;
         mhb_csi_camera_callback(MHB_CAMERA_NOTIFY_POWERED_OFF);
         MHB_CAM_DEV_OP(s_mhb_camera.cam_device, soc_disable);
+        mhb_camera_mode_invalidate();
         s_mhb_camera.soc_status = SOC_DISABLED;
     }
 
@@ -873,6 +1450,7 @@ mhb_camera_sm_event_t mhb_camera_stream_on(void)
         }
         pthread_mutex_unlock(&s_mhb_camera.mutex);
         mhb_camera_i2c_unlock();
+        mhb_camera_mode_invalidate();
         MHB_CAM_DEV_OP(s_mhb_camera.cam_device, stream_reset);
     } while (retry--);
 
@@ -1127,28 +1705,63 @@ static void mhb_cam_error_cb(int err) {
 static int _mhb_camera_ext_ctrl_cache(struct device *dev,
     uint32_t idx, uint8_t *ctrl_val, uint32_t ctrl_val_size)
 {
-    struct cached_ctrls_node *item;
+    struct cached_ctrl *ctrl;
+    uint8_t *buf;
 
-    item = kmm_malloc(sizeof(struct cached_ctrls_node));
-    if (!item) return -1;
-
-    item->ctrl_val = kmm_malloc(ctrl_val_size);
-    if (!item->ctrl_val) {
-        kmm_free(item);
-        return -1;
+    if (idx >= CONFIG_MHB_CAMERA_CTRL_CACHE_SLOTS) {
+        CAM_ERR("No cache slot for control %d\n", idx);
+        return -ENOSPC;
     }
 
-    memcpy(item->ctrl_val, ctrl_val, ctrl_val_size);
-    item->dev = dev;
-    item->idx = idx;
-    item->ctrl_val_size = ctrl_val_size;
+    ctrl = &s_ctrl_cache[idx];
+
     pthread_mutex_lock(&s_mhb_camera.ctrl_mutex);
-    list_add(&cached_ctrl_list, &item->node);
+    if (ctrl_val_size > sizeof(ctrl->val) && ctrl_val_size > ctrl->buf_size) {
+        buf = kmm_malloc(ctrl_val_size);
+        if (!buf) {
+            pthread_mutex_unlock(&s_mhb_camera.ctrl_mutex);
+            return -ENOMEM;
+        }
+        kmm_free(ctrl->buf);
+        ctrl->buf = buf;
+        ctrl->buf_size = ctrl_val_size;
+    }
+
+    ctrl->dev = dev;
+    ctrl->ctrl_val_size = ctrl_val_size;
+    memcpy(mhb_camera_ctrl_val(ctrl), ctrl_val, ctrl_val_size);
+
+    if (!ctrl->pending) {
+        ctrl->pending = true;
+        s_ctrl_order[s_ctrl_pending++] = idx;
+    }
     pthread_mutex_unlock(&s_mhb_camera.ctrl_mutex);
 
     return 0;
 }
 
+/* read back a control set but not applied yet */
+static int _mhb_camera_ext_ctrl_cached(uint32_t idx, uint8_t *ctrl_val,
+    uint32_t ctrl_val_size)
+{
+    struct cached_ctrl *ctrl;
+    int ret = -ENOENT;
+
+    if (idx >= CONFIG_MHB_CAMERA_CTRL_CACHE_SLOTS)
+        return ret;
+
+    ctrl = &s_ctrl_cache[idx];
+
+    pthread_mutex_lock(&s_mhb_camera.ctrl_mutex);
+    if (ctrl->pending && ctrl->ctrl_val_size == ctrl_val_size) {
+        memcpy(ctrl_val, mhb_camera_ctrl_val(ctrl), ctrl_val_size);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&s_mhb_camera.ctrl_mutex);
+
+    return ret;
+}
+
 static int _mhb_camera_ext_ctrl_set(struct device *dev,
     uint32_t idx, uint8_t *ctrl_val, uint32_t ctrl_val_size)
 {
@@ -1168,6 +1781,19 @@ static int _mhb_camera_ext_ctrl_set(struct device *dev,
 
         return 0;
     }
+
+#ifdef CONFIG_MHB_CAMERA_CTRL_BATCH
+    /*
+     * Batch the controls until the next frame while streaming. Only the
+     * last value of a control is applied, and failures are only logged.
+     */
+    if (state == MHB_CAMERA_STATE_STREAMING &&
+        !_mhb_camera_ext_ctrl_cache(dev, idx, ctrl_val, ctrl_val_size)) {
+        mhb_camera_schedule_ctrl_cache();
+        return 0;
+    }
+#endif
+
     return camera_ext_ctrl_set(dev, idx, ctrl_val, ctrl_val_size);
 }
 
@@ -1182,6 +1808,9 @@ static int _mhb_camera_ext_ctrl_get(struct device *dev,
         return -ENODEV;
     }
 
+    if (!_mhb_camera_ext_ctrl_cached(idx, ctrl_val, ctrl_val_size))
+        return 0;
+
     if (s_mhb_camera.soc_status != SOC_ENABLED ||
         state == MHB_CAMERA_STATE_WAIT_POWER_ON||
         state == MHB_CAMERA_STATE_WAIT_STREAM) {
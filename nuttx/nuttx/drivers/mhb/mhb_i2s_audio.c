@@ -159,6 +159,7 @@ static void mhb_print_i2s_status(const char *header, struct i2s_tunnel_info_s *i
     FROM_LE(info->i2s_tx_samples_dropped);
     FROM_LE(info->i2s_tx_samples_retransmitted);
     FROM_LE(info->i2s_tx_buffers_dropped);
+    FROM_LE(info->i2s_tx_drift_ppm);
 
     lldbg("%s:\n", header);
     lldbg("  Enabled:                      %u\n", (info->enabled));
@@ -172,6 +173,7 @@ static void mhb_print_i2s_status(const char *header, struct i2s_tunnel_info_s *i
     lldbg("  Samples removed:              %u\n", (info->i2s_tx_samples_dropped));
     lldbg("  Samples repeated:             %u\n", (info->i2s_tx_samples_retransmitted));
     lldbg("  Packets dropped:              %u\n", (info->i2s_tx_buffers_dropped));
+    lldbg("  Clock drift ppm:              %d\n", (info->i2s_tx_drift_ppm));
 }
 #endif
 
@@ -31,15 +31,12 @@
 #include <crc16_poly8005.h>
 #include <errno.h>
 #include <string.h>
-#include <queue.h>
 #include <unistd.h>
 
 #include <arch/atomic.h>
 #include <arch/byteorder.h>
 
-#ifdef CONFIG_MM_BUFRAM_ALLOCATOR
-#include <nuttx/bufram.h>
-#endif
+#include <nuttx/arch.h>
 #include <nuttx/util.h>
 #include <nuttx/clock.h>
 #include <nuttx/device.h>
@@ -60,11 +57,41 @@
 
 #define MHB_UART_TRACE (0)
 
-struct mhb_queue_item {
-    sq_entry_t entry;
-    size_t size;
+#if CONFIG_MHB_UART_TXBUFSIZE < MHB_MAX_MSG_SIZE
+#error CONFIG_MHB_UART_TXBUFSIZE must hold a message of MHB_MAX_MSG_SIZE
+#endif
+
+#if CONFIG_MHB_UART_RXBUFSIZE < MHB_MAX_MSG_SIZE
+#error CONFIG_MHB_UART_RXBUFSIZE must hold a message of MHB_MAX_MSG_SIZE
+#endif
+
+/*
+ * RX ring. The receiver fills it in place and the parser walks the
+ * packets through it, carrying the header and the CRC along as bytes
+ * arrive. head and tail stay below twice the ring size.
+ */
+struct mhb_rx_ring {
+    uint8_t buf[CONFIG_MHB_UART_RXBUFSIZE];
+    size_t head; /* end of the received bytes */
+    size_t tail; /* start of the packet being parsed */
+    /* packet being parsed */
+    struct mhb_hdr hdr;
+    bool have_hdr;
+    size_t crc_len; /* bytes of the packet covered by crc */
+    uint16_t crc;
+};
+
+#define mhb_rx_index(n) ((n) % CONFIG_MHB_UART_RXBUFSIZE)
+
+/* Packets waiting in the TX ring at most */
+#define MHB_TX_DESCS (16)
+
+/* A packet in the TX ring */
+struct mhb_tx_desc {
+    uint16_t offset;
+    uint16_t size;
     int flags;
-    uint8_t buffer[0];
+    volatile bool ready; /* written, can be sent */
 };
 
 struct mhb {
@@ -80,8 +107,18 @@ struct mhb {
     pthread_t rx_thread;
     /* tx */
     sem_t tx_sem;
-    sq_queue_t tx_queue;
     pthread_t tx_thread;
+    /*
+     * TX ring. mhb_send() reserves room for a whole packet and writes its
+     * header, payload and CRC in place. The TX thread hands each run of
+     * consecutive packets to the UART in a single write.
+     */
+    uint8_t tx_ring[CONFIG_MHB_UART_TXBUFSIZE];
+    struct mhb_tx_desc tx_descs[MHB_TX_DESCS];
+    unsigned int tx_desc_head; /* next descriptor to reserve */
+    unsigned int tx_desc_tail; /* oldest descriptor not sent */
+    sem_t tx_space_sem;
+    unsigned int tx_space_waiters;
     /* callbacks */
     /* IMPORTANT: Dependent on the implementation of _mhb_addr_to_index() */
     mhb_receiver receivers[MHB_FUNC_MAX + 1];
@@ -105,6 +142,9 @@ static int mhb_send(struct device *dev, struct mhb_hdr *hdr,
 
 #define PM_HANDSHAKE_TIMEOUT 1000 /* ms */
 
+/* Longest wait for room in the TX ring, covering a wake handshake */
+#define MHB_TX_SPACE_TIMEOUT (2 * PM_HANDSHAKE_TIMEOUT) /* ms */
+
 #define MHB_UART_ACTIVITY 10
 
 #define MHB_INVALID_GPIO (0xffffffff)
@@ -482,37 +522,159 @@ static int mhb_callback(struct mhb_hdr *hdr,
     }
 }
 
-#if CONFIG_MHB_UART_SEND_SYNC
-static int _mhb_send_sync_pattern(void)
+#define mhb_tx_desc(n) (&g_mhb->tx_descs[(n) % MHB_TX_DESCS])
+
+/* Offset of room for size bytes in the TX ring, or -ENOMEM. IRQs off. */
+static int _mhb_tx_find_room(size_t size)
 {
-    struct mhb_queue_item *item;
-    size_t length = MHB_UART_SYNC_LENGTH;
+    struct mhb_tx_desc *first;
+    struct mhb_tx_desc *last;
+    size_t head;
 
-    /* Allocate an item */
-#ifdef CONFIG_MM_BUFRAM_ALLOCATOR
-    uint8_t *buf = bufram_alloc(sizeof(*item) + length);
-#else
-    uint8_t *buf = kmm_zalloc(sizeof(*item) + length);
-#endif
-    if (!buf) {
-        dbg("ERROR: Failed to allocate\n");
+    if (g_mhb->tx_desc_head == g_mhb->tx_desc_tail) {
+        return 0;
+    }
+
+    if (g_mhb->tx_desc_head - g_mhb->tx_desc_tail >= MHB_TX_DESCS) {
         return -ENOMEM;
     }
 
-    /* Populate the queue item */
-    item = (struct mhb_queue_item *)buf;
-    item->size = length;
+    first = mhb_tx_desc(g_mhb->tx_desc_tail);
+    last = mhb_tx_desc(g_mhb->tx_desc_head - 1);
+    head = last->offset + last->size;
 
-    /* Set the sync */
-    memset(item->buffer, MHB_UART_SYNC_FLAG, length);
+    if (last->offset < first->offset) {
+        /* Wrapped: the free room is between the head and the tail */
+        return head + size <= first->offset ? head : -ENOMEM;
+    }
+
+    if (head + size <= sizeof(g_mhb->tx_ring)) {
+        return head;
+    }
+
+    /* Leave the end of the ring unused and wrap */
+    return size <= first->offset ? 0 : -ENOMEM;
+}
+
+/* Wake up all the senders waiting for room in the TX ring. IRQs off. */
+static void _mhb_tx_wake_waiters(void)
+{
+    while (g_mhb->tx_space_waiters) {
+        g_mhb->tx_space_waiters--;
+        sem_post(&g_mhb->tx_space_sem);
+    }
+}
+
+/*
+ * Whether the caller may wait for room in the TX ring. Interrupt handlers
+ * cannot, and neither can the RX and TX threads, since the ring may only
+ * drain once they go on. Nobody waits once the threads are told to stop.
+ */
+static bool _mhb_tx_may_wait(void)
+{
+    pthread_t self;
+
+    if (up_interrupt_context() || !g_mhb->should_run) {
+        return false;
+    }
+
+    self = pthread_self();
+    return !pthread_equal(self, g_mhb->rx_thread) &&
+           !pthread_equal(self, g_mhb->tx_thread);
+}
+
+/*
+ * Reserve a packet of size bytes in the TX ring, waiting up to
+ * MHB_TX_SPACE_TIMEOUT for room when the caller may wait. The caller fills
+ * it in then calls _mhb_tx_commit().
+ */
+static struct mhb_tx_desc *_mhb_tx_reserve(size_t size, int flags)
+{
+    struct mhb_tx_desc *desc;
+    struct timespec expires;
+    irqstate_t iflags;
+    int offset;
+
+    if (size > sizeof(g_mhb->tx_ring)) {
+        return NULL;
+    }
+
+    if (clock_gettime(CLOCK_REALTIME, &expires)) {
+        return NULL;
+    }
+
+    nsec_to_timespec(timespec_to_nsec(&expires) +
+                     (uint64_t)MHB_TX_SPACE_TIMEOUT * NSEC_PER_MSEC,
+                     &expires);
+
+    iflags = irqsave();
+
+    while ((offset = _mhb_tx_find_room(size)) < 0) {
+        if (!_mhb_tx_may_wait()) {
+            irqrestore(iflags);
+            return NULL;
+        }
+
+        g_mhb->tx_space_waiters++;
+        if (sem_timedwait(&g_mhb->tx_space_sem, &expires) < 0) {
+            /* Give the wake up back, or take it if already posted */
+            if (g_mhb->tx_space_waiters) {
+                g_mhb->tx_space_waiters--;
+            } else {
+                sem_trywait(&g_mhb->tx_space_sem);
+            }
+
+            irqrestore(iflags);
+            lldbg("ERROR: no room in the TX ring\n");
+            return NULL;
+        }
+    }
+
+    desc = mhb_tx_desc(g_mhb->tx_desc_head++);
+    desc->offset = offset;
+    desc->size = size;
+    desc->flags = flags;
+    desc->ready = false;
 
-    /* Queue the buffer */
-    irqstate_t iflags = irqsave();
-    sq_addlast(&item->entry, &g_mhb->tx_queue);
     irqrestore(iflags);
 
-    /* Signal the transmit thread that a buffer is available */
+    return desc;
+}
+
+static void _mhb_tx_commit(struct mhb_tx_desc *desc)
+{
+    desc->ready = true;
+
+    /* Signal the transmit thread that a packet is available */
     sem_post(&g_mhb->tx_sem);
+}
+
+/* Release the n oldest packets of the TX ring */
+static void _mhb_tx_release(unsigned int n)
+{
+    irqstate_t flags = irqsave();
+
+    g_mhb->tx_desc_tail += n;
+    _mhb_tx_wake_waiters();
+
+    irqrestore(flags);
+}
+
+#if CONFIG_MHB_UART_SEND_SYNC
+static int _mhb_send_sync_pattern(void)
+{
+    struct mhb_tx_desc *desc;
+
+    desc = _mhb_tx_reserve(MHB_UART_SYNC_LENGTH, 0);
+    if (!desc) {
+        dbg("ERROR: Failed to allocate\n");
+        return -ENOMEM;
+    }
+
+    /* Set the sync */
+    memset(g_mhb->tx_ring + desc->offset, MHB_UART_SYNC_FLAG, desc->size);
+
+    _mhb_tx_commit(desc);
 
     return 0;
 }
@@ -571,27 +733,179 @@ static int _mhb_wait_for_sync_pattern(uint8_t *rx_buf, size_t *rx_size)
     return ret;
 }
 
+/* Copy len bytes from the RX ring at pos, across the wrap */
+static void _mhb_rx_copy(struct mhb_rx_ring *rx, void *dst, size_t pos,
+    size_t len)
+{
+    size_t i = mhb_rx_index(pos);
+    size_t n = sizeof(rx->buf) - i;
+
+    if (n > len) {
+        n = len;
+    }
+
+    memcpy(dst, rx->buf + i, n);
+    memcpy((uint8_t *)dst + n, rx->buf, len - n);
+}
+
+/* Extend crc over len bytes of the RX ring at pos, across the wrap */
+static uint16_t _mhb_rx_crc(struct mhb_rx_ring *rx, size_t pos, size_t len,
+    uint16_t crc)
+{
+    size_t i = mhb_rx_index(pos);
+    size_t n = sizeof(rx->buf) - i;
+
+    if (n > len) {
+        n = len;
+    }
+
+    crc = crc16_poly8005(rx->buf + i, n, crc);
+    if (len > n) {
+        crc = crc16_poly8005(rx->buf, len - n, crc);
+    }
+
+    return crc;
+}
+
+/* Start parsing a new packet at pos */
+static void _mhb_rx_restart(struct mhb_rx_ring *rx, size_t pos)
+{
+    if (pos >= sizeof(rx->buf)) {
+        pos -= sizeof(rx->buf);
+        rx->head -= sizeof(rx->buf);
+    }
+
+    rx->tail = pos;
+    rx->have_hdr = false;
+    rx->crc_len = 0;
+    rx->crc = CRC_INIT_VAL;
+}
+
+/*
+ * Deliver every complete packet in the RX ring. A packet with a bad length
+ * or CRC is dropped one byte at a time, so the parser scans forward for the
+ * next valid header in what is already buffered.
+ */
+static void _mhb_rx_parse(struct mhb_rx_ring *rx)
+{
+    /* Payloads split by the wrap are made contiguous here */
+    static uint8_t payload_buf[MHB_MAX_PAYLOAD_SIZE];
+
+    for (;;) {
+        size_t avail = rx->head - rx->tail;
+
+        if (!rx->have_hdr) {
+            if (avail < MHB_HDR_SIZE) {
+                return;
+            }
+
+            /* Have a complete data link header */
+            _mhb_rx_copy(rx, &rx->hdr, rx->tail, MHB_HDR_SIZE);
+
+            /* Reverse header length */
+            uint16_t length = le16_to_cpu(rx->hdr.length);
+            if (length < MHB_HDR_SIZE + MHB_CRC_SIZE ||
+                length > MHB_MAX_MSG_SIZE) {
+                lldbg("ERROR: Invalid length=%04x\n", length);
+
+                /* Re-sync */
+                _mhb_rx_restart(rx, rx->tail + 1);
+                continue;
+            }
+
+            rx->hdr.length = length;
+            rx->have_hdr = true;
+        }
+
+        size_t length = rx->hdr.length;
+
+        /* Fold the bytes received since the last pass into the CRC */
+        size_t crc_len = length - MHB_CRC_SIZE;
+        if (crc_len > avail) {
+            crc_len = avail;
+        }
+
+        if (crc_len > rx->crc_len) {
+            rx->crc = _mhb_rx_crc(rx, rx->tail + rx->crc_len,
+                                  crc_len - rx->crc_len, rx->crc);
+            rx->crc_len = crc_len;
+        }
+
+        if (avail < length) {
+            return;
+        }
+
+        /* Have a complete packet, check the CRC */
+        uint16_t received_crc;
+        _mhb_rx_copy(rx, &received_crc, rx->tail + length - MHB_CRC_SIZE,
+                     MHB_CRC_SIZE);
+        received_crc = le16_to_cpu(received_crc);
+        if (received_crc && received_crc != rx->crc) {
+            /* Only check the CRC if it is non-zero.  Zero is a special
+               case that indicates CRC checking is disabled. */
+            lldbg("ERROR: CRC mismatch: rx=%04x, calc=%04x\n",
+                                    received_crc, rx->crc);
+
+            /* Re-sync */
+            _mhb_rx_restart(rx, rx->tail + 1);
+            continue;
+        }
+
+        /* Find the payload, in place unless it wraps */
+        size_t payload_index = mhb_rx_index(rx->tail + MHB_HDR_SIZE);
+        size_t payload_length = length - MHB_HDR_SIZE - MHB_CRC_SIZE;
+        uint8_t *payload;
+
+        if (payload_index + payload_length <= sizeof(rx->buf)) {
+            payload = rx->buf + payload_index;
+        } else {
+            _mhb_rx_copy(rx, payload_buf, payload_index, payload_length);
+            payload = payload_buf;
+        }
+
+        /* Notify listeners */
+        mhb_callback(&rx->hdr, payload, payload_length);
+
+        _mhb_rx_restart(rx, rx->tail + length);
+    }
+}
+
 static void *mhb_rx_thread(void *data)
 {
     int ret = 0;
-    static uint8_t rx_buf[CONFIG_MHB_UART_RXBUFSIZE];
+    static struct mhb_rx_ring rx;
     size_t rx_size = 0;
 
-    ret = _mhb_wait_for_sync_pattern(rx_buf, &rx_size);
+    ret = _mhb_wait_for_sync_pattern(rx.buf, &rx_size);
     vdbg("sync done: ret=%d\n", ret);
 
+    rx.head = rx_size;
+    _mhb_rx_restart(&rx, 0);
+
     while (!ret) {
         int got = 0;
 
+        /*
+         * Receive into the ring up to its wrap or to the packet being
+         * parsed. A pending packet is never larger than the ring, so
+         * there is always room once the complete ones are delivered.
+         */
+        size_t index = mhb_rx_index(rx.head);
+        size_t space = sizeof(rx.buf) - (rx.head - rx.tail);
+        if (space > sizeof(rx.buf) - index) {
+            space = sizeof(rx.buf) - index;
+        }
+
+        DEBUGASSERT(space > 0);
+
         pthread_mutex_lock(&g_mhb->run_mutex);
         if (!g_mhb->should_run) {
             pthread_mutex_unlock(&g_mhb->run_mutex);
             break;
         }
 
-        ret = device_uart_start_receiver(g_mhb->dev, rx_buf + rx_size,
-                      sizeof(rx_buf) - rx_size, NULL /* dma */,
-                      &got, NULL /* blocking */);
+        ret = device_uart_start_receiver(g_mhb->dev, rx.buf + index,
+                      space, NULL /* dma */, &got, NULL /* blocking */);
 
         pthread_mutex_unlock(&g_mhb->run_mutex);
 
@@ -602,59 +916,9 @@ static void *mhb_rx_thread(void *data)
             break;
         }
 
-        rx_size += got;
+        rx.head += got;
 
-        if (rx_size >= MHB_HDR_SIZE) {
-            /* Have a complete data link header */
-            struct mhb_hdr *rx_hdr = (struct mhb_hdr *)rx_buf;
-
-            uint16_t length = le16_to_cpu(rx_hdr->length);
-            if (rx_size >= length) {
-                /* Have a complete packet */
-
-                /* Reverse header length */
-                rx_hdr->length = length;
-
-                /* Check the CRC */
-                uint16_t received_crc =
-                    *((uint16_t *)(rx_buf + length - MHB_CRC_SIZE));
-                received_crc = le16_to_cpu(received_crc);
-                if (received_crc) {
-                    /* Only check the CRC if it is non-zero.  Zero is a special
-                       case that indicates CRC checking is disabled. */
-                    uint16_t calculated_crc = crc16_poly8005(rx_buf,
-                                length - sizeof(received_crc), CRC_INIT_VAL);
-                    if (received_crc != calculated_crc) {
-                        lldbg("ERROR: CRC mismatch: rx=%04x, calc=%04x\n",
-                                                received_crc, calculated_crc);
-
-                        /* Re-sync */
-                        ret = _mhb_wait_for_sync_pattern(rx_buf, &rx_size);
-                        vdbg("sync done: ret=%d\n", ret);
-                        continue;
-                    }
-                }
-
-                /* Find the payload */
-                uint8_t *payload = rx_buf + MHB_HDR_SIZE;
-                size_t payload_length =
-                    rx_hdr->length - MHB_HDR_SIZE - MHB_CRC_SIZE;
-
-                /* Notify listeners */
-                mhb_callback(rx_hdr, payload, payload_length);
-
-                /* Reset the rx size */
-                rx_size -= length;
-                memmove(rx_buf, rx_buf + length, rx_size);
-            } else if (length > MHB_MAX_MSG_SIZE) {
-                lldbg("ERROR: Invalid length=%04x\n", length);
-
-                 /* Re-sync */
-                 ret = _mhb_wait_for_sync_pattern(rx_buf, &rx_size);
-                 vdbg("sync done: ret=%d\n", ret);
-                 continue;
-            }
-        }
+        _mhb_rx_parse(&rx);
     }
 
     vdbg("done: ret=%d\n", ret);
@@ -663,7 +927,7 @@ static void *mhb_rx_thread(void *data)
 
 static int mhb_send(struct device *dev, struct mhb_hdr *hdr,
     uint8_t *payload, size_t payload_length, int flags) {
-    struct mhb_queue_item *item;
+    struct mhb_tx_desc *desc;
 
 #if MHB_UART_TRACE
     lldbg("tx: addr=%x, type=%x, res=%x\n", hdr->addr, hdr->type, hdr->result);
@@ -675,70 +939,87 @@ static int mhb_send(struct device *dev, struct mhb_hdr *hdr,
     /* Populate the packet length field */
     hdr->length = cpu_to_le16(length);
 
-    /* Allocate an item */
-#ifdef CONFIG_MM_BUFRAM_ALLOCATOR
-    uint8_t *buf = bufram_alloc(sizeof(*item) + length);
-#else
-    uint8_t *buf = kmm_zalloc(sizeof(*item) + length);
-#endif
-    if (!buf) {
+    /* Reserve the packet in the TX ring */
+    desc = _mhb_tx_reserve(length, flags);
+    if (!desc) {
         dbg("ERROR: Failed to allocate\n");
         return -ENOMEM;
     }
 
-    /* Populate the queue item */
-    item = (struct mhb_queue_item *)buf;
-    item->size = length;
-    item->flags = flags;
-
-    /* Copy the packet */
-    uint8_t *p = item->buffer;
+    uint8_t *p = g_mhb->tx_ring + desc->offset;
 
-    /* Copy the header */
-    memcpy(p, hdr, MHB_HDR_SIZE);
+    /* Copy the header and the payload, calculating the CRC on the way */
+    uint16_t crc = crc16_poly8005_copy(p, (uint8_t *)hdr, MHB_HDR_SIZE,
+                                       CRC_INIT_VAL);
     p += MHB_HDR_SIZE;
 
-    /* Copy the payload */
-    memcpy(p, payload, payload_length);
+    crc = crc16_poly8005_copy(p, payload, payload_length, crc);
     p += payload_length;
 
-    /* Calculate the CRC */
-    uint16_t crc =
-        crc16_poly8005(item->buffer, p - item->buffer, CRC_INIT_VAL);
     crc = cpu_to_le16(crc);
     memcpy(p, &crc, MHB_CRC_SIZE);
 
-    /* Queue the buffer */
-    irqstate_t iflags = irqsave();
-    sq_addlast(&item->entry, &g_mhb->tx_queue);
-    irqrestore(iflags);
-
-    /* Signal the transmit thread that a buffer is available */
-    sem_post(&g_mhb->tx_sem);
+    _mhb_tx_commit(desc);
 
     return 0;
 }
 
+/*
+ * Drop the packets committed but not sent. A packet still being written
+ * stays reserved, with the ones after it, until its sender commits it.
+ */
 static void mhb_tx_flush(void)
 {
-    irqstate_t flags = irqsave();
+    unsigned int n;
 
-    while (!sq_empty(&g_mhb->tx_queue)) {
-        struct mhb_queue_item *item =
-                        (struct mhb_queue_item *)sq_remfirst(&g_mhb->tx_queue);
-#ifdef CONFIG_MM_BUFRAM_ALLOCATOR
-        bufram_free(item);
-#else
-        kmm_free(item);
-#endif
+    for (n = 0; g_mhb->tx_desc_tail + n != g_mhb->tx_desc_head; n++) {
+        if (!mhb_tx_desc(g_mhb->tx_desc_tail + n)->ready) {
+            break;
+        }
     }
 
-    irqrestore(flags);
+    _mhb_tx_release(n);
+}
+
+/*
+ * Number of packets, from the oldest one, that can go out in a single
+ * write: ready, back to back in the ring and without PM flags, which are
+ * handled one packet at a time. The same goes while a baud rate change is
+ * pending, as it applies right after the packet that acknowledges it.
+ */
+static unsigned int mhb_tx_gather(size_t *size)
+{
+    struct mhb_tx_desc *prev = NULL;
+    struct mhb_tx_desc *desc;
+    unsigned int n;
+
+    *size = 0;
+
+    for (n = 0; g_mhb->tx_desc_tail + n != g_mhb->tx_desc_head; n++) {
+        desc = mhb_tx_desc(g_mhb->tx_desc_tail + n);
+        if (!desc->ready) {
+            break;
+        }
+
+        if (prev && (desc->flags || prev->offset + prev->size != desc->offset)) {
+            break;
+        }
+
+        *size += desc->size;
+        prev = desc;
+
+        if (desc->flags || g_mhb->current_baud != g_mhb->new_baud) {
+            n++;
+            break;
+        }
+    }
+
+    return n;
 }
 
-static void pm_pre_tx(const struct mhb_queue_item *item)
+static void pm_pre_tx(int tx_flags)
 {
-    if (item->flags & MHB_SEND_FLAGS_PEER_ASLEEP) {
+    if (tx_flags & MHB_SEND_FLAGS_PEER_ASLEEP) {
         /*
          * Responding to SLEEP Indication from the peer.
          * The peer may go in sleep anytime. Do not go through
@@ -748,7 +1029,7 @@ static void pm_pre_tx(const struct mhb_queue_item *item)
         return;
     }
 
-    if (item->flags & MHB_SEND_FLAGS_WAKE_ACK) {
+    if (tx_flags & MHB_SEND_FLAGS_WAKE_ACK) {
         /*
          * Responding to wake assert from the peer. Consider
          * the remote is up.
@@ -759,9 +1040,9 @@ static void pm_pre_tx(const struct mhb_queue_item *item)
     mhb_wake_peer();
 }
 
-static void pm_post_tx(const struct mhb_queue_item *item)
+static void pm_post_tx(int tx_flags)
 {
-    if (item->flags & MHB_SEND_FLAGS_LOCAL_SLEEP) {
+    if (tx_flags & MHB_SEND_FLAGS_LOCAL_SLEEP) {
         /*
          * Successfuly sent out SLEEP IND to the peer. The peer
          * may goto sleep anytime from this point. Consider peer
@@ -796,49 +1077,39 @@ static void *mhb_tx_thread(void *data)
             break;
         }
 
-        /* Get the next buffer */
-        irqstate_t flags = irqsave();
-        bool empty = sq_empty(&g_mhb->tx_queue);
-        irqrestore(flags);
+        /* Send everything that is ready, a run of packets at a time */
+        while (!ret) {
+            size_t size;
+            unsigned int n = mhb_tx_gather(&size);
+            if (!n) {
+                break;
+            }
 
-        if (empty) {
-            continue;
-        }
+            struct mhb_tx_desc *desc = mhb_tx_desc(g_mhb->tx_desc_tail);
+            int tx_flags = desc->flags;
 
-        struct mhb_queue_item *item =
-                        (struct mhb_queue_item *)sq_remfirst(&g_mhb->tx_queue);
+            pm_pre_tx(tx_flags);
 
-        pm_pre_tx(item);
+            int sent = 0;
+            ret = device_uart_start_transmitter(g_mhb->dev,
+                          g_mhb->tx_ring + desc->offset, size,
+                          NULL /* dma */, &sent,
+                          NULL /* callback, blocking without callback */);
+            if (ret) {
+                lldbg("ERROR: failed to write: %d\n", ret);
+                break;
+            }
 
-        /* Send the buffer */
-        int sent = 0;
-        ret = device_uart_start_transmitter(g_mhb->dev, item->buffer,
-                      item->size, NULL /* dma */, &sent,
-                      NULL /* callback, blocking without callback */);
-        if (ret) {
-            lldbg("ERROR: failed to write: %d\n", ret);
-#ifdef CONFIG_MM_BUFRAM_ALLOCATOR
-            bufram_free(item);
-#else
-            kmm_free(item);
-#endif
-            break;
-        }
+            pm_post_tx(tx_flags);
 
-        pm_post_tx(item);
+            /* Switch baud rates if requested. */
+            if (g_mhb->current_baud != g_mhb->new_baud) {
+                mhb_complete_baud_change(g_mhb->new_baud);
+                g_mhb->current_baud = g_mhb->new_baud;
+            }
 
-        /* Switch baud rates if requested. */
-        if (g_mhb->current_baud != g_mhb->new_baud) {
-            mhb_complete_baud_change(g_mhb->new_baud);
-            g_mhb->current_baud = g_mhb->new_baud;
+            _mhb_tx_release(n);
         }
-
-        /* Free the item and buffer */
-#ifdef CONFIG_MM_BUFRAM_ALLOCATOR
-        bufram_free(item);
-#else
-        kmm_free(item);
-#endif
     }
 
     mhb_tx_flush();
@@ -850,8 +1121,14 @@ static void *mhb_tx_thread(void *data)
 static int mhb_stop(void)
 {
     pthread_addr_t join_value;
+    irqstate_t flags;
 
     g_mhb->should_run = false;
+
+    /* Senders waiting for room give up */
+    flags = irqsave();
+    _mhb_tx_wake_waiters();
+    irqrestore(flags);
     if (g_mhb->rx_thread) {
         while(pthread_mutex_trylock(&g_mhb->run_mutex)) {
             pthread_kill(g_mhb->rx_thread, MHB_SIG_STOP);
@@ -1060,7 +1337,7 @@ static int mhb_dev_probe(struct device *dev)
     g_mhb->self = dev;
 
     sem_init(&g_mhb->tx_sem, 0, 0);
-    sq_init(&g_mhb->tx_queue);
+    sem_init(&g_mhb->tx_space_sem, 0, 0);
 
     pthread_mutex_init(&g_mhb->mutex, NULL);
     pthread_cond_init(&g_mhb->cond, NULL);
@@ -78,7 +78,7 @@ static enum bme680_return_type bme680_get_calib_param(struct bme680_t *bme680);
 
 static void bme680_scale_to_multiplication_factor(u16 *duration_u16);
 
-#ifndef	__linux__
+#if !defined(__linux__) || !defined(__KERNEL__)
 static void bme680_buffer_restruct_burst_write(u8 arr[], u8 reg_addr,
 	u8 data_size, u8 arr_size);
 #endif
@@ -1297,7 +1297,7 @@ enum bme680_return_type bme680_set_sensor_config(
 				BME680_SHIFT_FILTER) |
 				(sens_conf->spi_3w & 0x01);
 
-#ifndef	__linux__
+#if !defined(__linux__) || !defined(__KERNEL__)
 			bme680_buffer_restruct_burst_write(data_u8,
 						0x70,
 						BME680_SENS_CONF_LEN,
@@ -1515,7 +1515,7 @@ enum bme680_return_type bme680_set_gas_heater_config(
 			data_u8[30] = heatr_conf->heatr_dur_shared;
 
 		}
-#ifndef	__linux__
+#if !defined(__linux__) || !defined(__KERNEL__)
 		bme680_buffer_restruct_burst_write(data_u8,
 					BME680_ADDR_SENS_CONF_START,
 					BME680_SENS_HEATR_CONF_LEN,
@@ -1584,7 +1584,7 @@ static void bme680_scale_to_multiplication_factor(u16 *duration_u16)
  *	@return none
  *
 */
-#ifndef	__linux__
+#if !defined(__linux__) || !defined(__KERNEL__)
 static void bme680_buffer_restruct_burst_write(u8 arr[], u8 reg_addr,
 	u8 data_size, u8 arr_size)
 {
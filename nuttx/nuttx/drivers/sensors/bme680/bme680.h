@@ -75,6 +75,8 @@ Example: 2.0.0 */
 /***************************************************************************
 			Header files
 ****************************************************************************/
+#include <nuttx/config.h>
+
 #include "sensor_api_common_types.h"
 
 
@@ -138,7 +140,9 @@ of single function calls when not used */
  * else Floating Point calculation will be used
 */
 
+#ifdef CONFIG_SENSOR_BME680_FIXED_POINT
 #define FIXED_POINT_COMPENSATION
+#endif
 
 /* temperature to Resistance  formulae #defines */
 
@@ -159,15 +163,12 @@ of single function calls when not used */
 #define BME680_GAS_RANGE_RL_LENGTH		(16)
 #define BME680_SIGN_BIT_MASK			(0x08)
 
-#ifdef FIXED_POINT_COMPENSATION
 /**< Multiply by 1000, In order to convert
 float value into fixed point  */
 #define BME680_MAX_HUMIDITY_VALUE		(102400)
 #define BME680_MIN_HUMIDITY_VALUE		(0)
-#else
-#define BME680_MAX_HUMIDITY_VALUE		(double)(100.0)
-#define BME680_MIN_HUMIDITY_VALUE		(double)(0.0)
-#endif
+#define BME680_MAX_HUMIDITY_VALUE_DOUBLE	(double)(100.0)
+#define BME680_MIN_HUMIDITY_VALUE_DOUBLE	(double)(0.0)
 
 /* BME680 I2C addresses */
 #define BME680_I2C_ADDR_PRIMARY			(0x76)
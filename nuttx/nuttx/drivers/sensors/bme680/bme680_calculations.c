@@ -121,7 +121,7 @@ s32 bme680_calculate_gas_int32(u16 gas_adc_u16, u8 gas_range_u8,
 	var1 = (s64)((1340 + (5 * (s64)range_switching_error_val)) *
 		((s64)lookup_k1_range[gas_range_u8])) >> 16;
 	var2 = (s64)((s64)gas_adc_u16 << 15) - (s64)(1 << 24) + var1;
-	#ifndef __linux__
+	#if !defined(__linux__) || !defined(__KERNEL__)
 	gas_res = (s32)(((((s64)lookup_k2_range[gas_range_u8] *
 		(s64)var1) >> 9) + (var2 >> 1)) / var2);
 	#else
@@ -189,11 +189,11 @@ s32 bme680_compensate_humidity_int32(u32 v_uncomp_humidity_u32,
 	s32 temp_scaled = BME680_INIT_VALUE;
 	s32 var1	= BME680_INIT_VALUE;
 	s32 var2	= BME680_INIT_VALUE;
-	s32 var3	= BME680_INIT_VALUE;
+	s64 var3	= BME680_INIT_VALUE;
 	s32 var4	= BME680_INIT_VALUE;
-	s32 var5	= BME680_INIT_VALUE;
-	s32 var6	= BME680_INIT_VALUE;
-	s32 humidity_comp = BME680_INIT_VALUE;
+	s64 var5	= BME680_INIT_VALUE;
+	s64 var6	= BME680_INIT_VALUE;
+	s64 humidity_comp = BME680_INIT_VALUE;
 
 	temp_scaled = (((s32)bme680->cal_param.t_fine * 5) + 128) >> 8;
 	var1 = (s32)v_uncomp_humidity_u32 -
@@ -207,7 +207,8 @@ s32 bme680_compensate_humidity_int32(u32 v_uncomp_humidity_u32,
 		((temp_scaled * (s32)bme680->cal_param.par_H5) /
 		((s32)100))) >> 6) / ((s32)100)) + (s32)(1 << 14))) >> 10;
 
-	var3 = var1 * var2;
+	/* 64 bits, so readings past saturation clamp rather than wrap */
+	var3 = (s64)var1 * var2;
 
 	var4 = ((((s32)bme680->cal_param.par_H6) << 7) +
 		((temp_scaled * (s32)bme680->cal_param.par_H7) /
@@ -222,7 +223,7 @@ s32 bme680_compensate_humidity_int32(u32 v_uncomp_humidity_u32,
 	else if (humidity_comp < BME680_MIN_HUMIDITY_VALUE)
 		humidity_comp = BME680_MIN_HUMIDITY_VALUE;
 
-	return humidity_comp;
+	return (s32)humidity_comp;
 }
 
 
@@ -273,9 +274,10 @@ s32 bme680_compensate_pressure_int32(u32 v_uncomp_pressure_u32,
 		(pressure_comp >> 3)) >> 13)) >> 12;
 	var2 = ((s32)(pressure_comp >> 2) *
 		(s32)bme680->cal_param.par_P8) >> 13;
-	var3 = ((s32)(pressure_comp >> 8) * (s32)(pressure_comp >> 8) *
-		(s32)(pressure_comp >> 8) *
-		(s32)bme680->cal_param.par_P10) >> 17;
+	/* the cube overflows 32 bits above ~104 kPa */
+	var3 = (s32)(((s64)(pressure_comp >> 8) * (s64)(pressure_comp >> 8) *
+		(s64)(pressure_comp >> 8) *
+		(s64)bme680->cal_param.par_P10) >> 17);
 
 	pressure_comp = (s32)(pressure_comp) + ((var1 + var2 + var3 +
 		((s32)bme680->cal_param.par_P7 << 7)) >> 4);
@@ -401,7 +403,10 @@ u32 bme680_compensate_P_int32_twentyfour_bit_output(u32 v_uncomp_pressure_u32,
 	pressure = (u32)(pressure >> 1);
 	return pressure;
 }
-#else
+#endif
+
+#if !defined(FIXED_POINT_COMPENSATION) || \
+	defined(CONFIG_SENSOR_BME680_DOUBLE_REFERENCE)
 /*!
  *	@brief This function is used to convert uncompensated gas data to
  *	compensated gas data using compensation formula
@@ -498,10 +503,10 @@ double bme680_compensate_humidity_double(u16 uncom_humidity_u16,
 
 	humidity_comp = var2 +
 	((var3 + (var4 * comp_temperature)) * var2 * var2);
-	if (humidity_comp > BME680_MAX_HUMIDITY_VALUE)
-		humidity_comp = BME680_MAX_HUMIDITY_VALUE;
-	else if (humidity_comp < BME680_MIN_HUMIDITY_VALUE)
-		humidity_comp = BME680_MIN_HUMIDITY_VALUE;
+	if (humidity_comp > BME680_MAX_HUMIDITY_VALUE_DOUBLE)
+		humidity_comp = BME680_MAX_HUMIDITY_VALUE_DOUBLE;
+	else if (humidity_comp < BME680_MIN_HUMIDITY_VALUE_DOUBLE)
+		humidity_comp = BME680_MIN_HUMIDITY_VALUE_DOUBLE;
 	return humidity_comp;
 }
 
@@ -175,7 +175,10 @@ s16 bme680_compensate_T_int32_sixteen_bit_output(u32 v_uncomp_temperature_u32,
 u32 bme680_compensate_P_int32_twentyfour_bit_output(u32 v_uncomp_pressure_u32,
 	struct bme680_t *bme680);
 
-#else
+#endif
+
+#if !defined(FIXED_POINT_COMPENSATION) || \
+	defined(CONFIG_SENSOR_BME680_DOUBLE_REFERENCE)
 /**************************************************************/
 /**\name	FUNCTION FOR FLOAT OUTPUT GAS */
 /**************************************************************/
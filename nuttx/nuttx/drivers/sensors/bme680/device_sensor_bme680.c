@@ -78,9 +78,8 @@ struct sub_sensor {
     uint32_t max_report_latency_us;
     size_t sub_id; /* Index into sensors[SUB_SENSOR_MAX]. */
     uint8_t sensor_id; /* Assigned by device manager. */
-    size_t payload_size;
-    struct report_info_data *report_info_data;
-    void *event_data;
+    void *event_data; /* Latest sample, read into the batch. */
+    struct sensors_ext_batch batch;
 };
 
 struct sub_sensor_ops {
@@ -133,8 +132,7 @@ do { \
 } while (0)
 
 /* TEMPERATURE */
-#define TSS_READINGS (1)
-#define TSS_NUM_SENSORS_REPORTING (1)
+#define TSS_EVENT_SIZE (sizeof(struct tss_event_data) - sizeof(uint16_t))
 
 struct tss_event_data {
     uint16_t    time_delta;
@@ -165,8 +163,9 @@ static int tss_get_sensor_info(struct sub_sensor *sub_sensor,
     sinfo->min_delay = 100*1000; /* us */
     sinfo->max_delay = 10*1000*1000; /* us */
 
-    sinfo->fifo_mec = 0;    /* FIFO max-event count */
-    sinfo->fifo_rec = 0;    /* FIFO reserved-event count */
+    /* FIFO max-event and reserved-event count */
+    sinfo->fifo_mec = sensors_ext_batch_max_events(TSS_EVENT_SIZE);
+    sinfo->fifo_rec = sinfo->fifo_mec;
 
     sinfo->flags = SENSOR_EXT_FLAG_CONTINUOUS_MODE;
 
@@ -190,7 +189,9 @@ static int tss_start_reporting(struct sub_sensor *sub_sensor,
     sub_sensor->sampling_period_us = (uint32_t)(sampling_period_ns / 1000);
     sub_sensor->max_report_latency_us = (uint32_t)(max_report_latency_ns / 1000);
 
-    return OK;
+    return sensors_ext_batch_start(&sub_sensor->batch, sub_sensor->sensor_id,
+                                   sub_sensor->callback, sampling_period_ns,
+                                   max_report_latency_ns);
 }
 
 static int tss_stop_reporting(struct sub_sensor *sub_sensor)
@@ -200,33 +201,33 @@ static int tss_stop_reporting(struct sub_sensor *sub_sensor)
     sub_sensor->sampling_period_us = 0;
     sub_sensor->max_report_latency_us = 0;
     sub_sensor->running = 0;
+    sensors_ext_batch_stop(&sub_sensor->batch);
 
     return OK;
 }
 
 static int _tss_report(struct sub_sensor *sub_sensor, uint8_t flags)
 {
+    struct tss_event_data *event_data = sub_sensor->event_data;
     struct timespec ts;
-    struct report_info *rinfo;
+    int ret;
 
     vdbg("sub_sensor_id=%d\n", sub_sensor->sensor_id);
 
     up_rtc_gettime(&ts);
 
-    rinfo = sub_sensor->report_info_data->reportinfo;
-    rinfo->reference_time = timespec_to_nsec(&ts);
-    rinfo->flags = flags;
-
     vdbg("%d %u.%03u\n",
-        ((struct tss_event_data *)sub_sensor->event_data)->data_value,
+        event_data->data_value,
         ts.tv_sec, (ts.tv_nsec / 1000000));
 
-    if (sub_sensor->callback) {
-        sub_sensor->callback(sub_sensor->sensor_id,
-            sub_sensor->report_info_data, sub_sensor->payload_size);
+    /* Sent once max_report_latency is due or the batch is full. */
+    ret = sensors_ext_batch_add(&sub_sensor->batch, timespec_to_nsec(&ts),
+                                &event_data->data_value);
+    if (!ret && flags) {
+        ret = sensors_ext_batch_flush(&sub_sensor->batch, flags);
     }
 
-    return OK;
+    return ret;
 }
 
 static int tss_report(struct sub_sensor *sub_sensor)
@@ -236,48 +237,30 @@ static int tss_report(struct sub_sensor *sub_sensor)
 
 static int tss_flush(struct sub_sensor *sub_sensor)
 {
-    return OK;
+    return sensors_ext_batch_flush(&sub_sensor->batch,
+                REPORT_INFO_FLAG_FLUSHING | REPORT_INFO_FLAG_FLUSH_COMPLETE);
 }
 
 static int tss_alloc_report(struct sub_sensor *sub_sensor)
 {
-    struct report_info_data *report_info_data;
-    struct report_info *report_info;
+    static struct tss_event_data event_data;
 
     vdbg("sub_sensor=%p, sub_id=%d\n", sub_sensor, sub_sensor->sub_id);
 
-    sub_sensor->payload_size =
-        (TSS_NUM_SENSORS_REPORTING * sizeof(struct report_info) +
-        (TSS_READINGS * sizeof(struct tss_event_data)));
-
-    report_info_data = zalloc(sizeof(struct report_info_data) +
-                                                    sub_sensor->payload_size);
-    if (!report_info_data) {
-        return -ENOMEM;
-    }
-
-    report_info_data->num_sensors_reporting = TSS_NUM_SENSORS_REPORTING;
-
-    report_info = report_info_data->reportinfo;
-    report_info->readings = TSS_READINGS;
-
-    sub_sensor->report_info_data = report_info_data;
-    sub_sensor->event_data = report_info->data_payload;
+    sub_sensor->event_data = &event_data;
+    sensors_ext_batch_init(&sub_sensor->batch, TSS_EVENT_SIZE);
 
     return OK;
 }
 
 static void tss_free_report(struct sub_sensor *sub_sensor)
 {
-    free(sub_sensor->report_info_data);
-    sub_sensor->payload_size = 0;
-    sub_sensor->report_info_data = NULL;
+    sensors_ext_batch_deinit(&sub_sensor->batch);
     sub_sensor->event_data = NULL;
 }
 
 /* PRESSURE */
-#define PSS_READINGS (1)
-#define PSS_NUM_SENSORS_REPORTING (1)
+#define PSS_EVENT_SIZE (sizeof(struct pss_event_data) - sizeof(uint16_t))
 
 struct pss_event_data {
     uint16_t    time_delta;
@@ -308,8 +291,9 @@ static int pss_get_sensor_info(struct sub_sensor *sub_sensor,
     sinfo->min_delay = 10*1000; /* us */
     sinfo->max_delay = 10*1000*1000; /* us */
 
-    sinfo->fifo_mec = 0;    /* FIFO max-event count */
-    sinfo->fifo_rec = 0;    /* FIFO reserved-event count */
+    /* FIFO max-event and reserved-event count */
+    sinfo->fifo_mec = sensors_ext_batch_max_events(PSS_EVENT_SIZE);
+    sinfo->fifo_rec = sinfo->fifo_mec;
 
     sinfo->flags = SENSOR_EXT_FLAG_CONTINUOUS_MODE;
 
@@ -334,7 +318,9 @@ static int pss_start_reporting(struct sub_sensor *sub_sensor,
     sub_sensor->sampling_period_us = (uint32_t)(sampling_period_ns / 1000);
     sub_sensor->max_report_latency_us = (uint32_t)(max_report_latency_ns / 1000);
 
-    return OK;
+    return sensors_ext_batch_start(&sub_sensor->batch, sub_sensor->sensor_id,
+                                   sub_sensor->callback, sampling_period_ns,
+                                   max_report_latency_ns);
 }
 
 static int pss_stop_reporting(struct sub_sensor *sub_sensor)
@@ -344,33 +330,33 @@ static int pss_stop_reporting(struct sub_sensor *sub_sensor)
     sub_sensor->sampling_period_us = 0;
     sub_sensor->max_report_latency_us = 0;
     sub_sensor->running = 0;
+    sensors_ext_batch_stop(&sub_sensor->batch);
 
     return OK;
 }
 
 static int _pss_report(struct sub_sensor *sub_sensor, uint8_t flags)
 {
+    struct pss_event_data *event_data = sub_sensor->event_data;
     struct timespec ts;
-    struct report_info *rinfo;
+    int ret;
 
     vdbg("sub_sensor_id=%d\n", sub_sensor->sensor_id);
 
     up_rtc_gettime(&ts);
 
-    rinfo = sub_sensor->report_info_data->reportinfo;
-    rinfo->reference_time = timespec_to_nsec(&ts);
-    rinfo->flags = flags;
-
     vdbg("%d %u.%03u\n",
-        ((struct pss_event_data *)sub_sensor->event_data)->data_value,
+        event_data->data_value,
         ts.tv_sec, (ts.tv_nsec / 1000000));
 
-    if (sub_sensor->callback) {
-        sub_sensor->callback(sub_sensor->sensor_id,
-            sub_sensor->report_info_data, sub_sensor->payload_size);
+    /* Sent once max_report_latency is due or the batch is full. */
+    ret = sensors_ext_batch_add(&sub_sensor->batch, timespec_to_nsec(&ts),
+                                &event_data->data_value);
+    if (!ret && flags) {
+        ret = sensors_ext_batch_flush(&sub_sensor->batch, flags);
     }
 
-    return OK;
+    return ret;
 }
 
 static int pss_report(struct sub_sensor *sub_sensor)
@@ -380,48 +366,30 @@ static int pss_report(struct sub_sensor *sub_sensor)
 
 static int pss_flush(struct sub_sensor *sub_sensor)
 {
-    return OK;
+    return sensors_ext_batch_flush(&sub_sensor->batch,
+                REPORT_INFO_FLAG_FLUSHING | REPORT_INFO_FLAG_FLUSH_COMPLETE);
 }
 
 static int pss_alloc_report(struct sub_sensor *sub_sensor)
 {
-    struct report_info_data *report_info_data;
-    struct report_info *report_info;
+    static struct pss_event_data event_data;
 
     vdbg("sub_sensor=%p, sub_id=%d\n", sub_sensor, sub_sensor->sub_id);
 
-    sub_sensor->payload_size =
-        (PSS_NUM_SENSORS_REPORTING * sizeof(struct report_info) +
-        (PSS_READINGS * sizeof(struct pss_event_data)));
-
-    report_info_data = zalloc(sizeof(struct report_info_data) +
-                                                    sub_sensor->payload_size);
-    if (!report_info_data) {
-        return -ENOMEM;
-    }
-
-    report_info_data->num_sensors_reporting = PSS_NUM_SENSORS_REPORTING;
-
-    report_info = report_info_data->reportinfo;
-    report_info->readings = PSS_READINGS;
-
-    sub_sensor->report_info_data = report_info_data;
-    sub_sensor->event_data = report_info->data_payload;
+    sub_sensor->event_data = &event_data;
+    sensors_ext_batch_init(&sub_sensor->batch, PSS_EVENT_SIZE);
 
     return OK;
 }
 
 static void pss_free_report(struct sub_sensor *sub_sensor)
 {
-    free(sub_sensor->report_info_data);
-    sub_sensor->payload_size = 0;
-    sub_sensor->report_info_data = NULL;
+    sensors_ext_batch_deinit(&sub_sensor->batch);
     sub_sensor->event_data = NULL;
 }
 
 /* HUMIDITY */
-#define HSS_READINGS (1)
-#define HSS_NUM_SENSORS_REPORTING (1)
+#define HSS_EVENT_SIZE (sizeof(struct hss_event_data) - sizeof(uint16_t))
 
 struct hss_event_data {
     uint16_t    time_delta;
@@ -452,8 +420,9 @@ static int hss_get_sensor_info(struct sub_sensor *sub_sensor,
     sinfo->min_delay = 100*1000; /* us */
     sinfo->max_delay = 10*1000*1000; /* us */
 
-    sinfo->fifo_mec = 0;    /* FIFO max-event count */
-    sinfo->fifo_rec = 0;    /* FIFO reserved-event count */
+    /* FIFO max-event and reserved-event count */
+    sinfo->fifo_mec = sensors_ext_batch_max_events(HSS_EVENT_SIZE);
+    sinfo->fifo_rec = sinfo->fifo_mec;
 
     sinfo->flags = SENSOR_EXT_FLAG_CONTINUOUS_MODE;
 
@@ -478,7 +447,9 @@ static int hss_start_reporting(struct sub_sensor *sub_sensor,
     sub_sensor->sampling_period_us = (uint32_t)(sampling_period_ns / 1000);
     sub_sensor->max_report_latency_us = (uint32_t)(max_report_latency_ns / 1000);
 
-    return OK;
+    return sensors_ext_batch_start(&sub_sensor->batch, sub_sensor->sensor_id,
+                                   sub_sensor->callback, sampling_period_ns,
+                                   max_report_latency_ns);
 }
 
 static int hss_stop_reporting(struct sub_sensor *sub_sensor)
@@ -488,33 +459,33 @@ static int hss_stop_reporting(struct sub_sensor *sub_sensor)
     sub_sensor->sampling_period_us = 0;
     sub_sensor->max_report_latency_us = 0;
     sub_sensor->running = 0;
+    sensors_ext_batch_stop(&sub_sensor->batch);
 
     return OK;
 }
 
 static int _hss_report(struct sub_sensor *sub_sensor, uint8_t flags)
 {
+    struct hss_event_data *event_data = sub_sensor->event_data;
     struct timespec ts;
-    struct report_info *rinfo;
+    int ret;
 
     vdbg("sub_sensor_id=%d\n", sub_sensor->sensor_id);
 
     up_rtc_gettime(&ts);
 
-    rinfo = sub_sensor->report_info_data->reportinfo;
-    rinfo->reference_time = timespec_to_nsec(&ts);
-    rinfo->flags = flags;
-
     vdbg("%d %u.%03u\n",
-        ((struct pss_event_data *)sub_sensor->event_data)->data_value,
+        event_data->data_value,
         ts.tv_sec, (ts.tv_nsec / 1000000));
 
-    if (sub_sensor->callback) {
-        sub_sensor->callback(sub_sensor->sensor_id,
-            sub_sensor->report_info_data, sub_sensor->payload_size);
+    /* Sent once max_report_latency is due or the batch is full. */
+    ret = sensors_ext_batch_add(&sub_sensor->batch, timespec_to_nsec(&ts),
+                                &event_data->data_value);
+    if (!ret && flags) {
+        ret = sensors_ext_batch_flush(&sub_sensor->batch, flags);
     }
 
-    return OK;
+    return ret;
 }
 
 static int hss_report(struct sub_sensor *sub_sensor)
@@ -524,48 +495,30 @@ static int hss_report(struct sub_sensor *sub_sensor)
 
 static int hss_flush(struct sub_sensor *sub_sensor)
 {
-    return OK;
+    return sensors_ext_batch_flush(&sub_sensor->batch,
+                REPORT_INFO_FLAG_FLUSHING | REPORT_INFO_FLAG_FLUSH_COMPLETE);
 }
 
 static int hss_alloc_report(struct sub_sensor *sub_sensor)
 {
-    struct report_info_data *report_info_data;
-    struct report_info *report_info;
+    static struct hss_event_data event_data;
 
     vdbg("sub_sensor=%p, sub_id=%d\n", sub_sensor, sub_sensor->sub_id);
 
-    sub_sensor->payload_size =
-        (HSS_NUM_SENSORS_REPORTING * sizeof(struct report_info) +
-        (HSS_READINGS * sizeof(struct hss_event_data)));
-
-    report_info_data = zalloc(sizeof(struct report_info_data) +
-                                                    sub_sensor->payload_size);
-    if (!report_info_data) {
-        return -ENOMEM;
-    }
-
-    report_info_data->num_sensors_reporting = HSS_NUM_SENSORS_REPORTING;
-
-    report_info = report_info_data->reportinfo;
-    report_info->readings = HSS_READINGS;
-
-    sub_sensor->report_info_data = report_info_data;
-    sub_sensor->event_data = report_info->data_payload;
+    sub_sensor->event_data = &event_data;
+    sensors_ext_batch_init(&sub_sensor->batch, HSS_EVENT_SIZE);
 
     return OK;
 }
 
 static void hss_free_report(struct sub_sensor *sub_sensor)
 {
-    free(sub_sensor->report_info_data);
-    sub_sensor->payload_size = 0;
-    sub_sensor->report_info_data = NULL;
+    sensors_ext_batch_deinit(&sub_sensor->batch);
     sub_sensor->event_data = NULL;
 }
 
 /* GAS */
-#define GSS_READINGS (1)
-#define GSS_NUM_SENSORS_REPORTING (1)
+#define GSS_EVENT_SIZE (sizeof(struct gss_event_data) - sizeof(uint16_t))
 
 struct gss_event_data {
     uint16_t    time_delta;
@@ -598,8 +551,9 @@ static int gss_get_sensor_info(struct sub_sensor *sub_sensor,
     sinfo->min_delay = 250*1000; /* us */
     sinfo->max_delay = 10*1000*1000; /* us */
 
-    sinfo->fifo_mec = 0;    /* FIFO max-event count */
-    sinfo->fifo_rec = 0;    /* FIFO reserved-event count */
+    /* FIFO max-event and reserved-event count */
+    sinfo->fifo_mec = sensors_ext_batch_max_events(GSS_EVENT_SIZE);
+    sinfo->fifo_rec = sinfo->fifo_mec;
 
     sinfo->flags = SENSOR_EXT_FLAG_CONTINUOUS_MODE;
 
@@ -624,7 +578,9 @@ static int gss_start_reporting(struct sub_sensor *sub_sensor,
     sub_sensor->sampling_period_us = (uint32_t)(sampling_period_ns / 1000);
     sub_sensor->max_report_latency_us = (uint32_t)(max_report_latency_ns / 1000);
 
-    return OK;
+    return sensors_ext_batch_start(&sub_sensor->batch, sub_sensor->sensor_id,
+                                   sub_sensor->callback, sampling_period_ns,
+                                   max_report_latency_ns);
 }
 
 static int gss_stop_reporting(struct sub_sensor *sub_sensor)
@@ -634,33 +590,33 @@ static int gss_stop_reporting(struct sub_sensor *sub_sensor)
     sub_sensor->sampling_period_us = 0;
     sub_sensor->max_report_latency_us = 0;
     sub_sensor->running = 0;
+    sensors_ext_batch_stop(&sub_sensor->batch);
 
     return OK;
 }
 
 static int _gss_report(struct sub_sensor *sub_sensor, uint8_t flags)
 {
+    struct gss_event_data *event_data = sub_sensor->event_data;
     struct timespec ts;
-    struct report_info *rinfo;
+    int ret;
 
     vdbg("sub_sensor_id=%d\n", sub_sensor->sensor_id);
 
     up_rtc_gettime(&ts);
 
-    rinfo = sub_sensor->report_info_data->reportinfo;
-    rinfo->reference_time = timespec_to_nsec(&ts);
-    rinfo->flags = flags;
-
     vdbg("%d %u.%03u\n",
-        ((struct gss_event_data *)sub_sensor->event_data)->data_values[0],
+        event_data->data_values[0],
         ts.tv_sec, (ts.tv_nsec / 1000000));
 
-    if (sub_sensor->callback) {
-        sub_sensor->callback(sub_sensor->sensor_id,
-            sub_sensor->report_info_data, sub_sensor->payload_size);
+    /* Sent once max_report_latency is due or the batch is full. */
+    ret = sensors_ext_batch_add(&sub_sensor->batch, timespec_to_nsec(&ts),
+                                &event_data->data_values);
+    if (!ret && flags) {
+        ret = sensors_ext_batch_flush(&sub_sensor->batch, flags);
     }
 
-    return OK;
+    return ret;
 }
 
 static int gss_report(struct sub_sensor *sub_sensor)
@@ -670,42 +626,25 @@ static int gss_report(struct sub_sensor *sub_sensor)
 
 static int gss_flush(struct sub_sensor *sub_sensor)
 {
-    return OK;
+    return sensors_ext_batch_flush(&sub_sensor->batch,
+                REPORT_INFO_FLAG_FLUSHING | REPORT_INFO_FLAG_FLUSH_COMPLETE);
 }
 
 static int gss_alloc_report(struct sub_sensor *sub_sensor)
 {
-    struct report_info_data *report_info_data;
-    struct report_info *report_info;
+    static struct gss_event_data event_data;
 
     vdbg("sub_sensor=%p, sub_id=%d\n", sub_sensor, sub_sensor->sub_id);
 
-    sub_sensor->payload_size =
-        (GSS_NUM_SENSORS_REPORTING * sizeof(struct report_info) +
-        (GSS_READINGS * sizeof(struct gss_event_data)));
-
-    report_info_data = zalloc(sizeof(struct report_info_data) +
-                                                    sub_sensor->payload_size);
-    if (!report_info_data) {
-        return -ENOMEM;
-    }
-
-    report_info_data->num_sensors_reporting = GSS_NUM_SENSORS_REPORTING;
-
-    report_info = report_info_data->reportinfo;
-    report_info->readings = GSS_READINGS;
-
-    sub_sensor->report_info_data = report_info_data;
-    sub_sensor->event_data = report_info->data_payload;
+    sub_sensor->event_data = &event_data;
+    sensors_ext_batch_init(&sub_sensor->batch, GSS_EVENT_SIZE);
 
     return OK;
 }
 
 static void gss_free_report(struct sub_sensor *sub_sensor)
 {
-    free(sub_sensor->report_info_data);
-    sub_sensor->payload_size = 0;
-    sub_sensor->report_info_data = NULL;
+    sensors_ext_batch_deinit(&sub_sensor->batch);
     sub_sensor->event_data = NULL;
 }
 
@@ -983,10 +922,71 @@ static int bme680_adapter_config(struct bme680_info *info)
     return OK;
 }
 
+/*
+ * Compensation to the units reported to the host: hC, Pa, m%rH and Ohms.
+ * Pressure and humidity depend on the t_fine set by the temperature.
+ */
+#ifdef FIXED_POINT_COMPENSATION
+static int32_t bme680_comp_temperature(struct bme680_t *bme680,
+                                       struct bme680_uncomp_field_data *data)
+{
+    return bme680_compensate_temperature_int32(data->temp_adcv, bme680);
+}
+
+static int32_t bme680_comp_pressure(struct bme680_t *bme680,
+                                    struct bme680_uncomp_field_data *data)
+{
+    return bme680_compensate_pressure_int32(data->pres_adcv, bme680);
+}
+
+static int32_t bme680_comp_humidity(struct bme680_t *bme680,
+                                    struct bme680_uncomp_field_data *data)
+{
+    /* 1/1024 %rH */
+    return (bme680_compensate_humidity_int32(data->hum_adcv, bme680) * 1000)
+                >> 10;
+}
+
+static int32_t bme680_comp_gas(struct bme680_t *bme680,
+                               struct bme680_uncomp_field_data *data)
+{
+    return bme680_calculate_gas_int32(data->gas_res_adcv, data->gas_range,
+                                      bme680);
+}
+#else
+static int32_t bme680_comp_temperature(struct bme680_t *bme680,
+                                       struct bme680_uncomp_field_data *data)
+{
+    return bme680_compensate_temperature_double(data->temp_adcv, bme680)
+                * 100.0;
+}
+
+static int32_t bme680_comp_pressure(struct bme680_t *bme680,
+                                    struct bme680_uncomp_field_data *data)
+{
+    return bme680_compensate_pressure_double(data->pres_adcv, bme680);
+}
+
+static int32_t bme680_comp_humidity(struct bme680_t *bme680,
+                                    struct bme680_uncomp_field_data *data)
+{
+    return bme680_compensate_humidity_double(data->hum_adcv,
+                bme680->cal_param.t_fine / 5120.0, bme680) * 1000.0;
+}
+
+static int32_t bme680_comp_gas(struct bme680_t *bme680,
+                               struct bme680_uncomp_field_data *data)
+{
+    return bme680_compensate_gas_double(data->gas_res_adcv, data->gas_range,
+                                        bme680);
+}
+#endif
+
 static int bme680_adapter_read(struct bme680_info *info)
 {
     struct bme680_t *bme680 = &info->adapter;
     struct bme680_uncomp_field_data uncompensated_data;
+    int32_t temperature;
 
     bme680_get_uncomp_data(&uncompensated_data, 1, BME680_ALL, bme680);
     if (!uncompensated_data.status.new_data) {
@@ -996,9 +996,12 @@ static int bme680_adapter_read(struct bme680_info *info)
 
     vdbg("meas_index=%d\n", uncompensated_data.status.meas_index);
 
+    /* Always run, the other sub-sensors need its t_fine. */
+    temperature = bme680_comp_temperature(bme680, &uncompensated_data);
+
     if (DEBUG_ENABLE_ALL || info->sub_sensors[SUB_SENSOR_TEMPERATURE].running) {
         struct tss_event_data *src = info->sub_sensors[SUB_SENSOR_TEMPERATURE].event_data;
-        src->data_value = bme680_compensate_temperature_int32(uncompensated_data.temp_adcv, bme680);
+        src->data_value = temperature;
         vdbg("%d hC\n", src->data_value);
 #if CONFIG_REGLOG
         reglog_log(uncompensated_data.status.meas_index, src->data_value);
@@ -1007,7 +1010,7 @@ static int bme680_adapter_read(struct bme680_info *info)
 
     if (DEBUG_ENABLE_ALL || info->sub_sensors[SUB_SENSOR_PRESSURE].running) {
         struct pss_event_data *src = info->sub_sensors[SUB_SENSOR_PRESSURE].event_data;
-        src->data_value = bme680_compensate_pressure_int32(uncompensated_data.pres_adcv, bme680);
+        src->data_value = bme680_comp_pressure(bme680, &uncompensated_data);
         vdbg("%d Pa\n", src->data_value);
 #if CONFIG_REGLOG
         reglog_log(uncompensated_data.status.meas_index, src->data_value);
@@ -1016,8 +1019,8 @@ static int bme680_adapter_read(struct bme680_info *info)
 
     if (DEBUG_ENABLE_ALL || info->sub_sensors[SUB_SENSOR_HUMIDITY].running) {
         struct hss_event_data *src = info->sub_sensors[SUB_SENSOR_HUMIDITY].event_data;
-        src->data_value = bme680_compensate_humidity_int32(uncompensated_data.hum_adcv, bme680);
-        vdbg("%d rH\n", src->data_value);
+        src->data_value = bme680_comp_humidity(bme680, &uncompensated_data);
+        vdbg("%d m%%rH\n", src->data_value);
 #if CONFIG_REGLOG
         reglog_log(uncompensated_data.status.meas_index, src->data_value);
 #endif
@@ -1027,7 +1030,7 @@ static int bme680_adapter_read(struct bme680_info *info)
         if (uncompensated_data.status.gas_valid && uncompensated_data.status.heatr_stab) {
             struct gss_event_data *src = info->sub_sensors[SUB_SENSOR_GAS].event_data;
             if (uncompensated_data.status.gas_meas_index < ARRAY_SIZE(src->data_values)) {
-                src->data_values[uncompensated_data.status.gas_meas_index] = bme680_calculate_gas_int32(uncompensated_data.gas_res_adcv, uncompensated_data.gas_range, bme680);
+                src->data_values[uncompensated_data.status.gas_meas_index] = bme680_comp_gas(bme680, &uncompensated_data);
                 vdbg("gas_meas_index=%d\n", uncompensated_data.status.gas_meas_index);
                 vdbg("%d Ohm at %d C\n", src->data_values[uncompensated_data.status.gas_meas_index], (202 + 22 * uncompensated_data.status.gas_meas_index));
 #if CONFIG_REGLOG
@@ -1393,7 +1396,7 @@ static int bme680_op_register_callback(struct device *dev,
 
     sub_sensor->callback = callback;
     sub_sensor->sensor_id = sensor_id;
-    sub_sensor->report_info_data->reportinfo[0].id = sensor_id;
+    sensors_ext_batch_set_callback(&sub_sensor->batch, sensor_id, callback);
 
     ret = OK;
 
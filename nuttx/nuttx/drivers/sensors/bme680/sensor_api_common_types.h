@@ -80,7 +80,7 @@
 * @brief For the Linux platform support
 * Please use the types.h for your data types definitions
 */
-#ifdef	__linux__
+#if defined(__linux__) && defined(__KERNEL__)
 
 #include <linux/types.h>
 #include <linux/math64.h>
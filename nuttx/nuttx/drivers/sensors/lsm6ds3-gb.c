@@ -65,10 +65,7 @@
 #define ACCEL_MAX_RANGE     1024 * 16
 #define ACCEL_MIN_DELAY     2000
 #define ACCEL_MAX_DELAY     1000000
-#define ACCEL_FIFO_REC      0
-#define ACCEL_FIFO_MEC      0
 #define ACCEL_FLAGS         SENSOR_EXT_FLAG_CONTINUOUS_MODE
-#define REPORTING_SENSORS   1
 
 /* Gyroscope attributes */
 #define GYRO_DEVICE_NAME  "Gyro-LSM6DS3"
@@ -82,8 +79,6 @@
 #define GYRO_MAX_RANGE     1024 * 16
 #define GYRO_MIN_DELAY     2000
 #define GYRO_MAX_DELAY     1000000
-#define GYRO_FIFO_REC      0
-#define GYRO_FIFO_MEC      0
 #define GYRO_FLAGS         SENSOR_EXT_FLAG_CONTINUOUS_MODE
 
 /* Temperature attributes */
@@ -99,8 +94,6 @@
 #define TEMP_MAX_RANGE     1024 * 16
 #define TEMP_MIN_DELAY     2000
 #define TEMP_MAX_DELAY     1000000
-#define TEMP_FIFO_REC      0
-#define TEMP_FIFO_MEC      0
 #define TEMP_FLAGS         SENSOR_EXT_FLAG_CONTINUOUS_MODE
 
 /* acceleromter register offsets */
@@ -242,26 +235,15 @@ struct lsm6ds3_sensor_info {
     int a_scale_resolution;
     int g_scale_resolution;
     int latency_ms;
+    struct sensors_ext_batch batch;
 };
 
 /*
- * event fields for accelerometer in bytes
+ * event fields for all three sensors in bytes
  * [ time_delta (2) | data_value x (4) | data_value y (4) |data_value z (4) ]
+ * the time_delta is filled in by the batch.
 */
-struct sensor_event_data {
-    uint16_t    time_delta;
-    uint32_t    data_value[TAG_CHANNEL_SIZE];
-} __packed;
-
-#ifdef BATCH_PROCESS_ENABLED
-#define ACCEL_READING_NUM 2
-#define GYRO_READING_NUM 2
-#define TEMP_READING_NUM 2
-#else
-#define ACCEL_READING_NUM 1
-#define GYRO_READING_NUM 1
-#define TEMP_READING_NUM 1
-#endif
+#define LSM6DS3_EVENT_SIZE      (TAG_CHANNEL_SIZE * sizeof(uint32_t))
 
 #define TX_PROCESSING_DELAY     3 /* processing and tx delay (mS)*/
 #define LSM6DS3_TOTAL_SENSORS   3
@@ -275,6 +257,7 @@ enum lsm6ds3_sensor_type
 
 // sensor[i][j] means sensor_id is i, its actual sensor id is j
 static int sensor_list[LSM6DS3_TOTAL_SENSORS][2] = {{-1, -1}, {-1, -1}, {-1, -1}};
+static struct sensors_ext_batch *sensor_batch[LSM6DS3_TOTAL_SENSORS];
 static pthread_t tx_thread = 0;
 static int g_users = 0;
 static atomic_t txn;       /* Flag to indicate reporting in progress */
@@ -450,98 +433,58 @@ void set_gyro_ODR(struct lsm6ds3_sensor_info *info, lsm6ds3_odr aRate)
     I2C_WRITE(info->i2c, cmd, sizeof(cmd));
 }
 
+static void sensor_event_values(int type, uint32_t *data_value)
+{
+    switch (type) {
+    case LSM6DS3_ACCEL_ID:
+        data_value[0] = ax_raw;
+        data_value[1] = ay_raw;
+        data_value[2] = az_raw;
+        break;
+    case LSM6DS3_GYRO_ID:
+        data_value[0] = gx_raw;
+        data_value[1] = gy_raw;
+        data_value[2] = gz_raw;
+        break;
+    default:
+        data_value[0] = temp_raw;
+        data_value[1] = 0;
+        data_value[2] = 0;
+        break;
+    }
+}
+
 static void *sensor_tx_thread(void *arg)
 {
     struct lsm6ds3_sensor_info *info;
-    struct report_info *rinfo;
-    struct report_info_data *rinfo_data;
-    struct sensor_event_data *event_data;
+    uint32_t data_value[TAG_CHANNEL_SIZE];
     struct timespec ts;
-    uint16_t payload_size;
+    uint64_t time;
     int index;
 
     info = arg;
-    payload_size = (ACCEL_READING_NUM * sizeof(struct sensor_event_data))
-                    + (REPORTING_SENSORS * sizeof(struct report_info));
-
-    rinfo_data = malloc(sizeof(struct report_info_data) + payload_size);
-    if (!rinfo_data)
-        return (void *)-ENOMEM;
 
     while(1) {
         sem_wait(&g_thread_sem);
-        memset(rinfo_data, 0, sizeof(struct report_info_data) + payload_size);
-
-        if (info->callback) {
-            rinfo_data->num_sensors_reporting = REPORTING_SENSORS;
-            rinfo = rinfo_data->reportinfo;
-            rinfo->flags = 0;
-            event_data = (struct sensor_event_data *)&rinfo->data_payload[0];
-
-            up_rtc_gettime(&ts);
-            rinfo->reference_time = timespec_to_nsec(&ts);
-            read_temp_accel_gyro(info);
-            for (index = 0; index < LSM6DS3_TOTAL_SENSORS; index++){
-                if (sensor_list[index][1] == LSM6DS3_ACCEL_ID){
-                    rinfo->id = sensor_list[index][0];
-#ifdef BATCH_PROCESS_ENABLED
-                   /*
-                    * Batch sensor data values and its time_deltas
-                    * until max fifo event count
-                   */
-#else
-                    /* Single sensor event data */
-                    rinfo->readings = ACCEL_READING_NUM;
-                    event_data->time_delta = 0;
-                    event_data->data_value[0] = ax_raw;
-                    event_data->data_value[1] = ay_raw;
-                    event_data->data_value[2] = az_raw;
-#endif
-                } else if (sensor_list[index][1] == LSM6DS3_GYRO_ID){
-                    rinfo->id = sensor_list[index][0];
-#ifdef BATCH_PROCESS_ENABLED
-                    /*
-                     * Batch sensor data values and its time_deltas
-                     * until max fifo event count
-                    */
-#else
-                    /* Single sensor event data */
-                    rinfo->readings = GYRO_READING_NUM;
-                    event_data->time_delta = 0;
-                    event_data->data_value[0] = gx_raw;
-                    event_data->data_value[1] = gy_raw;
-                    event_data->data_value[2] = gz_raw;
-#endif
-                } else if (sensor_list[index][1] == LSM6DS3_TEMP_ID){
-                    rinfo->id = sensor_list[index][0];
-#ifdef BATCH_PROCESS_ENABLED
-                    /*
-                     * Batch sensor data values and its time_deltas
-                     * until max fifo event count
-                    */
-#else
-                    /* Single sensor event data */
-                    rinfo->readings = TEMP_READING_NUM;
-                    event_data->time_delta = 0;
-                    event_data->data_value[0] = temp_raw;
-                    event_data->data_value[1] = 0;
-                    event_data->data_value[2] = 0;
-#endif
-                }
-                vdbg("report sensor: %d, %lld\n", rinfo->id, (long long)rinfo->reference_time);
-                info->callback(rinfo->id, rinfo_data, payload_size);
-            }
+
+        up_rtc_gettime(&ts);
+        time = timespec_to_nsec(&ts);
+        read_temp_accel_gyro(info);
+        for (index = 0; index < LSM6DS3_TOTAL_SENSORS; index++){
+            if (sensor_list[index][1] == -1 || !sensor_batch[index])
+                continue;
+
+            /* the batch sends once max_report_latency is due */
+            sensor_event_values(sensor_list[index][1], data_value);
+            sensors_ext_batch_add(sensor_batch[index], time, data_value);
+            vdbg("report sensor: %d, %lld\n", sensor_list[index][0],
+                 (long long)time);
         }
 
         if (g_users == 0)
             break;
-
-        // TODO the delay time will be the minimal of all the enabled sensors
-        //up_mdelay(g_latency_ms);
     }
 
-    free(rinfo_data);
-
     return NULL;
 }
 
@@ -596,18 +539,8 @@ static int sensor_accel_op_get_sensor_info(struct device *dev,
     sinfo->resolution = 1;
     sinfo->min_delay = ACCEL_MIN_DELAY;
     sinfo->max_delay = ACCEL_MAX_DELAY;
-#ifdef BATCH_PROCESS_ENABLED
-    /*
-     * Example to calculate number of sensor events that can be batched in the
-     * payload. Each event consists of time_delta and sensor data fields.
-     * Reading size provides the number of sensor data fields reported.
-    */
-    sinfo->fifo_rec = ACCEL_READING_NUM;
+    sinfo->fifo_rec = sensors_ext_batch_max_events(LSM6DS3_EVENT_SIZE);
     sinfo->fifo_mec = sinfo->fifo_rec;
-#else
-    sinfo->fifo_rec = ACCEL_FIFO_REC;
-    sinfo->fifo_mec = ACCEL_FIFO_MEC;
-#endif
     sinfo->flags = ACCEL_FLAGS;
     sinfo->scale_int = ACCEL_SCALE_INT;
     sinfo->scale_nano = info->a_scale_resolution;
@@ -642,18 +575,8 @@ static int sensor_gyro_op_get_sensor_info(struct device *dev,
     sinfo->resolution = 1;
     sinfo->min_delay = GYRO_MIN_DELAY;
     sinfo->max_delay = GYRO_MAX_DELAY;
-#ifdef BATCH_PROCESS_ENABLED
-    /*
-     * Example to calculate number of sensor events that can be batched in the
-     * payload. Each event consists of time_delta and sensor data fields.
-     * Reading size provides the number of sensor data fields reported.
-    */
-    sinfo->fifo_rec = GYRO_READING_NUM;
+    sinfo->fifo_rec = sensors_ext_batch_max_events(LSM6DS3_EVENT_SIZE);
     sinfo->fifo_mec = sinfo->fifo_rec;
-#else
-    sinfo->fifo_rec = GYRO_FIFO_REC;
-    sinfo->fifo_mec = GYRO_FIFO_MEC;
-#endif
     sinfo->flags = GYRO_FLAGS;
     sinfo->scale_int = GYRO_SCALE_INT;
     sinfo->scale_nano = info->g_scale_resolution;
@@ -688,18 +611,8 @@ static int sensor_temp_op_get_sensor_info(struct device *dev,
     sinfo->resolution = 1;
     sinfo->min_delay = TEMP_MIN_DELAY;
     sinfo->max_delay = TEMP_MAX_DELAY;
-#ifdef BATCH_PROCESS_ENABLED
-    /*
-     * Example to calculate number of sensor events that can be batched in the
-     * payload. Each event consists of time_delta and sensor data fields.
-     * Reading size provides the number of sensor data fields reported.
-    */
-    sinfo->fifo_rec = TEMP_READING_NUM;
+    sinfo->fifo_rec = sensors_ext_batch_max_events(LSM6DS3_EVENT_SIZE);
     sinfo->fifo_mec = sinfo->fifo_rec;
-#else
-    sinfo->fifo_rec = TEMP_FIFO_REC;
-    sinfo->fifo_mec = TEMP_FIFO_MEC;
-#endif
     sinfo->flags = TEMP_FLAGS;
     sinfo->scale_int = TEMP_SCALE_INT;
     sinfo->scale_nano = 488281;//sensitivity of +16 LSB/degC, 10^9 * 16/32768
@@ -731,6 +644,11 @@ static int sensor_accel_op_start_reporting(struct device *dev,
     }
     info = device_get_private(dev);
 
+    ret = sensors_ext_batch_start(&info->batch, sensor_id, info->callback,
+                                  sampling_period, max_report_latency);
+    if (ret)
+        return ret;
+
     sampling_ms = sampling_period/1000000;
 
     vdbg("%s: requested sampling period %d mS\n", __func__, sampling_ms);
@@ -789,6 +707,7 @@ static int sensor_accel_op_start_reporting(struct device *dev,
     g_users++; // new thread user arrives
     sensor_list[g_users-1][0] = sensor_id;
     sensor_list[g_users-1][1] = LSM6DS3_ACCEL_ID;
+    sensor_batch[g_users-1] = &info->batch;
     if (!tx_thread && (g_users == 1)) {
         ret = pthread_create(&tx_thread, NULL, sensor_tx_thread, info);
         if (ret) {
@@ -819,6 +738,11 @@ static int sensor_gyro_op_start_reporting(struct device *dev,
     }
     info = device_get_private(dev);
 
+    ret = sensors_ext_batch_start(&info->batch, sensor_id, info->callback,
+                                  sampling_period, max_report_latency);
+    if (ret)
+        return ret;
+
     sampling_ms = sampling_period/1000000;
 
     vdbg("%s: requested sampling period %d mS\n", __func__, sampling_ms);
@@ -877,6 +801,7 @@ static int sensor_gyro_op_start_reporting(struct device *dev,
     g_users++; // new thread user arrives
     sensor_list[g_users-1][0] = sensor_id;
     sensor_list[g_users-1][1] = LSM6DS3_GYRO_ID;
+    sensor_batch[g_users-1] = &info->batch;
 
     if (!tx_thread) {
         ret = pthread_create(&tx_thread, NULL, sensor_tx_thread, info);
@@ -907,6 +832,11 @@ static int sensor_temp_op_start_reporting(struct device *dev,
     }
     info = device_get_private(dev);
 
+    ret = sensors_ext_batch_start(&info->batch, sensor_id, info->callback,
+                                  sampling_period, max_report_latency);
+    if (ret)
+        return ret;
+
     sampling_ms = sampling_period/1000000;
 
     vdbg("%s: requested sampling period %d mS\n", __func__, sampling_ms);
@@ -922,6 +852,7 @@ static int sensor_temp_op_start_reporting(struct device *dev,
     g_users++; // new thread user arrives
     sensor_list[g_users-1][0] = sensor_id;
     sensor_list[g_users-1][1] = LSM6DS3_TEMP_ID;
+    sensor_batch[g_users-1] = &info->batch;
 
     if (!tx_thread) {
         ret = pthread_create(&tx_thread, NULL, sensor_tx_thread, info);
@@ -938,167 +869,55 @@ static int sensor_temp_op_start_reporting(struct device *dev,
     return OK;
 }
 
-static int sensor_accel_op_flush(struct device *dev, uint8_t id)
+static int sensor_flush(struct lsm6ds3_sensor_info *info, int type)
 {
-    struct sensor_event_data *event_data;
-    struct lsm6ds3_sensor_info *info;
-    struct report_info_data *rinfo_data;
-    struct report_info *rinfo;
+    uint32_t data_value[TAG_CHANNEL_SIZE];
     struct timespec ts;
-    uint16_t payload_size;
 
-    payload_size = (ACCEL_READING_NUM * sizeof(struct sensor_event_data))
-                    + (REPORTING_SENSORS * sizeof(struct report_info));
+    if (!info->callback)
+        return OK;
+
+    up_rtc_gettime(&ts);
+    vdbg("[%u.%03u]\n", ts.tv_sec, (ts.tv_nsec / 1000000));
+    read_temp_accel_gyro(info);
+    sensor_event_values(type, data_value);
+    sensors_ext_batch_add(&info->batch, timespec_to_nsec(&ts), data_value);
 
+    return sensors_ext_batch_flush(&info->batch,
+                REPORT_INFO_FLAG_FLUSHING | REPORT_INFO_FLAG_FLUSH_COMPLETE);
+}
+
+static int sensor_accel_op_flush(struct device *dev, uint8_t id)
+{
     vdbg("%s:\n", __func__);
 
     if (!dev || !device_get_private(dev)) {
         return -EINVAL;
     }
-    info = device_get_private(dev);
-
-    if (info->callback) {
-        rinfo_data = malloc(sizeof(struct report_info) + payload_size);
-        if (!rinfo_data)
-            return -ENOMEM;
-
-        rinfo_data->num_sensors_reporting = REPORTING_SENSORS;
-        rinfo = rinfo_data->reportinfo;
-        rinfo->id = info->sensor_id;
-        event_data = (struct sensor_event_data *)&rinfo->data_payload[0];
 
-        up_rtc_gettime(&ts);
-        rinfo->reference_time = timespec_to_nsec(&ts);
-        vdbg("[%u.%03u]\n", ts.tv_sec, (ts.tv_nsec / 1000000));
-        rinfo->flags = REPORT_INFO_FLAG_FLUSHING | REPORT_INFO_FLAG_FLUSH_COMPLETE;
-        read_temp_accel_gyro(info);
-#ifdef BATCH_PROCESS_ENABLED
-        /*
-         * Batch sensor data values and its time_deltas
-         * until max fifo event count
-        */
-#else
-        /* Single sensor event data */
-        rinfo->readings = ACCEL_READING_NUM;
-        event_data->time_delta = 0;
-        event_data->data_value[0] = ax_raw;
-        event_data->data_value[1] = ay_raw;
-        event_data->data_value[2] = az_raw;
-#endif
-        info->callback(info->sensor_id, rinfo_data, payload_size);
-
-        free(rinfo_data);
-    }
-
-    return OK;
+    return sensor_flush(device_get_private(dev), LSM6DS3_ACCEL_ID);
 }
 
 static int sensor_gyro_op_flush(struct device *dev, uint8_t id)
 {
-    struct sensor_event_data *event_data;
-    struct lsm6ds3_sensor_info *info;
-    struct report_info_data *rinfo_data;
-    struct report_info *rinfo;
-    struct timespec ts;
-    uint16_t payload_size;
-
-    payload_size = (GYRO_READING_NUM * sizeof(struct sensor_event_data))
-                    + (REPORTING_SENSORS * sizeof(struct report_info));
-
     vdbg("%s:\n", __func__);
 
     if (!dev || !device_get_private(dev)) {
         return -EINVAL;
     }
-    info = device_get_private(dev);
-
-    if (info->callback) {
-        rinfo_data = malloc(sizeof(struct report_info) + payload_size);
-        if (!rinfo_data)
-            return -ENOMEM;
-
-        rinfo_data->num_sensors_reporting = REPORTING_SENSORS;
-        rinfo = rinfo_data->reportinfo;
-        rinfo->id = info->sensor_id;
-        event_data = (struct sensor_event_data *)&rinfo->data_payload[0];
-
-        up_rtc_gettime(&ts);
-        rinfo->reference_time = timespec_to_nsec(&ts);
-        vdbg("[%u.%03u]\n", ts.tv_sec, (ts.tv_nsec / 1000000));
-        rinfo->flags = REPORT_INFO_FLAG_FLUSHING | REPORT_INFO_FLAG_FLUSH_COMPLETE;
-        read_temp_accel_gyro(info);
-#ifdef BATCH_PROCESS_ENABLED
-        /*
-         * Batch sensor data values and its time_deltas
-         * until max fifo event count
-        */
-#else
-        /* Single sensor event data */
-        rinfo->readings = GYRO_READING_NUM;
-        event_data->time_delta = 0;
-        event_data->data_value[0] = gx_raw;
-        event_data->data_value[1] = gy_raw;
-        event_data->data_value[2] = gz_raw;
-#endif
-        info->callback(info->sensor_id, rinfo_data, payload_size);
 
-        free(rinfo_data);
-    }
-
-    return OK;
+    return sensor_flush(device_get_private(dev), LSM6DS3_GYRO_ID);
 }
 
 static int sensor_temp_op_flush(struct device *dev, uint8_t id)
 {
-    struct sensor_event_data *event_data;
-    struct lsm6ds3_sensor_info *info;
-    struct report_info_data *rinfo_data;
-    struct report_info *rinfo;
-    struct timespec ts;
-    uint16_t payload_size;
-
-    payload_size = (TEMP_READING_NUM * sizeof(struct sensor_event_data))
-                    + (REPORTING_SENSORS * sizeof(struct report_info));
-
     vdbg("%s:\n", __func__);
 
     if (!dev || !device_get_private(dev)) {
         return -EINVAL;
     }
-    info = device_get_private(dev);
-
-    if (info->callback) {
-        rinfo_data = malloc(sizeof(struct report_info) + payload_size);
-        if (!rinfo_data)
-            return -ENOMEM;
 
-        rinfo_data->num_sensors_reporting = REPORTING_SENSORS;
-        rinfo = rinfo_data->reportinfo;
-        rinfo->id = info->sensor_id;
-        event_data = (struct sensor_event_data *)&rinfo->data_payload[0];
-
-        up_rtc_gettime(&ts);
-        rinfo->reference_time = timespec_to_nsec(&ts);
-        vdbg("[%u.%03u]\n", ts.tv_sec, (ts.tv_nsec / 1000000));
-        rinfo->flags = REPORT_INFO_FLAG_FLUSHING | REPORT_INFO_FLAG_FLUSH_COMPLETE;
-        read_temp_accel_gyro(info);
-#ifdef BATCH_PROCESS_ENABLED
-        /*
-         * Batch sensor data values and its time_deltas
-         * until max fifo event count
-        */
-#else
-        /* Single sensor event data */
-        rinfo->readings = TEMP_READING_NUM;
-        event_data->time_delta = 0;
-        event_data->data_value[0] = temp_raw;
-#endif
-        info->callback(info->sensor_id, rinfo_data, payload_size);
-
-        free(rinfo_data);
-    }
-
-    return OK;
+    return sensor_flush(device_get_private(dev), LSM6DS3_TEMP_ID);
 }
 
 static void sensor_kill_pthread(struct lsm6ds3_sensor_info *info)
@@ -1129,9 +948,11 @@ static int sensor_accel_op_stop_reporting(struct device *dev,
         if (sensor_list[index][1] == LSM6DS3_ACCEL_ID){
             sensor_list[index][0] = -1;
             sensor_list[index][1] = -1;
+            sensor_batch[index] = NULL;
         }
     }
     sensor_kill_pthread(info);
+    sensors_ext_batch_stop(&info->batch);
 
     set_accel_ODR(info, A_POWER_DOWN);
     atomic_dec(&txn);
@@ -1155,9 +976,11 @@ static int sensor_gyro_op_stop_reporting(struct device *dev,
         if (sensor_list[index][1] == LSM6DS3_GYRO_ID){
             sensor_list[index][0] = -1;
             sensor_list[index][1] = -1;
+            sensor_batch[index] = NULL;
         }
     }
     sensor_kill_pthread(info);
+    sensors_ext_batch_stop(&info->batch);
     set_gyro_ODR(info, A_POWER_DOWN);
     atomic_dec(&txn);
 
@@ -1180,9 +1003,11 @@ static int sensor_temp_op_stop_reporting(struct device *dev,
         if (sensor_list[index][1] == LSM6DS3_TEMP_ID){
             sensor_list[index][0] = -1;
             sensor_list[index][1] = -1;
+            sensor_batch[index] = NULL;
         }
     }
     sensor_kill_pthread(info);
+    sensors_ext_batch_stop(&info->batch);
     atomic_dec(&txn);
 
     return OK;
@@ -1202,6 +1027,7 @@ static int sensor_op_register_callback(struct device *dev,
 
     info->callback = callback;
     info->sensor_id = se_id;
+    sensors_ext_batch_set_callback(&info->batch, se_id, callback);
     return 0;
 }
 
@@ -1360,6 +1186,7 @@ static int sensor_dev_probe(struct device *dev)
 
     info->dev = dev;
     device_set_private(dev, info);
+    sensors_ext_batch_init(&info->batch, LSM6DS3_EVENT_SIZE);
 
     i2c_bus = device_resource_get_by_name(dev, DEVICE_RESOURCE_TYPE_REGS,
             "i2c_bus");
@@ -1445,6 +1272,7 @@ static void sensor_accel_dev_remove(struct device *dev)
     }
     info->flags = 0;
 
+    sensors_ext_batch_deinit(&info->batch);
     free(info);
     device_set_private(dev, NULL);
 }
@@ -1466,6 +1294,7 @@ static void sensor_gyro_dev_remove(struct device *dev)
     }
     info->flags = 0;
 
+    sensors_ext_batch_deinit(&info->batch);
     free(info);
     device_set_private(dev, NULL);
 }
@@ -1487,6 +1316,7 @@ static void sensor_temp_dev_remove(struct device *dev)
     }
     info->flags = 0;
 
+    sensors_ext_batch_deinit(&info->batch);
     free(info);
     device_set_private(dev, NULL);
 }
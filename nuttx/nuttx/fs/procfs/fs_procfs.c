@@ -96,6 +96,10 @@ extern const struct procfs_operations smartfs_procfsoperations;
 extern const struct procfs_operations ccm_procfsoperations;
 #endif
 
+#if defined(CONFIG_GREYBUS_STATS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_GREYBUS)
+extern const struct procfs_operations gb_stats_procfsoperations;
+#endif
+
 /****************************************************************************
  * Private Types
  ****************************************************************************/
@@ -132,6 +136,10 @@ static const struct procfs_entry_s g_procfsentries[] =
 #if defined(CONFIG_STM32_CCM_PROCFS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_CCM)
   { "ccm",             &ccm_procfsoperations },
 #endif
+
+#if defined(CONFIG_GREYBUS_STATS) && !defined(CONFIG_FS_PROCFS_EXCLUDE_GREYBUS)
+  { "greybus",          &gb_stats_procfsoperations },
+#endif
 };
 
 static const uint8_t g_procfsentrycount = sizeof(g_procfsentries) /
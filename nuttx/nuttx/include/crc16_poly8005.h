@@ -51,6 +51,11 @@ extern "C"
 #define CRC_INIT_VAL (0x0000)
 #define CRC_FINAL_VAL (0x0000)
 
+/* Signature of the CRC implementations, see crc16_poly8005() */
+
+typedef uint16_t (*crc16_poly8005_t)(FAR const uint8_t *src, size_t len,
+                                     uint16_t crc16val);
+
 /****************************************************************************
  * Name: crc16_poly8005
  *
@@ -64,6 +69,44 @@ extern "C"
 
 uint16_t crc16_poly8005(FAR const uint8_t *src, size_t len, uint16_t crc16val);
 
+/****************************************************************************
+ * Name: crc16_poly8005_sw
+ *
+ * Description:
+ *   Same as crc16_poly8005() but always uses the table implementation
+ *   selected in the configuration, never the registered backend.
+ *
+ ****************************************************************************/
+
+uint16_t crc16_poly8005_sw(FAR const uint8_t *src, size_t len,
+                           uint16_t crc16val);
+
+/****************************************************************************
+ * Name: crc16_poly8005_copy
+ *
+ * Description:
+ *   Copy len bytes from src to dest and return their CRC-16, calculated
+ *   on the way instead of as a second pass over the buffer. Like
+ *   crc16_poly8005(), crc16val is CRC_INIT_VAL or the result of a previous
+ *   call, so a packet can be assembled and checksummed piece by piece.
+ *
+ ****************************************************************************/
+
+uint16_t crc16_poly8005_copy(FAR uint8_t *dest, FAR const uint8_t *src,
+                             size_t len, uint16_t crc16val);
+
+/****************************************************************************
+ * Name: crc16_poly8005_backend
+ *
+ * Description:
+ *   Register a faster implementation of crc16_poly8005(), such as a
+ *   hardware CRC unit, or NULL to go back to the table implementation.
+ *   The backend must be callable from interrupt context.
+ *
+ ****************************************************************************/
+
+void crc16_poly8005_backend(crc16_poly8005_t backend);
+
 #undef EXTERN
 #ifdef __cplusplus
 }
@@ -31,7 +31,9 @@
 
 #define DEVICE_TYPE_SENSORS_HW          "sensors_ext"
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <pthread.h>
 #include <nuttx/greybus/types.h>
 
 #define SENSOR_EXT_FLAG_CONTINUOUS_MODE 0x00000000
@@ -117,6 +119,42 @@ struct report_info_data {
 typedef int (*sensors_ext_event_callback)(uint8_t se_id,
                     struct report_info_data *rinfo_data, uint16_t payload_size);
 
+/**
+ * Batch of events of one sensor, sent as a single report_info_data once the
+ * sensor's max_report_latency is about to expire, the buffer is full or the
+ * batch is flushed. Each event is a 16 bit time_delta, in microseconds after
+ * the reference_time of its report_info, followed by data_size bytes of data.
+ */
+struct sensors_ext_batch {
+    pthread_mutex_t lock;
+    sensors_ext_event_callback callback;
+    uint8_t sensor_id;
+    uint16_t data_size;
+    uint64_t sampling_period;
+    uint64_t max_report_latency;
+    struct report_info_data *rinfo_data;
+    struct report_info *rinfo;
+    uint16_t payload_size;
+    uint64_t first_time;
+    uint64_t last_time;
+    bool started;
+};
+
+void sensors_ext_batch_init(struct sensors_ext_batch *batch, uint16_t data_size);
+void sensors_ext_batch_deinit(struct sensors_ext_batch *batch);
+int sensors_ext_batch_start(struct sensors_ext_batch *batch, uint8_t sensor_id,
+                            sensors_ext_event_callback callback,
+                            uint64_t sampling_period,
+                            uint64_t max_report_latency);
+void sensors_ext_batch_stop(struct sensors_ext_batch *batch);
+void sensors_ext_batch_set_callback(struct sensors_ext_batch *batch,
+                                    uint8_t sensor_id,
+                                    sensors_ext_event_callback callback);
+int sensors_ext_batch_add(struct sensors_ext_batch *batch, uint64_t time,
+                          const void *data);
+int sensors_ext_batch_flush(struct sensors_ext_batch *batch, uint8_t flags);
+uint32_t sensors_ext_batch_max_events(uint16_t data_size);
+
 struct device_sensors_ext_type_ops {
     int (*get_sensor_count)(struct device *dev, uint8_t *count);
     int (*get_sensor_info)(struct device *dev, uint8_t sensor_id,
@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __INCLUDE_NUTTX_FWUNPACK_H
+#define __INCLUDE_NUTTX_FWUNPACK_H
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <nuttx/config.h>
+
+#include <sys/types.h>
+#include <stdint.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* RAM used by a decoder for output staging or for one delta block */
+
+#ifndef CONFIG_LIB_FWUNPACK_BUFSIZE
+#  define CONFIG_LIB_FWUNPACK_BUFSIZE 2048
+#endif
+
+/* Base block of a delta block that starts from erased flash */
+
+#define FWUNPACK_DELTA_ERASED 0xffff
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/*
+ * Encodings of a firmware image:
+ *
+ * FWUNPACK_LZ4:   LZ4 block format, as produced by LZ4_compress_default().
+ *                 Matches may reach back up to 64KiB into the output, which
+ *                 is read back from the device instead of being kept in RAM.
+ *
+ * FWUNPACK_DELTA: The new image in blocks of 1 << shift bytes, built on top
+ *                 of blocks of the image being replaced. The stream starts
+ *                 with the shift (u8) followed, for each block, by the index
+ *                 of its base block (le16, FWUNPACK_DELTA_ERASED for none)
+ *                 and patches of the base: a byte count to keep (le16), a
+ *                 byte count to replace (le16) and the replacement bytes.
+ *                 A patch replacing 0 bytes ends the block. The update is
+ *                 done in place, so a block may only be based on itself or
+ *                 on a later block, which has not been overwritten yet.
+ */
+
+enum fwunpack_type_e
+{
+  FWUNPACK_LZ4,
+  FWUNPACK_DELTA,
+};
+
+/* Access to the device the image is unpacked to */
+
+struct fwunpack_ops_s
+{
+  /*
+   * Write len bytes at offset. Output is written in order, in multiples of
+   * 8 bytes but for the end of the image.
+   */
+
+  int (*write)(FAR void *arg, uint32_t offset, FAR const uint8_t *buf,
+               size_t len);
+
+  /*
+   * Read len bytes at offset: image already written before it, image being
+   * replaced after it.
+   */
+
+  int (*read)(FAR void *arg, uint32_t offset, FAR uint8_t *buf, size_t len);
+};
+
+/* Decoder state, opaque to the users */
+
+struct fwunpack_s
+{
+  FAR const struct fwunpack_ops_s *ops;
+  FAR void *arg;
+  enum fwunpack_type_e type;
+  uint8_t state;
+  uint8_t token;                /* Current LZ4 sequence token */
+  uint32_t out_size;            /* Size of the unpacked image */
+  uint32_t out_pos;             /* Bytes of the image produced */
+  uint32_t flushed;             /* Bytes of the image written to the device */
+  uint32_t count;               /* Length of the current literal/match/patch */
+  uint16_t offset;              /* Distance of the current LZ4 match */
+  uint16_t shift;               /* log2 of the delta block size */
+  uint16_t pos;                 /* Position in the current delta block */
+  uint8_t buf[CONFIG_LIB_FWUNPACK_BUFSIZE];
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+#ifdef __cplusplus
+#define EXTERN extern "C"
+extern "C"
+{
+#else
+#define EXTERN extern
+#endif
+
+/****************************************************************************
+ * Name: fwunpack_init
+ *
+ * Description:
+ *   Prepare to unpack an image of out_size bytes encoded as type.
+ *
+ * Returned Value:
+ *   0 on success or negative errno on failure
+ *
+ ****************************************************************************/
+
+int fwunpack_init(FAR struct fwunpack_s *unpack, enum fwunpack_type_e type,
+                  uint32_t out_size, FAR const struct fwunpack_ops_s *ops,
+                  FAR void *arg);
+
+/****************************************************************************
+ * Name: fwunpack_feed
+ *
+ * Description:
+ *   Decode the next len bytes of the packed image, in chunks of any size.
+ *
+ * Returned Value:
+ *   0 on success, -EINVAL if the data is corrupted or any error of the
+ *   device accesses.
+ *
+ ****************************************************************************/
+
+int fwunpack_feed(FAR struct fwunpack_s *unpack, FAR const uint8_t *data,
+                  size_t len);
+
+/****************************************************************************
+ * Name: fwunpack_finish
+ *
+ * Description:
+ *   Write what remains of the image after the whole packed image was fed.
+ *
+ * Returned Value:
+ *   0 on success, -EINVAL if the image is incomplete or any error of the
+ *   device accesses.
+ *
+ ****************************************************************************/
+
+int fwunpack_finish(FAR struct fwunpack_s *unpack);
+
+#ifdef CONFIG_LIB_FWPACK
+/****************************************************************************
+ * Name: fwpack_lz4, fwpack_delta
+ *
+ * Description:
+ *   Encode an image of len bytes for the decoders above. fwpack_delta()
+ *   encodes it against old, old_len bytes long, in blocks of 1 << shift
+ *   bytes. The encoders are meant for the host packer and tests, not for
+ *   small targets.
+ *
+ * Returned Value:
+ *   Size of the packed image or negative errno, -ENOSPC if larger than
+ *   out_len.
+ *
+ ****************************************************************************/
+
+ssize_t fwpack_lz4(FAR const uint8_t *in, size_t len, FAR uint8_t *out,
+                   size_t out_len);
+ssize_t fwpack_delta(FAR const uint8_t *in, size_t len,
+                     FAR const uint8_t *old, size_t old_len, uint8_t shift,
+                     FAR uint8_t *out, size_t out_len);
+#endif
+
+#undef EXTERN
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __INCLUDE_NUTTX_FWUNPACK_H */
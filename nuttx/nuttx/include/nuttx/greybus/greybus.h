@@ -65,6 +65,13 @@ typedef void (*gb_operation_fast_handler_t)(unsigned int cport, void *data);
         .type = t, \
         .fast_handler = h, \
     }
+
+#define GB_INLINE_HANDLER(t, h) \
+    { \
+        .type = t, \
+        .handler = h, \
+        .nonblocking = true, \
+    }
 #else
 #define GB_HANDLER(t, h) \
     { \
@@ -79,12 +86,27 @@ typedef void (*gb_operation_fast_handler_t)(unsigned int cport, void *data);
         .fast_handler = h, \
         .name = #h, \
     }
+
+#define GB_INLINE_HANDLER(t, h) \
+    { \
+        .type = t, \
+        .handler = h, \
+        .nonblocking = true, \
+        .name = #h, \
+    }
 #endif
 
 struct gb_operation_handler {
     uint8_t type;
     gb_operation_handler_t handler;
     gb_operation_fast_handler_t fast_handler;
+
+    /*
+     * The handler never sleeps, only waits on short-held locks, answers
+     * with a small response and does not keep the operation: it may run
+     * straight from the receive thread, see CONFIG_GREYBUS_INLINE_HANDLERS.
+     */
+    bool nonblocking;
 #ifdef CONFIG_GREYBUS_DEBUG
     const char *name;
 #endif
@@ -100,13 +122,26 @@ struct gb_transport_backend {
     int (*send)(unsigned int cport, const void *buf, size_t len);
     void *(*alloc_buf)(size_t size);
     void (*free_buf)(void *ptr);
+
+    /*
+     * Optional: largest message size, not above size, that fills the last
+     * packet used by the transport to carry it.
+     */
+    size_t (*fit_size)(size_t size);
+
+    /*
+     * Optional: send a message from within the receive callback of the
+     * transport, which is running in a thread. Needed to answer requests
+     * inline.
+     */
+    int (*send_inline)(unsigned int cport, const void *buf, size_t len);
 };
 
 struct gb_operation {
     unsigned int cport;
     bool has_responded;
     atomic_t ref_count;
-    struct timespec time;
+    uint32_t expires;           /* timer wheel deadline */
 
     void *request_headroom;
     void *response_headroom;
@@ -114,6 +149,7 @@ struct gb_operation {
     void *request_buffer;
     void *response_buffer;
     bool is_unipro_rx_buf;
+    bool is_inline;             /* on the stack of the receive thread */
 
     gb_operation_callback callback;
     sem_t sync_sem;
@@ -127,6 +163,18 @@ struct gb_operation {
     struct timespec send_ts;
     struct timespec recv_ts;
 #endif
+#ifdef CONFIG_GREYBUS_STATS
+    uint32_t recv_us;           /* hrt_getusec() when received */
+#endif
+};
+
+/*
+ * Priority of the messages sent on a CPort, for transports able to send
+ * some ahead of others.
+ */
+enum gb_tx_priority {
+    GB_TX_PRIO_NORMAL,              /* bulk and everything else */
+    GB_TX_PRIO_HIGH,                /* control, input and other short replies */
 };
 
 struct gb_driver {
@@ -140,6 +188,43 @@ struct gb_driver {
     size_t stack_size;
     size_t op_handlers_count;
     const char *name;
+    enum gb_tx_priority tx_priority;
+    bool blocking;              /* handlers wait for other messages */
+};
+
+/* Message dispatch footprint, see gb_dispatch_get_info() */
+struct gb_dispatch_info {
+    unsigned int threads;           /* threads handling Greybus messages */
+    unsigned int cports;            /* CPorts with a registered driver */
+    size_t stack_bytes;             /* stack allocated to those threads */
+    size_t per_cport_stack_bytes;   /* same, with one thread per CPort */
+};
+
+/*
+ * Bucket n of the latency histograms counts the messages which took
+ * [2^(n-1), 2^n) microseconds, bucket 0 those under a microsecond and the
+ * last one everything above.
+ */
+#define GB_STATS_HIST_BUCKETS   16
+
+/*
+ * Per-CPort traffic counters, see gb_stats_get(). The handler and latency
+ * fields need CONFIG_ARCH_HAVE_HIRES_TIMER and stay at 0 without it.
+ */
+struct gb_cport_stats {
+    uint32_t rx_msgs;               /* messages received */
+    uint32_t rx_bytes;
+    uint32_t rx_drops;              /* received but never handled */
+    uint32_t tx_msgs;               /* messages accepted by the transport */
+    uint32_t tx_bytes;
+    uint32_t tx_errors;             /* messages refused by the transport */
+    uint32_t oom_responses;         /* requests answered GB_OP_NO_MEMORY */
+    uint32_t timeouts;              /* requests never answered */
+    uint16_t rx_queue_depth;        /* messages waiting for a worker */
+    uint16_t rx_queue_hwm;          /* highest rx_queue_depth seen */
+    uint32_t handler_max_us;        /* slowest request handler */
+    uint32_t handler_hist[GB_STATS_HIST_BUCKETS];   /* handler run time */
+    uint32_t latency_hist[GB_STATS_HIST_BUCKETS];   /* reception to reply */
 };
 
 struct gb_operation_hdr {
@@ -231,6 +316,7 @@ int gb_listen(unsigned int cport);
 int gb_stop_listening(unsigned int cport);
 int gb_notify(unsigned cport, enum gb_event event);
 int gb_notify_all(enum gb_event event);
+size_t gb_fit_payload_size(size_t size);
 
 void gb_operation_destroy(struct gb_operation *operation);
 void *gb_operation_alloc_response(struct gb_operation *operation, size_t size);
@@ -239,6 +325,10 @@ int gb_operation_send_request_sync(struct gb_operation *operation);
 int gb_operation_send_request(struct gb_operation *operation,
                               gb_operation_callback callback,
                               bool need_response);
+int gb_operation_send_request_timeout(struct gb_operation *operation,
+                                      gb_operation_callback callback,
+                                      bool need_response,
+                                      unsigned int timeout_ms);
 struct gb_operation *gb_operation_create(unsigned int cport, uint8_t type,
                                          uint32_t req_size);
 void gb_operation_ref(struct gb_operation *operation);
@@ -246,6 +336,7 @@ void gb_operation_unref(struct gb_operation *operation);
 size_t gb_operation_get_request_payload_size(struct gb_operation *operation);
 uint8_t gb_operation_get_request_result(struct gb_operation *operation);
 int greybus_rx_handler(unsigned int, void*, size_t);
+int greybus_rx_handler_take(unsigned int cport, void *buf, size_t size);
 
 void gb_control_register(int cport);
 void gb_gpio_register(int cport);
@@ -261,5 +352,11 @@ struct  i2c_dev_s *gb_i2c_get_dev(void);
 uint8_t gb_errno_to_op_result(int err);
 
 bool gb_is_valid_cport(unsigned int cport);
+void gb_dispatch_get_info(struct gb_dispatch_info *info);
+int gb_set_tx_priority(unsigned int cport, enum gb_tx_priority prio);
+enum gb_tx_priority gb_get_tx_priority(unsigned int cport);
+int gb_stats_get(unsigned int cport, struct gb_cport_stats *stats);
+int gb_stats_next_cport(int cport);
+void gb_stats_reset(unsigned int cport);
 
 #endif /* _GREYBUS_H_ */
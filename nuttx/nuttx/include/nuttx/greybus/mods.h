@@ -29,8 +29,13 @@
 #ifndef _GREYBUS_MODS_H_
 #define _GREYBUS_MODS_H_
 
+#include <stdint.h>
+
 #include <nuttx/notifier.h>
 
+/* Message size buckets of the packet size statistics, up to 2^11 bytes */
+#define MODS_DL_SIZE_BUCKETS (12)
+
 /*
  * Base attach logic assumes this enum order. Do not change without changing
  * both!
@@ -93,4 +98,40 @@ int mods_attach_register(notifier_fn_t callback, void *arg);
 
 int mods_network_init(void);
 
+/*
+ * Packet size statistics of the data link. Bucket i counts the messages of
+ * more than 2^(i-1) and up to 2^i bytes. The cost estimated for a payload
+ * size of 2^i bytes is in bytes on the wire, 0 if not a candidate.
+ */
+
+struct mods_dl_pkt_stats
+{
+  uint16_t pl_size;                      /* Payload size in use */
+  uint16_t max_pl_size;                  /* Largest payload size of the base */
+  uint32_t resizes;                      /* Payload size changes requested */
+
+  /* Inputs and outcome of the last evaluation */
+  uint32_t msgs[MODS_DL_SIZE_BUCKETS];   /* Messages sent and received */
+  uint32_t txns;                         /* Transactions with the base */
+  uint32_t txn_errs;                     /* Transactions that failed */
+  uint32_t cost[MODS_DL_SIZE_BUCKETS];   /* Estimated cost per payload size */
+  uint16_t chosen_pl_size;               /* Payload size with lowest cost */
+};
+
+/****************************************************************************
+ * Name: mods_dl_get_pkt_stats
+ *
+ * Description:
+ *   Get the statistics behind the payload size chosen by the data link.
+ *
+ * Input Parameter:
+ *   stats - Structure to fill in
+ *
+ * Returned Value:
+ *   0 on success or negative errno on failure
+ *
+ ****************************************************************************/
+
+int mods_dl_get_pkt_stats(FAR struct mods_dl_pkt_stats *stats);
+
 #endif /* _GREYBUS_MODS_H_ */
@@ -0,0 +1,68 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef __GREYBUS_POOL_H__
+#define __GREYBUS_POOL_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct gb_operation;
+
+/* Size classes, from the smallest to the largest */
+enum gb_pool_class {
+    GB_POOL_OPERATION,      /* struct gb_operation */
+    GB_POOL_SMALL,          /* small messages */
+    GB_POOL_MTU,            /* largest messages */
+
+    GB_POOL_CLASS_COUNT,
+};
+
+struct gb_pool_class_stats {
+    uint16_t size;          /* block size in bytes */
+    uint16_t count;         /* number of blocks */
+    uint16_t free;          /* blocks currently free */
+    uint16_t min_free;      /* lowest number of free blocks seen */
+    uint32_t allocs;        /* allocations served by this class */
+    uint32_t fallbacks;     /* requests fitting this class that it missed */
+};
+
+struct gb_pool_stats {
+    struct gb_pool_class_stats classes[GB_POOL_CLASS_COUNT];
+    uint32_t heap_allocs;   /* allocations that went to the heap */
+    uint32_t heap_frees;
+    uint32_t irq_misses;    /* pool misses failed in interrupt context */
+};
+
+int gb_pool_init(size_t headroom);
+struct gb_operation *gb_pool_alloc_operation(void);
+void *gb_pool_alloc(size_t size);
+void gb_pool_free(void *ptr);
+void gb_pool_get_stats(struct gb_pool_stats *stats);
+
+#endif /* __GREYBUS_POOL_H__ */
@@ -76,6 +76,7 @@ struct i2s_tunnel_info_s
     unsigned int i2s_tx_samples_dropped;
     unsigned int i2s_tx_samples_retransmitted;
     unsigned int i2s_tx_buffers_dropped;
+    int i2s_tx_drift_ppm;
 };
 
 #endif
@@ -40,6 +40,27 @@ enum {
     MHB_CAMERA_REG_DWORD = 4,
 };
 
+/*
+ * Register of a sequence written by mhb_camera_i2c_write_seq(). Registers
+ * are MHB_CAMERA_REG_BYTE unless size is MHB_CAMERA_REG_WORD. The sequence
+ * waits delay_ms after writing the register.
+ */
+struct mhb_camera_reg {
+    uint16_t addr;
+    uint16_t value;
+    uint8_t size;
+    uint8_t delay_ms;
+};
+
+/* mhb_camera_i2c_write_seq() flags */
+#define MHB_CAMERA_SEQ_VERIFY   (1 << 0) /* read the registers back */
+
+/* Register table of a sensor mode, see mhb_camera_mode_register(). */
+struct mhb_camera_mode {
+    const struct mhb_camera_reg *regs;
+    size_t count;
+};
+
 enum mhb_camera_notification_event{
     MHB_CAMERA_NOTIFY_POWERED_ON      = 0x00,
     MHB_CAMERA_NOTIFY_POWERED_OFF     = 0x01,
@@ -59,6 +80,14 @@ int mhb_camera_i2c_read(uint16_t i2c_addr,
                         uint8_t *data, int data_len);
 int mhb_camera_i2c_write(uint16_t i2c_addr,
                          uint8_t *addr, int addr_len);
+int mhb_camera_i2c_write_seq(uint16_t i2c_addr,
+                             const struct mhb_camera_reg *regs, size_t count,
+                             uint8_t reg_width, uint32_t flags);
+int mhb_camera_mode_register(uint16_t i2c_addr, uint8_t reg_width,
+                             const struct mhb_camera_mode *modes,
+                             size_t count);
+int mhb_camera_mode_set(const struct mhb_camera_mode *mode);
+void mhb_camera_mode_invalidate(void);
 int mhb_camera_i2c_read_reg(uint16_t i2c_addr, uint16_t regaddr,
                              void *value, uint8_t reg_size, uint8_t reg_width);
 int mhb_camera_i2c_write_reg(uint16_t i2c_addr, uint16_t regaddr,
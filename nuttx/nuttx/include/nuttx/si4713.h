@@ -1,23 +1,48 @@
-
 /*
- * Si4713 driver support for the fm_xmitter modification.
- * allows for driver support from the code, and allows for
- * fm transmission using the required commands through the i2c
- * bus.
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
  *
- *             Author: David Kroell
- *            Version: 1.2.0
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
-
 #ifndef __INCLUDE_SI4713_H
 #define __INCLUDE_SI4713_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <nuttx/i2c.h>
+#include <nuttx/list.h>
 #include <nuttx/util.h>
 
-#define SI4713_MAX_I2C_SIZE   252
+#define SI4713_I2C_ADDR           0x63
+#define SI4713_MAX_I2C_SIZE       252
 
-/****************** Registers *******************/
+#define SI4713_MAX_ARGS           7
+#define SI4713_MAX_RESP           16
+
+/****************** Commands *******************/
 #define SI4713_POWER_UP           0x01      // Power up device and mode selection.
 #define SI4713_GET_REV            0x10      // Returns revision information in the device
 #define SI4713_POWER_DOWN         0x11      // Power down device
@@ -37,51 +62,193 @@
 #define SI4713_GPIO_CTL           0x80      // Configures the GPO1, 2, and 3 as output for Hi-Z
 #define SI4713_GPIO_SET           0x81      // Sets GPO1, 2, and 3 output level (low or high)
 
-//
-// This function will power up the board.
-//
-void si4713_powerup();
-
-//
-// This function will power down the board. Probably wont be used.
-//
-void si4713_powerdown();
+/****************** Status byte ****************/
+#define SI4713_STATUS_CTS         0x80      // Clear to send next command
+#define SI4713_STATUS_ERR         0x40      // Error executing last command
+#define SI4713_STATUS_RDSINT      0x04      // RDS interrupt
+#define SI4713_STATUS_ASQINT      0x02      // Audio signal quality interrupt
+#define SI4713_STATUS_STCINT      0x01      // Seek/tune complete interrupt
+
+/****************** POWER_UP args **************/
+#define SI4713_PWUP_CTSIEN        0x80
+#define SI4713_PWUP_GPO2OEN       0x40
+#define SI4713_PWUP_PATCH         0x20
+#define SI4713_PWUP_XOSCEN        0x10
+#define SI4713_PWUP_FUNC_TX       0x02
+#define SI4713_PWUP_OPMOD_ANALOG  0x50
+#define SI4713_PWUP_OPMOD_DIGITAL 0x0F
+
+/****************** TX_TUNE_STATUS args ********/
+#define SI4713_TUNE_STATUS_INTACK 0x01
+
+/****************** TX_RDS_BUFF args ***********/
+#define SI4713_RDS_BUFF_FIFO      0x80      // Operate on the FIFO
+#define SI4713_RDS_BUFF_LDBUFF    0x04      // Load the group into the buffer
+#define SI4713_RDS_BUFF_MTBUFF    0x02      // Empty the buffer
+#define SI4713_RDS_BUFF_INTACK    0x01      // Clear RDSINT
+
+/* TX_RDS_BUFF response: resp[4] FIFOAVAIL and resp[5] FIFOUSED, in blocks */
+#define SI4713_RDS_BUFF_NRESP     6
+#define SI4713_RDS_BUFF_FIFOAVAIL 4
+#define SI4713_RDS_BUFF_FIFOUSED  5
+
+/****************** Properties *****************/
+#define SI4713_PROP_GPO_IEN                 0x0001
+#define SI4713_PROP_DIGITAL_INPUT_FORMAT    0x0101
+#define SI4713_PROP_DIGITAL_INPUT_RATE      0x0103
+#define SI4713_PROP_REFCLK_FREQ             0x0201
+#define SI4713_PROP_REFCLK_PRESCALE         0x0202
+#define SI4713_PROP_TX_COMPONENT_ENABLE     0x2100
+#define SI4713_PROP_TX_AUDIO_DEVIATION      0x2101
+#define SI4713_PROP_TX_PILOT_DEVIATION      0x2102
+#define SI4713_PROP_TX_RDS_DEVIATION        0x2103
+#define SI4713_PROP_TX_LINE_LEVEL_INPUT     0x2104
+#define SI4713_PROP_TX_LINE_INPUT_MUTE      0x2105
+#define SI4713_PROP_TX_PREEMPHASIS          0x2106
+#define SI4713_PROP_TX_PILOT_FREQUENCY      0x2107
+#define SI4713_PROP_TX_ACOMP_ENABLE         0x2200
+#define SI4713_PROP_TX_ACOMP_THRESHOLD      0x2201
+#define SI4713_PROP_TX_ACOMP_ATTACK_TIME    0x2202
+#define SI4713_PROP_TX_ACOMP_RELEASE_TIME   0x2203
+#define SI4713_PROP_TX_ACOMP_GAIN           0x2204
+#define SI4713_PROP_TX_LIMITER_RELEASE_TIME 0x2205
+#define SI4713_PROP_TX_ASQ_INTERRUPT_SOURCE 0x2300
+#define SI4713_PROP_TX_RDS_INTERRUPT_SOURCE 0x2C00
+#define SI4713_PROP_TX_RDS_PI               0x2C01
+#define SI4713_PROP_TX_RDS_PS_MIX           0x2C02
+#define SI4713_PROP_TX_RDS_PS_MISC          0x2C03
+#define SI4713_PROP_TX_RDS_PS_REPEAT_COUNT  0x2C04
+#define SI4713_PROP_TX_RDS_PS_MESSAGE_COUNT 0x2C05
+#define SI4713_PROP_TX_RDS_PS_AF            0x2C06
+#define SI4713_PROP_TX_RDS_FIFO_SIZE        0x2C07
+
+/* TX_COMPONENT_ENABLE bits */
+#define SI4713_COMPONENT_PILOT    0x0001
+#define SI4713_COMPONENT_LMR      0x0002
+#define SI4713_COMPONENT_RDS      0x0004
+
+/* TX_RDS_INTERRUPT_SOURCE bits */
+#define SI4713_RDS_INT_FIFOMT     0x0001
+#define SI4713_RDS_INT_CBUFWRAP   0x0002
+#define SI4713_RDS_INT_FIFOXMIT   0x0004
+#define SI4713_RDS_INT_CBUFXMIT   0x0008
+#define SI4713_RDS_INT_PSXMIT     0x0010
+
+/* GPO_IEN bits */
+#define SI4713_GPO_IEN_STCIEN     0x0001
+#define SI4713_GPO_IEN_ASQIEN     0x0002
+#define SI4713_GPO_IEN_RDSIEN     0x0004
+#define SI4713_GPO_IEN_CTSIEN     0x0080
+
+/* Frequency range, in 10 kHz units */
+#define SI4713_FREQ_MIN           7600
+#define SI4713_FREQ_MAX           10800
+
+/* Response length of TX_TUNE_STATUS */
+#define SI4713_TUNE_STATUS_NRESP  8
+
+/* Special values for the int_gpio argument of si4713_initialize() */
+#define SI4713_INT_NONE           (-1)      // No interrupt line, poll status
+#define SI4713_INT_EXTERNAL       (-2)      // Board calls si4713_interrupt()
+
+/* si4713_cmd_s flags */
+#define SI4713_CMD_F_STC          (1 << 0)  // Command completes on STCINT
+#define SI4713_CMD_F_URGENT       (1 << 1)  // Queue ahead of pending commands
+
+struct si4713_dev_s;
+struct si4713_cmd_s;
 
-//
-// This function will automatically tune the transmitter to 101.1 MHz
-// Note that this band is open where I am located in Newport News.
-// 
-void si4713_tune_freq();
+/*
+ * Completion callback, called from the driver work queue once the command
+ * has finished (status == 0) or failed (negative errno). The command may be
+ * resubmitted from within the callback.
+ */
+typedef void (*si4713_callback_t)(struct si4713_cmd_s *cmd, int status);
 
+/*
+ * Chip event callback (RDSINT or ASQINT set in the status byte), called
+ * from the driver work queue. status is the raw status byte.
+ */
+typedef void (*si4713_event_t)(void *priv, uint8_t status);
 
 /*
- * si4713_device - private data
+ * A command slot. The storage belongs to the caller and must stay valid
+ * until the callback has been invoked. On completion resp[] holds the
+ * response bytes (resp[0] is the status byte).
  */
-struct si4713_device {
-  /* v4l2_subdev and i2c reference (v4l2_subdev priv data) */
-  struct v4l2_subdev sd;
-
-  /* private data structures */
-  struct mutex mutex;
-
-  struct completion work;
-  struct rds_info rds_info;
-  struct limiter_info limiter_info;
-  struct pilot_info pilot_info;
-  struct acomp_info acomp_info;
-  struct regulator_bulk_data supplies[2];
-
-  int gpio_reset;
-  u32 frequency;
-  u32 preemphasis;
-  u32 mute;
-  u32 power_level;
-  u32 power_state;
-  u32 antenna_capacitor;
-  u32 stereo;
-  u32 tune_rnl;
+struct si4713_cmd_s {
+    struct list_head list;
+    uint8_t cmd;
+    uint8_t nargs;
+    uint8_t nresp;
+    uint8_t flags;
+    uint8_t args[SI4713_MAX_ARGS];
+    uint8_t resp[SI4713_MAX_RESP];
+    si4713_callback_t callback;
+    void *priv;
+    uint32_t submit_us;
+};
 
+struct si4713_stats_s {
+    uint32_t submitted;
+    uint32_t completed;
+    uint32_t errors;
+    uint32_t timeouts;
+    uint32_t max_depth;
+    uint32_t max_latency_us;
+    uint64_t total_latency_us;
 };
 
+struct si4713_dev_s *si4713_initialize(struct i2c_dev_s *i2c, uint8_t addr,
+                                       int int_gpio, int rst_gpio);
+void si4713_uninitialize(struct si4713_dev_s *dev);
+
+int si4713_submit(struct si4713_dev_s *dev, struct si4713_cmd_s *cmd);
+int si4713_command(struct si4713_dev_s *dev, struct si4713_cmd_s *cmd);
+int si4713_cancel(struct si4713_dev_s *dev, struct si4713_cmd_s *cmd);
+void si4713_interrupt(struct si4713_dev_s *dev);
+void si4713_get_stats(struct si4713_dev_s *dev, struct si4713_stats_s *stats);
+void si4713_set_event_callback(struct si4713_dev_s *dev, si4713_event_t cb,
+                               void *priv);
+
+void si4713_prep_set_property(struct si4713_cmd_s *cmd, uint16_t prop,
+                              uint16_t val);
+void si4713_prep_get_property(struct si4713_cmd_s *cmd, uint16_t prop);
+void si4713_prep_tune_freq(struct si4713_cmd_s *cmd, uint16_t freq);
+void si4713_prep_tune_power(struct si4713_cmd_s *cmd, uint8_t power,
+                            uint8_t antcap);
+
+int si4713_powerup(struct si4713_dev_s *dev, bool analog);
+int si4713_powerdown(struct si4713_dev_s *dev);
+
+/****************** RDS group scheduler ********/
+
+#define SI4713_RDS_PS_LEN         8
+#define SI4713_RDS_RT_LEN         64
+#define SI4713_RDS_MAX_AF         7         // Fits the 4 PS groups of a cycle
+
+struct si4713_rds_s;
+
+struct si4713_rds_stats_s {
+    uint32_t groups_loaded;     // groups written to the chip FIFO
+    uint32_t groups_encoded;    // groups (re-)encoded by an update
+    uint32_t groups_patched;    // queued ring entries rewritten by an update
+    uint32_t topups;            // FIFO top-up batches
+    uint32_t underruns;         // loads that left at most 3 blocks in the chip FIFO
+    uint32_t load_errors;
+};
+
+struct si4713_rds_s *si4713_rds_initialize(struct si4713_dev_s *dev,
+                                           uint16_t pi, uint8_t pty);
+void si4713_rds_uninitialize(struct si4713_rds_s *rds);
+
+int si4713_rds_set_ps(struct si4713_rds_s *rds, const char *ps);
+int si4713_rds_set_rt(struct si4713_rds_s *rds, const char *rt, bool clear);
+int si4713_rds_set_af(struct si4713_rds_s *rds, const uint16_t *freqs,
+                      int count);
+int si4713_rds_set_ct(struct si4713_rds_s *rds, uint32_t utc,
+                      int8_t offset);
+void si4713_rds_get_stats(struct si4713_rds_s *rds,
+                          struct si4713_rds_stats_s *stats);
 
-#endif /* Include si4713.h */
+#endif /* __INCLUDE_SI4713_H */
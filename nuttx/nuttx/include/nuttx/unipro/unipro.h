@@ -51,6 +51,12 @@ enum unipro_event {
     UNIPRO_EVT_MAILBOX,
 };
 
+/* Order in which asynchronous sends of different CPorts are served */
+enum unipro_tx_priority {
+    UNIPRO_TX_PRIO_NORMAL,      /* bulk and everything else */
+    UNIPRO_TX_PRIO_HIGH,        /* audio tunnel, control */
+};
+
 typedef int (*unipro_send_completion_t)(int status, const void *buf,
                                         void *priv);
 typedef void (*cport_reset_completion_cb_t)(unsigned int cportid, void *data);
@@ -74,6 +80,8 @@ int unipro_send_async(unsigned int cportid, const void *buf, size_t len,
                       unipro_send_completion_t callback, void *priv);
 int unipro_reset_cport(unsigned int cportid, cport_reset_completion_cb_t cb,
                        void *priv);
+int unipro_set_tx_priority(unsigned int cportid,
+                           enum unipro_tx_priority prio);
 
 int unipro_set_max_inflight_rxbuf_count(unsigned int cportid,
                                         size_t max_inflight_buf);
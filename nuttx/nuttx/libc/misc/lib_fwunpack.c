@@ -0,0 +1,796 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Streaming decoders of compressed (LZ4) and delta firmware images. The
+ * packed image is fed in chunks as it arrives and unpacked straight to the
+ * device with a RAM footprint of CONFIG_LIB_FWUNPACK_BUFSIZE bytes: LZ4
+ * matches are read back from the image already written and delta blocks
+ * are built over the image being replaced. See include/nuttx/fwunpack.h
+ * for the formats.
+ */
+
+#include <nuttx/config.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <nuttx/fwunpack.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#ifndef MIN
+#  define MIN(a,b) ((a) < (b) ? (a) : (b))
+#endif
+
+#define LZ4_MIN_MATCH     4
+#define LZ4_RUN_MASK      0x0f
+
+/* Smallest and largest delta blocks */
+#define DELTA_MIN_SHIFT   3
+#define DELTA_MAX_SHIFT   15
+
+/* Decoder states */
+
+enum
+{
+  S_LZ4_TOKEN,
+  S_LZ4_LIT_LEN,
+  S_LZ4_LIT,
+  S_LZ4_OFF_LO,
+  S_LZ4_OFF_HI,
+  S_LZ4_MATCH_LEN,
+  S_DELTA_SHIFT,
+  S_DELTA_BASE_LO,
+  S_DELTA_BASE_HI,
+  S_DELTA_KEEP_LO,
+  S_DELTA_KEEP_HI,
+  S_DELTA_LEN_LO,
+  S_DELTA_LEN_HI,
+  S_DELTA_DATA,
+  S_DONE,
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/* Write the LZ4 output staged in the buffer to the device */
+
+static int lz4_flush(FAR struct fwunpack_s *unpack)
+{
+  size_t len = unpack->out_pos - unpack->flushed;
+  int ret;
+
+  if (!len)
+    {
+      return 0;
+    }
+
+  ret = unpack->ops->write(unpack->arg, unpack->flushed, unpack->buf, len);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  unpack->flushed = unpack->out_pos;
+  return 0;
+}
+
+/* Room left in the staging buffer, flushing it if full */
+
+static int lz4_room(FAR struct fwunpack_s *unpack, FAR size_t *room)
+{
+  int ret;
+
+  if (unpack->out_pos - unpack->flushed == CONFIG_LIB_FWUNPACK_BUFSIZE)
+    {
+      ret = lz4_flush(unpack);
+      if (ret < 0)
+        {
+          return ret;
+        }
+    }
+
+  *room = CONFIG_LIB_FWUNPACK_BUFSIZE - (unpack->out_pos - unpack->flushed);
+  return 0;
+}
+
+/* Copy the current match, from the staging buffer or from the device */
+
+static int lz4_match(FAR struct fwunpack_s *unpack)
+{
+  uint32_t src;
+  size_t room;
+  size_t fill;
+  size_t n;
+  int ret;
+
+  if (!unpack->offset || unpack->offset > unpack->out_pos ||
+      unpack->count > unpack->out_size - unpack->out_pos)
+    {
+      return -EINVAL;
+    }
+
+  while (unpack->count)
+    {
+      ret = lz4_room(unpack, &room);
+      if (ret < 0)
+        {
+          return ret;
+        }
+
+      fill = unpack->out_pos - unpack->flushed;
+      src = unpack->out_pos - unpack->offset;
+
+      if (src >= unpack->flushed)
+        {
+          /* No overlap of source and destination when n <= offset */
+
+          n = MIN(MIN(unpack->count, room), unpack->offset);
+          memcpy(&unpack->buf[fill], &unpack->buf[src - unpack->flushed], n);
+        }
+      else
+        {
+          n = MIN(MIN(unpack->count, room), unpack->flushed - src);
+          ret = unpack->ops->read(unpack->arg, src, &unpack->buf[fill], n);
+          if (ret < 0)
+            {
+              return ret;
+            }
+        }
+
+      unpack->out_pos += n;
+      unpack->count -= n;
+    }
+
+  return 0;
+}
+
+/* Copy the match ending the current sequence */
+
+static int lz4_end_sequence(FAR struct fwunpack_s *unpack)
+{
+  int ret;
+
+  unpack->count += LZ4_MIN_MATCH;
+  ret = lz4_match(unpack);
+  if (ret < 0)
+    {
+      return ret;
+    }
+
+  if (unpack->out_pos == unpack->out_size)
+    {
+      unpack->state = S_DONE;
+      return lz4_flush(unpack);
+    }
+
+  unpack->state = S_LZ4_TOKEN;
+  return 0;
+}
+
+static int lz4_feed(FAR struct fwunpack_s *unpack, FAR const uint8_t *data,
+                    size_t len)
+{
+  size_t room;
+  size_t n;
+  uint8_t c;
+  int ret;
+
+  while (len)
+    {
+      if (unpack->state == S_LZ4_LIT)
+        {
+          ret = lz4_room(unpack, &room);
+          if (ret < 0)
+            {
+              return ret;
+            }
+
+          n = MIN(MIN(unpack->count, room), len);
+          memcpy(&unpack->buf[unpack->out_pos - unpack->flushed], data, n);
+          unpack->out_pos += n;
+          unpack->count -= n;
+          data += n;
+          len -= n;
+
+          if (unpack->count)
+            {
+              continue;
+            }
+
+          unpack->state = (unpack->out_pos == unpack->out_size) ?
+                          S_DONE : S_LZ4_OFF_LO;
+          if (unpack->state == S_DONE)
+            {
+              ret = lz4_flush(unpack);
+              if (ret < 0)
+                {
+                  return ret;
+                }
+            }
+
+          continue;
+        }
+
+      c = *data++;
+      len--;
+
+      switch (unpack->state)
+        {
+          case S_LZ4_TOKEN:
+            unpack->token = c;
+            unpack->count = c >> 4;
+            unpack->state = (unpack->count == LZ4_RUN_MASK) ?
+                            S_LZ4_LIT_LEN : S_LZ4_LIT;
+            break;
+
+          case S_LZ4_LIT_LEN:
+            unpack->count += c;
+            if (c != 0xff)
+              {
+                unpack->state = S_LZ4_LIT;
+              }
+            break;
+
+          case S_LZ4_OFF_LO:
+            unpack->offset = c;
+            unpack->state = S_LZ4_OFF_HI;
+            break;
+
+          case S_LZ4_OFF_HI:
+            unpack->offset |= c << 8;
+            unpack->count = unpack->token & LZ4_RUN_MASK;
+            if (unpack->count == LZ4_RUN_MASK)
+              {
+                unpack->state = S_LZ4_MATCH_LEN;
+                break;
+              }
+
+            ret = lz4_end_sequence(unpack);
+            if (ret < 0)
+              {
+                return ret;
+              }
+            break;
+
+          case S_LZ4_MATCH_LEN:
+            unpack->count += c;
+            if (c == 0xff)
+              {
+                break;
+              }
+
+            ret = lz4_end_sequence(unpack);
+            if (ret < 0)
+              {
+                return ret;
+              }
+            break;
+
+          default:
+            return -EINVAL;
+        }
+
+      /* Literals must not run past the end of the image */
+
+      if (unpack->state == S_LZ4_LIT &&
+          unpack->count > unpack->out_size - unpack->out_pos)
+        {
+          return -EINVAL;
+        }
+    }
+
+  return 0;
+}
+
+/* Size of the delta block being built */
+
+static size_t delta_block_len(FAR struct fwunpack_s *unpack)
+{
+  return MIN((uint32_t)1 << unpack->shift,
+             unpack->out_size - unpack->out_pos);
+}
+
+/* Start a block from a copy of its base */
+
+static int delta_base(FAR struct fwunpack_s *unpack, uint32_t base)
+{
+  size_t len = delta_block_len(unpack);
+
+  unpack->pos = 0;
+
+  if (base == FWUNPACK_DELTA_ERASED)
+    {
+      memset(unpack->buf, 0xff, len);
+      return 0;
+    }
+
+  /* Earlier blocks of the old image are already overwritten */
+
+  if (base < (unpack->out_pos >> unpack->shift))
+    {
+      return -EINVAL;
+    }
+
+  return unpack->ops->read(unpack->arg, base << unpack->shift, unpack->buf,
+                           len);
+}
+
+static int delta_feed(FAR struct fwunpack_s *unpack, FAR const uint8_t *data,
+                      size_t len)
+{
+  size_t n;
+  uint8_t c;
+  int ret;
+
+  while (len)
+    {
+      if (unpack->state == S_DELTA_DATA)
+        {
+          n = MIN(unpack->count, len);
+          memcpy(&unpack->buf[unpack->pos], data, n);
+          unpack->pos += n;
+          unpack->count -= n;
+          data += n;
+          len -= n;
+
+          if (!unpack->count)
+            {
+              unpack->state = S_DELTA_KEEP_LO;
+            }
+
+          continue;
+        }
+
+      c = *data++;
+      len--;
+
+      switch (unpack->state)
+        {
+          case S_DELTA_SHIFT:
+            if (c < DELTA_MIN_SHIFT || c > DELTA_MAX_SHIFT ||
+                ((size_t)1 << c) > CONFIG_LIB_FWUNPACK_BUFSIZE)
+              {
+                return -EINVAL;
+              }
+
+            unpack->shift = c;
+            unpack->state = S_DELTA_BASE_LO;
+            break;
+
+          case S_DELTA_BASE_LO:
+          case S_DELTA_KEEP_LO:
+          case S_DELTA_LEN_LO:
+            unpack->count = c;
+            unpack->state++;
+            break;
+
+          case S_DELTA_BASE_HI:
+            ret = delta_base(unpack, unpack->count | (c << 8));
+            if (ret < 0)
+              {
+                return ret;
+              }
+
+            unpack->state = S_DELTA_KEEP_LO;
+            break;
+
+          case S_DELTA_KEEP_HI:
+            unpack->count = unpack->pos + (unpack->count | (c << 8));
+            if (unpack->count > delta_block_len(unpack))
+              {
+                return -EINVAL;
+              }
+
+            unpack->pos = unpack->count;
+            unpack->state = S_DELTA_LEN_LO;
+            break;
+
+          case S_DELTA_LEN_HI:
+            unpack->count |= c << 8;
+            if (unpack->count > delta_block_len(unpack) - unpack->pos)
+              {
+                return -EINVAL;
+              }
+
+            if (unpack->count)
+              {
+                unpack->state = S_DELTA_DATA;
+                break;
+              }
+
+            /* End of the block */
+
+            n = delta_block_len(unpack);
+            ret = unpack->ops->write(unpack->arg, unpack->out_pos,
+                                     unpack->buf, n);
+            if (ret < 0)
+              {
+                return ret;
+              }
+
+            unpack->out_pos += n;
+            unpack->flushed = unpack->out_pos;
+            unpack->state = (unpack->out_pos == unpack->out_size) ?
+                            S_DONE : S_DELTA_BASE_LO;
+            break;
+
+          default:
+            return -EINVAL;
+        }
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int fwunpack_init(FAR struct fwunpack_s *unpack, enum fwunpack_type_e type,
+                  uint32_t out_size, FAR const struct fwunpack_ops_s *ops,
+                  FAR void *arg)
+{
+  if (!out_size || !ops || !ops->write || !ops->read)
+    {
+      return -EINVAL;
+    }
+
+  unpack->ops = ops;
+  unpack->arg = arg;
+  unpack->type = type;
+  unpack->out_size = out_size;
+  unpack->out_pos = 0;
+  unpack->flushed = 0;
+  unpack->count = 0;
+  unpack->pos = 0;
+
+  switch (type)
+    {
+      case FWUNPACK_LZ4:
+        unpack->state = S_LZ4_TOKEN;
+        return 0;
+
+      case FWUNPACK_DELTA:
+        unpack->state = S_DELTA_SHIFT;
+        return 0;
+
+      default:
+        return -EINVAL;
+    }
+}
+
+int fwunpack_feed(FAR struct fwunpack_s *unpack, FAR const uint8_t *data,
+                  size_t len)
+{
+  if (unpack->state == S_DONE)
+    {
+      return len ? -EINVAL : 0;
+    }
+
+  if (unpack->type == FWUNPACK_LZ4)
+    {
+      return lz4_feed(unpack, data, len);
+    }
+
+  return delta_feed(unpack, data, len);
+}
+
+int fwunpack_finish(FAR struct fwunpack_s *unpack)
+{
+  /* The decoders write all the output on reaching the end of the image */
+
+  return (unpack->state == S_DONE) ? 0 : -EINVAL;
+}
+
+#ifdef CONFIG_LIB_FWPACK
+/****************************************************************************
+ * Encoders
+ ****************************************************************************/
+
+#define LZ4_HASH_BITS     12
+#define LZ4_MAX_OFFSET    65535
+
+/* The last match starts 12 bytes and ends 5 bytes before the end at most */
+#define LZ4_MF_LIMIT      12
+#define LZ4_LAST_LITERALS 5
+
+/* Bytes of a delta patch header */
+#define DELTA_PATCH_HDR   4
+
+struct pack_out_s
+{
+  FAR uint8_t *buf;
+  size_t len;
+  size_t pos;
+};
+
+static void pack_put(FAR struct pack_out_s *out, FAR const uint8_t *data,
+                     size_t len)
+{
+  /* Keep counting past the end so the caller can report -ENOSPC */
+
+  if (out->buf && out->pos + len <= out->len)
+    {
+      memcpy(&out->buf[out->pos], data, len);
+    }
+
+  out->pos += len;
+}
+
+static void pack_put8(FAR struct pack_out_s *out, uint8_t c)
+{
+  pack_put(out, &c, 1);
+}
+
+static void pack_put16(FAR struct pack_out_s *out, uint16_t v)
+{
+  pack_put8(out, v & 0xff);
+  pack_put8(out, v >> 8);
+}
+
+static uint32_t lz4_read32(FAR const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void lz4_put_len(FAR struct pack_out_s *out, size_t len)
+{
+  for (; len >= 0xff; len -= 0xff)
+    {
+      pack_put8(out, 0xff);
+    }
+
+  pack_put8(out, len);
+}
+
+static void lz4_put_sequence(FAR struct pack_out_s *out,
+                             FAR const uint8_t *lit, size_t lit_len,
+                             uint16_t offset, size_t match_len)
+{
+  size_t mlen = match_len ? match_len - LZ4_MIN_MATCH : 0;
+
+  pack_put8(out, (MIN(lit_len, LZ4_RUN_MASK) << 4) |
+                 MIN(mlen, LZ4_RUN_MASK));
+  if (lit_len >= LZ4_RUN_MASK)
+    {
+      lz4_put_len(out, lit_len - LZ4_RUN_MASK);
+    }
+
+  pack_put(out, lit, lit_len);
+  if (!match_len)
+    {
+      return;
+    }
+
+  pack_put16(out, offset);
+  if (mlen >= LZ4_RUN_MASK)
+    {
+      lz4_put_len(out, mlen - LZ4_RUN_MASK);
+    }
+}
+
+ssize_t fwpack_lz4(FAR const uint8_t *in, size_t len, FAR uint8_t *out,
+                   size_t out_len)
+{
+  struct pack_out_s o = { out, out_len, 0 };
+  FAR uint32_t *table;
+  size_t anchor = 0;
+  size_t i = 0;
+  size_t ref;
+  size_t mlen;
+  uint32_t h;
+
+  if (!len)
+    {
+      return -EINVAL;
+    }
+
+  table = malloc(sizeof(*table) << LZ4_HASH_BITS);
+  if (!table)
+    {
+      return -ENOMEM;
+    }
+
+  memset(table, 0xff, sizeof(*table) << LZ4_HASH_BITS);
+
+  /* Greedy parse, first match found through a hash of 4 bytes */
+
+  while (len > LZ4_MF_LIMIT && i < len - LZ4_MF_LIMIT)
+    {
+      h = (lz4_read32(&in[i]) * 2654435761u) >> (32 - LZ4_HASH_BITS);
+      ref = table[h];
+      table[h] = i;
+
+      if (ref == 0xffffffff || i - ref > LZ4_MAX_OFFSET ||
+          lz4_read32(&in[ref]) != lz4_read32(&in[i]))
+        {
+          i++;
+          continue;
+        }
+
+      mlen = LZ4_MIN_MATCH;
+      while (i + mlen < len - LZ4_LAST_LITERALS &&
+             in[ref + mlen] == in[i + mlen])
+        {
+          mlen++;
+        }
+
+      lz4_put_sequence(&o, &in[anchor], i - anchor, i - ref, mlen);
+      i += mlen;
+      anchor = i;
+    }
+
+  lz4_put_sequence(&o, &in[anchor], len - anchor, 0, 0);
+  free(table);
+
+  return (o.pos > out_len) ? -ENOSPC : o.pos;
+}
+
+/* Byte k of a delta base, false if unknown */
+
+static bool delta_base_byte(FAR const uint8_t *old, size_t old_len,
+                            uint32_t base, uint8_t shift, size_t k,
+                            FAR uint8_t *c)
+{
+  size_t pos = ((size_t)base << shift) + k;
+
+  if (base == FWUNPACK_DELTA_ERASED)
+    {
+      *c = 0xff;
+      return true;
+    }
+
+  if (pos >= old_len)
+    {
+      return false;
+    }
+
+  *c = old[pos];
+  return true;
+}
+
+/*
+ * Encode a block of len bytes against a base block, patching runs of
+ * differences. Runs closer than a patch header are merged. Returns the
+ * encoded size; out may have a NULL buffer to only get the size.
+ */
+
+static size_t delta_block(FAR struct pack_out_s *out, FAR const uint8_t *in,
+                          size_t len, FAR const uint8_t *old, size_t old_len,
+                          uint32_t base, uint8_t shift)
+{
+  size_t start = out->pos;
+  size_t kept = 0;
+  size_t k = 0;
+  size_t end;
+  size_t gap;
+  uint8_t c;
+
+  pack_put16(out, base);
+
+  while (k < len)
+    {
+      if (delta_base_byte(old, old_len, base, shift, k, &c) && c == in[k])
+        {
+          k++;
+          continue;
+        }
+
+      /* Extend the run until DELTA_PATCH_HDR matching bytes in a row */
+
+      end = k + 1;
+      for (gap = 0; end + gap < len && gap < DELTA_PATCH_HDR; )
+        {
+          if (delta_base_byte(old, old_len, base, shift, end + gap, &c) &&
+              c == in[end + gap])
+            {
+              gap++;
+            }
+          else
+            {
+              end += gap + 1;
+              gap = 0;
+            }
+        }
+
+      pack_put16(out, k - kept);
+      pack_put16(out, end - k);
+      pack_put(out, &in[k], end - k);
+      kept = end;
+      k = end;
+    }
+
+  pack_put16(out, 0);
+  pack_put16(out, 0);
+
+  return out->pos - start;
+}
+
+ssize_t fwpack_delta(FAR const uint8_t *in, size_t len,
+                     FAR const uint8_t *old, size_t old_len, uint8_t shift,
+                     FAR uint8_t *out, size_t out_len)
+{
+  struct pack_out_s o = { out, out_len, 0 };
+  struct pack_out_s dry;
+  size_t block = (size_t)1 << shift;
+  size_t nblocks = (old_len + block - 1) >> shift;
+  size_t blen;
+  size_t size;
+  size_t best_size;
+  uint32_t best;
+  uint32_t i;
+  uint32_t j;
+
+  if (!len || shift < DELTA_MIN_SHIFT || shift > DELTA_MAX_SHIFT ||
+      ((len + block - 1) >> shift) >= FWUNPACK_DELTA_ERASED)
+    {
+      return -EINVAL;
+    }
+
+  pack_put8(&o, shift);
+
+  for (i = 0; (size_t)i << shift < len; i++)
+    {
+      blen = MIN(block, len - ((size_t)i << shift));
+
+      /*
+       * Pick the cheapest base among erased flash and the blocks of the old
+       * image not overwritten yet.
+       */
+
+      best = FWUNPACK_DELTA_ERASED;
+      memset(&dry, 0, sizeof(dry));
+      best_size = delta_block(&dry, &in[i << shift], blen, old, old_len,
+                              best, shift);
+
+      for (j = i; j < nblocks && j < FWUNPACK_DELTA_ERASED; j++)
+        {
+          memset(&dry, 0, sizeof(dry));
+          size = delta_block(&dry, &in[i << shift], blen, old, old_len, j,
+                             shift);
+          if (size < best_size)
+            {
+              best = j;
+              best_size = size;
+            }
+        }
+
+      delta_block(&o, &in[i << shift], blen, old, old_len, best, shift);
+    }
+
+  return (o.pos > out_len) ? -ENOSPC : o.pos;
+}
+#endif /* CONFIG_LIB_FWPACK */
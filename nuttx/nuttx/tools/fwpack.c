@@ -0,0 +1,390 @@
+/*
+ * Copyright (c) 2017 Motorola Mobility, LLC.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS;
+ * OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY,
+ * WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR
+ * OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * fwpack - Pack the code section of a TFTF firmware image for the Greybus
+ * firmware protocol (CONFIG_GREYBUS_FIRMWARE_UNPACK):
+ *
+ *   fwpack -z in.tftf out.tftf
+ *     LZ4 compressed code section.
+ *
+ *   fwpack -d old.tftf|old.bin [-b shift] in.tftf out.tftf
+ *     Block delta code section against the installed image, in blocks of
+ *     1 << shift bytes (default 11). The blocks must be a multiple of the
+ *     flash page size of the target.
+ *
+ * The other sections are copied as is. Each packed section is unpacked
+ * again with the target decoder and compared before being written.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <nuttx/fwunpack.h>
+
+#define TFTF_HDR_SIZE                     512
+#define TFTF_NUM_SECTIONS                 20
+#define TFTF_SECTION_TYPE_RAW_CODE        0x0001
+#define TFTF_SECTION_TYPE_COMPRESSED_CODE 0x0003
+#define TFTF_SECTION_TYPE_END             0x00fe
+#define TFTF_SECTION_TYPE_DELTA_CODE      0x0008
+
+#define DEFAULT_SHIFT                     11
+
+struct section_descriptor
+{
+  uint8_t section_type;
+  uint8_t section_class[3];
+  uint32_t section_id;
+  uint32_t section_length;
+  uint32_t section_load_address;
+  uint32_t section_expanded_length;
+} __attribute__((packed));
+
+struct tftf_header
+{
+  char sentinel_value[4];
+  uint32_t header_size;
+  uint8_t build_timestamp[16];
+  char firmware_package_name[48];
+  uint32_t package_type;
+  uint32_t start_location;
+  uint32_t unipro_vid;
+  uint32_t unipro_pid;
+  uint32_t ara_vid;
+  uint32_t ara_pid;
+  uint8_t reserved[16];
+  struct section_descriptor desc[TFTF_NUM_SECTIONS];
+} __attribute__((packed));
+
+struct image
+{
+  uint8_t *data;
+  size_t len;
+};
+
+/* RAM device to check the packed sections, holding the old image */
+
+static struct image g_dev;
+
+static void show_usage(const char *progname)
+{
+  fprintf(stderr, "USAGE: %s -z <in.tftf> <out.tftf>\n", progname);
+  fprintf(stderr, "       %s -d <old.tftf|old.bin> [-b <shift>] "
+          "<in.tftf> <out.tftf>\n", progname);
+  exit(EXIT_FAILURE);
+}
+
+static int read_file(const char *path, struct image *img)
+{
+  FILE *f;
+  long len;
+
+  f = fopen(path, "rb");
+  if (!f)
+    {
+      fprintf(stderr, "ERROR: cannot open %s\n", path);
+      return -ENOENT;
+    }
+
+  fseek(f, 0, SEEK_END);
+  len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+
+  img->data = malloc(len ? len : 1);
+  img->len = len;
+  if (!img->data || fread(img->data, 1, len, f) != (size_t)len)
+    {
+      fprintf(stderr, "ERROR: cannot read %s\n", path);
+      fclose(f);
+      return -EIO;
+    }
+
+  fclose(f);
+  return 0;
+}
+
+/* Find the raw code section, returns its descriptor index */
+
+static int find_code(const struct image *img, size_t *offset)
+{
+  const struct tftf_header *hdr = (const struct tftf_header *)img->data;
+  size_t pos;
+  int i;
+
+  if (img->len < TFTF_HDR_SIZE || memcmp(hdr->sentinel_value, "TFTF", 4))
+    {
+      return -ENOENT;
+    }
+
+  pos = hdr->header_size;
+  for (i = 0; i < TFTF_NUM_SECTIONS; i++)
+    {
+      if (hdr->desc[i].section_type == TFTF_SECTION_TYPE_END)
+        {
+          break;
+        }
+
+      if (hdr->desc[i].section_type == TFTF_SECTION_TYPE_RAW_CODE)
+        {
+          if (pos + hdr->desc[i].section_length > img->len)
+            {
+              return -EINVAL;
+            }
+
+          *offset = pos;
+          return i;
+        }
+
+      pos += hdr->desc[i].section_length;
+    }
+
+  return -ENOENT;
+}
+
+static int dev_write(void *arg, uint32_t offset, const uint8_t *buf,
+                     size_t len)
+{
+  if (offset + len > g_dev.len)
+    {
+      return -EINVAL;
+    }
+
+  memcpy(&g_dev.data[offset], buf, len);
+  return 0;
+}
+
+static int dev_read(void *arg, uint32_t offset, uint8_t *buf, size_t len)
+{
+  if (offset + len > g_dev.len)
+    {
+      return -EINVAL;
+    }
+
+  memcpy(buf, &g_dev.data[offset], len);
+  return 0;
+}
+
+static const struct fwunpack_ops_s g_dev_ops =
+{
+  .write = dev_write,
+  .read  = dev_read,
+};
+
+/* Unpack in place over the old image, as the target does */
+
+static int verify(enum fwunpack_type_e type, const uint8_t *packed,
+                  size_t packed_len, const uint8_t *code, size_t len,
+                  const struct image *old)
+{
+  static struct fwunpack_s unpack;
+  size_t chunk;
+  size_t i;
+  int ret;
+
+  g_dev.len = len > old->len ? len : old->len;
+  g_dev.data = malloc(g_dev.len);
+  if (!g_dev.data)
+    {
+      return -ENOMEM;
+    }
+
+  memset(g_dev.data, 0xff, g_dev.len);
+  memcpy(g_dev.data, old->data, old->len);
+
+  ret = fwunpack_init(&unpack, type, len, &g_dev_ops, NULL);
+
+  /* Odd chunk size to go through the decoder states at chunk boundaries */
+
+  for (i = 0, chunk = 997; !ret && i < packed_len; i += chunk)
+    {
+      ret = fwunpack_feed(&unpack, &packed[i], packed_len - i < chunk ?
+                          packed_len - i : chunk);
+    }
+
+  if (!ret)
+    {
+      ret = fwunpack_finish(&unpack);
+    }
+
+  if (!ret && memcmp(g_dev.data, code, len))
+    {
+      ret = -EILSEQ;
+    }
+
+  free(g_dev.data);
+  return ret;
+}
+
+int main(int argc, char **argv)
+{
+  enum fwunpack_type_e type = FWUNPACK_LZ4;
+  struct image old = { NULL, 0 };
+  struct image in;
+  struct tftf_header *hdr;
+  struct section_descriptor *desc;
+  const char *old_path = NULL;
+  uint8_t *packed;
+  size_t packed_max;
+  ssize_t packed_len;
+  size_t code_off;
+  size_t old_off;
+  size_t len;
+  int shift = DEFAULT_SHIFT;
+  int mode = 0;
+  int index;
+  int ret;
+  FILE *f;
+  int ch;
+
+  while ((ch = getopt(argc, argv, "zd:b:h")) > 0)
+    {
+      switch (ch)
+        {
+          case 'z':
+            mode = ch;
+            type = FWUNPACK_LZ4;
+            break;
+
+          case 'd':
+            mode = ch;
+            type = FWUNPACK_DELTA;
+            old_path = optarg;
+            break;
+
+          case 'b':
+            shift = atoi(optarg);
+            break;
+
+          default:
+            show_usage(argv[0]);
+        }
+    }
+
+  if (!mode || argc - optind != 2)
+    {
+      show_usage(argv[0]);
+    }
+
+  if (shift < 3 || (1 << shift) > CONFIG_LIB_FWUNPACK_BUFSIZE)
+    {
+      fprintf(stderr, "ERROR: blocks of 8 to %d bytes only\n",
+              CONFIG_LIB_FWUNPACK_BUFSIZE);
+      return EXIT_FAILURE;
+    }
+
+  if (read_file(argv[optind], &in) < 0)
+    {
+      return EXIT_FAILURE;
+    }
+
+  index = find_code(&in, &code_off);
+  if (index < 0)
+    {
+      fprintf(stderr, "ERROR: no raw code section in %s\n", argv[optind]);
+      return EXIT_FAILURE;
+    }
+
+  hdr = (struct tftf_header *)in.data;
+  desc = &hdr->desc[index];
+  len = desc->section_length;
+
+  /* The installed image, from its TFTF or as a raw binary */
+
+  if (old_path)
+    {
+      if (read_file(old_path, &old) < 0)
+        {
+          return EXIT_FAILURE;
+        }
+
+      ret = find_code(&old, &old_off);
+      if (ret >= 0)
+        {
+          old.len = ((struct tftf_header *)old.data)->desc[ret].section_length;
+          memmove(old.data, &old.data[old_off], old.len);
+        }
+    }
+
+  packed_max = 2 * len + 1024;
+  packed = malloc(packed_max);
+  if (!packed)
+    {
+      return EXIT_FAILURE;
+    }
+
+  if (type == FWUNPACK_DELTA)
+    {
+      packed_len = fwpack_delta(&in.data[code_off], len, old.data, old.len,
+                                shift, packed, packed_max);
+    }
+  else
+    {
+      packed_len = fwpack_lz4(&in.data[code_off], len, packed, packed_max);
+    }
+
+  if (packed_len < 0)
+    {
+      fprintf(stderr, "ERROR: packing failed: %d\n", (int)packed_len);
+      return EXIT_FAILURE;
+    }
+
+  ret = verify(type, packed, packed_len, &in.data[code_off], len, &old);
+  if (ret < 0)
+    {
+      fprintf(stderr, "ERROR: packed section does not unpack: %d\n", ret);
+      return EXIT_FAILURE;
+    }
+
+  printf("code section: %zu bytes packed to %zd (%zd%%)\n", len, packed_len,
+         packed_len * 100 / len);
+
+  desc->section_type = (type == FWUNPACK_DELTA) ?
+                       TFTF_SECTION_TYPE_DELTA_CODE :
+                       TFTF_SECTION_TYPE_COMPRESSED_CODE;
+  desc->section_length = packed_len;
+  desc->section_expanded_length = len;
+
+  f = fopen(argv[optind + 1], "wb");
+  if (!f ||
+      fwrite(in.data, 1, code_off, f) != code_off ||
+      fwrite(packed, 1, packed_len, f) != (size_t)packed_len ||
+      fwrite(&in.data[code_off + len], 1, in.len - code_off - len, f) !=
+          in.len - code_off - len)
+    {
+      fprintf(stderr, "ERROR: cannot write %s\n", argv[optind + 1]);
+      return EXIT_FAILURE;
+    }
+
+  fclose(f);
+  return EXIT_SUCCESS;
+}